@@ -0,0 +1,171 @@
+// Benchmarks building and publishing a modelV2-sized message, comparing a fresh
+// MallocMessageBuilder flattened with messageToFlatArray against the pooled
+// MessageBuilder serialized straight into the msgq ring.
+// Usage: bench_builder [iterations] [--realtime] [--raw]
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "messaging.h"
+
+#ifdef __GLIBC__
+// Count heap allocations by interposing the glibc entry points
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+static thread_local size_t alloc_count = 0;
+extern "C" void *malloc(size_t size) { alloc_count++; return __libc_malloc(size); }
+extern "C" void *calloc(size_t n, size_t size) { alloc_count++; return __libc_calloc(n, size); }
+#else
+static size_t alloc_count = 0;
+#endif
+
+// Same shape as model_publish: 33 point trajectories, 4 lane lines, 2 road edges, 3 leads
+constexpr int TRAJECTORY_SIZE = 33;
+constexpr int LEAD_TRAJ_LEN = 6;
+constexpr int RAW_PRED_SIZE = 6472;
+
+static std::vector<float> values(size_t n, float v) {
+  std::vector<float> ret(n);
+  std::iota(ret.begin(), ret.end(), v);
+  return ret;
+}
+
+static void fill_xyzt(cereal::ModelDataV2::XYZTData::Builder xyzt, const std::vector<float> &v, bool with_std) {
+  auto arr = kj::ArrayPtr<const float>(v.data(), v.size());
+  xyzt.setT(arr);
+  xyzt.setX(arr);
+  xyzt.setY(arr);
+  xyzt.setZ(arr);
+  if (with_std) {
+    xyzt.setXStd(arr);
+    xyzt.setYStd(arr);
+    xyzt.setZStd(arr);
+  }
+}
+
+static void fill_model_v2(cereal::Event::Builder event, uint32_t frame_id, bool raw) {
+  static const std::vector<float> traj = values(TRAJECTORY_SIZE, 0.5);
+  static const std::vector<float> lead = values(LEAD_TRAJ_LEN, 1.5);
+  static const std::vector<float> raw_pred = values(RAW_PRED_SIZE, 0.);
+
+  auto framed = event.initModelV2();
+  framed.setFrameId(frame_id);
+  framed.setTimestampEof(frame_id * 50000000ULL);
+  if (raw) {
+    framed.setRawPredictions(kj::ArrayPtr<const float>(raw_pred.data(), raw_pred.size()).asBytes());
+  }
+  fill_xyzt(framed.initPosition(), traj, true);
+  fill_xyzt(framed.initVelocity(), traj, false);
+  fill_xyzt(framed.initOrientation(), traj, false);
+  fill_xyzt(framed.initOrientationRate(), traj, false);
+
+  auto lane_lines = framed.initLaneLines(4);
+  for (int i = 0; i < 4; i++) fill_xyzt(lane_lines[i], traj, false);
+  framed.setLaneLineProbs({0.1, 0.9, 0.9, 0.1});
+  framed.setLaneLineStds({1.0, 0.2, 0.2, 1.0});
+
+  auto road_edges = framed.initRoadEdges(2);
+  for (int i = 0; i < 2; i++) fill_xyzt(road_edges[i], traj, false);
+  framed.setRoadEdgeStds({1.0, 1.0});
+
+  auto leads = framed.initLeadsV3(3);
+  auto lead_arr = kj::ArrayPtr<const float>(lead.data(), lead.size());
+  for (int i = 0; i < 3; i++) {
+    leads[i].setProb(0.5);
+    leads[i].setT(lead_arr);
+    leads[i].setX(lead_arr);
+    leads[i].setY(lead_arr);
+    leads[i].setV(lead_arr);
+    leads[i].setA(lead_arr);
+    leads[i].setXStd(lead_arr);
+    leads[i].setYStd(lead_arr);
+    leads[i].setVStd(lead_arr);
+    leads[i].setAStd(lead_arr);
+  }
+  auto meta = framed.initMeta();
+  meta.setEngagedProb(0.9);
+  meta.setDesirePrediction(kj::ArrayPtr<const float>(traj.data(), 32));
+  meta.setDesireState(kj::ArrayPtr<const float>(traj.data(), 8));
+}
+
+struct Result {
+  std::vector<double> latency_us;
+  size_t allocs = 0;
+  size_t bytes = 0;
+};
+
+template <typename F>
+static Result run(int iterations, bool realtime, F publish) {
+  Result r;
+  r.latency_us.reserve(iterations);
+  for (int i = 0; i < iterations; i++) {
+    size_t allocs_before = alloc_count;
+    auto start = std::chrono::steady_clock::now();
+    r.bytes = publish(i);
+    auto end = std::chrono::steady_clock::now();
+    r.allocs += alloc_count - allocs_before;
+    r.latency_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    if (realtime) {
+      std::this_thread::sleep_until(start + std::chrono::milliseconds(50));
+    }
+  }
+  return r;
+}
+
+static void print_result(const char *name, Result &r) {
+  auto &l = r.latency_us;
+  std::sort(l.begin(), l.end());
+  double mean = std::accumulate(l.begin(), l.end(), 0.0) / l.size();
+  printf("%-10s %7zu bytes  allocs/msg %6.2f  mean %7.1f us  p50 %7.1f us  p99 %7.1f us  max %7.1f us\n",
+         name, r.bytes, (double)r.allocs / l.size(), mean, l[l.size() / 2], l[l.size() * 99 / 100], l.back());
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 2000;
+  bool realtime = false, raw = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--realtime") == 0) {
+      realtime = true;
+    } else if (strcmp(argv[i], "--raw") == 0) {
+      raw = true;
+    } else {
+      iterations = std::max(1, atoi(argv[i]));
+    }
+  }
+
+  // Only one publisher may own the queue at a time, so the sockets are created in turn
+  Context *ctx = Context::create();
+  PubSocket *sock = PubSocket::create(ctx, "modelV2");
+  assert(sock != nullptr);
+
+  auto legacy = run(iterations, realtime, [&](int i) {
+    capnp::MallocMessageBuilder msg;
+    fill_model_v2(msg.initRoot<cereal::Event>(), i, raw);
+    auto words = capnp::messageToFlatArray(msg);
+    auto bytes = words.asBytes();
+    sock->send((char *)bytes.begin(), bytes.size());
+    return bytes.size();
+  });
+  delete sock;
+
+  PubMaster pm({"modelV2"});
+  auto pooled = run(iterations, realtime, [&](int i) {
+    MessageBuilder msg("modelV2");
+    fill_model_v2(msg.initEvent(), i, raw);
+    pm.send("modelV2", msg);
+    return capnp::computeSerializedSizeInWords(msg) * sizeof(capnp::word);
+  });
+
+  printf("modelV2 publish, %d iterations%s\n", iterations, realtime ? " at 20 Hz" : "");
+  print_result("legacy", legacy);
+  print_result("pooled", pooled);
+
+  delete ctx;
+  return 0;
+}
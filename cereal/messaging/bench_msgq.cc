@@ -0,0 +1,124 @@
+// Contention benchmark for multi publisher msgq queues. 1-4 writer threads publish
+// into one queue while a reader checks that every writer's messages arrive in order.
+// Usage: bench_msgq [messages per writer] [message size]
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "msgq.h"
+
+const char *BENCH_ENDPOINT = "bench_msgq";
+const size_t BENCH_QUEUE_SIZE = 1024 * 1024;
+
+struct BenchHeader {
+  uint32_t writer;
+  uint32_t seq;
+};
+
+struct WriterResult {
+  std::vector<double> latency_ns;
+};
+
+static void writer(int id, int count, size_t size, std::atomic<bool> *go, WriterResult *result) {
+  msgq_queue_t q;
+  int ret = msgq_new_queue(&q, BENCH_ENDPOINT, BENCH_QUEUE_SIZE);
+  assert(ret == 0);
+  msgq_init_multi_publisher(&q);
+
+  std::vector<char> buf(size);
+  result->latency_ns.reserve(count);
+  while (!*go) std::this_thread::yield();
+
+  for (int i = 0; i < count; i++) {
+    BenchHeader h = {(uint32_t)id, (uint32_t)i};
+    memcpy(buf.data(), &h, sizeof(h));
+
+    msgq_msg_t msg = {size, buf.data()};
+    auto start = std::chrono::steady_clock::now();
+    int r = msgq_msg_send(&msg, &q);
+    auto end = std::chrono::steady_clock::now();
+    assert(r == (int)size);
+    result->latency_ns.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+  }
+  msgq_close_queue(&q);
+}
+
+static void bench(int num_writers, int count, size_t size) {
+  // The first publisher sets the queue up, the writers join it
+  msgq_queue_t pub, sub;
+  int ret = msgq_new_queue(&pub, BENCH_ENDPOINT, BENCH_QUEUE_SIZE);
+  assert(ret == 0);
+  // Start from a clean queue, then switch it to multi publisher mode
+  msgq_init_publisher(&pub);
+  msgq_init_multi_publisher(&pub);
+  ret = msgq_new_queue(&sub, BENCH_ENDPOINT, BENCH_QUEUE_SIZE);
+  assert(ret == 0);
+  msgq_init_subscriber(&sub);
+
+  std::atomic<bool> go = false;
+  std::vector<WriterResult> results(num_writers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_writers; i++) {
+    threads.emplace_back(writer, i, count, size, &go, &results[i]);
+  }
+
+  std::vector<int64_t> last_seq(num_writers, -1);
+  uint64_t received = 0, out_of_order = 0;
+  std::atomic<bool> writers_done = false;
+  std::thread reader([&]() {
+    msgq_msg_t msg;
+    while (true) {
+      int r = msgq_msg_recv(&msg, &sub);
+      if (r <= 0) {
+        if (writers_done) break;
+        std::this_thread::yield();
+        continue;
+      }
+      BenchHeader h;
+      memcpy(&h, msg.data, sizeof(h));
+      assert(h.writer < (uint32_t)num_writers);
+      out_of_order += (int64_t)h.seq <= last_seq[h.writer];
+      last_seq[h.writer] = h.seq;
+      received++;
+      msgq_msg_close(&msg);
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+  for (auto &t : threads) t.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  writers_done = true;
+  reader.join();
+
+  std::vector<double> latency;
+  for (auto &r : results) latency.insert(latency.end(), r.latency_ns.begin(), r.latency_ns.end());
+  std::sort(latency.begin(), latency.end());
+
+  uint64_t sent = (uint64_t)num_writers * count;
+  printf("%d writers: %8.0f msgs/s  send p50 %6.0f ns  p99 %7.0f ns  max %9.0f ns  received %5.1f%%  out of order %lu\n",
+         num_writers, sent / seconds, latency[latency.size() / 2], latency[latency.size() * 99 / 100], latency.back(),
+         100.0 * received / sent, out_of_order);
+  assert(out_of_order == 0);
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&pub);
+}
+
+int main(int argc, char *argv[]) {
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  size_t size = argc > 2 ? std::max(sizeof(BenchHeader), (size_t)atoi(argv[2])) : 256;
+
+  printf("msgq multi publisher, %d messages of %zu bytes per writer\n", count, size);
+  for (int num_writers = 1; num_writers <= 4; num_writers++) {
+    bench(num_writers, count, size);
+  }
+  return 0;
+}
@@ -35,6 +35,20 @@ static size_t get_size(std::string endpoint){
   return sz;
 }
 
+// Services marked multi_publisher in services.py are written by more than one process.
+// MSGQ_MULTI_PUBLISHER puts every queue in multi publisher mode, e.g. to run replay or
+// tools next to the real publishers
+static bool is_multi_publisher(std::string endpoint){
+  if (std::getenv("MSGQ_MULTI_PUBLISHER") != nullptr){
+    return true;
+  }
+  for (const auto& it : services) {
+    if (it.name == endpoint) {
+      return it.multi_publisher;
+    }
+  }
+  return false;
+}
 
 MSGQContext::MSGQContext() {
 }
@@ -175,7 +189,11 @@ int MSGQPubSocket::connect(Context *context, std::string endpoint, bool check_en
     return r;
   }
 
-  msgq_init_publisher(q);
+  if (is_multi_publisher(endpoint)){
+    msgq_init_multi_publisher(q);
+  } else {
+    msgq_init_publisher(q);
+  }
 
   return 0;
 }
@@ -196,6 +214,21 @@ int MSGQPubSocket::send(char *data, size_t size){
   return msgq_msg_send(&msg, q);
 }
 
+int MSGQPubSocket::sendBuilder(capnp::MessageBuilder &msg){
+  auto segments = msg.getSegmentsForOutput();
+  size_t size = capnp::computeSerializedSizeInWords(segments) * sizeof(capnp::word);
+
+  char *p = msgq_msg_reserve(q, size);
+  if (p == NULL){
+    return -1;
+  }
+
+  // Segment table and segments are written directly into the ring slot
+  kj::ArrayOutputStream stream(kj::arrayPtr((kj::byte *)p, size));
+  capnp::writeMessage(stream, segments);
+  return msgq_msg_commit(q, size);
+}
+
 bool MSGQPubSocket::all_readers_updated() {
   return msgq_all_readers_updated(q);
 }
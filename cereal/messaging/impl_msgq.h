@@ -48,6 +48,7 @@ public:
   int connect(Context *context, std::string endpoint, bool check_endpoint=true);
   int sendMessage(Message *message);
   int send(char *data, size_t size);
+  int sendBuilder(capnp::MessageBuilder &msg);
   bool all_readers_updated();
   ~MSGQPubSocket();
 };
@@ -66,6 +66,12 @@ PubSocket * PubSocket::create(Context * context, std::string endpoint, bool chec
   }
 }
 
+int PubSocket::sendBuilder(capnp::MessageBuilder &msg){
+  auto words = capnp::messageToFlatArray(msg);
+  auto bytes = words.asBytes();
+  return send((char*)bytes.begin(), bytes.size());
+}
+
 Poller * Poller::create(){
   Poller * p;
   if (messaging_use_zmq()){
@@ -48,6 +48,7 @@ public:
   virtual int connect(Context *context, std::string endpoint, bool check_endpoint=true) = 0;
   virtual int sendMessage(Message *message) = 0;
   virtual int send(char *data, size_t size) = 0;
+  virtual int sendBuilder(capnp::MessageBuilder &msg);
   virtual bool all_readers_updated() = 0;
   static PubSocket * create();
   static PubSocket * create(Context * context, std::string endpoint, bool check_endpoint=true);
@@ -92,9 +93,26 @@ private:
   std::map<std::string, SubMessage *> services_;
 };
 
-class MessageBuilder : public capnp::MallocMessageBuilder {
+// Per-thread pool of zeroed first segments. A MessageBuilder borrows one for its
+// lifetime, so a publisher loop stops allocating once the pool is warm.
+// Hints remember the largest message seen per service on this thread
+class MessageArena {
 public:
-  MessageBuilder() = default;
+  explicit MessageArena(size_t words);
+  ~MessageArena();
+  static size_t hint(const char *service);
+  static void update_hint(const char *service, size_t words);
+
+protected:
+  kj::Array<capnp::word> segment_;
+};
+
+// MessageArena comes first so the segment is returned only after MallocMessageBuilder has zeroed it
+class MessageBuilder : private MessageArena, public capnp::MallocMessageBuilder {
+public:
+  explicit MessageBuilder(size_t first_segment_words = capnp::SUGGESTED_FIRST_SEGMENT_WORDS)
+    : MessageArena(first_segment_words), capnp::MallocMessageBuilder(segment_) {}
+  explicit MessageBuilder(const char *service) : MessageBuilder(MessageArena::hint(service)) {}
 
   cereal::Event::Builder initEvent(bool valid = true) {
     cereal::Event::Builder event = initRoot<cereal::Event>();
@@ -118,12 +136,16 @@ private:
 class PubMaster {
 public:
   PubMaster(const std::vector<const char *> &service_list);
-  inline int send(const char *name, capnp::byte *data, size_t size) { return sockets_.at(name)->send((char *)data, size); }
+  inline int send(const char *name, capnp::byte *data, size_t size) { return socket(name)->send((char *)data, size); }
+  // Serializes straight into the socket, without flattening the message first when using msgq
   int send(const char *name, MessageBuilder &msg);
   ~PubMaster();
 
 private:
-  std::map<std::string, PubSocket *> sockets_;
+  // throws std::out_of_range for a service this PubMaster wasn't created with, like map::at
+  PubSocket *socket(const char *name) const;
+  // transparent, so sending by name doesn't build a std::string
+  std::map<std::string, PubSocket *, std::less<>> sockets_;
 };
 
 class AlignedBuffer {
@@ -9,6 +9,7 @@
 #include <cstdlib>
 #include <csignal>
 #include <random>
+#include <thread>
 
 #include <poll.h>
 #include <sys/ioctl.h>
@@ -23,6 +24,23 @@
 
 #include "msgq.h"
 
+static const uint64_t COMMIT_SLOT_EMPTY = UINT64_MAX;
+
+// Multi publisher slots are tagged with a skip tag from reserve until commit. A slot that
+// gets published without a commit is skipped by the readers. The upper half holds the
+// write cycle, so a stale tag from an earlier cycle is never taken for the current one
+static int64_t msgq_skip_tag(uint32_t cycles, uint32_t len){
+  uint64_t tag;
+  uint32_t marker = 0x80000000 | (cycles & 0x7FFFFFFF);
+  PACK64(tag, marker, len);
+  return (int64_t)tag;
+}
+
+static uint64_t msgq_now_ns(void){
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
 void sigusr2_handler(int signal) {
   assert(signal == SIGUSR2);
 }
@@ -125,12 +143,21 @@ int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size){
     q->read_uids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_uids[i]);
   }
 
+  q->multi_publisher = reinterpret_cast<std::atomic<uint64_t>*>(&header->multi_publisher);
+  q->reserve_pointer = reinterpret_cast<std::atomic<uint64_t>*>(&header->reserve_pointer);
+  for (size_t i = 0; i < NUM_COMMIT_SLOTS; i++){
+    q->commit_slots[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->commit_slots[i]);
+  }
+
   q->data = mem + sizeof(msgq_header_t);
   q->size = size;
   q->reader_id = -1;
 
   q->endpoint = path;
   q->read_conflate = false;
+  q->write_multi = false;
+  q->write_stalled = COMMIT_SLOT_EMPTY;
+  q->write_stalled_since = 0;
 
   return 0;
 }
@@ -154,7 +181,27 @@ void msgq_init_publisher(msgq_queue_t * q) {
     *q->read_uids[i] = 0;
   }
 
+  *q->multi_publisher = false;
+  *q->reserve_pointer = (uint64_t)*q->write_pointer;
+
   q->write_uid_local = uid;
+  q->write_multi = false;
+}
+
+void msgq_init_multi_publisher(msgq_queue_t * q) {
+  // Join the other publishers without resetting the readers
+  if (*q->multi_publisher){
+    q->write_uid_local = *q->write_uid;
+    q->write_multi = true;
+    return;
+  }
+
+  msgq_init_publisher(q);
+  for (size_t i = 0; i < NUM_COMMIT_SLOTS; i++){
+    *q->commit_slots[i] = COMMIT_SLOT_EMPTY;
+  }
+  *q->multi_publisher = true;
+  q->write_multi = true;
 }
 
 static void thread_signal(uint32_t tid) {
@@ -216,21 +263,260 @@ void msgq_init_subscriber(msgq_queue_t * q) {
   msgq_reset_reader(q);
 }
 
-int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
+// Invalidate all readers that are beyond the write pointer when wrapping around
+static void msgq_invalidate_wrapped_readers(msgq_queue_t *q, uint32_t write_cycles, uint32_t write_pointer){
+  // TODO: should we handle the case where a new reader shows up while this is running?
+  uint64_t num_readers = *q->num_readers;
+  for (uint64_t i = 0; i < num_readers; i++){
+    uint64_t read_pointer = *q->read_pointers[i];
+    uint64_t read_cycles = read_pointer >> 32;
+    read_pointer &= 0xFFFFFFFF;
+
+    if ((read_pointer > write_pointer) && (read_cycles != write_cycles)) {
+      *q->read_valids[i] = false;
+    }
+  }
+}
+
+// Invalidate readers that are in the area that will be written
+static void msgq_invalidate_overwritten_readers(msgq_queue_t *q, uint32_t write_cycles, uint64_t start, uint64_t end){
+  uint64_t num_readers = *q->num_readers;
+  for (uint64_t i = 0; i < num_readers; i++){
+    uint32_t read_cycles, read_pointer;
+    UNPACK64(read_cycles, read_pointer, *q->read_pointers[i]);
+
+    if ((read_pointer >= start) && (read_pointer < end) && (read_cycles != write_cycles)) {
+      *q->read_valids[i] = false;
+    }
+  }
+}
+
+static void msgq_notify_readers(msgq_queue_t *q){
+  uint64_t num_readers = *q->num_readers;
+  for (uint64_t i = 0; i < num_readers; i++){
+    uint64_t reader_uid = *q->read_uids[i];
+    thread_signal(reader_uid & 0xFFFFFFFF);
+  }
+}
+
+// End of the committed slot at `start`, derived from its size tag
+static uint64_t msgq_slot_end(msgq_queue_t *q, uint64_t start){
+  uint32_t cycles, pointer;
+  UNPACK64(cycles, pointer, start);
+
+  int64_t size = *reinterpret_cast<std::atomic<int64_t>*>(q->data + pointer);
+  uint64_t end;
+  if (size == -1){
+    uint32_t next_cycles = cycles + 1;
+    PACK64(end, next_cycles, 0);
+  } else if (size < -1){
+    uint32_t skip_pointer = pointer + (size & 0xFFFFFFFF);
+    PACK64(end, cycles, skip_pointer);
+  } else {
+    PACK64(end, cycles, ALIGN(pointer + sizeof(int64_t) + size));
+  }
+  return end;
+}
+
+// Called by the publisher whose slot is at the write pointer. Publishes it, and then
+// every following slot whose publisher already committed and left a flag behind
+static void msgq_advance_write_pointer(msgq_queue_t *q, uint64_t start){
+  while (true){
+    // A publisher that commits late races the one that gave up on its slot, only one moves on
+    uint64_t end = msgq_slot_end(q, start);
+    if (!q->write_pointer->compare_exchange_strong(start, end)){
+      return;
+    }
+    start = end;
+
+    bool found = false;
+    for (size_t i = 0; i < NUM_COMMIT_SLOTS && !found; i++){
+      uint64_t expected = start;
+      found = q->commit_slots[i]->compare_exchange_strong(expected, COMMIT_SLOT_EMPTY);
+    }
+    if (!found){
+      return;
+    }
+  }
+}
+
+static bool msgq_tag_valid(msgq_queue_t *q, uint32_t cycles, uint32_t pointer, int64_t size){
+  if (size == -1){
+    return true;
+  } else if (size < -1){
+    uint32_t len = size & 0xFFFFFFFF;
+    return size == msgq_skip_tag(cycles, len) && len >= sizeof(int64_t) && (uint64_t)pointer + len <= q->size;
+  }
+  return size > 0 && (uint64_t)size < q->size && pointer + ALIGN(size + sizeof(int64_t)) <= q->size;
+}
+
+// Give up on the slot at the write pointer when nothing got published for MSGQ_RESERVE_TIMEOUT_NS
+// while there were reservations. A publisher that dies between reserve and commit would
+// otherwise hold up every message after its own
+static void msgq_recover_abandoned(msgq_queue_t *q){
+  uint64_t head = *q->write_pointer;
+  uint64_t now = msgq_now_ns();
+  if (head == *q->reserve_pointer || head != q->write_stalled){
+    q->write_stalled = head;
+    q->write_stalled_since = now;
+    return;
+  }
+  if (now - q->write_stalled_since < MSGQ_RESERVE_TIMEOUT_NS){
+    return;
+  }
+
+  uint32_t cycles, pointer;
+  UNPACK64(cycles, pointer, head);
+  std::atomic<int64_t> *size_p = reinterpret_cast<std::atomic<int64_t>*>(q->data + pointer);
+  int64_t size = *size_p;
+
+  // Once the next cycle reached this part of the ring the tag belongs to a newer slot
+  uint64_t reserve_pointer = *q->reserve_pointer;
+  bool reused = (reserve_pointer >> 32) != cycles && (reserve_pointer & 0xFFFFFFFF) > pointer;
+
+  if (reused || !msgq_tag_valid(q, cycles, pointer, size)){
+    // The publisher died before tagging its slot. It ends where the next slot we know of starts
+    uint64_t end = reserve_pointer;
+    for (size_t i = 0; i < NUM_COMMIT_SLOTS; i++){
+      uint64_t flag = *q->commit_slots[i];
+      if (flag != COMMIT_SLOT_EMPTY && flag > head && flag < end){
+        end = flag;
+      }
+    }
+
+    uint32_t end_cycles, end_pointer;
+    UNPACK64(end_cycles, end_pointer, end);
+    int64_t skip = (end_cycles == cycles) ? msgq_skip_tag(cycles, end_pointer - pointer) : -1;
+    size_p->compare_exchange_strong(size, skip);
+  }
+
+  std::cout << "Skipping abandoned message: " << q->endpoint << std::endl;
+  msgq_advance_write_pointer(q, head);
+
+  // Drop the flags of slots that were skipped over, their publishers already returned
+  uint64_t write_pointer = *q->write_pointer;
+  for (size_t i = 0; i < NUM_COMMIT_SLOTS; i++){
+    uint64_t flag = *q->commit_slots[i];
+    if (flag != COMMIT_SLOT_EMPTY && flag < write_pointer){
+      q->commit_slots[i]->compare_exchange_strong(flag, COMMIT_SLOT_EMPTY);
+    }
+  }
+  msgq_notify_readers(q);
+}
+
+static void msgq_commit_slot(msgq_queue_t *q, uint64_t start){
+  uint64_t write_pointer = *q->write_pointer;
+  if (write_pointer == start){
+    msgq_advance_write_pointer(q, start);
+    return;
+  } else if (write_pointer > start){
+    // The slot was given up on and already published
+    return;
+  }
+
+  // An earlier slot is still being written. Leave a commit flag for its publisher,
+  // or publish ourselves if it finishes before a flag is free
+  size_t slot = NUM_COMMIT_SLOTS;
+  while (slot == NUM_COMMIT_SLOTS){
+    for (size_t i = 0; i < NUM_COMMIT_SLOTS; i++){
+      uint64_t expected = COMMIT_SLOT_EMPTY;
+      if (q->commit_slots[i]->compare_exchange_strong(expected, start)){
+        slot = i;
+        break;
+      }
+    }
+    if (slot == NUM_COMMIT_SLOTS){
+      write_pointer = *q->write_pointer;
+      if (write_pointer == start){
+        msgq_advance_write_pointer(q, start);
+        return;
+      } else if (write_pointer > start){
+        return;
+      }
+      msgq_recover_abandoned(q);
+      std::this_thread::yield();
+    }
+  }
+
+  // The previous publisher may have advanced before our flag was visible. Whoever
+  // takes the flag back publishes the slot, unless it was given up on in the meantime
+  write_pointer = *q->write_pointer;
+  if (write_pointer >= start){
+    uint64_t expected = start;
+    if (q->commit_slots[slot]->compare_exchange_strong(expected, COMMIT_SLOT_EMPTY) && write_pointer == start){
+      msgq_advance_write_pointer(q, start);
+    }
+  }
+}
+
+// Move the reserve pointer to the start of the cycle after `cycles`, unless it already moved on
+static void msgq_next_cycle(msgq_queue_t *q, uint32_t cycles){
+  uint64_t cur = *q->reserve_pointer;
+  uint64_t next;
+  uint32_t next_cycles = cycles + 1;
+  PACK64(next, next_cycles, 0);
+  while ((cur >> 32) == cycles && !q->reserve_pointer->compare_exchange_weak(cur, next)){
+    ;
+  }
+}
+
+static char *msgq_msg_reserve_multi(msgq_queue_t *q, size_t size){
+  uint64_t total_msg_size = ALIGN(size + sizeof(int64_t));
+  // Always leave space for a wraparound tag for the next message
+  uint64_t limit = q->size - sizeof(int64_t);
+
+  msgq_recover_abandoned(q);
+
+  while (true){
+    uint64_t start = q->reserve_pointer->fetch_add(total_msg_size);
+    uint32_t write_cycles, write_pointer;
+    UNPACK64(write_cycles, write_pointer, start);
+
+    if (write_pointer + total_msg_size < limit){
+      msgq_invalidate_overwritten_readers(q, write_cycles, write_pointer, write_pointer + total_msg_size);
+      // Tag the slot right away so it can be skipped if we never commit it
+      *reinterpret_cast<std::atomic<int64_t>*>(q->data + write_pointer) = msgq_skip_tag(write_cycles, total_msg_size);
+      q->write_reserved = start;
+      return q->data + write_pointer + sizeof(int64_t);
+    } else if (write_pointer < limit){
+      // We crossed the end of the buffer. Write -1 size tag indicating wraparound,
+      // start the next cycle and publish the tag like any other slot
+      *reinterpret_cast<std::atomic<int64_t>*>(q->data + write_pointer) = -1;
+      msgq_invalidate_wrapped_readers(q, write_cycles, write_pointer);
+      msgq_next_cycle(q, write_cycles);
+      msgq_commit_slot(q, start);
+    } else {
+      // Another publisher is wrapping around, retry in the next cycle. Start
+      // that cycle ourselves if the other publisher died before it could
+      uint64_t since = msgq_now_ns();
+      while ((*q->reserve_pointer >> 32) == write_cycles){
+        if (msgq_now_ns() - since > MSGQ_RESERVE_TIMEOUT_NS){
+          msgq_next_cycle(q, write_cycles);
+        }
+        std::this_thread::yield();
+      }
+    }
+  }
+}
+
+char *msgq_msg_reserve(msgq_queue_t *q, size_t size){
   // Die if we are no longer the active publisher
-  if (q->write_uid_local != *q->write_uid){
+  bool active = q->write_multi ? (bool)*q->multi_publisher : q->write_uid_local == *q->write_uid;
+  if (!active){
     std::cout << "Killing old publisher: " << q->endpoint << std::endl;
     errno = EADDRINUSE;
-    return -1;
+    return NULL;
   }
 
-  uint64_t total_msg_size = ALIGN(msg->size + sizeof(int64_t));
+  uint64_t total_msg_size = ALIGN(size + sizeof(int64_t));
 
   // We need to fit at least three messages in the queue,
   // then we can always safely access the last message
   assert(3 * total_msg_size <= q->size);
 
-  uint64_t num_readers = *q->num_readers;
+  if (q->write_multi){
+    return msgq_msg_reserve_multi(q, size);
+  }
 
   uint32_t write_cycles, write_pointer;
   UNPACK64(write_cycles, write_pointer, *q->write_pointer);
@@ -243,18 +529,7 @@ int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
   if (remaining_space <= 0){
     // Write -1 size tag indicating wraparound
     *(int64_t*)p = -1;
-
-    // Invalidate all readers that are beyond the write pointer
-    // TODO: should we handle the case where a new reader shows up while this is running?
-    for (uint64_t i = 0; i < num_readers; i++){
-      uint64_t read_pointer = *q->read_pointers[i];
-      uint64_t read_cycles = read_pointer >> 32;
-      read_pointer &= 0xFFFFFFFF;
-
-      if ((read_pointer > write_pointer) && (read_cycles != write_cycles)) {
-        *q->read_valids[i] = false;
-      }
-    }
+    msgq_invalidate_wrapped_readers(q, write_cycles, write_pointer);
 
     // Update global and local copies of write pointer and write_cycles
     write_pointer = 0;
@@ -265,39 +540,46 @@ int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
     p = q->data;
   }
 
-  // Invalidate readers that are in the area that will be written
   uint64_t start = write_pointer;
-  uint64_t end = ALIGN(start + sizeof(int64_t) + msg->size);
-
-  for (uint64_t i = 0; i < num_readers; i++){
-    uint32_t read_cycles, read_pointer;
-    UNPACK64(read_cycles, read_pointer, *q->read_pointers[i]);
+  uint64_t end = ALIGN(start + sizeof(int64_t) + size);
+  msgq_invalidate_overwritten_readers(q, write_cycles, start, end);
 
-    if ((read_pointer >= start) && (read_pointer < end) && (read_cycles != write_cycles)) {
-      *q->read_valids[i] = false;
-    }
-  }
+  // Readers never look past the write pointer, so the slot can be filled in place
+  return p + sizeof(int64_t);
+}
 
+int msgq_msg_commit(msgq_queue_t *q, size_t size){
+  uint64_t start = q->write_multi ? q->write_reserved : (uint64_t)*q->write_pointer;
+  uint32_t write_cycles, write_pointer;
+  UNPACK64(write_cycles, write_pointer, start);
+  char *p = q->data + write_pointer;
 
-  // Write size tag
+  // Write size tag, which doubles as the commit flag contents for multi publisher queues
   std::atomic<int64_t> *size_p = reinterpret_cast<std::atomic<int64_t>*>(p);
-  *size_p = msg->size;
-
-  // Copy data
-  memcpy(p + sizeof(int64_t), msg->data, msg->size);
+  *size_p = size;
   __sync_synchronize();
 
-  // Update write pointer
-  uint32_t new_ptr = ALIGN(write_pointer + msg->size + sizeof(int64_t));
-  PACK64(*q->write_pointer, write_cycles, new_ptr);
+  if (q->write_multi){
+    msgq_commit_slot(q, start);
+  } else {
+    // Update write pointer
+    uint32_t new_ptr = ALIGN(write_pointer + size + sizeof(int64_t));
+    PACK64(*q->write_pointer, write_cycles, new_ptr);
+  }
 
-  // Notify readers
-  for (uint64_t i = 0; i < num_readers; i++){
-    uint64_t reader_uid = *q->read_uids[i];
-    thread_signal(reader_uid & 0xFFFFFFFF);
+  msgq_notify_readers(q);
+  return size;
+}
+
+int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
+  char *p = msgq_msg_reserve(q, msg->size);
+  if (p == NULL){
+    return -1;
   }
 
-  return msg->size;
+  // Copy data
+  memcpy(p, msg->data, msg->size);
+  return msgq_msg_commit(q, msg->size);
 }
 
 
@@ -376,6 +658,14 @@ int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
     goto start;
   }
 
+  // A multi publisher slot that was published without a commit
+  if (size < -1){
+    uint64_t skip_pointer = (uint64_t)read_pointer + (size & 0xFFFFFFFF);
+    assert(skip_pointer <= q->size);
+    PACK64(*q->read_pointers[id], read_cycles, skip_pointer);
+    goto start;
+  }
+
   // crashing is better than passing garbage data to the consumer
   // the size will have weird value if it was overwritten by data accidentally
   assert((uint64_t)size < q->size);
@@ -6,6 +6,9 @@
 
 #define DEFAULT_SEGMENT_SIZE (10 * 1024 * 1024)
 #define NUM_READERS 10
+#define NUM_COMMIT_SLOTS 8
+// A multi publisher slot that stays reserved this long while nothing is published is skipped
+#define MSGQ_RESERVE_TIMEOUT_NS (1000ULL * 1000 * 1000)
 #define ALIGN(n) ((n + (8 - 1)) & -8)
 
 #define UNPACK64(higher, lower, input) do {uint64_t tmp = input; higher = tmp >> 32; lower = tmp & 0xFFFFFFFF;} while (0)
@@ -18,6 +21,9 @@ struct  msgq_header_t {
   uint64_t read_pointers[NUM_READERS];
   uint64_t read_valids[NUM_READERS];
   uint64_t read_uids[NUM_READERS];
+  uint64_t multi_publisher;
+  uint64_t reserve_pointer;
+  uint64_t commit_slots[NUM_COMMIT_SLOTS];
 };
 
 struct msgq_queue_t {
@@ -27,12 +33,19 @@ struct msgq_queue_t {
   std::atomic<uint64_t> *read_pointers[NUM_READERS];
   std::atomic<uint64_t> *read_valids[NUM_READERS];
   std::atomic<uint64_t> *read_uids[NUM_READERS];
+  std::atomic<uint64_t> *multi_publisher;
+  std::atomic<uint64_t> *reserve_pointer;
+  std::atomic<uint64_t> *commit_slots[NUM_COMMIT_SLOTS];
   char * mmap_p;
   char * data;
   size_t size;
   int reader_id;
   uint64_t read_uid_local;
   uint64_t write_uid_local;
+  bool write_multi;
+  uint64_t write_reserved;
+  uint64_t write_stalled;
+  uint64_t write_stalled_since;
 
   bool read_conflate;
   std::string endpoint;
@@ -58,9 +71,18 @@ int msgq_msg_close(msgq_msg_t *msg);
 int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size);
 void msgq_close_queue(msgq_queue_t *q);
 void msgq_init_publisher(msgq_queue_t * q);
+// Multi publisher queues reserve ring space with a fetch-add and publish slots in order
+// through per-slot commit flags. All publishers of a queue must use the same mode.
+// A slot that is not committed within MSGQ_RESERVE_TIMEOUT_NS, e.g. because its publisher
+// died, is published as a gap that readers skip
+void msgq_init_multi_publisher(msgq_queue_t * q);
 void msgq_init_subscriber(msgq_queue_t * q);
 
 int msgq_msg_send(msgq_msg_t *msg, msgq_queue_t *q);
+// Split send: reserve returns a slot of `size` bytes in the ring that is published by commit.
+// Only one message may be reserved at a time per queue handle, and the size passed to commit must match
+char *msgq_msg_reserve(msgq_queue_t *q, size_t size);
+int msgq_msg_commit(msgq_queue_t *q, size_t size);
 int msgq_msg_recv(msgq_msg_t *msg, msgq_queue_t *q);
 int msgq_msg_ready(msgq_queue_t * q);
 int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout);
@@ -0,0 +1,304 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "msgq.h"
+
+const size_t MULTI_QUEUE_SIZE = 16 * 1024;
+
+struct MultiHeader {
+  uint32_t writer;
+  uint32_t seq;
+};
+
+// Messages vary in size so slots end on different alignments, the payload is
+// derived from the header so torn messages are caught
+static size_t multi_msg_size(uint32_t seq) {
+  return sizeof(MultiHeader) + seq % 37;
+}
+
+static void multi_msg_fill(char *p, uint32_t writer, uint32_t seq) {
+  MultiHeader h = {writer, seq};
+  memcpy(p, &h, sizeof(h));
+  memset(p + sizeof(h), (writer * 31 + seq) & 0xFF, multi_msg_size(seq) - sizeof(h));
+}
+
+static bool multi_msg_check(const msgq_msg_t &msg, MultiHeader *h) {
+  if (msg.size < sizeof(MultiHeader)) return false;
+  memcpy(h, msg.data, sizeof(*h));
+  if (msg.size != multi_msg_size(h->seq)) return false;
+  for (size_t i = sizeof(*h); i < msg.size; i++) {
+    if ((uint8_t)msg.data[i] != ((h->writer * 31 + h->seq) & 0xFF)) return false;
+  }
+  return true;
+}
+
+static int multi_send(msgq_queue_t *q, uint32_t writer, uint32_t seq) {
+  char *p = msgq_msg_reserve(q, multi_msg_size(seq));
+  if (p == NULL) return -1;
+  multi_msg_fill(p, writer, seq);
+  return msgq_msg_commit(q, multi_msg_size(seq));
+}
+
+// First publisher of a test, starts from an empty queue
+static void multi_init_first(msgq_queue_t *q, const char *endpoint) {
+  REQUIRE(msgq_new_queue(q, endpoint, MULTI_QUEUE_SIZE) == 0);
+  msgq_init_publisher(q);
+  *q->write_pointer = 0;
+  memset(q->data, 0, q->size);
+  msgq_init_multi_publisher(q);
+}
+
+static void multi_init(msgq_queue_t *q, const char *endpoint) {
+  REQUIRE(msgq_new_queue(q, endpoint, MULTI_QUEUE_SIZE) == 0);
+  msgq_init_multi_publisher(q);
+}
+
+static bool multi_flags_empty(msgq_queue_t *q) {
+  for (size_t i = 0; i < NUM_COMMIT_SLOTS; i++) {
+    if (*q->commit_slots[i] != UINT64_MAX) return false;
+  }
+  return true;
+}
+
+static std::vector<MultiHeader> multi_recv_all(msgq_queue_t *q) {
+  std::vector<MultiHeader> received;
+  msgq_msg_t msg;
+  while (msgq_msg_recv(&msg, q) > 0) {
+    MultiHeader h;
+    REQUIRE(multi_msg_check(msg, &h));
+    received.push_back(h);
+    msgq_msg_close(&msg);
+  }
+  return received;
+}
+
+static void multi_sleep_timeout() {
+  std::this_thread::sleep_for(std::chrono::nanoseconds(MSGQ_RESERVE_TIMEOUT_NS + 100 * 1000 * 1000));
+}
+
+TEST_CASE("msgq multi publisher contended wraparound") {
+  const char *endpoint = "test_msgq_multi_wrap";
+  const int num_writers = 4, count = 5000;
+
+  msgq_queue_t pub, sub;
+  multi_init_first(&pub, endpoint);
+  REQUIRE(msgq_new_queue(&sub, endpoint, MULTI_QUEUE_SIZE) == 0);
+  msgq_init_subscriber(&sub);
+
+  std::atomic<bool> go = false, writers_done = false, caught_up = false, done = false;
+  std::vector<int> failed(num_writers, 0);
+  std::vector<std::thread> writers;
+  for (int w = 0; w < num_writers; w++) {
+    writers.emplace_back([&, w]() {
+      msgq_queue_t q;
+      msgq_new_queue(&q, endpoint, MULTI_QUEUE_SIZE);
+      msgq_init_multi_publisher(&q);
+      while (!go) std::this_thread::yield();
+      for (int i = 0; i < count; i++) {
+        if (multi_send(&q, w, i) != (int)multi_msg_size(i)) failed[w]++;
+      }
+      msgq_close_queue(&q);
+    });
+  }
+
+  // The reader may be overrun and lose messages, but never sees a torn
+  // message or messages of one writer out of order
+  std::vector<int64_t> last_seq(num_writers + 1, -1);
+  uint64_t received = 0, torn = 0, out_of_order = 0;
+  std::thread reader([&]() {
+    msgq_msg_t msg;
+    while (true) {
+      bool finished = done;
+      int r = msgq_msg_recv(&msg, &sub);
+      if (r == 0) {
+        if (finished) break;
+        if (writers_done) caught_up = true;
+        std::this_thread::yield();
+        continue;
+      }
+      MultiHeader h;
+      if (!multi_msg_check(msg, &h) || h.writer > num_writers) {
+        torn++;
+      } else {
+        if ((int64_t)h.seq <= last_seq[h.writer]) out_of_order++;
+        last_seq[h.writer] = h.seq;
+        received++;
+      }
+      msgq_msg_close(&msg);
+    }
+  });
+
+  go = true;
+  for (auto &t : writers) t.join();
+  // Nothing overruns the reader once it caught up after the writers are done
+  writers_done = true;
+  while (!caught_up) std::this_thread::yield();
+  REQUIRE(multi_send(&pub, num_writers, 0) > 0);
+  done = true;
+  reader.join();
+
+  for (int w = 0; w < num_writers; w++) {
+    REQUIRE(failed[w] == 0);
+  }
+  REQUIRE(torn == 0);
+  REQUIRE(out_of_order == 0);
+  REQUIRE(received > 0);
+  REQUIRE(last_seq[num_writers] == 0);
+
+  // Every slot got published, several times around the ring
+  REQUIRE(*pub.write_pointer == *pub.reserve_pointer);
+  REQUIRE((*pub.write_pointer >> 32) > 10);
+  REQUIRE(multi_flags_empty(&pub));
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&pub);
+}
+
+TEST_CASE("msgq multi publisher reader join") {
+  const char *endpoint = "test_msgq_multi_join";
+
+  msgq_queue_t a, b, sub;
+  multi_init_first(&a, endpoint);
+  multi_init(&b, endpoint);
+  REQUIRE(multi_send(&a, 0, 0) > 0);
+
+  // A reader that joins while a slot is reserved starts at that slot, and
+  // sees the messages committed after it only once it is published
+  char *p = msgq_msg_reserve(&a, multi_msg_size(1));
+  REQUIRE(p != NULL);
+  REQUIRE(multi_send(&b, 1, 0) > 0);
+
+  REQUIRE(msgq_new_queue(&sub, endpoint, MULTI_QUEUE_SIZE) == 0);
+  msgq_init_subscriber(&sub);
+  REQUIRE(msgq_msg_ready(&sub) == 0);
+  REQUIRE(multi_recv_all(&sub).empty());
+
+  multi_msg_fill(p, 0, 1);
+  REQUIRE(msgq_msg_commit(&a, multi_msg_size(1)) > 0);
+
+  auto received = multi_recv_all(&sub);
+  REQUIRE(received.size() == 2);
+  REQUIRE(received[0].writer == 0);
+  REQUIRE(received[0].seq == 1);
+  REQUIRE(received[1].writer == 1);
+  REQUIRE(received[1].seq == 0);
+
+  // A second reader joining later only sees new messages
+  msgq_queue_t sub2;
+  REQUIRE(msgq_new_queue(&sub2, endpoint, MULTI_QUEUE_SIZE) == 0);
+  msgq_init_subscriber(&sub2);
+  REQUIRE(multi_send(&b, 1, 1) > 0);
+  received = multi_recv_all(&sub2);
+  REQUIRE(received.size() == 1);
+  REQUIRE(received[0].seq == 1);
+  REQUIRE(multi_flags_empty(&a));
+
+  msgq_close_queue(&sub2);
+  msgq_close_queue(&sub);
+  msgq_close_queue(&b);
+  msgq_close_queue(&a);
+}
+
+TEST_CASE("msgq multi publisher writer takeover") {
+  const char *endpoint = "test_msgq_multi_takeover";
+
+  msgq_queue_t a, b, sub;
+  multi_init_first(&a, endpoint);
+  multi_init(&b, endpoint);
+  REQUIRE(msgq_new_queue(&sub, endpoint, MULTI_QUEUE_SIZE) == 0);
+  msgq_init_subscriber(&sub);
+
+  SECTION("abandoned reservation is skipped") {
+    // a dies between reserve and commit
+    char *p = msgq_msg_reserve(&a, multi_msg_size(0));
+    REQUIRE(p != NULL);
+    for (uint32_t i = 0; i < 3; i++) {
+      REQUIRE(multi_send(&b, 1, i) > 0);
+    }
+    REQUIRE(multi_recv_all(&sub).empty());
+
+    multi_sleep_timeout();
+    REQUIRE(multi_send(&b, 1, 3) > 0);
+    auto received = multi_recv_all(&sub);
+    REQUIRE(received.size() == 4);
+    for (uint32_t i = 0; i < 4; i++) {
+      REQUIRE(received[i].writer == 1);
+      REQUIRE(received[i].seq == i);
+    }
+
+    // A late commit doesn't publish anything or block the queue
+    multi_msg_fill(p, 0, 0);
+    REQUIRE(msgq_msg_commit(&a, multi_msg_size(0)) > 0);
+    REQUIRE(multi_flags_empty(&a));
+    REQUIRE(multi_send(&a, 0, 1) > 0);
+    received = multi_recv_all(&sub);
+    REQUIRE(received.size() == 1);
+    REQUIRE(received[0].writer == 0);
+    REQUIRE(received[0].seq == 1);
+  }
+
+  SECTION("reservation without a tag is skipped") {
+    // a dies right after reserving, before it could tag the slot
+    a.reserve_pointer->fetch_add(64);
+    REQUIRE(multi_send(&b, 1, 0) > 0);
+    REQUIRE(multi_recv_all(&sub).empty());
+
+    multi_sleep_timeout();
+    REQUIRE(multi_send(&b, 1, 1) > 0);
+    auto received = multi_recv_all(&sub);
+    REQUIRE(received.size() == 2);
+    REQUIRE(received[0].seq == 0);
+    REQUIRE(received[1].seq == 1);
+    REQUIRE(*a.write_pointer == *a.reserve_pointer);
+  }
+
+  SECTION("wraparound of a dead publisher is finished") {
+    // a dies after crossing the end of the ring, before starting the next cycle
+    uint64_t start = MULTI_QUEUE_SIZE - 128;
+    *a.write_pointer = start;
+    *a.reserve_pointer = start;
+    msgq_reset_reader(&sub);
+    a.reserve_pointer->fetch_add(256);
+    auto sender = std::thread([&]() {
+      multi_send(&b, 1, 0);
+    });
+    sender.join();
+    REQUIRE(multi_recv_all(&sub).empty());
+
+    multi_sleep_timeout();
+    REQUIRE(multi_send(&b, 1, 1) > 0);
+    auto received = multi_recv_all(&sub);
+    REQUIRE(received.size() == 2);
+    REQUIRE(received[0].seq == 0);
+    REQUIRE(received[1].seq == 1);
+    REQUIRE((*a.write_pointer >> 32) == (start >> 32) + 1);
+    REQUIRE(*a.write_pointer == *a.reserve_pointer);
+    REQUIRE(multi_flags_empty(&a));
+  }
+
+  SECTION("single publisher takes over") {
+    REQUIRE(multi_send(&a, 0, 0) > 0);
+    msgq_queue_t c;
+    REQUIRE(msgq_new_queue(&c, endpoint, MULTI_QUEUE_SIZE) == 0);
+    msgq_init_publisher(&c);
+
+    REQUIRE(msgq_msg_reserve(&a, multi_msg_size(1)) == NULL);
+    REQUIRE(errno == EADDRINUSE);
+    REQUIRE(msgq_msg_reserve(&b, multi_msg_size(0)) == NULL);
+
+    msgq_init_subscriber(&sub);
+    REQUIRE(multi_send(&c, 2, 0) > 0);
+    auto received = multi_recv_all(&sub);
+    REQUIRE(received.size() == 1);
+    REQUIRE(received[0].writer == 2);
+    msgq_close_queue(&c);
+  }
+
+  msgq_close_queue(&sub);
+  msgq_close_queue(&b);
+  msgq_close_queue(&a);
+}
@@ -1,8 +1,12 @@
 #include <time.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <mutex>
+#include <unordered_map>
+#include <algorithm>
 
 #include "services.h"
 #include "messaging.h"
@@ -186,6 +190,55 @@ SubMaster::~SubMaster() {
   }
 }
 
+// Keep a few segments per thread, enough for the publishers that interleave several services
+static constexpr size_t ARENA_POOL_SIZE = 8;
+// Don't let one huge message pin a large first segment forever
+static constexpr size_t ARENA_MAX_HINT_WORDS = 1 << 17;
+
+struct ArenaPool {
+  std::vector<kj::Array<capnp::word>> segments;
+  // keyed by views of the names in services, so looking a service up doesn't allocate
+  std::unordered_map<std::string_view, size_t> hints;
+};
+static thread_local ArenaPool arena_pool;
+
+MessageArena::MessageArena(size_t words) {
+  auto &segments = arena_pool.segments;
+  for (auto it = segments.begin(); it != segments.end(); ++it) {
+    if (it->size() >= words) {
+      segment_ = std::move(*it);
+      segments.erase(it);
+      return;
+    }
+  }
+  // MallocMessageBuilder requires a zeroed first segment, and zeroes it again when done
+  segment_ = kj::heapArray<capnp::word>(words);
+  memset(segment_.begin(), 0, segment_.size() * sizeof(capnp::word));
+}
+
+MessageArena::~MessageArena() {
+  auto &segments = arena_pool.segments;
+  if (segments.size() < ARENA_POOL_SIZE) {
+    segments.push_back(std::move(segment_));
+  }
+}
+
+size_t MessageArena::hint(const char *service) {
+  auto it = arena_pool.hints.find(service);
+  return it == arena_pool.hints.end() ? capnp::SUGGESTED_FIRST_SEGMENT_WORDS : it->second;
+}
+
+void MessageArena::update_hint(const char *service, size_t words) {
+  auto it = arena_pool.hints.find(service);
+  if (it == arena_pool.hints.end()) {
+    const struct service *serv = get_service(service);
+    assert(serv != nullptr);
+    it = arena_pool.hints.emplace(serv->name, 0).first;
+  }
+  size_t &hint = it->second;
+  hint = std::min(std::max({hint, words, (size_t)capnp::SUGGESTED_FIRST_SEGMENT_WORDS}), ARENA_MAX_HINT_WORDS);
+}
+
 PubMaster::PubMaster(const std::vector<const char *> &service_list) {
   for (auto name : service_list) {
     assert(get_service(name) != nullptr);
@@ -195,9 +248,18 @@ PubMaster::PubMaster(const std::vector<const char *> &service_list) {
   }
 }
 
+PubSocket *PubMaster::socket(const char *name) const {
+  auto it = sockets_.find(name);
+  if (it == sockets_.end()) {
+    throw std::out_of_range(std::string("PubMaster: no socket for ") + name);
+  }
+  return it->second;
+}
+
 int PubMaster::send(const char *name, MessageBuilder &msg) {
-  auto bytes = msg.toBytes();
-  return send(name, bytes.begin(), bytes.size());
+  PubSocket *s = socket(name);
+  MessageArena::update_hint(name, capnp::computeSerializedSizeInWords(msg));
+  return s->sendBuilder(msg);
 }
 
 PubMaster::~PubMaster() {
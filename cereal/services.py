@@ -13,16 +13,18 @@ def new_port(port: int):
 
 
 class Service:
-  def __init__(self, port: int, should_log: bool, frequency: float, decimation: Optional[int] = None):
+  def __init__(self, port: int, should_log: bool, frequency: float, decimation: Optional[int] = None,
+               multi_publisher: bool = False):
     self.port = port
     self.should_log = should_log
     self.frequency = frequency
     self.decimation = decimation
+    self.multi_publisher = multi_publisher
 
 DCAM_FREQ = 10. if not TICI else 20.
 
 services = {
-  # service: (should_log, frequency, qlog decimation (optional))
+  # service: (should_log, frequency, qlog decimation (optional), multi publisher (optional))
   "sensorEvents": (True, 100., 100),
   "gpsNMEA": (True, 9.),
   "deviceState": (True, 2., 1),
@@ -67,6 +69,7 @@ services = {
   "navRoute": (True, 0.),
   "navThumbnail": (True, 0.),
   "roadLimitSpeed": (False, 0.),
+  "visionIpcStats": (True, 1., 1, True),
 
   # debug
   "testJoystick": (False, 0.),
@@ -80,13 +83,14 @@ def build_header():
   h += "/* THIS IS AN AUTOGENERATED FILE, PLEASE EDIT services.py */\n"
   h += "#ifndef __SERVICES_H\n"
   h += "#define __SERVICES_H\n"
-  h += "struct service { char name[0x100]; int port; bool should_log; int frequency; int decimation; };\n"
+  h += "struct service { char name[0x100]; int port; bool should_log; int frequency; int decimation; bool multi_publisher; };\n"
   h += "static struct service services[] = {\n"
   for k, v in service_list.items():
     should_log = "true" if v.should_log else "false"
     decimation = -1 if v.decimation is None else v.decimation
-    h += '  { "%s", %d, %s, %d, %d },\n' % \
-         (k, v.port, should_log, v.frequency, decimation)
+    multi_publisher = "true" if v.multi_publisher else "false"
+    h += '  { "%s", %d, %s, %d, %d, %s },\n' % \
+         (k, v.port, should_log, v.frequency, decimation, multi_publisher)
   h += "};\n"
   h += "#endif\n"
   return h
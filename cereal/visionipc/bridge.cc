@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "visionipc/visionipc_bridge.h"
+
+static std::atomic<bool> do_exit = false;
+
+static void set_do_exit(int sig) {
+  do_exit = true;
+}
+
+static const std::map<std::string, VisionStreamType> stream_names = {
+  {"rgbRoad", VISION_STREAM_RGB_BACK},
+  {"rgbDriver", VISION_STREAM_RGB_FRONT},
+  {"rgbWideRoad", VISION_STREAM_RGB_WIDE},
+  {"road", VISION_STREAM_ROAD},
+  {"driver", VISION_STREAM_DRIVER},
+  {"wideRoad", VISION_STREAM_WIDE_ROAD},
+};
+
+static void usage(const char *prog) {
+  printf("usage: %s [--zerocopy]                          serve local camerad streams\n", prog);
+  printf("       %s <ip> <stream,...> [--downscale]       republish remote streams as camerad\n", prog);
+  printf("streams: rgbRoad rgbDriver rgbWideRoad road driver wideRoad\n");
+}
+
+int main(int argc, char **argv) {
+  std::signal(SIGINT, set_do_exit);
+  std::signal(SIGTERM, set_do_exit);
+
+  bool zerocopy = false, downscale = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--zerocopy") == 0) {
+      zerocopy = true;
+    } else if (strcmp(argv[i], "--downscale") == 0) {
+      downscale = true;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+
+  std::unique_ptr<VisionIpcBridgeSender> sender;
+  std::unique_ptr<VisionIpcBridgeReceiver> receiver;
+  std::map<VisionStreamType, VisionIpcBridgeStats> *stats = nullptr;
+  if (args.empty()) {
+    sender = std::make_unique<VisionIpcBridgeSender>("camerad", VISIONIPC_BRIDGE_PORT, zerocopy);
+    sender->start();
+    stats = &sender->stats;
+  } else if (args.size() == 2) {
+    std::vector<VisionStreamType> types;
+    size_t start = 0;
+    while (start <= args[1].size()) {
+      size_t end = std::min(args[1].find(',', start), args[1].size());
+      auto it = stream_names.find(args[1].substr(start, end - start));
+      if (it == stream_names.end()) {
+        usage(argv[0]);
+        return 1;
+      }
+      types.push_back(it->second);
+      start = end + 1;
+    }
+    receiver = std::make_unique<VisionIpcBridgeReceiver>("camerad", args[0], types, VISIONIPC_BRIDGE_PORT, downscale);
+    receiver->start();
+    stats = &receiver->stats;
+  } else {
+    usage(argv[0]);
+    return 1;
+  }
+
+  while (!do_exit) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    visionipc_bridge_print_stats(sender ? "send" : "recv", *stats, 1.0);
+  }
+  return 0;
+}
@@ -15,4 +15,19 @@ struct VisionIpcPacket {
   uint64_t server_id;
   size_t idx;
   struct VisionIpcBufExtra extra;
+  uint64_t timestamp_sent;
 };
+
+// Per-client delivery stats, accumulated since connect or the last reset_stats()
+struct VisionIpcClientStats {
+  uint64_t delivered;        // buffers returned by recv
+  uint64_t skipped;          // frames sent by the server that this client never received
+  uint64_t torn;             // buffers the server reused before the client was done reading them
+  uint64_t age_sum_ns;       // time between the server sending a buffer and recv returning it
+  uint64_t age_max_ns;
+  uint64_t frame_interval_ns;  // time between consecutive frames as seen by this client
+};
+
+// Number of buffers a server needs so that a consumer lagging lag_ns
+// behind never reads a buffer that is being overwritten
+size_t visionipc_buffer_count_hint(uint64_t frame_interval_ns, uint64_t lag_ns);
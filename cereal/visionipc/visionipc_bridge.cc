@@ -0,0 +1,416 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef SO_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+
+#include "libyuv.h"
+
+#include "visionipc/visionipc_bridge.h"
+#include "logger/logger.h"
+#include "selfdrive/common/timing.h"
+
+static bool wait_readable(int fd, const std::atomic<bool> &should_exit) {
+  while (!should_exit) {
+    struct pollfd polls[1] = {{.fd = fd, .events = POLLIN}};
+    int ret = poll(polls, 1, 100);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN) return false;
+    if (ret > 0) return true;
+  }
+  return false;
+}
+
+static bool recv_all(int fd, void *data, size_t len, const std::atomic<bool> &should_exit) {
+  uint8_t *p = (uint8_t *)data;
+  while (len > 0) {
+    if (!wait_readable(fd, should_exit)) return false;
+
+    ssize_t r = recv(fd, p, len, 0);
+    if (r < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+    if (r <= 0) return false;
+    p += r;
+    len -= r;
+  }
+  return true;
+}
+
+static void set_nodelay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// a stream as sent over the bridge, rows packed. downscaling halves YUV streams
+static VisionIpcBridgeStream stream_info(VisionStreamType type, const VisionBuf &buf, bool downscale) {
+  VisionIpcBridgeStream info = {
+    .type = (uint32_t)type,
+    .rgb = buf.rgb,
+    .width = buf.width,
+    .height = buf.height,
+  };
+  if (downscale && !buf.rgb) {
+    info.width = (buf.width / 2) & ~1;
+    info.height = (buf.height / 2) & ~1;
+  }
+  info.stride = buf.rgb ? info.width * 3 : info.width;
+  info.len = buf.rgb ? info.stride * info.height : info.width * info.height * 3 / 2;
+  return info;
+}
+
+// copies rows between layouts with different strides
+static void copy_rows(uint8_t *dst, size_t dst_stride, const uint8_t *src, size_t src_stride, size_t row_len, size_t rows) {
+  for (size_t i = 0; i < rows; i++) {
+    memcpy(dst + i * dst_stride, src + i * src_stride, row_len);
+  }
+}
+
+static void update_stats(VisionIpcBridgeStats &s, uint64_t bytes, uint64_t latency_ns) {
+  s.frames++;
+  s.bytes += bytes;
+  s.latency_sum_ns += latency_ns;
+  uint64_t prev = s.latency_max_ns;
+  while (prev < latency_ns && !s.latency_max_ns.compare_exchange_weak(prev, latency_ns)) {}
+}
+
+void visionipc_bridge_print_stats(const char *prefix, std::map<VisionStreamType, VisionIpcBridgeStats> &stats, double seconds) {
+  for (auto &[type, s] : stats) {
+    uint64_t frames = s.frames.exchange(0);
+    uint64_t bytes = s.bytes.exchange(0);
+    uint64_t latency_sum = s.latency_sum_ns.exchange(0);
+    uint64_t latency_max = s.latency_max_ns.exchange(0);
+    if (frames == 0) continue;
+
+    printf("%s stream %d: %.1f fps, %.2f MB/s, latency avg %.2f ms, max %.2f ms\n", prefix, type,
+           frames / seconds, bytes / seconds / 1e6, latency_sum / frames / 1e6, latency_max / 1e6);
+  }
+}
+
+// ***** sender *****
+
+VisionIpcBridgeSender::VisionIpcBridgeSender(std::string name, int port, bool zerocopy) : name(name), port(port), zerocopy(zerocopy) {
+  for (int i = 0; i < VISION_STREAM_MAX; i++) {
+    stats[(VisionStreamType)i];
+  }
+#ifndef SO_ZEROCOPY
+  if (zerocopy) {
+    LOGW("MSG_ZEROCOPY not supported on this platform");
+    this->zerocopy = false;
+  }
+#endif
+}
+
+void VisionIpcBridgeSender::start() {
+  sender_thread = std::thread(&VisionIpcBridgeSender::sender, this);
+}
+
+void VisionIpcBridgeSender::sender() {
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  assert(sock >= 0);
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  int err = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+  assert(err == 0);
+  err = listen(sock, 1);
+  assert(err == 0);
+
+  while (!should_exit) {
+    if (!wait_readable(sock, should_exit)) continue;
+
+    int fd = accept(sock, NULL, NULL);
+    if (fd < 0) continue;
+    set_nodelay(fd);
+
+    VisionIpcBridgeRequest request = {};
+    if (!recv_all(fd, &request, sizeof(request), should_exit) ||
+        request.magic != VISIONIPC_BRIDGE_MAGIC || request.num_types > VISION_STREAM_MAX) {
+      LOGE("invalid bridge request");
+      close(fd);
+      continue;
+    }
+
+#ifdef SO_ZEROCOPY
+    if (zerocopy && setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) {
+      LOGW("SO_ZEROCOPY failed, falling back to copying sends");
+      zerocopy = false;
+    }
+#endif
+
+    // connect to all requested streams before describing them to the receiver
+    std::vector<std::unique_ptr<VisionIpcClient>> clients;
+    std::vector<VisionIpcBridgeStream> streams;
+    for (int i = 0; i < request.num_types && !should_exit; i++) {
+      VisionStreamType type = (VisionStreamType)request.types[i];
+      auto client = std::make_unique<VisionIpcClient>(name, type, true);
+      while (!should_exit && !client->connect(false)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+      streams.push_back(stream_info(type, client->buffers[0], request.downscale));
+      clients.push_back(std::move(client));
+    }
+
+    if (!should_exit && send(fd, streams.data(), streams.size() * sizeof(streams[0]), MSG_NOSIGNAL) == streams.size() * sizeof(streams[0])) {
+      printf("bridge: streaming %zu streams to receiver\n", streams.size());
+
+      zerocopy_next = zerocopy_done = 0;
+      std::atomic<bool> connected = true;
+      std::vector<std::thread> threads;
+      for (int i = 0; i < clients.size(); i++) {
+        threads.emplace_back(&VisionIpcBridgeSender::stream, this, fd, clients[i].get(),
+                             (VisionStreamType)request.types[i], (bool)request.downscale, &connected);
+      }
+      for (auto &t : threads) t.join();
+      printf("bridge: receiver disconnected\n");
+    }
+    close(fd);
+  }
+
+  close(sock);
+}
+
+void VisionIpcBridgeSender::stream(int fd, VisionIpcClient *client, VisionStreamType type, bool downscale, std::atomic<bool> *connected) {
+  std::vector<uint8_t> scaled;
+
+  while (!should_exit && *connected) {
+    VisionIpcBufExtra extra = {};
+    VisionBuf *buf = client->recv(&extra);
+    if (buf == nullptr) {
+      if (!client->connected) *connected = false;
+      continue;
+    }
+
+    const VisionIpcBridgeStream info = stream_info(type, *buf, downscale);
+    const uint8_t *data = (const uint8_t *)buf->addr;
+    if (info.rgb && info.stride != buf->stride) {
+      // e.g. QCOM pads the rows of rgb buffers
+      scaled.resize(info.len);
+      copy_rows(scaled.data(), info.stride, data, buf->stride, info.stride, info.height);
+      data = scaled.data();
+    } else if (!info.rgb && info.width != buf->width) {
+      scaled.resize(info.len);
+      uint8_t *y = scaled.data();
+      uint8_t *u = y + info.width * info.height;
+      uint8_t *v = u + (info.width / 2) * (info.height / 2);
+      libyuv::I420Scale(buf->y, buf->width, buf->u, buf->width / 2, buf->v, buf->width / 2,
+                        buf->width, buf->height,
+                        y, info.width, u, info.width / 2, v, info.width / 2,
+                        info.width, info.height, libyuv::kFilterBox);
+      data = scaled.data();
+    }
+
+    VisionIpcBridgeFrame frame = {
+      .type = (uint32_t)type,
+      .extra = extra,
+      .timestamp_sent = nanos_since_boot(),
+      .len = info.len,
+    };
+    // MSG_ZEROCOPY hands the shared buffer itself to the NIC, a copy made here is cheap enough to copy again
+    const bool use_zerocopy = zerocopy && data == buf->addr;
+    uint32_t last_zerocopy = 0;
+    if (!send_frame(fd, &frame, data, use_zerocopy, &last_zerocopy)) {
+      *connected = false;
+      break;
+    }
+    // the kernel reads the pages until the send completes, camerad can't have the buffer back before that
+    if (use_zerocopy && !wait_zerocopy(fd, last_zerocopy)) {
+      *connected = false;
+      break;
+    }
+    if (!client->release(buf)) {
+      LOGD("bridge: stream %d frame %d overwritten while sending", type, extra.frame_id);
+    }
+    update_stats(stats[type], sizeof(frame) + info.len, nanos_since_boot() - frame.timestamp_sent);
+  }
+}
+
+bool VisionIpcBridgeSender::send_frame(int fd, VisionIpcBridgeFrame *frame, const uint8_t *data, bool use_zerocopy, uint32_t *last_zerocopy) {
+  std::lock_guard lk(send_lock);
+
+  struct iovec iov[2] = {
+    {.iov_base = frame, .iov_len = sizeof(*frame)},
+    {.iov_base = (void *)data, .iov_len = frame->len},
+  };
+  struct msghdr msg = {};
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  int flags = MSG_NOSIGNAL;
+#ifdef SO_ZEROCOPY
+  if (use_zerocopy) flags |= MSG_ZEROCOPY;
+#endif
+
+  // sendmsg reads straight from the mmap'd buffer, no intermediate copy in userspace
+  while (msg.msg_iovlen > 0) {
+    ssize_t sent = sendmsg(fd, &msg, flags);
+    if (sent < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS) continue;
+      return false;
+    }
+    // every zerocopy send that went through gets a completion
+    if (use_zerocopy) {
+      std::lock_guard zlk(zerocopy_lock);
+      *last_zerocopy = zerocopy_next++;
+    }
+
+    // skip what was sent on partial writes
+    while (msg.msg_iovlen > 0 && sent >= msg.msg_iov[0].iov_len) {
+      sent -= msg.msg_iov[0].iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen > 0) {
+      msg.msg_iov[0].iov_base = (uint8_t *)msg.msg_iov[0].iov_base + sent;
+      msg.msg_iov[0].iov_len -= sent;
+    }
+  }
+  return true;
+}
+
+// reads the completions off the socket error queue until the zerocopy send id is done
+bool VisionIpcBridgeSender::wait_zerocopy(int fd, uint32_t id) {
+#ifdef SO_ZEROCOPY
+  std::unique_lock lk(zerocopy_lock);
+  while ((int32_t)(id - zerocopy_done) >= 0) {
+    if (should_exit) return false;
+
+    char control[128];
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+      // POLLERR is reported without asking once a completion is queued
+      struct pollfd polls[1] = {{.fd = fd, .events = 0}};
+      lk.unlock();
+      int ret = poll(polls, 1, 100);
+      lk.lock();
+      if (ret > 0 && (polls[0].revents & (POLLHUP | POLLNVAL))) return false;
+      continue;
+    }
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+      struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+      if (serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+        // sends ee_info to ee_data are done, they complete in order on a TCP socket
+        if ((int32_t)(serr->ee_data + 1 - zerocopy_done) > 0) {
+          zerocopy_done = serr->ee_data + 1;
+        }
+      }
+    }
+  }
+#endif
+  return true;
+}
+
+VisionIpcBridgeSender::~VisionIpcBridgeSender() {
+  should_exit = true;
+  if (sender_thread.joinable()) sender_thread.join();
+}
+
+// ***** receiver *****
+
+VisionIpcBridgeReceiver::VisionIpcBridgeReceiver(std::string name, std::string ip, std::vector<VisionStreamType> types, int port, bool downscale)
+  : name(name), ip(ip), port(port), types(types), downscale(downscale) {
+  assert(types.size() <= VISION_STREAM_MAX);
+  for (auto type : types) {
+    stats[type];
+  }
+}
+
+void VisionIpcBridgeReceiver::start() {
+  receiver_thread = std::thread(&VisionIpcBridgeReceiver::receiver, this);
+}
+
+void VisionIpcBridgeReceiver::receiver() {
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  int err = inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+  assert(err == 1);
+
+  while (!should_exit) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    set_nodelay(fd);
+
+    VisionIpcBridgeRequest request = {
+      .magic = VISIONIPC_BRIDGE_MAGIC,
+      .downscale = downscale,
+      .num_types = (uint32_t)types.size(),
+    };
+    for (int i = 0; i < types.size(); i++) {
+      request.types[i] = types[i];
+    }
+
+    std::vector<VisionIpcBridgeStream> streams(types.size());
+    if (send(fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request) ||
+        !recv_all(fd, streams.data(), streams.size() * sizeof(streams[0]), should_exit)) {
+      close(fd);
+      continue;
+    }
+
+    // republish with the sizes the sender reported. received data goes straight into the shared
+    // buffers when their rows are laid out like on the wire
+    VisionIpcServer server(name);
+    std::map<VisionStreamType, VisionIpcBridgeStream> infos;
+    for (auto &s : streams) {
+      VisionStreamType type = (VisionStreamType)s.type;
+      server.create_buffers(type, VISIONIPC_BRIDGE_BUFFERS, s.rgb, s.width, s.height);
+      infos[type] = s;
+    }
+    server.start_listener();
+    printf("bridge: connected to %s:%d\n", ip.c_str(), port);
+
+    std::vector<uint8_t> staging;
+    VisionIpcBridgeFrame frame = {};
+    while (!should_exit && recv_all(fd, &frame, sizeof(frame), should_exit)) {
+      VisionStreamType type = (VisionStreamType)frame.type;
+      if (infos.count(type) == 0 || infos[type].len != frame.len) {
+        LOGE("bridge: unexpected frame for stream %d with size %lu", type, (unsigned long)frame.len);
+        break;
+      }
+
+      const VisionIpcBridgeStream &info = infos[type];
+      VisionBuf *buf = server.get_buffer(type);
+      if (!info.rgb || buf->stride == info.stride) {
+        assert(frame.len <= buf->len);
+        if (!recv_all(fd, buf->addr, frame.len, should_exit)) break;
+      } else {
+        staging.resize(frame.len);
+        if (!recv_all(fd, staging.data(), frame.len, should_exit)) break;
+        copy_rows((uint8_t *)buf->addr, buf->stride, staging.data(), info.stride, info.stride, info.height);
+      }
+
+      update_stats(stats[type], sizeof(frame) + frame.len, nanos_since_boot() - frame.timestamp_sent);
+      server.send(buf, &frame.extra, false);
+    }
+
+    printf("bridge: disconnected from %s:%d\n", ip.c_str(), port);
+    close(fd);
+  }
+}
+
+VisionIpcBridgeReceiver::~VisionIpcBridgeReceiver() {
+  should_exit = true;
+  if (receiver_thread.joinable()) receiver_thread.join();
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "visionipc/visionipc.h"
+#include "visionipc/visionbuf.h"
+#include "visionipc/visionipc_client.h"
+#include "visionipc/visionipc_server.h"
+
+constexpr int VISIONIPC_BRIDGE_PORT = 9100;
+constexpr uint32_t VISIONIPC_BRIDGE_MAGIC = 0x76697063;  // "vipc"
+constexpr size_t VISIONIPC_BRIDGE_BUFFERS = 4;
+
+// Wire format. The receiver sends a request, the sender answers with one
+// stream description per requested type and then streams frames
+struct VisionIpcBridgeRequest {
+  uint32_t magic;
+  uint32_t downscale;
+  uint32_t num_types;
+  uint32_t types[VISION_STREAM_MAX];
+};
+
+// Frames go over the wire with rows of stride bytes, whatever the layout of the buffers on
+// either end is, len is the size of a frame
+struct VisionIpcBridgeStream {
+  uint32_t type;
+  uint32_t rgb;
+  uint64_t width;
+  uint64_t height;
+  uint64_t stride;
+  uint64_t len;
+};
+
+struct VisionIpcBridgeFrame {
+  uint32_t type;
+  struct VisionIpcBufExtra extra;
+  uint64_t timestamp_sent;
+  uint64_t len;
+};
+
+struct VisionIpcBridgeStats {
+  std::atomic<uint64_t> frames = 0;
+  std::atomic<uint64_t> bytes = 0;
+  // send to republish, only meaningful when both ends share a clock (e.g. loopback)
+  std::atomic<uint64_t> latency_sum_ns = 0;
+  std::atomic<uint64_t> latency_max_ns = 0;
+};
+
+// Runs next to the VisionIPC server `name`. Accepts one receiver at a time and
+// streams the frames it asks for straight from the shared buffers
+class VisionIpcBridgeSender {
+ private:
+  std::string name;
+  int port;
+  bool zerocopy;
+
+  std::atomic<bool> should_exit = false;
+  std::thread sender_thread;
+  std::mutex send_lock;
+
+  // MSG_ZEROCOPY sends of the connection, numbered like the kernel does, and the first one the
+  // kernel isn't done with yet
+  std::mutex zerocopy_lock;
+  uint32_t zerocopy_next = 0;
+  uint32_t zerocopy_done = 0;
+
+  void sender();
+  void stream(int fd, VisionIpcClient *client, VisionStreamType type, bool downscale, std::atomic<bool> *connected);
+  bool send_frame(int fd, VisionIpcBridgeFrame *frame, const uint8_t *data, bool use_zerocopy, uint32_t *last_zerocopy);
+  bool wait_zerocopy(int fd, uint32_t id);
+
+ public:
+  std::map<VisionStreamType, VisionIpcBridgeStats> stats;
+
+  VisionIpcBridgeSender(std::string name, int port=VISIONIPC_BRIDGE_PORT, bool zerocopy=false);
+  ~VisionIpcBridgeSender();
+  void start();
+};
+
+// Runs on the remote machine. Connects to a sender and republishes the
+// requested streams through a local VisionIpcServer named `name`
+class VisionIpcBridgeReceiver {
+ private:
+  std::string name;
+  std::string ip;
+  int port;
+  std::vector<VisionStreamType> types;
+  bool downscale;
+
+  std::atomic<bool> should_exit = false;
+  std::thread receiver_thread;
+
+  void receiver();
+
+ public:
+  std::map<VisionStreamType, VisionIpcBridgeStats> stats;
+
+  VisionIpcBridgeReceiver(std::string name, std::string ip, std::vector<VisionStreamType> types,
+                          int port=VISIONIPC_BRIDGE_PORT, bool downscale=false);
+  ~VisionIpcBridgeReceiver();
+  void start();
+};
+
+void visionipc_bridge_print_stats(const char *prefix, std::map<VisionStreamType, VisionIpcBridgeStats> &stats, double seconds);
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <cassert>
 #include <iostream>
@@ -7,6 +8,7 @@
 #include "visionipc/visionipc_client.h"
 #include "visionipc/visionipc_server.h"
 #include "logger/logger.h"
+#include "selfdrive/common/timing.h"
 
 VisionIpcClient::VisionIpcClient(std::string name, VisionStreamType type, bool conflate, cl_device_id device_id, cl_context ctx) : name(name), type(type), device_id(device_id), ctx(ctx) {
   msg_ctx = Context::create();
@@ -28,6 +30,8 @@ bool VisionIpcClient::connect(bool blocking){
   }
 
   num_buffers = 0;
+  reset_stats();
+  last_timestamp_sent = 0;
 
   // Connect to server socket and ask for all FDs of type
   std::string path = "/tmp/visionipc_" + name;
@@ -110,10 +114,48 @@ VisionBuf * VisionIpcClient::recv(VisionIpcBufExtra * extra, const int timeout_m
     LOGE("Failed to sync buffer");
   }
 
+  // update stats
+  const uint32_t frame_id = packet->extra.frame_id;
+  const uint64_t age = nanos_since_boot() - packet->timestamp_sent;
+  if (last_timestamp_sent != 0 && frame_id > last_frame_id) {
+    stats.skipped += frame_id - last_frame_id - 1;
+    stats.frame_interval_ns = (packet->timestamp_sent - last_timestamp_sent) / (frame_id - last_frame_id);
+  }
+  stats.delivered++;
+  stats.age_sum_ns += age;
+  stats.age_max_ns = std::max(stats.age_max_ns, age);
+  last_frame_id = frame_id;
+  last_timestamp_sent = packet->timestamp_sent;
+
+  buf_frame_ids[buf->idx] = frame_id;
+  buf_torn[buf->idx] = false;
+  release(buf);
+
   delete r;
   return buf;
 }
 
+bool VisionIpcClient::release(VisionBuf * buf) {
+  if (buf_torn[buf->idx]) return false;
+
+  if (buf->get_frame_id() != buf_frame_ids[buf->idx]) {
+    buf_torn[buf->idx] = true;
+    stats.torn++;
+    return false;
+  }
+  return true;
+}
+
+size_t VisionIpcClient::buffer_count_hint() {
+  return visionipc_buffer_count_hint(stats.frame_interval_ns, stats.age_max_ns);
+}
+
+void VisionIpcClient::reset_stats() {
+  uint64_t frame_interval_ns = stats.frame_interval_ns;
+  stats = {};
+  stats.frame_interval_ns = frame_interval_ns;
+}
+
 
 
 VisionIpcClient::~VisionIpcClient(){
@@ -19,15 +19,27 @@ private:
   cl_device_id device_id = nullptr;
   cl_context ctx = nullptr;
 
+  // frame id each buffer was delivered with, to detect the server reusing it
+  uint32_t buf_frame_ids[VISIONIPC_MAX_FDS] = {};
+  bool buf_torn[VISIONIPC_MAX_FDS] = {};
+  uint32_t last_frame_id = 0;
+  uint64_t last_timestamp_sent = 0;
+
   void init_msgq(bool conflate);
 
 public:
   bool connected = false;
   int num_buffers = 0;
   VisionBuf buffers[VISIONIPC_MAX_FDS];
+  VisionIpcClientStats stats = {};
   VisionIpcClient(std::string name, VisionStreamType type, bool conflate, cl_device_id device_id=nullptr, cl_context ctx=nullptr);
   ~VisionIpcClient();
   VisionBuf * recv(VisionIpcBufExtra * extra=nullptr, const int timeout_ms=100);
   bool connect(bool blocking=true);
   bool is_connected() { return connected; }
+  // Call when done reading a buffer returned by recv. Returns false if the server
+  // reused the buffer in the meantime, in which case its contents can't be trusted
+  bool release(VisionBuf * buf);
+  size_t buffer_count_hint();
+  void reset_stats();
 };
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <chrono>
 #include <cassert>
@@ -11,6 +12,7 @@
 #include "visionipc/ipc.h"
 #include "visionipc/visionipc_server.h"
 #include "logger/logger.h"
+#include "selfdrive/common/timing.h"
 
 std::string get_endpoint_name(std::string name, VisionStreamType type){
   if (messaging_use_zmq()){
@@ -141,7 +143,10 @@ VisionBuf * VisionIpcServer::get_buffer(VisionStreamType type){
   // Do we want to keep track if the buffer has been sent out yet and warn user?
   assert(buffers.count(type));
   auto b = buffers[type];
-  return b[cur_idx[type]++ % b.size()];
+  VisionBuf *buf = b[cur_idx[type]++ % b.size()];
+  // invalidate the frame id while the buffer is being written, so clients still reading it notice
+  buf->set_frame_id(UINT64_MAX);
+  return buf;
 }
 
 void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync){
@@ -152,16 +157,39 @@ void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync
   }
   assert(buffers.count(buf->type));
   assert(buf->idx < buffers[buf->type].size());
+  buf->set_frame_id(extra->frame_id);
+
+  // track send rate for buffer count hints
+  uint64_t now = nanos_since_boot();
+  uint64_t &last_send = last_send_ns[buf->type];
+  if (last_send != 0 && now > last_send) {
+    uint64_t &interval = frame_interval_ns[buf->type];
+    interval = interval == 0 ? now - last_send : (interval * 7 + (now - last_send)) / 8;
+  }
+  last_send = now;
 
   // Send over correct msgq socket
   VisionIpcPacket packet = {0};
   packet.server_id = server_id;
   packet.idx = buf->idx;
   packet.extra = *extra;
+  packet.timestamp_sent = now;
 
   sockets[buf->type]->send((char*)&packet, sizeof(packet));
 }
 
+size_t VisionIpcServer::buffer_count_hint(VisionStreamType type, uint64_t lag_ns) {
+  return visionipc_buffer_count_hint(frame_interval_ns[type], lag_ns);
+}
+
+size_t visionipc_buffer_count_hint(uint64_t frame_interval_ns, uint64_t lag_ns) {
+  if (frame_interval_ns == 0) return 0;
+
+  // one buffer being written, the ones a lagging consumer can still be reading, and one of margin
+  size_t count = (lag_ns + frame_interval_ns - 1) / frame_interval_ns + 2;
+  return std::min(count, (size_t)VISIONIPC_MAX_FDS - 1);
+}
+
 VisionIpcServer::~VisionIpcServer(){
   should_exit = true;
   listener_thread.join();
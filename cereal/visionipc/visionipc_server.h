@@ -24,6 +24,8 @@ class VisionIpcServer {
   std::map<VisionStreamType, std::atomic<size_t> > cur_idx;
   std::map<VisionStreamType, std::vector<VisionBuf*> > buffers;
   std::map<VisionStreamType, std::map<VisionBuf*, size_t> > idxs;
+  std::map<VisionStreamType, uint64_t> last_send_ns;
+  std::map<VisionStreamType, uint64_t> frame_interval_ns;
 
   Context * msg_ctx;
   std::map<VisionStreamType, PubSocket*> sockets;
@@ -39,4 +41,6 @@ class VisionIpcServer {
   void create_buffers(VisionStreamType type, size_t num_buffers, bool rgb, size_t width, size_t height);
   void send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync=true);
   void start_listener();
+  // buffers needed by this stream for consumers lagging lag_ns behind, at the measured send rate
+  size_t buffer_count_hint(VisionStreamType type, uint64_t lag_ns);
 };
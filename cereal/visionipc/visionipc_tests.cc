@@ -4,6 +4,7 @@
 #include "catch2/catch.hpp"
 #include "visionipc_server.h"
 #include "visionipc_client.h"
+#include "visionipc_bridge.h"
 
 static void zmq_sleep(int milliseconds=1000){
   if (messaging_use_zmq()){
@@ -135,3 +136,136 @@ TEST_CASE("Test conflate"){
   recv_buf = client.recv(&extra_recv);
   REQUIRE(recv_buf == nullptr);
 }
+
+TEST_CASE("Client stats"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 2, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  // the third frame reuses the buffer of the first one before the client read it
+  for (uint32_t frame_id : {1, 2, 5}) {
+    VisionIpcBufExtra extra = {0};
+    extra.frame_id = frame_id;
+    server.send(server.get_buffer(VISION_STREAM_ROAD), &extra);
+  }
+
+  VisionIpcBufExtra extra_recv = {0};
+  VisionBuf * recv_buf = client.recv(&extra_recv);
+  REQUIRE(recv_buf != nullptr);
+  REQUIRE(extra_recv.frame_id == 1);
+  REQUIRE(client.release(recv_buf) == false);
+
+  for (uint32_t frame_id : {2, 5}) {
+    recv_buf = client.recv(&extra_recv);
+    REQUIRE(recv_buf != nullptr);
+    REQUIRE(extra_recv.frame_id == frame_id);
+    REQUIRE(client.release(recv_buf));
+  }
+
+  REQUIRE(client.stats.delivered == 3);
+  REQUIRE(client.stats.skipped == 2);
+  REQUIRE(client.stats.torn == 1);
+  REQUIRE(client.stats.age_max_ns > 0);
+
+  client.reset_stats();
+  REQUIRE(client.stats.delivered == 0);
+  REQUIRE(client.stats.torn == 0);
+}
+
+TEST_CASE("Buffer count hint"){
+  const uint64_t frame_interval = 50000000ULL;
+  REQUIRE(visionipc_buffer_count_hint(0, frame_interval) == 0);
+  REQUIRE(visionipc_buffer_count_hint(frame_interval, 0) == 2);
+  REQUIRE(visionipc_buffer_count_hint(frame_interval, 120000000ULL) == 5);
+  REQUIRE(visionipc_buffer_count_hint(frame_interval, 1000 * frame_interval) == VISIONIPC_MAX_FDS - 1);
+}
+
+TEST_CASE("Bridge over loopback"){
+  const int port = VISIONIPC_BRIDGE_PORT + 1;
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 2, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcBridgeSender sender("camerad", port);
+  sender.start();
+  VisionIpcBridgeReceiver receiver("bridge", "127.0.0.1", {VISION_STREAM_ROAD}, port);
+  receiver.start();
+
+  VisionIpcClient client = VisionIpcClient("bridge", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  REQUIRE(client.buffers[0].width == 100);
+  REQUIRE(client.buffers[0].height == 100);
+  zmq_sleep();
+
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_ROAD);
+  for (int i = 0; i < buf->len; i++) {
+    ((uint8_t*)buf->addr)[i] = i % 251;
+  }
+  VisionIpcBufExtra extra = {0};
+  extra.frame_id = 42;
+  extra.timestamp_eof = 1234;
+
+  // the sender connects to camerad in the background, keep sending until a frame makes it through
+  VisionBuf * recv_buf = nullptr;
+  VisionIpcBufExtra extra_recv = {0};
+  for (int i = 0; i < 50 && recv_buf == nullptr; i++) {
+    server.send(buf, &extra);
+    recv_buf = client.recv(&extra_recv);
+  }
+
+  REQUIRE(recv_buf != nullptr);
+  REQUIRE(extra_recv.frame_id == 42);
+  REQUIRE(extra_recv.timestamp_eof == 1234);
+  REQUIRE(memcmp(recv_buf->addr, buf->addr, buf->len) == 0);
+  REQUIRE(receiver.stats[VISION_STREAM_ROAD].frames > 0);
+  REQUIRE(receiver.stats[VISION_STREAM_ROAD].bytes >= buf->len);
+}
+
+TEST_CASE("Bridge rgb with zerocopy"){
+  const int port = VISIONIPC_BRIDGE_PORT + 2;
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_RGB_BACK, 4, true, 100, 50);
+  server.start_listener();
+
+  VisionIpcBridgeSender sender("camerad", port, true);
+  sender.start();
+  VisionIpcBridgeReceiver receiver("bridge", "127.0.0.1", {VISION_STREAM_RGB_BACK}, port);
+  receiver.start();
+
+  VisionIpcClient client = VisionIpcClient("bridge", VISION_STREAM_RGB_BACK, false);
+  REQUIRE(client.connect());
+  REQUIRE(client.buffers[0].rgb);
+  REQUIRE(client.buffers[0].width == 100);
+  REQUIRE(client.buffers[0].height == 50);
+  zmq_sleep();
+
+  // frames keep coming, every one released only once the kernel is done sending it
+  VisionBuf * recv_buf = nullptr;
+  VisionIpcBufExtra extra_recv = {0};
+  int received = 0;
+  for (int i = 0; i < 100 && received < 10; i++) {
+    VisionBuf * buf = server.get_buffer(VISION_STREAM_RGB_BACK);
+    for (int j = 0; j < buf->len; j++) {
+      ((uint8_t*)buf->addr)[j] = (i + j) % 251;
+    }
+    VisionIpcBufExtra extra = {0};
+    extra.frame_id = i;
+    server.send(buf, &extra);
+
+    recv_buf = client.recv(&extra_recv);
+    if (recv_buf != nullptr) {
+      REQUIRE(recv_buf->stride == client.buffers[0].width * 3);
+      for (int row = 0; row < recv_buf->height; row++) {
+        for (int col = 0; col < recv_buf->width * 3; col++) {
+          REQUIRE(((uint8_t*)recv_buf->addr)[row * recv_buf->stride + col] == (extra_recv.frame_id + row * buf->stride + col) % 251);
+        }
+      }
+      received++;
+    }
+  }
+  REQUIRE(received > 0);
+}
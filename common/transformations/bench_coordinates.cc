@@ -0,0 +1,89 @@
+// Times the batch coordinate transforms against the single point ones on 1M points. Whether
+// they agree is checked by tests/test_coordinates.cc
+//
+// Usage: ./bench_coordinates
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "common/transformations/coordinates.hpp"
+
+const size_t N = 1000000;
+
+struct Points {
+  std::vector<double> c[3];
+  Points(size_t n) {
+    for (auto &v : c) v.resize(n);
+  }
+  double *operator[](int i) { return c[i].data(); }
+};
+
+template <class F>
+static double time_us(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  // from below sea level to low orbit, the poles included
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180), alt(-500, 500000);
+  Points geodetic(N);
+  for (size_t i = 0; i < N; i++) {
+    geodetic[0][i] = i % 1000 == 0 ? (i % 2000 == 0 ? 90 : -90) : lat(gen);
+    geodetic[1][i] = lon(gen);
+    geodetic[2][i] = alt(gen);
+  }
+  LocalCoord local(Geodetic{32.7, -117.2, 10});
+
+  // single points
+  Points ecef(N), back(N), ned(N), ned_ecef(N);
+  double t_single = time_us([&]() {
+    for (size_t i = 0; i < N; i++) {
+      ECEF e = geodetic2ecef({geodetic[0][i], geodetic[1][i], geodetic[2][i]});
+      ecef[0][i] = e.x, ecef[1][i] = e.y, ecef[2][i] = e.z;
+    }
+  });
+  t_single += time_us([&]() {
+    for (size_t i = 0; i < N; i++) {
+      Geodetic g = ecef2geodetic({ecef[0][i], ecef[1][i], ecef[2][i]});
+      back[0][i] = g.lat, back[1][i] = g.lon, back[2][i] = g.alt;
+    }
+  });
+  double t_single_ned = time_us([&]() {
+    for (size_t i = 0; i < N; i++) {
+      NED n = local.ecef2ned({ecef[0][i], ecef[1][i], ecef[2][i]});
+      ned[0][i] = n.n, ned[1][i] = n.e, ned[2][i] = n.d;
+    }
+  });
+  t_single_ned += time_us([&]() {
+    for (size_t i = 0; i < N; i++) {
+      ECEF e = local.ned2ecef({ned[0][i], ned[1][i], ned[2][i]});
+      ned_ecef[0][i] = e.x, ned_ecef[1][i] = e.y, ned_ecef[2][i] = e.z;
+    }
+  });
+
+  // batches
+  Points ecef_b(N), back_b(N), ned_b(N), ned_ecef_b(N);
+  double t_batch = time_us([&]() {
+    geodetic2ecef_batch(geodetic[0], geodetic[1], geodetic[2], ecef_b[0], ecef_b[1], ecef_b[2], N);
+  });
+  t_batch += time_us([&]() {
+    ecef2geodetic_batch(ecef_b[0], ecef_b[1], ecef_b[2], back_b[0], back_b[1], back_b[2], N);
+  });
+  double t_batch_ned = time_us([&]() {
+    local.ecef2ned_batch(ecef_b[0], ecef_b[1], ecef_b[2], ned_b[0], ned_b[1], ned_b[2], N);
+  });
+  t_batch_ned += time_us([&]() {
+    local.ned2ecef_batch(ned_b[0], ned_b[1], ned_b[2], ned_ecef_b[0], ned_ecef_b[1], ned_ecef_b[2], N);
+  });
+
+  printf("geodetic -> ecef -> geodetic, 1M points: single %.1f ms, batch %.1f ms\n", t_single / 1e3, t_batch / 1e3);
+  printf("ecef -> ned -> ecef, 1M points: single %.1f ms, batch %.1f ms\n", t_single_ned / 1e3, t_batch_ned / 1e3);
+  return 0;
+}
@@ -0,0 +1,78 @@
+// Times the batch orientation functions against the single value ones on 1M values. Whether
+// they agree is checked by tests/test_orientation.cc
+//
+// Usage: ./bench_orientation
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "common/transformations/orientation.hpp"
+
+const size_t N = 1000000;
+
+template <class F>
+static double time_ms(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> angle(-M_PI, M_PI), half_angle(-M_PI / 2, M_PI / 2);
+  std::vector<double> euler(3 * N);
+  for (size_t i = 0; i < N; i++) {
+    euler[i] = angle(gen);
+    // some in gimbal lock
+    euler[N + i] = i % 100 == 0 ? M_PI / 2 : half_angle(gen);
+    euler[2 * N + i] = angle(gen);
+  }
+  const ECEF ecef_init = geodetic2ecef({32.7, -117.2, 10});
+
+  std::vector<double> quat(4 * N), rot(9 * N), quat_euler(3 * N), rot_euler(3 * N), ned(3 * N);
+  double t_single = time_ms([&]() {
+    for (size_t i = 0; i < N; i++) {
+      Eigen::Quaterniond q = euler2quat({euler[i], euler[N + i], euler[2 * N + i]});
+      quat[i] = q.w(), quat[N + i] = q.x(), quat[2 * N + i] = q.y(), quat[3 * N + i] = q.z();
+    }
+    for (size_t i = 0; i < N; i++) {
+      Eigen::Quaterniond q(quat[i], quat[N + i], quat[2 * N + i], quat[3 * N + i]);
+      Eigen::Vector3d e = quat2euler(q);
+      for (int k = 0; k < 3; k++) quat_euler[k * N + i] = e(k);
+      Eigen::Matrix3d r = quat2rot(q);
+      for (int k = 0; k < 9; k++) rot[k * N + i] = r(k / 3, k % 3);
+    }
+    for (size_t i = 0; i < N; i++) {
+      Eigen::Matrix3d r;
+      for (int k = 0; k < 9; k++) r(k / 3, k % 3) = rot[k * N + i];
+      Eigen::Vector3d e = rot2euler(r);
+      for (int k = 0; k < 3; k++) rot_euler[k * N + i] = e(k);
+    }
+  });
+  double t_single_ned = time_ms([&]() {
+    for (size_t i = 0; i < N; i++) {
+      Eigen::Vector3d e = ned_euler_from_ecef(ecef_init, {euler[i], euler[N + i], euler[2 * N + i]});
+      for (int k = 0; k < 3; k++) ned[k * N + i] = e(k);
+    }
+  });
+
+  std::vector<double> quat_b(4 * N), rot_b(9 * N), quat_euler_b(3 * N), rot_euler_b(3 * N), ned_b(3 * N);
+  double t_batch = time_ms([&]() {
+    euler2quat_batch(euler.data(), quat_b.data(), N);
+    quat2euler_batch(quat_b.data(), quat_euler_b.data(), N);
+    quat2rot_batch(quat_b.data(), rot_b.data(), N);
+    rot2euler_batch(rot_b.data(), rot_euler_b.data(), N);
+  });
+  double t_batch_ned = time_ms([&]() {
+    ned_euler_from_ecef_batch(ecef_init, euler.data(), ned_b.data(), N);
+  });
+
+  printf("euler -> quat -> euler, rot -> euler, %zu values: single %.1f ms, batch %.1f ms\n", N, t_single, t_batch);
+  printf("ned_euler_from_ecef, %zu values: single %.1f ms, batch %.1f ms\n", N, t_single_ned, t_batch_ned);
+  return 0;
+}
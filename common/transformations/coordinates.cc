@@ -1,5 +1,6 @@
 #define _USE_MATH_DEFINES
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 #include <eigen3/Eigen/Dense>
@@ -8,10 +9,10 @@
 
 
 
-double a = 6378137; // lgtm [cpp/short-global-name]
-double b = 6356752.3142; // lgtm [cpp/short-global-name]
-double esq = 6.69437999014 * 0.001; // lgtm [cpp/short-global-name]
-double e1sq = 6.73949674228 * 0.001;
+const double a = 6378137; // lgtm [cpp/short-global-name]
+const double b = 6356752.3142; // lgtm [cpp/short-global-name]
+const double esq = 6.69437999014 * 0.001; // lgtm [cpp/short-global-name]
+const double e1sq = 6.73949674228 * 0.001;
 
 
 static Geodetic to_degrees(Geodetic geodetic){
@@ -26,41 +27,67 @@ static Geodetic to_radians(Geodetic geodetic){
   return geodetic;
 }
 
-
-ECEF geodetic2ecef(Geodetic g){
-  g = to_radians(g);
-  double xi = sqrt(1.0 - esq * pow(sin(g.lat), 2));
-  double x = (a / xi + g.alt) * cos(g.lat) * cos(g.lon);
-  double y = (a / xi + g.alt) * cos(g.lat) * sin(g.lon);
-  double z = (a / xi * (1.0 - esq) + g.alt) * sin(g.lat);
-  return {x, y, z};
+// The single point and batch transforms share these, in radians
+static inline void geodetic2ecef_rad(double lat, double lon, double alt, double &x, double &y, double &z){
+  double sin_lat = sin(lat);
+  double cos_lat = cos(lat);
+  double xi = sqrt(1.0 - esq * sin_lat * sin_lat);
+  x = (a / xi + alt) * cos_lat * cos(lon);
+  y = (a / xi + alt) * cos_lat * sin(lon);
+  z = (a / xi * (1.0 - esq) + alt) * sin_lat;
 }
 
-Geodetic ecef2geodetic(ECEF e){
+static inline void ecef2geodetic_rad(double x, double y, double z, double &lat, double &lon, double &alt){
   // Convert from ECEF to geodetic using Ferrari's methods
   // https://en.wikipedia.org/wiki/Geographic_coordinate_conversion#Ferrari.27s_solution
-  double x = e.x;
-  double y = e.y;
-  double z = e.z;
-
+  // Closed form, no iterations
   double r = sqrt(x * x + y * y);
   double Esq = a * a - b * b;
   double F = 54 * b * b * z * z;
   double G = r * r + (1 - esq) * z * z - esq * Esq;
-  double C = (esq * esq * F * r * r) / (pow(G, 3));
+  double C = (esq * esq * F * r * r) / (G * G * G);
   double S = cbrt(1 + C + sqrt(C * C + 2 * C));
-  double P = F / (3 * pow((S + 1 / S + 1), 2) * G * G);
+  double S_1 = S + 1 / S + 1;
+  double P = F / (3 * S_1 * S_1 * G * G);
   double Q = sqrt(1 + 2 * esq * esq * P);
   double r_0 = -(P * esq * r) / (1 + Q) + sqrt(0.5 * a * a*(1 + 1.0 / Q) - P * (1 - esq) * z * z / (Q * (1 + Q)) - 0.5 * P * r * r);
-  double U = sqrt(pow((r - esq * r_0), 2) + z * z);
-  double V = sqrt(pow((r - esq * r_0), 2) + (1 - esq) * z * z);
+  double r_1 = r - esq * r_0;
+  double U = sqrt(r_1 * r_1 + z * z);
+  double V = sqrt(r_1 * r_1 + (1 - esq) * z * z);
   double Z_0 = b * b * z / (a * V);
-  double h = U * (1 - b * b / (a * V));
 
-  double lat = atan((z + e1sq * Z_0) / r);
-  double lon = atan2(y, x);
+  alt = U * (1 - b * b / (a * V));
+  lat = atan((z + e1sq * Z_0) / r);
+  lon = atan2(y, x);
+}
+
+
+ECEF geodetic2ecef(Geodetic g){
+  g = to_radians(g);
+  ECEF e;
+  geodetic2ecef_rad(g.lat, g.lon, g.alt, e.x, e.y, e.z);
+  return e;
+}
+
+Geodetic ecef2geodetic(ECEF e){
+  Geodetic g;
+  ecef2geodetic_rad(e.x, e.y, e.z, g.lat, g.lon, g.alt);
+  return to_degrees(g);
+}
+
+void geodetic2ecef_batch(const double *lat, const double *lon, const double *alt, double *x, double *y, double *z, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    geodetic2ecef_rad(DEG2RAD(lat[i]), DEG2RAD(lon[i]), alt[i], x[i], y[i], z[i]);
+  }
+}
 
-  return to_degrees({lat, lon, h});
+void ecef2geodetic_batch(const double *x, const double *y, const double *z, double *lat, double *lon, double *alt, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    double lat_rad, lon_rad;
+    ecef2geodetic_rad(x[i], y[i], z[i], lat_rad, lon_rad, alt[i]);
+    lat[i] = RAD2DEG(lat_rad);
+    lon[i] = RAD2DEG(lon_rad);
+  }
 }
 
 LocalCoord::LocalCoord(Geodetic g, ECEF e){
@@ -100,3 +127,45 @@ Geodetic LocalCoord::ned2geodetic(NED n){
   ECEF e = ned2ecef(n);
   return ::ecef2geodetic(e);
 }
+
+// The rotations copy a block of points at a time, so the outputs may be the inputs
+const size_t BATCH_BLOCK = 256;
+typedef Eigen::Array<double, Eigen::Dynamic, 1, 0, BATCH_BLOCK, 1> BlockArray;
+typedef Eigen::Map<const Eigen::ArrayXd> ConstArrayMap;
+typedef Eigen::Map<Eigen::ArrayXd> ArrayMap;
+
+void LocalCoord::ecef2ned_batch(const double *x, const double *y, const double *z, double *n, double *e, double *d, size_t len) {
+  const Eigen::Matrix3d &m = ecef2ned_matrix;
+  for (size_t i = 0; i < len; i += BATCH_BLOCK) {
+    size_t k = std::min(BATCH_BLOCK, len - i);
+    BlockArray dx = ConstArrayMap(x + i, k) - init_ecef[0];
+    BlockArray dy = ConstArrayMap(y + i, k) - init_ecef[1];
+    BlockArray dz = ConstArrayMap(z + i, k) - init_ecef[2];
+    ArrayMap(n + i, k) = m(0, 0) * dx + m(0, 1) * dy + m(0, 2) * dz;
+    ArrayMap(e + i, k) = m(1, 0) * dx + m(1, 1) * dy + m(1, 2) * dz;
+    ArrayMap(d + i, k) = m(2, 0) * dx + m(2, 1) * dy + m(2, 2) * dz;
+  }
+}
+
+void LocalCoord::ned2ecef_batch(const double *n, const double *e, const double *d, double *x, double *y, double *z, size_t len) {
+  const Eigen::Matrix3d &m = ned2ecef_matrix;
+  for (size_t i = 0; i < len; i += BATCH_BLOCK) {
+    size_t k = std::min(BATCH_BLOCK, len - i);
+    BlockArray bn = ConstArrayMap(n + i, k);
+    BlockArray be = ConstArrayMap(e + i, k);
+    BlockArray bd = ConstArrayMap(d + i, k);
+    ArrayMap(x + i, k) = m(0, 0) * bn + m(0, 1) * be + m(0, 2) * bd + init_ecef[0];
+    ArrayMap(y + i, k) = m(1, 0) * bn + m(1, 1) * be + m(1, 2) * bd + init_ecef[1];
+    ArrayMap(z + i, k) = m(2, 0) * bn + m(2, 1) * be + m(2, 2) * bd + init_ecef[2];
+  }
+}
+
+void LocalCoord::geodetic2ned_batch(const double *lat, const double *lon, const double *alt, double *n, double *e, double *d, size_t len) {
+  ::geodetic2ecef_batch(lat, lon, alt, n, e, d, len);
+  ecef2ned_batch(n, e, d, n, e, d, len);
+}
+
+void LocalCoord::ned2geodetic_batch(const double *n, const double *e, const double *d, double *lat, double *lon, double *alt, size_t len) {
+  ned2ecef_batch(n, e, d, lat, lon, alt, len);
+  ::ecef2geodetic_batch(lat, lon, alt, lat, lon, alt, len);
+}
@@ -25,6 +25,11 @@ struct Geodetic {
 ECEF geodetic2ecef(Geodetic g);
 Geodetic ecef2geodetic(ECEF e);
 
+// The batch versions take n points as separate arrays of each coordinate, geodetic in degrees.
+// An output array may be the input array of the same coordinate
+void geodetic2ecef_batch(const double *lat, const double *lon, const double *alt, double *x, double *y, double *z, size_t n);
+void ecef2geodetic_batch(const double *x, const double *y, const double *z, double *lat, double *lon, double *alt, size_t n);
+
 class LocalCoord {
 public:
   Eigen::Matrix3d ned2ecef_matrix;
@@ -38,4 +43,9 @@ public:
   ECEF ned2ecef(NED n);
   NED geodetic2ned(Geodetic g);
   Geodetic ned2geodetic(NED n);
+
+  void ecef2ned_batch(const double *x, const double *y, const double *z, double *n, double *e, double *d, size_t len);
+  void ned2ecef_batch(const double *n, const double *e, const double *d, double *x, double *y, double *z, size_t len);
+  void geodetic2ned_batch(const double *lat, const double *lon, const double *alt, double *n, double *e, double *d, size_t len);
+  void ned2geodetic_batch(const double *n, const double *e, const double *d, double *lat, double *lon, double *alt, size_t len);
 };
@@ -1,5 +1,6 @@
 #define _USE_MATH_DEFINES
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 #include <eigen3/Eigen/Dense>
@@ -25,15 +26,21 @@ Eigen::Quaterniond euler2quat(Eigen::Vector3d euler){
 }
 
 
+// shared with quat2euler_batch
+static inline void quat2euler(double w, double x, double y, double z, double &gamma, double &theta, double &psi){
+  gamma = atan2(2 * (w * x + y * z), 1 - 2 * (x*x + y*y));
+  double asin_arg_clipped = std::clamp(2 * (w * y - z * x), -1.0, 1.0);
+  theta = asin(asin_arg_clipped);
+  psi = atan2(2 * (w * z + x * y), 1 - 2 * (y*y + z*z));
+}
+
 Eigen::Vector3d quat2euler(Eigen::Quaterniond quat){
   // TODO: switch to eigen implementation if the range of the Euler angles doesn't matter anymore
   // Eigen::Vector3d euler = quat.toRotationMatrix().eulerAngles(2, 1, 0);
   // return {euler(2), euler(1), euler(0)};
-  double gamma = atan2(2 * (quat.w() * quat.x() + quat.y() * quat.z()), 1 - 2 * (quat.x()*quat.x() + quat.y()*quat.y()));
-  double asin_arg_clipped = std::clamp(2 * (quat.w() * quat.y() - quat.z() * quat.x()), -1.0, 1.0);
-  double theta = asin(asin_arg_clipped);
-  double psi = atan2(2 * (quat.w() * quat.z() + quat.x() * quat.y()), 1 - 2 * (quat.y()*quat.y() + quat.z()*quat.z()));
-  return {gamma, theta, psi};
+  Eigen::Vector3d euler;
+  quat2euler(quat.w(), quat.x(), quat.y(), quat.z(), euler(0), euler(1), euler(2));
+  return euler;
 }
 
 Eigen::Matrix3d quat2rot(Eigen::Quaterniond quat){
@@ -142,3 +149,79 @@ Eigen::Vector3d ned_euler_from_ecef(ECEF ecef_init, Eigen::Vector3d ecef_pose){
   return {phi, theta, psi};
 }
 
+
+
+void euler2quat_batch(const double *euler, double *quat, size_t n){
+  // the product of the three half angle rotations, as euler2quat does with AngleAxisd
+  for (size_t i = 0; i < n; i++) {
+    double cr = cos(euler[i] / 2), sr = sin(euler[i] / 2);
+    double cp = cos(euler[n + i] / 2), sp = sin(euler[n + i] / 2);
+    double cy = cos(euler[2 * n + i] / 2), sy = sin(euler[2 * n + i] / 2);
+    double w = cy * cp * cr + sy * sp * sr;
+    double sign = w > 0 ? 1 : -1;
+    quat[i] = sign * w;
+    quat[n + i] = sign * (cy * cp * sr - sy * sp * cr);
+    quat[2 * n + i] = sign * (cy * sp * cr + sy * cp * sr);
+    quat[3 * n + i] = sign * (sy * cp * cr - cy * sp * sr);
+  }
+}
+
+void quat2euler_batch(const double *quat, double *euler, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    quat2euler(quat[i], quat[n + i], quat[2 * n + i], quat[3 * n + i], euler[i], euler[n + i], euler[2 * n + i]);
+  }
+}
+
+void quat2rot_batch(const double *quat, double *rot, size_t n){
+  // Eigen's toRotationMatrix, on arrays so it vectorizes
+  typedef Eigen::Map<const Eigen::ArrayXd> In;
+  typedef Eigen::Map<Eigen::ArrayXd> Out;
+  In w(quat, n), x(quat + n, n), y(quat + 2 * n, n), z(quat + 3 * n, n);
+  Out(rot, n) = 1 - 2 * (y * y + z * z);
+  Out(rot + n, n) = 2 * (x * y - z * w);
+  Out(rot + 2 * n, n) = 2 * (x * z + y * w);
+  Out(rot + 3 * n, n) = 2 * (x * y + z * w);
+  Out(rot + 4 * n, n) = 1 - 2 * (x * x + z * z);
+  Out(rot + 5 * n, n) = 2 * (y * z - x * w);
+  Out(rot + 6 * n, n) = 2 * (x * z - y * w);
+  Out(rot + 7 * n, n) = 2 * (y * z + x * w);
+  Out(rot + 8 * n, n) = 1 - 2 * (x * x + y * y);
+}
+
+void rot2euler_batch(const double *rot, double *euler, size_t n){
+  // through the quaternion like rot2euler, so both agree in gimbal lock
+  for (size_t i = 0; i < n; i++) {
+    Eigen::Matrix3d r;
+    r << rot[i], rot[n + i], rot[2 * n + i],
+         rot[3 * n + i], rot[4 * n + i], rot[5 * n + i],
+         rot[6 * n + i], rot[7 * n + i], rot[8 * n + i];
+    Eigen::Quaterniond q = rot2quat(r);
+    quat2euler(q.w(), q.x(), q.y(), q.z(), euler[i], euler[n + i], euler[2 * n + i]);
+  }
+}
+
+void ned_euler_from_ecef_batch(ECEF ecef_init, const double *ecef_pose, double *ned_pose, size_t n){
+  // The construction of ned_euler_from_ecef in closed form: the body x and y axes are the first
+  // two columns of the pose rotation, taken into ned. Yaw and pitch are those of the x axis, roll
+  // is the angle of the y axis from the ned y axis turned by yaw, about the x axis
+  LocalCoord converter = LocalCoord(ecef_init);
+  const Eigen::Matrix3d &m = converter.ecef2ned_matrix;
+
+  for (size_t i = 0; i < n; i++) {
+    double cr = cos(ecef_pose[i]), sr = sin(ecef_pose[i]);
+    double cp = cos(ecef_pose[n + i]), sp = sin(ecef_pose[n + i]);
+    double cy = cos(ecef_pose[2 * n + i]), sy = sin(ecef_pose[2 * n + i]);
+    Eigen::Vector3d x3(cy * cp, sy * cp, -sp);
+    Eigen::Vector3d y3(cy * sp * sr - sy * cr, sy * sp * sr + cy * cr, cp * sr);
+    x3 = m * x3;
+    y3 = m * y3;
+
+    double psi = atan2(x3(1), x3(0));
+    double theta = atan2(-x3(2), sqrt(x3(0) * x3(0) + x3(1) * x3(1)));
+    double y2_y3 = -sin(psi) * y3(0) + cos(psi) * y3(1);
+    double z2_y3 = cos(psi) * sin(theta) * y3(0) + sin(psi) * sin(theta) * y3(1) + cos(theta) * y3(2);
+    ned_pose[i] = atan2(z2_y3, y2_y3);
+    ned_pose[n + i] = theta;
+    ned_pose[2 * n + i] = psi;
+  }
+}
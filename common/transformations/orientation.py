@@ -2,12 +2,12 @@
 import numpy as np
 
 from common.transformations.transformations import (ecef_euler_from_ned_single,
-                                                    euler2quat_single,
+                                                    euler2quat_array,
                                                     euler2rot_single,
-                                                    ned_euler_from_ecef_single,
-                                                    quat2euler_single,
-                                                    quat2rot_single,
-                                                    rot2euler_single,
+                                                    ned_euler_from_ecef_array,
+                                                    quat2euler_array,
+                                                    quat2rot_array,
+                                                    rot2euler_array,
                                                     rot2quat_single)
 
 
@@ -33,14 +33,28 @@ def numpy_wrap(function, input_shape, output_shape):
   return f
 
 
-euler2quat = numpy_wrap(euler2quat_single, (3,), (4,))
-quat2euler = numpy_wrap(quat2euler_single, (4,), (3,))
-quat2rot = numpy_wrap(quat2rot_single, (4,), (3, 3))
+def batch_wrap(function, input_shape, output_shape):
+  """Wrap a function on arrays of one row per component to take either an input or list of inputs
+  and return the correct shape, in a single call"""
+  def f(*inps):
+    *args, inp = inps
+    inp = np.asarray(inp, dtype=np.float64)
+    shape = inp.shape[:inp.ndim - len(input_shape)]
+
+    inp = np.ascontiguousarray(inp.reshape(-1, int(np.prod(input_shape))).T)
+    result = np.ascontiguousarray(function(*args, inp).T)
+    return result.reshape(shape + output_shape)
+  return f
+
+
+euler2quat = batch_wrap(euler2quat_array, (3,), (4,))
+quat2euler = batch_wrap(quat2euler_array, (4,), (3,))
+quat2rot = batch_wrap(quat2rot_array, (4,), (3, 3))
 rot2quat = numpy_wrap(rot2quat_single, (3, 3), (4,))
 euler2rot = numpy_wrap(euler2rot_single, (3,), (3, 3))
-rot2euler = numpy_wrap(rot2euler_single, (3, 3), (3,))
+rot2euler = batch_wrap(rot2euler_array, (3, 3), (3,))
 ecef_euler_from_ned = numpy_wrap(ecef_euler_from_ned_single, (3,), (3,))
-ned_euler_from_ecef = numpy_wrap(ned_euler_from_ecef_single, (3,), (3,))
+ned_euler_from_ecef = batch_wrap(ned_euler_from_ecef_array, (3,), (3,))
 
 quats_from_rotations = rot2quat
 quat_from_rot = rot2quat
@@ -0,0 +1,115 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "catch2/catch.hpp"
+#include "common/transformations/coordinates.hpp"
+
+// the timings on 1M points are in bench_coordinates
+const size_t N = 100000;
+
+struct Points {
+  std::vector<double> c[3];
+  Points(size_t n) {
+    for (auto &v : c) v.resize(n);
+  }
+  double *operator[](int i) { return c[i].data(); }
+};
+
+static double max_diff(Points &p, Points &q) {
+  double diff = 0;
+  for (int i = 0; i < 3; i++) {
+    for (size_t j = 0; j < p.c[i].size(); j++) {
+      diff = std::max(diff, std::abs(p.c[i][j] - q.c[i][j]));
+    }
+  }
+  return diff;
+}
+
+// the points and their transforms, single point and batch, made once for all the sections
+struct Transformed {
+  LocalCoord local = LocalCoord(Geodetic{32.7, -117.2, 10});
+  Points geodetic = Points(N);
+  Points ecef = Points(N), back = Points(N), ned = Points(N), ned_ecef = Points(N);
+  Points ecef_b = Points(N), back_b = Points(N), ned_b = Points(N), ned_ecef_b = Points(N);
+
+  Transformed() {
+    // from below sea level to low orbit, the poles included
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<double> lat(-90, 90), lon(-180, 180), alt(-500, 500000);
+    for (size_t i = 0; i < N; i++) {
+      geodetic[0][i] = i % 1000 == 0 ? (i % 2000 == 0 ? 90 : -90) : lat(gen);
+      geodetic[1][i] = lon(gen);
+      geodetic[2][i] = alt(gen);
+    }
+
+    // single points
+    for (size_t i = 0; i < N; i++) {
+      ECEF e = geodetic2ecef({geodetic[0][i], geodetic[1][i], geodetic[2][i]});
+      ecef[0][i] = e.x, ecef[1][i] = e.y, ecef[2][i] = e.z;
+      Geodetic g = ecef2geodetic(e);
+      back[0][i] = g.lat, back[1][i] = g.lon, back[2][i] = g.alt;
+      NED n = local.ecef2ned(e);
+      ned[0][i] = n.n, ned[1][i] = n.e, ned[2][i] = n.d;
+      ECEF e2 = local.ned2ecef(n);
+      ned_ecef[0][i] = e2.x, ned_ecef[1][i] = e2.y, ned_ecef[2][i] = e2.z;
+    }
+
+    // batches
+    geodetic2ecef_batch(geodetic[0], geodetic[1], geodetic[2], ecef_b[0], ecef_b[1], ecef_b[2], N);
+    ecef2geodetic_batch(ecef_b[0], ecef_b[1], ecef_b[2], back_b[0], back_b[1], back_b[2], N);
+    local.ecef2ned_batch(ecef_b[0], ecef_b[1], ecef_b[2], ned_b[0], ned_b[1], ned_b[2], N);
+    local.ned2ecef_batch(ned_b[0], ned_b[1], ned_b[2], ned_ecef_b[0], ned_ecef_b[1], ned_ecef_b[2], N);
+  }
+};
+
+TEST_CASE("batch coordinate transforms match the single point ones") {
+  static Transformed t;
+  LocalCoord &local = t.local;
+  Points &geodetic = t.geodetic;
+  Points &ecef = t.ecef, &back = t.back, &ned = t.ned, &ned_ecef = t.ned_ecef;
+  Points &ecef_b = t.ecef_b, &back_b = t.back_b, &ned_b = t.ned_b, &ned_ecef_b = t.ned_ecef_b;
+
+  SECTION("geodetic and ecef") {
+    REQUIRE(max_diff(ecef, ecef_b) == 0);
+    REQUIRE(max_diff(back, back_b) == 0);
+  }
+
+  SECTION("ned") {
+    REQUIRE(max_diff(ned, ned_b) < 1e-8);
+    REQUIRE(max_diff(ned_ecef, ned_ecef_b) < 1e-8);
+  }
+
+  SECTION("round trips") {
+    // longitude is arbitrary at the poles
+    double lat_err = 0, lon_err = 0, alt_err = 0;
+    for (size_t i = 0; i < N; i++) {
+      lat_err = std::max(lat_err, std::abs(back_b[0][i] - geodetic[0][i]));
+      alt_err = std::max(alt_err, std::abs(back_b[2][i] - geodetic[2][i]));
+      if (std::abs(geodetic[0][i]) < 89.999) {
+        lon_err = std::max(lon_err, std::abs(std::remainder(back_b[1][i] - geodetic[1][i], 360.0)));
+      }
+    }
+    REQUIRE(lat_err < 1e-8);
+    REQUIRE(lon_err < 1e-8);
+    REQUIRE(alt_err < 1e-3);
+    REQUIRE(max_diff(ned_ecef_b, ecef_b) < 1e-6);
+  }
+
+  SECTION("in place") {
+    // the way geodetic2ned_batch and ned2geodetic_batch are called
+    Points in_place = geodetic;
+    local.geodetic2ned_batch(in_place[0], in_place[1], in_place[2], in_place[0], in_place[1], in_place[2], N);
+    REQUIRE(max_diff(in_place, ned_b) < 1e-8);
+
+    local.ned2geodetic_batch(in_place[0], in_place[1], in_place[2], in_place[0], in_place[1], in_place[2], N);
+    Points ned_geodetic(N);
+    for (size_t i = 0; i < N; i++) {
+      Geodetic g = local.ned2geodetic({ned_b[0][i], ned_b[1][i], ned_b[2][i]});
+      ned_geodetic[0][i] = g.lat, ned_geodetic[1][i] = g.lon, ned_geodetic[2][i] = g.alt;
+    }
+    REQUIRE(max_diff(in_place, ned_geodetic) < 1e-6);
+  }
+}
@@ -0,0 +1,109 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "catch2/catch.hpp"
+#include "common/transformations/orientation.hpp"
+
+// the timings are in bench_orientation
+const size_t N = 100000;
+
+static double max_diff(const std::vector<double> &a, const std::vector<double> &b) {
+  double diff = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    diff = std::max(diff, std::abs(a[i] - b[i]));
+  }
+  return diff;
+}
+
+// the angles and their conversions, single value and batch, made once for all the sections
+struct Converted {
+  std::vector<double> euler = std::vector<double>(3 * N);
+  ECEF ecef_init = geodetic2ecef({32.7, -117.2, 10});
+  std::vector<double> quat = std::vector<double>(4 * N), rot = std::vector<double>(9 * N);
+  std::vector<double> quat_euler = std::vector<double>(3 * N), rot_euler = std::vector<double>(3 * N);
+  std::vector<double> ned = std::vector<double>(3 * N);
+  std::vector<double> quat_b = std::vector<double>(4 * N), rot_b = std::vector<double>(9 * N);
+  std::vector<double> quat_euler_b = std::vector<double>(3 * N), rot_euler_b = std::vector<double>(3 * N);
+  std::vector<double> ned_b = std::vector<double>(3 * N);
+
+  Converted() {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI), half_angle(-M_PI / 2, M_PI / 2);
+    for (size_t i = 0; i < N; i++) {
+      euler[i] = angle(gen);
+      // some in gimbal lock
+      euler[N + i] = i % 100 == 0 ? M_PI / 2 : half_angle(gen);
+      euler[2 * N + i] = angle(gen);
+    }
+
+    for (size_t i = 0; i < N; i++) {
+      Eigen::Quaterniond q = euler2quat({euler[i], euler[N + i], euler[2 * N + i]});
+      quat[i] = q.w(), quat[N + i] = q.x(), quat[2 * N + i] = q.y(), quat[3 * N + i] = q.z();
+      Eigen::Vector3d e = quat2euler(q);
+      for (int k = 0; k < 3; k++) quat_euler[k * N + i] = e(k);
+      Eigen::Matrix3d r = quat2rot(q);
+      for (int k = 0; k < 9; k++) rot[k * N + i] = r(k / 3, k % 3);
+      e = rot2euler(r);
+      for (int k = 0; k < 3; k++) rot_euler[k * N + i] = e(k);
+      e = ned_euler_from_ecef(ecef_init, {euler[i], euler[N + i], euler[2 * N + i]});
+      for (int k = 0; k < 3; k++) ned[k * N + i] = e(k);
+    }
+
+    euler2quat_batch(euler.data(), quat_b.data(), N);
+    quat2euler_batch(quat_b.data(), quat_euler_b.data(), N);
+    quat2rot_batch(quat_b.data(), rot_b.data(), N);
+    rot2euler_batch(rot_b.data(), rot_euler_b.data(), N);
+    ned_euler_from_ecef_batch(ecef_init, euler.data(), ned_b.data(), N);
+  }
+};
+
+TEST_CASE("batch orientation functions match the single value ones") {
+  static const Converted c;
+  const std::vector<double> &euler = c.euler;
+  const std::vector<double> &quat = c.quat, &rot = c.rot, &quat_euler = c.quat_euler, &rot_euler = c.rot_euler;
+  const std::vector<double> &ned = c.ned, &quat_b = c.quat_b, &quat_euler_b = c.quat_euler_b;
+  const std::vector<double> &rot_euler_b = c.rot_euler_b, &ned_b = c.ned_b;
+
+  SECTION("euler2quat") {
+    REQUIRE(max_diff(quat, quat_b) < 1e-12);
+  }
+
+  SECTION("quat2euler, quat2rot and rot2euler") {
+    // from the same quaternions they are the same computation
+    std::vector<double> quat_euler_same(3 * N), rot_same(9 * N), rot_euler_same(3 * N);
+    quat2euler_batch(quat.data(), quat_euler_same.data(), N);
+    quat2rot_batch(quat.data(), rot_same.data(), N);
+    rot2euler_batch(rot.data(), rot_euler_same.data(), N);
+    REQUIRE(max_diff(quat_euler, quat_euler_same) == 0);
+    REQUIRE(max_diff(rot, rot_same) == 0);
+    REQUIRE(max_diff(rot_euler, rot_euler_same) == 0);
+  }
+
+  SECTION("round trips") {
+    // roll and yaw are only defined together in gimbal lock
+    double round_trip = 0;
+    for (size_t i = 0; i < N; i++) {
+      if (i % 100 == 0) continue;
+      for (int k = 0; k < 3; k++) {
+        round_trip = std::max(round_trip, std::abs(std::remainder(quat_euler_b[k * N + i] - euler[k * N + i], 2 * M_PI)));
+        round_trip = std::max(round_trip, std::abs(std::remainder(rot_euler_b[k * N + i] - euler[k * N + i], 2 * M_PI)));
+      }
+    }
+    REQUIRE(round_trip < 1e-6);
+  }
+
+  SECTION("ned_euler_from_ecef") {
+    // and close to it rounding errors in them grow as 1 / cos(pitch)
+    double ned_diff = 0;
+    for (size_t i = 0; i < N; i++) {
+      for (int k = 0; k < 3; k++) {
+        const double diff = std::abs(std::remainder(ned[k * N + i] - ned_b[k * N + i], 2 * M_PI));
+        ned_diff = std::max(ned_diff, diff * std::cos(ned_b[N + i]));
+      }
+    }
+    REQUIRE(ned_diff < 1e-8);
+  }
+}
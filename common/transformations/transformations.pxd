@@ -34,6 +34,12 @@ cdef extern from "orientation.hpp":
   Vector3 ecef_euler_from_ned(ECEF, Vector3)
   Vector3 ned_euler_from_ecef(ECEF, Vector3)
 
+  void euler2quat_batch(const double*, double*, size_t)
+  void quat2euler_batch(const double*, double*, size_t)
+  void quat2rot_batch(const double*, double*, size_t)
+  void rot2euler_batch(const double*, double*, size_t)
+  void ned_euler_from_ecef_batch(ECEF, const double*, double*, size_t)
+
 
 cdef extern from "coordinates.cc":
   cdef struct ECEF:
@@ -55,6 +61,9 @@ cdef extern from "coordinates.cc":
   ECEF geodetic2ecef(Geodetic)
   Geodetic ecef2geodetic(ECEF)
 
+  void geodetic2ecef_batch(const double*, const double*, const double*, double*, double*, double*, size_t)
+  void ecef2geodetic_batch(const double*, const double*, const double*, double*, double*, double*, size_t)
+
   cdef cppclass LocalCoord_c "LocalCoord":
     Matrix3 ned2ecef_matrix
     Matrix3 ecef2ned_matrix
@@ -68,5 +77,10 @@ cdef extern from "coordinates.cc":
     NED geodetic2ned(Geodetic)
     Geodetic ned2geodetic(NED)
 
+    void ecef2ned_batch(const double*, const double*, const double*, double*, double*, double*, size_t)
+    void ned2ecef_batch(const double*, const double*, const double*, double*, double*, double*, size_t)
+    void geodetic2ned_batch(const double*, const double*, const double*, double*, double*, double*, size_t)
+    void ned2geodetic_batch(const double*, const double*, const double*, double*, double*, double*, size_t)
+
 cdef extern from "coordinates.hpp":
   pass
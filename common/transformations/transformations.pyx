@@ -12,8 +12,15 @@ from common.transformations.transformations cimport rot2euler as rot2euler_c
 from common.transformations.transformations cimport rot_matrix as rot_matrix_c
 from common.transformations.transformations cimport ecef_euler_from_ned as ecef_euler_from_ned_c
 from common.transformations.transformations cimport ned_euler_from_ecef as ned_euler_from_ecef_c
+from common.transformations.transformations cimport euler2quat_batch as euler2quat_batch_c
+from common.transformations.transformations cimport quat2euler_batch as quat2euler_batch_c
+from common.transformations.transformations cimport quat2rot_batch as quat2rot_batch_c
+from common.transformations.transformations cimport rot2euler_batch as rot2euler_batch_c
+from common.transformations.transformations cimport ned_euler_from_ecef_batch as ned_euler_from_ecef_batch_c
 from common.transformations.transformations cimport geodetic2ecef as geodetic2ecef_c
 from common.transformations.transformations cimport ecef2geodetic as ecef2geodetic_c
+from common.transformations.transformations cimport geodetic2ecef_batch as geodetic2ecef_batch_c
+from common.transformations.transformations cimport ecef2geodetic_batch as ecef2geodetic_batch_c
 from common.transformations.transformations cimport LocalCoord_c
 
 
@@ -101,6 +108,37 @@ def ned_euler_from_ecef_single(ecef_init, ecef_pose):
     cdef Vector3 e = ned_euler_from_ecef_c(init, pose)
     return [e(0), e(1), e(2)]
 
+# The array functions take arrays of one row per component, euler angles 3xN, quaternions 4xN
+# and rotation matrices 9xN in row major order
+ctypedef void (*orientation_batch_fn)(const double*, double*, size_t)
+
+cdef np.ndarray[double, ndim=2] call_orientation_batch(orientation_batch_fn f, np.ndarray[double, ndim=2, mode="c"] inp,
+                                                       int inp_rows, int out_rows):
+    assert inp.shape[0] == inp_rows
+    cdef size_t n = inp.shape[1]
+    cdef np.ndarray[double, ndim=2, mode="c"] out = np.empty((out_rows, n))
+    f(<double*>inp.data, <double*>out.data, n)
+    return out
+
+def euler2quat_array(euler):
+    return call_orientation_batch(euler2quat_batch_c, euler, 3, 4)
+
+def quat2euler_array(quat):
+    return call_orientation_batch(quat2euler_batch_c, quat, 4, 3)
+
+def quat2rot_array(quat):
+    return call_orientation_batch(quat2rot_batch_c, quat, 4, 9)
+
+def rot2euler_array(rot):
+    return call_orientation_batch(rot2euler_batch_c, rot, 9, 3)
+
+def ned_euler_from_ecef_array(ecef_init, np.ndarray[double, ndim=2, mode="c"] ecef_pose):
+    assert ecef_pose.shape[0] == 3
+    cdef size_t n = ecef_pose.shape[1]
+    cdef np.ndarray[double, ndim=2, mode="c"] ned_pose = np.empty((3, n))
+    ned_euler_from_ecef_batch_c(list2ecef(ecef_init), <double*>ecef_pose.data, <double*>ned_pose.data, n)
+    return ned_pose
+
 def geodetic2ecef_single(geodetic):
     cdef Geodetic g = list2geodetic(geodetic)
     cdef ECEF e = geodetic2ecef_c(g)
@@ -111,6 +149,24 @@ def ecef2geodetic_single(ecef):
     cdef Geodetic g = ecef2geodetic_c(e)
     return [g.lat, g.lon, g.alt]
 
+# The array functions take 3xN arrays, one row per coordinate, and return the same
+ctypedef void (*batch_fn)(const double*, const double*, const double*, double*, double*, double*, size_t)
+
+cdef np.ndarray[double, ndim=2] call_batch(batch_fn f, np.ndarray[double, ndim=2, mode="c"] inp):
+    assert inp.shape[0] == 3
+    cdef size_t n = inp.shape[1]
+    cdef np.ndarray[double, ndim=2, mode="c"] out = np.empty((3, n))
+    cdef double *i = <double*>inp.data
+    cdef double *o = <double*>out.data
+    f(i, i + n, i + 2 * n, o, o + n, o + 2 * n, n)
+    return out
+
+def geodetic2ecef_array(geodetic):
+    return call_batch(geodetic2ecef_batch_c, geodetic)
+
+def ecef2geodetic_array(ecef):
+    return call_batch(ecef2geodetic_batch_c, ecef)
+
 
 cdef class LocalCoord:
     cdef LocalCoord_c * lc
@@ -170,5 +226,41 @@ cdef class LocalCoord:
         cdef Geodetic g = self.lc.ned2geodetic(n)
         return [g.lat, g.lon, g.alt]
 
+    def ecef2ned_batch(self, np.ndarray[double, ndim=2, mode="c"] ecef):
+        assert self.lc
+        cdef np.ndarray[double, ndim=2, mode="c"] ned = np.empty_like(ecef)
+        cdef size_t n = self.check_batch(ecef)
+        self.lc.ecef2ned_batch(<double*>ecef.data, <double*>ecef.data + n, <double*>ecef.data + 2 * n,
+                               <double*>ned.data, <double*>ned.data + n, <double*>ned.data + 2 * n, n)
+        return ned
+
+    def ned2ecef_batch(self, np.ndarray[double, ndim=2, mode="c"] ned):
+        assert self.lc
+        cdef np.ndarray[double, ndim=2, mode="c"] ecef = np.empty_like(ned)
+        cdef size_t n = self.check_batch(ned)
+        self.lc.ned2ecef_batch(<double*>ned.data, <double*>ned.data + n, <double*>ned.data + 2 * n,
+                               <double*>ecef.data, <double*>ecef.data + n, <double*>ecef.data + 2 * n, n)
+        return ecef
+
+    def geodetic2ned_batch(self, np.ndarray[double, ndim=2, mode="c"] geodetic):
+        assert self.lc
+        cdef np.ndarray[double, ndim=2, mode="c"] ned = np.empty_like(geodetic)
+        cdef size_t n = self.check_batch(geodetic)
+        self.lc.geodetic2ned_batch(<double*>geodetic.data, <double*>geodetic.data + n, <double*>geodetic.data + 2 * n,
+                                   <double*>ned.data, <double*>ned.data + n, <double*>ned.data + 2 * n, n)
+        return ned
+
+    def ned2geodetic_batch(self, np.ndarray[double, ndim=2, mode="c"] ned):
+        assert self.lc
+        cdef np.ndarray[double, ndim=2, mode="c"] geodetic = np.empty_like(ned)
+        cdef size_t n = self.check_batch(ned)
+        self.lc.ned2geodetic_batch(<double*>ned.data, <double*>ned.data + n, <double*>ned.data + 2 * n,
+                                   <double*>geodetic.data, <double*>geodetic.data + n, <double*>geodetic.data + 2 * n, n)
+        return geodetic
+
+    cdef size_t check_batch(self, np.ndarray inp):
+        assert inp.shape[0] == 3
+        return inp.shape[1]
+
     def __dealloc__(self):
         del self.lc
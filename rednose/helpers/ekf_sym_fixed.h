@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/StdVector>
+
+#include "common_ekf.h"
+#include "ekf_sym.h"
+#include "logger/logger.h"
+
+namespace EKFS {
+
+// EKFSym with the state and error dimensions known at compile time. State, covariance and
+// observations are fixed size, and the rewind history is a ring preallocated at construction,
+// so predicting and updating never allocates. It calls the same generated functions on the
+// same data as EKFSym, so the results are identical. No augmented states or extra args
+template <int DIM, int EDIM, int MAX_ZDIM, int MAX_BATCH = 1, int REWIND = REWIND_TO_KEEP>
+class EKFSymFixed {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  typedef Eigen::Matrix<double, DIM, 1> StateVector;
+  typedef Eigen::Matrix<double, EDIM, EDIM, Eigen::RowMajor> CovMatrix;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, Eigen::ColMajor, MAX_ZDIM, 1> ObsVector;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor, MAX_ZDIM, MAX_ZDIM> ObsMatrix;
+
+  EKFSymFixed(std::string name, const CovMatrix &Q, const StateVector &x_initial, const CovMatrix &P_initial,
+              std::vector<int> quaternion_idxs = std::vector<int>(), double max_rewind_age = 1.0)
+    : Q(Q), quaternion_idxs(quaternion_idxs), max_rewind_age(max_rewind_age), rewind_states(REWIND), replay(REWIND) {
+    this->ekf = ekf_lookup(name);
+    assert(this->ekf);
+    this->init_state(x_initial, P_initial, NAN);
+  }
+
+  void init_state(const StateVector &state, const CovMatrix &covs, double init_filter_time) {
+    this->x = state;
+    this->P = covs;
+    this->filter_time = init_filter_time;
+    this->reset_rewind();
+  }
+
+  const StateVector &state() const { return this->x; }
+  const CovMatrix &covs() const { return this->P; }
+  void set_filter_time(double t) { this->filter_time = t; }
+  void set_process_noise(const CovMatrix &process_noise) { this->Q = process_noise; }
+  double get_filter_time() const { return this->filter_time; }
+
+  void normalize_quaternions() {
+    for (int idx : this->quaternion_idxs) {
+      // same expression as EKFSym, a fixed size segment could reduce in another order
+      this->x.block(idx, 0, 4, 1).normalize();
+    }
+  }
+
+  void set_global(std::string global_var, double val) {
+    this->ekf->sets.at(global_var)(val);
+  }
+
+  void reset_rewind() {
+    this->rewind_head = 0;
+    this->rewind_size = 0;
+  }
+
+  void predict(double t) {
+    // initialize time
+    if (std::isnan(this->filter_time)) {
+      this->filter_time = t;
+    }
+
+    // predict
+    double dt = t - this->filter_time;
+    assert(dt >= 0.0);
+
+    this->ekf->predict(this->x.data(), this->P.data(), this->Q.data(), dt);
+    this->normalize_quaternions();
+    this->filter_time = t;
+  }
+
+  // the state and covs predicted to t, leaving the filter at its time so it can still take
+  // observations before t without rewinding
+  void predicted(double t, StateVector &x, CovMatrix &P) {
+    x = this->x;
+    P = this->P;
+    double dt = t - this->filter_time;
+    if (!(dt > 0.0)) {
+      return;
+    }
+
+    this->ekf->predict(x.data(), P.data(), this->Q.data(), dt);
+    for (int idx : this->quaternion_idxs) {
+      x.block(idx, 0, 4, 1).normalize();
+    }
+  }
+
+  // false if the observation was too old to rewind to
+  template <class ZVec, class RMat>
+  bool predict_and_update_batch(double t, int kind, const std::vector<ZVec> &z, const std::vector<RMat> &R) {
+    assert(z.size() == R.size() && z.size() <= MAX_BATCH);
+
+    int rewound = 0;
+    if (!std::isnan(this->filter_time) && t < this->filter_time) {
+      if (this->rewind_size == 0 || t < this->checkpoint_at(0).t || t < this->checkpoint_at(this->rewind_size - 1).t - this->max_rewind_age) {
+        LOGD("observation too old at %f with filter at %f, ignoring!", t, this->filter_time);
+        return false;
+      }
+      rewound = this->rewind(t);
+    }
+
+    Observation obs;
+    obs.t = t;
+    obs.kind = kind;
+    obs.n = z.size();
+    for (int i = 0; i < obs.n; i++) {
+      obs.z[i] = z[i];
+      obs.R[i] = R[i];
+    }
+    this->predict_and_update_batch(obs);
+
+    // fast forward
+    for (int i = 0; i < rewound; i++) {
+      this->predict_and_update_batch(this->replay[i]);
+    }
+    return true;
+  }
+
+  extra_routine_t get_extra_routine(const std::string &routine) const {
+    return this->ekf->extra_routines.at(routine);
+  }
+
+private:
+  struct Observation {
+    double t;
+    int kind;
+    int n;
+    ObsVector z[MAX_BATCH];
+    ObsMatrix R[MAX_BATCH];
+  };
+
+  struct Checkpoint {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    double t;
+    StateVector x;
+    CovMatrix P;
+    Observation obs;
+  };
+
+  Checkpoint &checkpoint_at(int i) {
+    return this->rewind_states[(this->rewind_head + i) % REWIND];
+  }
+
+  // drops the checkpoints after t into replay, oldest first, returns how many
+  int rewind(double t) {
+    int n = 0;
+    while (this->checkpoint_at(this->rewind_size - n - 1).t > t) {
+      n++;
+    }
+    for (int i = 0; i < n; i++) {
+      this->replay[i] = this->checkpoint_at(this->rewind_size - n + i).obs;
+    }
+    this->rewind_size -= n;
+
+    // set the state to the time right before that
+    const Checkpoint &last = this->checkpoint_at(this->rewind_size - 1);
+    this->filter_time = last.t;
+    this->x = last.x;
+    this->P = last.P;
+    return n;
+  }
+
+  void checkpoint(const Observation &obs) {
+    // only keep a certain number around, overwriting the oldest
+    if (this->rewind_size == REWIND) {
+      this->rewind_head = (this->rewind_head + 1) % REWIND;
+      this->rewind_size--;
+    }
+    Checkpoint &c = this->checkpoint_at(this->rewind_size++);
+    c.t = this->filter_time;
+    c.x = this->x;
+    c.P = this->P;
+    c.obs = obs;
+  }
+
+  void predict_and_update_batch(const Observation &obs) {
+    this->predict(obs.t);
+    for (int i = 0; i < obs.n; i++) {
+      assert(obs.z[i].rows() == obs.R[i].rows());
+      assert(obs.z[i].rows() == obs.R[i].cols());
+
+      // the generated update takes z and R as mutable and writes the innovation back into z,
+      // it gets copies so the observation is kept as is for replay
+      ObsVector z = obs.z[i];
+      ObsMatrix R = obs.R[i];
+      this->ekf->updates.at(obs.kind)(this->x.data(), this->P.data(), z.data(), R.data(), nullptr);
+      this->normalize_quaternions();
+    }
+    this->checkpoint(obs);
+  }
+
+  // stuct with linked sympy generated functions
+  const EKF *ekf = NULL;
+
+  StateVector x;  // state
+  CovMatrix P;  // covs
+  CovMatrix Q;  // process noise
+  double filter_time;
+
+  std::vector<int> quaternion_idxs;
+
+  // rewind stuff
+  double max_rewind_age;
+  std::vector<Checkpoint, Eigen::aligned_allocator<Checkpoint>> rewind_states;
+  int rewind_head = 0;
+  int rewind_size = 0;
+  std::vector<Observation, Eigen::aligned_allocator<Observation>> replay;
+};
+
+}
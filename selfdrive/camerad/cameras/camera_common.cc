@@ -2,6 +2,7 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <chrono>
@@ -10,6 +11,7 @@
 #include "libyuv.h"
 #include <jpeglib.h>
 
+#include "selfdrive/camerad/cameras/cpu_isp.h"
 #include "selfdrive/camerad/imgproc/utils.h"
 #include "selfdrive/common/clutil.h"
 #include "selfdrive/common/modeldata.h"
@@ -42,16 +44,57 @@ public:
              "-cl-fast-relaxed-math -cl-denorms-are-zero "
              "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d "
              "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DRGB_STRIDE=%d "
-             "-DBAYER_FLIP=%d -DHDR=%d -DCAM_NUM=%d",
+             "-DBAYER_FLIP=%d -DHDR=%d -DCAM_NUM=%d "
+             "-DRGB_SIZE=%d -DUV_WIDTH=%d -DUV_HEIGHT=%d",
              ci->frame_width, ci->frame_height, ci->frame_stride,
              b->rgb_width, b->rgb_height, b->rgb_stride,
-             ci->bayer_flip, ci->hdr, s->camera_num);
-    const char *cl_file = Hardware::TICI() ? "cameras/real_debayer.cl" : "cameras/debayer.cl";
-    cl_program prg_debayer = cl_program_from_file(context, device_id, cl_file, args);
+             ci->bayer_flip, ci->hdr, s->camera_num,
+             b->rgb_width * b->rgb_height, b->rgb_width / 2, b->rgb_height / 2);
+    const bool fused = Hardware::TICI() && env_fused_isp;
+    cl_program prg_debayer;
+    if (fused) {
+      // debayer10_yuv uses the helpers of real_debayer.cl, so it's built appended to it
+      prg_debayer = cl_program_from_source(context, device_id, util::read_file("cameras/real_debayer.cl") + util::read_file("cameras/real_debayer_yuv.cl"), args);
+    } else {
+      const char *cl_file = Hardware::TICI() ? "cameras/real_debayer.cl" : "cameras/debayer.cl";
+      prg_debayer = cl_program_from_file(context, device_id, cl_file, args);
+    }
     krnl_ = CL_CHECK_ERR(clCreateKernel(prg_debayer, "debayer10", &err));
+    if (fused) {
+      krnl_yuv_ = CL_CHECK_ERR(clCreateKernel(prg_debayer, "debayer10_yuv", &err));
+      hist_cl_ = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, 256 * sizeof(uint32_t), NULL, &err));
+    }
     CL_CHECK(clReleaseProgram(prg_debayer));
   }
 
+  bool fused() const {
+    return krnl_yuv_ != nullptr;
+  }
+
+  // debayers straight to rgb and yuv in one pass, counting the luminance histogram of roi
+  void queue_yuv(cl_command_queue q, cl_mem cam_buf_cl, cl_mem buf_cl, cl_mem yuv_cl, int width, int height, const ExposureRoi &roi, uint32_t *hist) {
+    const uint32_t zero = 0;
+    CL_CHECK(clEnqueueFillBuffer(q, hist_cl_, &zero, sizeof(zero), 0, 256 * sizeof(uint32_t), 0, NULL, NULL));
+
+    const int debayer_local_worksize = 16;
+    constexpr int localMemSize = (2 * debayer_local_worksize + 2) * (2 * debayer_local_worksize + 2) * sizeof(short int);
+    CL_CHECK(clSetKernelArg(krnl_yuv_, 0, sizeof(cl_mem), &cam_buf_cl));
+    CL_CHECK(clSetKernelArg(krnl_yuv_, 1, sizeof(cl_mem), &buf_cl));
+    CL_CHECK(clSetKernelArg(krnl_yuv_, 2, sizeof(cl_mem), &yuv_cl));
+    CL_CHECK(clSetKernelArg(krnl_yuv_, 3, localMemSize, 0));
+    CL_CHECK(clSetKernelArg(krnl_yuv_, 4, sizeof(cl_mem), &hist_cl_));
+    const int roi_args[] = {roi.x_start, roi.x_end, roi.x_skip, roi.y_start, roi.y_end, roi.y_skip};
+    for (int i = 0; i < std::size(roi_args); i++) {
+      CL_CHECK(clSetKernelArg(krnl_yuv_, 5 + i, sizeof(int), &roi_args[i]));
+    }
+
+    // one work item per 2x2 quad
+    const size_t globalWorkSize[] = {size_t(width / 2), size_t(height / 2)};
+    const size_t localWorkSize[] = {debayer_local_worksize, debayer_local_worksize};
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl_yuv_, 2, NULL, globalWorkSize, localWorkSize, 0, 0, NULL));
+    CL_CHECK(clEnqueueReadBuffer(q, hist_cl_, CL_TRUE, 0, 256 * sizeof(uint32_t), hist, 0, NULL, NULL));
+  }
+
   void queue(cl_command_queue q, cl_mem cam_buf_cl, cl_mem buf_cl, int width, int height, float gain, cl_event *debayer_event) {
     CL_CHECK(clSetKernelArg(krnl_, 0, sizeof(cl_mem), &cam_buf_cl));
     CL_CHECK(clSetKernelArg(krnl_, 1, sizeof(cl_mem), &buf_cl));
@@ -83,10 +126,16 @@ public:
 
   ~Debayer() {
     CL_CHECK(clReleaseKernel(krnl_));
+    if (krnl_yuv_) {
+      CL_CHECK(clReleaseKernel(krnl_yuv_));
+      CL_CHECK(clReleaseMemObject(hist_cl_));
+    }
   }
 
 private:
   cl_kernel krnl_;
+  cl_kernel krnl_yuv_ = nullptr;
+  cl_mem hist_cl_ = nullptr;
   bool hdr_;
 };
 
@@ -126,10 +175,15 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
 
   vipc_server->create_buffers(yuv_type, YUV_BUFFER_COUNT, false, rgb_width, rgb_height);
 
-  if (ci->bayer) {
-    debayer = new Debayer(device_id, context, this, s);
+  if (env_cpu_isp) {
+    LOGW("camera %d processing frames on the CPU, not verified against the GPU kernels", s->camera_num);
+    cpu_isp = std::make_unique<CpuIsp>(*ci, s->camera_num, rgb_width, rgb_height, rgb_stride, Hardware::TICI());
+  } else {
+    if (ci->bayer) {
+      debayer = new Debayer(device_id, context, this, s);
+    }
+    rgb2yuv = std::make_unique<Rgb2Yuv>(context, device_id, rgb_width, rgb_height, rgb_stride);
   }
-  rgb2yuv = std::make_unique<Rgb2Yuv>(context, device_id, rgb_width, rgb_height, rgb_stride);
 
 #ifdef __APPLE__
   q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
@@ -147,6 +201,17 @@ CameraBuf::~CameraBuf() {
   if (q) CL_CHECK(clReleaseCommandQueue(q));
 }
 
+static float debayer_gain(const CameraState *s) {
+  float gain = 0.0;
+
+#ifndef QCOM2
+  gain = s->digital_gain;
+  if ((int)gain == 0) gain = 1.0;
+#endif
+
+  return gain;
+}
+
 bool CameraBuf::acquire() {
   if (!safe_queue.try_pop(cur_buf_idx, 1)) return false;
 
@@ -158,30 +223,45 @@ bool CameraBuf::acquire() {
 
   cur_frame_data = camera_bufs_metadata[cur_buf_idx];
   cur_rgb_buf = vipc_server->get_buffer(rgb_type);
-  cl_mem camrabuf_cl = camera_bufs[cur_buf_idx].buf_cl;
-  cl_event event;
+  cur_yuv_buf = vipc_server->get_buffer(yuv_type);
+  exposure_hist_valid = false;
 
   float start_time = millis_since_boot();
 
-  if (debayer) {
-    float gain = 0.0;
-
-#ifndef QCOM2
-    gain = camera_state->digital_gain;
-    if ((int)gain == 0) gain = 1.0;
-#endif
-
-    debayer->queue(q, camrabuf_cl, cur_rgb_buf->buf_cl, rgb_width, rgb_height, gain, &event);
+  if (cpu_isp) {
+    // the sensor frames and the vipc buffers are shared with the device, keep the caches coherent
+    camera_bufs[cur_buf_idx].sync(VISIONBUF_SYNC_FROM_DEVICE);
+    const uint8_t *frame = (const uint8_t *)camera_bufs[cur_buf_idx].addr;
+    if (camera_state->ci.bayer) {
+      cpu_isp->debayer(frame, (uint8_t *)cur_rgb_buf->addr, debayer_gain(camera_state));
+    } else {
+      assert(rgb_stride == camera_state->ci.frame_stride);
+      memcpy(cur_rgb_buf->addr, frame, cur_rgb_buf->len);
+    }
+    cpu_isp->rgb_to_yuv((const uint8_t *)cur_rgb_buf->addr, (uint8_t *)cur_yuv_buf->addr);
+    cur_rgb_buf->sync(VISIONBUF_SYNC_TO_DEVICE);
+    cur_yuv_buf->sync(VISIONBUF_SYNC_TO_DEVICE);
+  } else if (debayer && debayer->fused()) {
+    // the kernel counts a single roi, an empty one when there are several
+    exposure_hist_roi = exposure.rois().size() == 1 ? exposure.rois()[0] : ExposureRoi{};
+    debayer->queue_yuv(q, camera_bufs[cur_buf_idx].buf_cl, cur_rgb_buf->buf_cl, cur_yuv_buf->buf_cl, rgb_width, rgb_height, exposure_hist_roi, exposure_hist);
+    exposure_hist_valid = true;
   } else {
-    assert(rgb_stride == camera_state->ci.frame_stride);
-    CL_CHECK(clEnqueueCopyBuffer(q, camrabuf_cl, cur_rgb_buf->buf_cl, 0, 0, cur_rgb_buf->len, 0, 0, &event));
-  }
+    cl_mem camrabuf_cl = camera_bufs[cur_buf_idx].buf_cl;
+    cl_event event;
+
+    if (debayer) {
+      debayer->queue(q, camrabuf_cl, cur_rgb_buf->buf_cl, rgb_width, rgb_height, debayer_gain(camera_state), &event);
+    } else {
+      assert(rgb_stride == camera_state->ci.frame_stride);
+      CL_CHECK(clEnqueueCopyBuffer(q, camrabuf_cl, cur_rgb_buf->buf_cl, 0, 0, cur_rgb_buf->len, 0, 0, &event));
+    }
 
-  clWaitForEvents(1, &event);
-  CL_CHECK(clReleaseEvent(event));
+    clWaitForEvents(1, &event);
+    CL_CHECK(clReleaseEvent(event));
 
-  cur_yuv_buf = vipc_server->get_buffer(yuv_type);
-  rgb2yuv->queue(q, cur_rgb_buf->buf_cl, cur_yuv_buf->buf_cl);
+    rgb2yuv->queue(q, cur_rgb_buf->buf_cl, cur_yuv_buf->buf_cl);
+  }
 
   cur_frame_data.processing_time = (millis_since_boot() - start_time) / 1000.0;
 
@@ -333,32 +413,19 @@ static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
   pm->send("thumbnail", msg);
 }
 
-float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip) {
-  int lum_med;
-  uint32_t lum_binning[256] = {0};
-  const uint8_t *pix_ptr = b->cur_yuv_buf->y;
-
-  unsigned int lum_total = 0;
-  for (int y = y_start; y < y_end; y += y_skip) {
-    for (int x = x_start; x < x_end; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->rgb_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
-    }
-  }
-
-
-  // Find mean lumimance value
-  unsigned int lum_cur = 0;
-  for (lum_med = 255; lum_med >= 0; lum_med--) {
-    lum_cur += lum_binning[lum_med];
-
-    if (lum_cur >= lum_total / 2) {
-      break;
-    }
+float set_exposure_target(CameraBuf *b, const std::vector<ExposureRoi> &rois, const std::vector<float> &weights) {
+  b->exposure.set_rois(rois, weights);
+  if (b->exposure_hist_valid && rois.size() == 1 && rois[0] == b->exposure_hist_roi) {
+    // counted while debayering
+    b->exposure.update(b->exposure_hist);
+  } else {
+    b->exposure.update(b->cur_yuv_buf->y, b->rgb_width);
   }
+  return b->exposure.median() / 256.0;
+}
 
-  return lum_med / 256.0;
+float set_exposure_target(CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip) {
+  return set_exposure_target(b, {{x_start, x_end, x_skip, y_start, y_end, y_skip}});
 }
 
 void *processing_thread(MultiCameraState *cameras, CameraState *cs, process_thread_cb callback) {
@@ -394,37 +461,32 @@ std::thread start_process_thread(MultiCameraState *cameras, CameraState *cs, pro
 
 static void driver_cam_auto_exposure(CameraState *c, SubMaster &sm) {
   static const bool is_rhd = Params().getBool("IsRHD");
-  struct ExpRect {int x1, x2, x_skip, y1, y2, y_skip;};
-  const CameraBuf *b = &c->buf;
+  CameraBuf *b = &c->buf;
 
-  int x_offset = 0, y_offset = 0;
-  int frame_width = b->rgb_width, frame_height = b->rgb_height;
-
-
-  ExpRect def_rect;
-  if (Hardware::TICI()) {
-    x_offset = 630, y_offset = 156;
-    frame_width = 668, frame_height = frame_width / 1.33;
-    def_rect = {96, 1832, 2, 242, 1148, 4};
-  } else {
-    def_rect = {is_rhd ? 0 : b->rgb_width * 3 / 5, is_rhd ? b->rgb_width * 2 / 5 : b->rgb_width, 2,
-                b->rgb_height / 3, b->rgb_height, 1};
-  }
-
-  static ExpRect rect = def_rect;
+  // computed once, then only when the face moves
+  static ExposureRoi roi = Hardware::TICI() ? ExposureRoi{96, 1832, 2, 242, 1148, 4}
+                                            : ExposureRoi{is_rhd ? 0 : b->rgb_width * 3 / 5, is_rhd ? b->rgb_width * 2 / 5 : b->rgb_width, 2,
+                                                          b->rgb_height / 3, b->rgb_height, 1};
   // use driver face crop for AE
   if (Hardware::EON() && sm.updated("driverState")) {
     if (auto state = sm["driverState"].getDriverState(); state.getFaceProb() > 0.4) {
+      int x_offset = 0, y_offset = 0;
+      int frame_width = b->rgb_width, frame_height = b->rgb_height;
+      if (Hardware::TICI()) {
+        x_offset = 630, y_offset = 156;
+        frame_width = 668, frame_height = frame_width / 1.33;
+      }
+
       auto face_position = state.getFacePosition();
       int x = is_rhd ? 0 : frame_width - (0.5 * frame_height);
       x += (face_position[0] * (is_rhd ? -1.0 : 1.0) + 0.5) * (0.5 * frame_height) + x_offset;
       int y = (face_position[1] + 0.5) * frame_height + y_offset;
-      rect = {std::max(0, x - 72), std::min(b->rgb_width - 1, x + 72), 2,
-              std::max(0, y - 72), std::min(b->rgb_height - 1, y + 72), 1};
+      roi = {std::max(0, x - 72), std::min(b->rgb_width - 1, x + 72), 2,
+             std::max(0, y - 72), std::min(b->rgb_height - 1, y + 72), 1};
     }
   }
 
-  camera_autoexposure(c, set_exposure_target(b, rect.x1, rect.x2, rect.x_skip, rect.y1, rect.y2, rect.y_skip));
+  camera_autoexposure(c, set_exposure_target(b, {roi}));
 }
 
 void common_process_driver_camera(MultiCameraState *s, CameraState *c, int cnt) {
@@ -433,7 +495,7 @@ void common_process_driver_camera(MultiCameraState *s, CameraState *c, int cnt)
     s->sm->update(0);
     driver_cam_auto_exposure(c, *(s->sm));
   }
-  MessageBuilder msg;
+  MessageBuilder msg("driverCameraState");
   auto framed = msg.initEvent().initDriverCameraState();
   framed.setFrameType(cereal::FrameData::FrameType::FRONT);
   fill_frame_data(framed, c->buf.cur_frame_data);
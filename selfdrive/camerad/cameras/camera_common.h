@@ -9,6 +9,7 @@
 #include "cereal/visionipc/visionbuf.h"
 #include "cereal/visionipc/visionipc.h"
 #include "cereal/visionipc/visionipc_server.h"
+#include "selfdrive/camerad/imgproc/exposure.h"
 #include "selfdrive/camerad/transforms/rgb_to_yuv.h"
 #include "selfdrive/common/mat.h"
 #include "selfdrive/common/queue.h"
@@ -45,6 +46,10 @@ const bool env_send_wide_road = getenv("SEND_WIDE_ROAD") != NULL;
 // note: ONLY_ROAD doesn't work, likely due to a mixup with wideRoad cam in the kernel
 const bool env_only_driver = getenv("ONLY_DRIVER") != NULL;
 const bool env_debug_frames = getenv("DEBUG_FRAMES") != NULL;
+// debayer and convert to yuv on the CPU instead of with OpenCL
+const bool env_cpu_isp = getenv("CPU_ISP") != NULL;
+// on TICI, debayer, convert to yuv and count the exposure histogram in the single debayer10_yuv kernel
+const bool env_fused_isp = getenv("FUSED_ISP") != NULL;
 
 typedef void (*release_cb)(void *cookie, int buf_idx);
 
@@ -87,6 +92,7 @@ typedef struct CameraExpInfo {
 struct MultiCameraState;
 struct CameraState;
 class Debayer;
+class CpuIsp;
 
 class CameraBuf {
 private:
@@ -94,6 +100,7 @@ private:
   CameraState *camera_state;
   Debayer *debayer = nullptr;
   std::unique_ptr<Rgb2Yuv> rgb2yuv;
+  std::unique_ptr<CpuIsp> cpu_isp;
 
   VisionStreamType rgb_type, yuv_type;
 
@@ -115,6 +122,12 @@ public:
 
   mat3 yuv_transform;
 
+  ExposureStats exposure;
+  // luminance histogram of exposure_hist_roi in cur_yuv_buf, valid when counted by the fused debayer
+  ExposureRoi exposure_hist_roi;
+  uint32_t exposure_hist[256] = {};
+  bool exposure_hist_valid = false;
+
   CameraBuf() = default;
   ~CameraBuf();
   void init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType rgb_type, VisionStreamType yuv_type, release_cb release_callback=nullptr);
@@ -127,7 +140,8 @@ typedef void (*process_thread_cb)(MultiCameraState *s, CameraState *c, int cnt);
 
 void fill_frame_data(cereal::FrameData::Builder &framed, const FrameMetadata &frame_data);
 kj::Array<uint8_t> get_frame_image(const CameraBuf *b);
-float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip);
+float set_exposure_target(CameraBuf *b, const std::vector<ExposureRoi> &rois, const std::vector<float> &weights = {});
+float set_exposure_target(CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip);
 std::thread start_process_thread(MultiCameraState *cameras, CameraState *cs, process_thread_cb callback);
 void common_process_driver_camera(MultiCameraState *s, CameraState *c, int cnt);
 
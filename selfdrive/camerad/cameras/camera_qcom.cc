@@ -1051,12 +1051,12 @@ static void setup_self_recover(CameraState *c, const uint16_t *lapres, size_t la
 
 // called by processing_thread
 void process_road_camera(MultiCameraState *s, CameraState *c, int cnt) {
-  const CameraBuf *b = &c->buf;
+  CameraBuf *b = &c->buf;
   const int roi_id = cnt % std::size(s->lapres);  // rolling roi
   s->lapres[roi_id] = s->lap_conv->Update(b->q, (uint8_t *)b->cur_rgb_buf->addr, roi_id);
   setup_self_recover(c, &s->lapres[0], std::size(s->lapres));
 
-  MessageBuilder msg;
+  MessageBuilder msg("roadCameraState");
   auto framed = msg.initEvent().initRoadCameraState();
   fill_frame_data(framed, b->cur_frame_data);
   if (env_send_road) {
@@ -1024,9 +1024,9 @@ void camera_autoexposure(CameraState *s, float grey_frac) {
 
 // called by processing_thread
 void process_road_camera(MultiCameraState *s, CameraState *c, int cnt) {
-  const CameraBuf *b = &c->buf;
+  CameraBuf *b = &c->buf;
 
-  MessageBuilder msg;
+  MessageBuilder msg(c == &s->road_cam ? "roadCameraState" : "wideRoadCameraState");
   auto framed = c == &s->road_cam ? msg.initEvent().initRoadCameraState() : msg.initEvent().initWideRoadCameraState();
   fill_frame_data(framed, b->cur_frame_data);
   if ((c == &s->road_cam && env_send_road) || (c == &s->wide_road_cam && env_send_wide_road)) {
@@ -54,10 +54,14 @@ void run_camera(CameraState *s) {
       // loop stream
       stream_frame_id = 0;
     }
-    if (s->frame->get(stream_frame_id++, rgb_buf.get(), yuv_buf.get())) {
+    auto &buf = s->buf.camera_bufs[buf_idx];
+    // the CPU path reads the frame from host memory, decode straight into it
+    uint8_t *rgb = env_cpu_isp ? (uint8_t *)buf.addr : rgb_buf.get();
+    if (s->frame->get(stream_frame_id++, rgb, yuv_buf.get())) {
       s->buf.camera_bufs_metadata[buf_idx] = {.frame_id = frame_id};
-      auto &buf = s->buf.camera_bufs[buf_idx];
-      CL_CHECK(clEnqueueWriteBuffer(buf.copy_q, buf.buf_cl, CL_TRUE, 0, s->frame->getRGBSize(), rgb_buf.get(), 0, NULL, NULL));
+      if (!env_cpu_isp) {
+        CL_CHECK(clEnqueueWriteBuffer(buf.copy_q, buf.buf_cl, CL_TRUE, 0, s->frame->getRGBSize(), rgb_buf.get(), 0, NULL, NULL));
+      }
       s->buf.queue(buf_idx);
       ++frame_id;
       buf_idx = (buf_idx + 1) % FRAME_BUF_COUNT;
@@ -78,7 +82,7 @@ void road_camera_thread(CameraState *s) {
 
 void process_road_camera(MultiCameraState *s, CameraState *c, int cnt) {
   const CameraBuf *b = &c->buf;
-  MessageBuilder msg;
+  MessageBuilder msg("roadCameraState");
   auto framed = msg.initEvent().initRoadCameraState();
   fill_frame_data(framed, b->cur_frame_data);
   framed.setImage(kj::arrayPtr((const uint8_t *)b->cur_yuv_buf->addr, b->cur_yuv_buf->len));
@@ -0,0 +1,405 @@
+#include "selfdrive/camerad/cameras/cpu_isp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "selfdrive/common/util.h"
+
+// Runs the tiles of a frame on the calling thread and threads - 1 workers
+class CpuIspPool {
+public:
+  explicit CpuIspPool(int threads) {
+    for (int i = 1; i < threads; i++) {
+      workers.emplace_back(&CpuIspPool::work, this);
+    }
+  }
+
+  ~CpuIspPool() {
+    {
+      std::lock_guard lk(lock);
+      exit = true;
+    }
+    cv.notify_all();
+    for (auto &t : workers) t.join();
+  }
+
+  void run(int num_tiles, const std::function<void(int)> &fn) {
+    if (workers.empty()) {
+      for (int i = 0; i < num_tiles; i++) fn(i);
+      return;
+    }
+    {
+      std::lock_guard lk(lock);
+      job = &fn;
+      tiles = num_tiles;
+      next_tile = 0;
+      busy = workers.size();
+      generation++;
+    }
+    cv.notify_all();
+    run_tiles(fn);
+
+    std::unique_lock lk(lock);
+    done_cv.wait(lk, [&] { return busy == 0; });
+    job = nullptr;
+  }
+
+private:
+  void run_tiles(const std::function<void(int)> &fn) {
+    for (int i = next_tile++; i < tiles; i = next_tile++) {
+      fn(i);
+    }
+  }
+
+  void work() {
+    util::set_thread_name("camerad_cpu_isp");
+    uint64_t seen = 0;
+    while (true) {
+      const std::function<void(int)> *fn;
+      {
+        std::unique_lock lk(lock);
+        cv.wait(lk, [&] { return exit || generation != seen; });
+        if (exit) return;
+        seen = generation;
+        fn = job;
+      }
+      run_tiles(*fn);
+      {
+        std::lock_guard lk(lock);
+        if (--busy == 0) done_cv.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable cv, done_cv;
+  const std::function<void(int)> *job = nullptr;
+  int tiles = 0, busy = 0;
+  std::atomic<int> next_tile = 0;
+  uint64_t generation = 0;
+  bool exit = false;
+};
+
+// convert_uchar_sat: rounds toward zero, NaN is 0
+static inline uint8_t sat_u8(float v) {
+  return v >= 255.0f ? 255 : (v > 0.0f ? (uint8_t)v : 0);
+}
+
+CpuIsp::CpuIsp(const CameraInfo &ci, int camera_num, int rgb_width, int rgb_height, int rgb_stride, bool real_debayer, int threads)
+  : ci(ci), camera_num(camera_num), rgb_width(rgb_width), rgb_height(rgb_height), rgb_stride(rgb_stride), real_debayer(real_debayer) {
+  assert(rgb_width % 2 == 0 && rgb_height % 2 == 0);
+  if (threads <= 0) threads = std::max(1U, std::thread::hardware_concurrency());
+  pool = std::make_unique<CpuIspPool>(threads);
+}
+
+CpuIsp::~CpuIsp() {}
+
+// *** debayer.cl ***
+
+static const float eon_color_correction[3][3] = {
+  // Matrix from WBraw -> sRGBD65 (normalized)
+  { 1.62393627, -0.2092988,  0.00119886},
+  {-0.45734315,  1.5534676, -0.59296798},
+  {-0.16659312, -0.3441688,  1.59176912},
+};
+
+static const int dpcm_lookup[512] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 0, -1, -2, -3, -4, -5, -6, -7, -8, -9, -10, -11, -12, -13, -14, -15, -16, -17, -18, -19, -20, -21, -22, -23, -24, -25, -26, -27, -28, -29, -30, -31, 935, 951, 967, 983, 999, 1015, 1031, 1047, 1063, 1079, 1095, 1111, 1127, 1143, 1159, 1175, 1191, 1207, 1223, 1239, 1255, 1271, 1287, 1303, 1319, 1335, 1351, 1367, 1383, 1399, 1415, 1431, -935, -951, -967, -983, -999, -1015, -1031, -1047, -1063, -1079, -1095, -1111, -1127, -1143, -1159, -1175, -1191, -1207, -1223, -1239, -1255, -1271, -1287, -1303, -1319, -1335, -1351, -1367, -1383, -1399, -1415, -1431, 419, 427, 435, 443, 451, 459, 467, 475, 483, 491, 499, 507, 515, 523, 531, 539, 547, 555, 563, 571, 579, 587, 595, 603, 611, 619, 627, 635, 643, 651, 659, 667, 675, 683, 691, 699, 707, 715, 723, 731, 739, 747, 755, 763, 771, 779, 787, 795, 803, 811, 819, 827, 835, 843, 851, 859, 867, 875, 883, 891, 899, 907, 915, 923, -419, -427, -435, -443, -451, -459, -467, -475, -483, -491, -499, -507, -515, -523, -531, -539, -547, -555, -563, -571, -579, -587, -595, -603, -611, -619, -627, -635, -643, -651, -659, -667, -675, -683, -691, -699, -707, -715, -723, -731, -739, -747, -755, -763, -771, -779, -787, -795, -803, -811, -819, -827, -835, -843, -851, -859, -867, -875, -883, -891, -899, -907, -915, -923, 161, 165, 169, 173, 177, 181, 185, 189, 193, 197, 201, 205, 209, 213, 217, 221, 225, 229, 233, 237, 241, 245, 249, 253, 257, 261, 265, 269, 273, 277, 281, 285, 289, 293, 297, 301, 305, 309, 313, 317, 321, 325, 329, 333, 337, 341, 345, 349, 353, 357, 361, 365, 369, 373, 377, 381, 385, 389, 393, 397, 401, 405, 409, 413, -161, -165, -169, -173, -177, -181, -185, -189, -193, -197, -201, -205, -209, -213, -217, -221, -225, -229, -233, -237, -241, -245, -249, -253, -257, -261, -265, -269, -273, -277, -281, -285, -289, -293, -297, -301, -305, -309, -313, -317, -321, -325, -329, -333, -337, -341, -345, -349, -353, -357, -361, -365, -369, -373, -377, -381, -385, -389, -393, -397, -401, -405, -409, -413, 32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62, 64, 66, 68, 70, 72, 74, 76, 78, 80, 82, 84, 86, 88, 90, 92, 94, 96, 98, 100, 102, 104, 106, 108, 110, 112, 114, 116, 118, 120, 122, 124, 126, 128, 130, 132, 134, 136, 138, 140, 142, 144, 146, 148, 150, 152, 154, 156, 158, -32, -34, -36, -38, -40, -42, -44, -46, -48, -50, -52, -54, -56, -58, -60, -62, -64, -66, -68, -70, -72, -74, -76, -78, -80, -82, -84, -86, -88, -90, -92, -94, -96, -98, -100, -102, -104, -106, -108, -110, -112, -114, -116, -118, -120, -122, -124, -126, -128, -130, -132, -134, -136, -138, -140, -142, -144, -146, -148, -150, -152, -154, -156, -158};
+
+static inline uint32_t decompress(uint32_t p, uint32_t pl) {
+  if (p < 0x200) return pl + dpcm_lookup[p];
+  uint32_t r2 = ((p - 0x200) << 5) | 0xF;
+  return r2 + (r2 <= pl ? 1 : 0);
+}
+
+static inline float srgb_gamma(float p) {
+  return p <= 0.0031308f ? p * 12.92f : (1.0f + 0.055f) * powf(p, 1 / 2.4f) - 0.055f;
+}
+
+void CpuIsp::debayer_rows(const uint8_t *frame, uint8_t *rgb, float gain, int row_start, int row_end) const {
+  // 56 is the black level of the sensor, 64 without HDR
+  const float black_level = 56.0f;
+  const float white_level = ci.hdr ? 16384.0f : 1024.0f;
+  const float wb[3] = {0.4609375, 1.0, 0.546875};
+
+  for (int oy = row_start; oy < row_end; oy++) {
+    const uint8_t *l1 = frame + (oy * 2) * ci.frame_stride;
+    const uint8_t *l2 = l1 + ci.frame_stride;
+    uint32_t pint_last[4] = {};
+
+    for (int ox = 0; ox < rgb_width; ox += 2) {
+      const uint8_t *v1 = l1 + (ox / 2) * 5, *v2 = l2 + (ox / 2) * 5;
+      const uint8_t ex1 = v1[4], ex2 = v2[4];
+      uint32_t pinta[2][4] = {
+        {((uint32_t)v1[0] << 2) + ((ex1 >> 0) & 3), ((uint32_t)v1[1] << 2) + ((ex1 >> 2) & 3),
+         ((uint32_t)v2[0] << 2) + ((ex2 >> 0) & 3), ((uint32_t)v2[1] << 2) + ((ex2 >> 2) & 3)},
+        {((uint32_t)v1[2] << 2) + ((ex1 >> 4) & 3), ((uint32_t)v1[3] << 2) + ((ex1 >> 6) & 3),
+         ((uint32_t)v2[2] << 2) + ((ex2 >> 4) & 3), ((uint32_t)v2[3] << 2) + ((ex2 >> 6) & 3)},
+      };
+
+      // vignetting, the same for both pixels
+      const float r = ((oy - rgb_height/2)*(oy - rgb_height/2) + (ox - rgb_width/2)*(ox - rgb_width/2));
+      const float lil_a = 1.0f + r / (700.0f * 700.0f);
+
+      for (int px = 0; px < 2; px++) {
+        uint32_t *pint = pinta[px];
+        if (ci.hdr) {
+          for (int i = 0; i < 4; i++) {
+            pint[i] = (ox == 0 && px == 0) ? ((pint[i] << 4) | 8) : decompress(pint[i], pint_last[i]);
+            pint_last[i] = pint[i];
+          }
+        }
+
+        float p[4];
+        for (int i = 0; i < 4; i++) {
+          p[i] = ((float)pint[i] - black_level) * lil_a * lil_a / (white_level - black_level) * gain;
+        }
+
+        // use both green channels
+        float c1[3];
+        switch (ci.bayer_flip) {
+          case 3: c1[0] = p[3]; c1[1] = (p[1] + p[2]) / 2.0f; c1[2] = p[0]; break;
+          case 2: c1[0] = p[2]; c1[1] = (p[0] + p[3]) / 2.0f; c1[2] = p[1]; break;
+          case 1: c1[0] = p[1]; c1[1] = (p[0] + p[3]) / 2.0f; c1[2] = p[2]; break;
+          default: c1[0] = p[0]; c1[1] = (p[1] + p[2]) / 2.0f; c1[2] = p[3]; break;
+        }
+
+        // white balance and color correction
+        float out[3] = {};
+        for (int i = 0; i < 3; i++) {
+          const float x = std::clamp(c1[i] / wb[i], 0.0f, 1.0f);
+          for (int j = 0; j < 3; j++) out[j] += x * eon_color_correction[i][j];
+        }
+        if (ci.hdr) {
+          for (float &c : out) c = srgb_gamma(c);
+        }
+
+        // output BGR
+        uint8_t *o = rgb + 3 * (oy * rgb_stride / 3 + ox + px);
+        o[0] = sat_u8(out[2] * 255.0f);
+        o[1] = sat_u8(out[1] * 255.0f);
+        o[2] = sat_u8(out[0] * 255.0f);
+      }
+    }
+  }
+}
+
+// *** real_debayer.cl ***
+
+static const float tici_color_correction[3][3] = {
+  // post wb CCM
+  {1.82717181, -0.31231438, 0.07307673},
+  {-0.5743977, 1.36858544, -0.53183455},
+  {-0.25277411, -0.05627105, 1.45875782},
+};
+
+// tone mapping curve of real_debayer.cl, mf(x, 0.01)
+static inline float tone_map(float x) {
+  constexpr float cpk = 0.75f, cpb = 0.125f, cp = 0.01f;
+  constexpr float rk = 9 - 100 * cp;
+  constexpr float mid = cpk * cp + cpb;
+  constexpr float hi = (1 - mid) * (1 + 1 / (rk * (1 - cp)));
+  constexpr float lo = mid * (1 + 1 / (rk * cp));
+  const float d = rk * (x - cp);
+  return x > cp ? d * hi / (1 + d) + mid : (x < cp ? d * lo / (1 - d) + mid : x);
+}
+
+static inline void store_tici_bgr(float r, float g, float b, uint8_t *o) {
+  // clamp(0, 1, x) in the kernel only limits from above
+  r = std::min(r, 1.0f);
+  g = std::min(g, 1.0f);
+  b = std::min(b, 1.0f);
+  const float (&cc)[3][3] = tici_color_correction;
+  o[0] = sat_u8(tone_map(r * cc[0][2] + g * cc[1][2] + b * cc[2][2]) * 255.0f);
+  o[1] = sat_u8(tone_map(r * cc[0][1] + g * cc[1][1] + b * cc[2][1]) * 255.0f);
+  o[2] = sat_u8(tone_map(r * cc[0][0] + g * cc[1][0] + b * cc[2][0]) * 255.0f);
+}
+
+static inline float phi(float x) {
+  return 2.0f - x;
+}
+
+// Normalized, vignetting corrected values of one raw row, split into even and odd columns
+static void unpack_row(const uint8_t *frame, const CameraInfo &ci, bool vignetting, int width, int height, int gy, float *even, float *odd) {
+  const uint8_t *src = frame + gy * ci.frame_stride;
+  const float gy2 = float((gy - height / 2) * (gy - height / 2));
+  for (int x = 0; x < width; x++) {
+    const uint8_t *group = src + 5 * (x / 4);
+    const int offset = x % 4;
+    float pv = (float)(((uint32_t)group[offset] << 2) + ((group[4] >> (2 * offset)) & 3));
+    pv = std::max(0.0f, pv - 42.0f) * 0.00101833f;
+
+    if (vignetting) {
+      const float gx = x - width / 2;
+      const float r = gx * gx + gy2;
+      float s;
+      if (r < 62500) {
+        s = 1.0f + 0.0000008f * r;
+      } else if (r < 490000) {
+        s = 0.9625f + 0.0000014f * r;
+      } else if (r < 1102500) {
+        s = 1.26434f + 0.0000000000016f * r * r;
+      } else {
+        s = 0.53503625f + 0.0000000000022f * r * r;
+      }
+      pv *= s;
+    }
+    (x % 2 == 0 ? even : odd)[x / 2] = std::min(pv, 1.0f);
+  }
+}
+
+// Interpolates one row of a GRBG pattern. Even rows have green at even columns and red at
+// odd ones, odd rows blue at even columns and green at odd ones.
+// u, m and d are the rows above, at and below, split into even (e) and odd (o) columns
+template <bool EVEN_ROW>
+static void demosaic_row(const float *ue, const float *uo, const float *me, const float *mo, const float *de, const float *dn,
+                         int half_width, uint8_t *out) {
+  // even columns, x = 2k
+  for (int k = 1; k < half_width; k++) {
+    const float pv = me[k];
+    const float d1 = uo[k - 1], d2 = uo[k], d3 = dn[k - 1], d4 = dn[k];
+    const float n1 = ue[k], n2 = mo[k], n3 = de[k], n4 = mo[k - 1];
+    float r, g, b;
+    if (EVEN_ROW) {
+      g = pv;
+      const float k1 = phi(fabsf(d1 - pv) + fabsf(d2 - pv));
+      const float k2 = phi(fabsf(d2 - pv) + fabsf(d4 - pv));
+      const float k3 = phi(fabsf(d3 - pv) + fabsf(d4 - pv));
+      const float k4 = phi(fabsf(d1 - pv) + fabsf(d3 - pv));
+      r = (k2 * n2 + k4 * n4) / (k2 + k4);
+      b = (k1 * n1 + k3 * n3) / (k1 + k3);
+    } else {
+      b = pv;
+      const float k1 = phi(fabsf(d1 - d3) + fabsf(d2 - d4));
+      const float k2 = phi(fabsf(n1 - n4) + fabsf(n2 - n3));
+      const float k3 = phi(fabsf(d1 - d2) + fabsf(d3 - d4));
+      const float k4 = phi(fabsf(n1 - n2) + fabsf(n3 - n4));
+      g = (k1 * (n1 + n3) * 0.5f + k3 * (n2 + n4) * 0.5f) / (k1 + k3);
+      r = (k2 * (d2 + d3) * 0.5f + k4 * (d1 + d4) * 0.5f) / (k2 + k4);
+    }
+    store_tici_bgr(r, g, b, out + 3 * (2 * k));
+  }
+
+  // odd columns, x = 2k + 1
+  for (int k = 0; k < half_width - 1; k++) {
+    const float pv = mo[k];
+    const float d1 = ue[k], d2 = ue[k + 1], d3 = de[k], d4 = de[k + 1];
+    const float n1 = uo[k], n2 = me[k + 1], n3 = dn[k], n4 = me[k];
+    float r, g, b;
+    if (EVEN_ROW) {
+      r = pv;
+      const float k1 = phi(fabsf(d1 - d3) + fabsf(d2 - d4));
+      const float k2 = phi(fabsf(n1 - n4) + fabsf(n2 - n3));
+      const float k3 = phi(fabsf(d1 - d2) + fabsf(d3 - d4));
+      const float k4 = phi(fabsf(n1 - n2) + fabsf(n3 - n4));
+      g = (k1 * (n1 + n3) * 0.5f + k3 * (n2 + n4) * 0.5f) / (k1 + k3);
+      b = (k2 * (d2 + d3) * 0.5f + k4 * (d1 + d4) * 0.5f) / (k2 + k4);
+    } else {
+      g = pv;
+      const float k1 = phi(fabsf(d1 - pv) + fabsf(d2 - pv));
+      const float k2 = phi(fabsf(d2 - pv) + fabsf(d4 - pv));
+      const float k3 = phi(fabsf(d3 - pv) + fabsf(d4 - pv));
+      const float k4 = phi(fabsf(d1 - pv) + fabsf(d3 - pv));
+      r = (k1 * n1 + k3 * n3) / (k1 + k3);
+      b = (k2 * n2 + k4 * n4) / (k2 + k4);
+    }
+    store_tici_bgr(r, g, b, out + 3 * (2 * k + 1));
+  }
+}
+
+void CpuIsp::real_debayer_rows(const uint8_t *frame, uint8_t *rgb, int row_start, int row_end) const {
+  // like the kernel, the one pixel border is left as it is
+  row_start = std::max(row_start, 1);
+  row_end = std::min(row_end, rgb_height - 1);
+  if (row_start >= row_end) return;
+
+  // three rows of even and odd columns, rolled down the band
+  const int half_width = rgb_width / 2;
+  thread_local std::vector<float> buf;
+  buf.resize(6 * half_width);
+  float *rows[3][2];
+  for (int i = 0; i < 3; i++) {
+    rows[i][0] = &buf[(2 * i) * half_width];
+    rows[i][1] = &buf[(2 * i + 1) * half_width];
+  }
+
+  const bool vignetting = camera_num == 1;
+  unpack_row(frame, ci, vignetting, rgb_width, rgb_height, row_start - 1, rows[0][0], rows[0][1]);
+  unpack_row(frame, ci, vignetting, rgb_width, rgb_height, row_start, rows[1][0], rows[1][1]);
+  for (int y = row_start; y < row_end; y++) {
+    float **u = rows[(y - row_start) % 3], **m = rows[(y - row_start + 1) % 3], **d = rows[(y - row_start + 2) % 3];
+    unpack_row(frame, ci, vignetting, rgb_width, rgb_height, y + 1, d[0], d[1]);
+
+    uint8_t *out = rgb + 3 * y * rgb_width;
+    if (y % 2 == 0) {
+      demosaic_row<true>(u[0], u[1], m[0], m[1], d[0], d[1], half_width, out);
+    } else {
+      demosaic_row<false>(u[0], u[1], m[0], m[1], d[0], d[1], half_width, out);
+    }
+  }
+}
+
+void CpuIsp::debayer(const uint8_t *frame, uint8_t *rgb, float gain) {
+  const int band = 32;
+  pool->run((rgb_height + band - 1) / band, [&](int i) {
+    const int start = i * band, end = std::min(start + band, rgb_height);
+    if (real_debayer) {
+      real_debayer_rows(frame, rgb, start, end);
+    } else {
+      debayer_rows(frame, rgb, gain, start, end);
+    }
+  });
+}
+
+// *** rgb_to_yuv.cl ***
+
+static inline uint8_t rgb_to_y(int r, int g, int b) {
+  return (((b * 13 + g * 65 + r * 33) + 64) >> 7) + 16;
+}
+
+// r, g and b are sums of 2x2 pixels halved, twice the average
+static inline uint8_t rgb_to_u(int r, int g, int b) {
+  return (b * 56 - g * 37 - r * 19 + 0x8080) >> 8;
+}
+
+static inline uint8_t rgb_to_v(int r, int g, int b) {
+  return (r * 56 - g * 47 - b * 9 + 0x8080) >> 8;
+}
+
+void CpuIsp::rgb_to_yuv_rows(const uint8_t *rgb, uint8_t *yuv, int row_start, int row_end) const {
+  const int uv_width = rgb_width / 2;
+  for (int row = row_start; row < row_end; row += 2) {
+    const uint8_t *p0 = rgb + row * rgb_stride, *p1 = p0 + rgb_stride;
+    uint8_t *y0 = yuv + row * rgb_width, *y1 = y0 + rgb_width;
+    uint8_t *u = yuv + rgb_width * rgb_height + (row / 2) * uv_width;
+    uint8_t *v = u + uv_width * (rgb_height / 2);
+    for (int x = 0; x < uv_width; x++) {
+      const uint8_t *a = p0 + 6 * x, *b = p1 + 6 * x;
+      y0[2 * x] = rgb_to_y(a[2], a[1], a[0]);
+      y0[2 * x + 1] = rgb_to_y(a[5], a[4], a[3]);
+      y1[2 * x] = rgb_to_y(b[2], b[1], b[0]);
+      y1[2 * x + 1] = rgb_to_y(b[5], b[4], b[3]);
+
+      const int ab = (a[0] + a[3] + b[0] + b[3] + 1) >> 1;
+      const int ag = (a[1] + a[4] + b[1] + b[4] + 1) >> 1;
+      const int ar = (a[2] + a[5] + b[2] + b[5] + 1) >> 1;
+      u[x] = rgb_to_u(ar, ag, ab);
+      v[x] = rgb_to_v(ar, ag, ab);
+    }
+  }
+}
+
+void CpuIsp::rgb_to_yuv(const uint8_t *rgb, uint8_t *yuv) {
+  const int band = 32;
+  pool->run((rgb_height + band - 1) / band, [&](int i) {
+    const int start = i * band;
+    rgb_to_yuv_rows(rgb, yuv, start, std::min(start + band, rgb_height));
+  });
+}
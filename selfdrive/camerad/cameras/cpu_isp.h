@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "selfdrive/camerad/cameras/camera_common.h"
+
+class CpuIspPool;
+
+// CPU versions of debayer.cl, real_debayer.cl and rgb_to_yuv.cl for running camerad without
+// a usable OpenCL GPU, enabled with CPU_ISP=1. They follow the kernels' math, frames are
+// split into bands of rows that are processed by a pool of threads.
+// real_debayer.cl computes in half precision, so its CPU version can be a few levels off
+// Not compared against the kernels on a GPU yet, cpu_isp_test has to pass on one before
+// CPU_ISP is used for anything but development
+class CpuIsp {
+public:
+  // threads = 0 uses one thread per core
+  CpuIsp(const CameraInfo &ci, int camera_num, int rgb_width, int rgb_height, int rgb_stride, bool real_debayer, int threads = 0);
+  ~CpuIsp();
+
+  // raw 10 bit bayer frame -> BGR, like Debayer::queue
+  void debayer(const uint8_t *frame, uint8_t *rgb, float gain);
+  // BGR -> yuv420, like Rgb2Yuv::queue
+  void rgb_to_yuv(const uint8_t *rgb, uint8_t *yuv);
+
+private:
+  void debayer_rows(const uint8_t *frame, uint8_t *rgb, float gain, int row_start, int row_end) const;
+  void real_debayer_rows(const uint8_t *frame, uint8_t *rgb, int row_start, int row_end) const;
+  void rgb_to_yuv_rows(const uint8_t *rgb, uint8_t *yuv, int row_start, int row_end) const;
+
+  CameraInfo ci;
+  int camera_num;
+  int rgb_width, rgb_height, rgb_stride;
+  bool real_debayer;
+  std::unique_ptr<CpuIspPool> pool;
+};
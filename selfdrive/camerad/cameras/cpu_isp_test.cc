@@ -0,0 +1,250 @@
+// Checks the CPU debayer and rgb to yuv against debayer.cl, real_debayer.cl and rgb_to_yuv.cl,
+// and times both. Run from selfdrive/camerad. rgb_to_yuv is exact, real_debayer.cl computes
+// in half precision so a few of its pixels are allowed to be off by more than a level.
+// On TICI it also checks the fused debayer10_yuv kernel against the two kernels it replaces
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "selfdrive/camerad/cameras/cpu_isp.h"
+#include "selfdrive/camerad/transforms/rgb_to_yuv.h"
+#include "selfdrive/common/clutil.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+
+constexpr int ITERATIONS = 20;
+
+// fraction of real_debayer pixels allowed to be off by more than MAX_HALF_DIFF
+constexpr double MAX_HALF_MISMATCH = 1e-2;
+constexpr int MAX_HALF_DIFF = 4;
+
+struct Frame {
+  CameraInfo ci;
+  int camera_num;
+  bool real_debayer;
+};
+
+// the build options, kernel arguments and work sizes of camerad's Debayer
+static cl_kernel cl_debayer_kernel(cl_device_id device_id, cl_context context, const Frame &f, int rgb_width, int rgb_height, int rgb_stride,
+                                   const char *name = "debayer10") {
+  char args[4096];
+  snprintf(args, sizeof(args),
+           "-cl-fast-relaxed-math -cl-denorms-are-zero "
+           "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d "
+           "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DRGB_STRIDE=%d "
+           "-DBAYER_FLIP=%d -DHDR=%d -DCAM_NUM=%d "
+           "-DRGB_SIZE=%d -DUV_WIDTH=%d -DUV_HEIGHT=%d",
+           f.ci.frame_width, f.ci.frame_height, f.ci.frame_stride, rgb_width, rgb_height, rgb_stride,
+           f.ci.bayer_flip, f.ci.hdr, f.camera_num, rgb_width * rgb_height, rgb_width / 2, rgb_height / 2);
+  std::string src = util::read_file(f.real_debayer ? "cameras/real_debayer.cl" : "cameras/debayer.cl");
+  if (strcmp(name, "debayer10_yuv") == 0) {
+    src += util::read_file("cameras/real_debayer_yuv.cl");
+  }
+  cl_program prg = cl_program_from_source(context, device_id, src, args);
+  cl_kernel krnl = CL_CHECK_ERR(clCreateKernel(prg, name, &err));
+  CL_CHECK(clReleaseProgram(prg));
+  return krnl;
+}
+
+static void cl_debayer(cl_command_queue q, cl_kernel krnl, const Frame &f, int rgb_width, int rgb_height, cl_mem frame_cl, cl_mem rgb_cl, float gain) {
+  CL_CHECK(clSetKernelArg(krnl, 0, sizeof(cl_mem), &frame_cl));
+  CL_CHECK(clSetKernelArg(krnl, 1, sizeof(cl_mem), &rgb_cl));
+  if (f.real_debayer) {
+    const int local_worksize = 16;
+    const size_t global_work_size[] = {size_t(rgb_width), size_t(rgb_height)};
+    const size_t local_work_size[] = {local_worksize, local_worksize};
+    CL_CHECK(clSetKernelArg(krnl, 2, (local_worksize + 2) * (local_worksize + 2) * sizeof(short int), 0));
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, global_work_size, local_work_size, 0, 0, NULL));
+  } else if (f.ci.hdr) {
+    const size_t local_worksize = 128, work_size = rgb_height;
+    CL_CHECK(clSetKernelArg(krnl, 2, sizeof(float), &gain));
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 1, NULL, &work_size, &local_worksize, 0, 0, NULL));
+  } else {
+    const size_t global_work_size[] = {size_t(rgb_height), size_t(rgb_width / 2)};
+    const size_t local_work_size[] = {32, 32};
+    CL_CHECK(clSetKernelArg(krnl, 2, sizeof(float), &gain));
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, global_work_size, local_work_size, 0, 0, NULL));
+  }
+  CL_CHECK(clFinish(q));
+}
+
+// debayer10_yuv leaves out the second pass over rgb and fills the border, so the interior
+// has to match debayer10 and rgb_to_yuv exactly
+static bool test_fused(cl_device_id device_id, cl_context context, cl_command_queue q, const Frame &f, cl_mem frame_cl,
+                       const std::vector<uint8_t> &cl_rgb, const std::vector<uint8_t> &cl_yuv, double two_pass_ms) {
+  const int width = f.ci.frame_width, height = f.ci.frame_height, stride = width * 3;
+  const size_t rgb_size = stride * height, yuv_size = width * height * 3 / 2;
+  const ExposureRoi roi = {96, width - 96, 2, 160, height - 62, 2};
+
+  cl_kernel krnl = cl_debayer_kernel(device_id, context, f, width, height, stride, "debayer10_yuv");
+  cl_mem rgb_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, rgb_size, NULL, &err));
+  cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, yuv_size, NULL, &err));
+  cl_mem hist_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, 256 * sizeof(uint32_t), NULL, &err));
+
+  const int local_worksize = 16;
+  CL_CHECK(clSetKernelArg(krnl, 0, sizeof(cl_mem), &frame_cl));
+  CL_CHECK(clSetKernelArg(krnl, 1, sizeof(cl_mem), &rgb_cl));
+  CL_CHECK(clSetKernelArg(krnl, 2, sizeof(cl_mem), &yuv_cl));
+  CL_CHECK(clSetKernelArg(krnl, 3, (2 * local_worksize + 2) * (2 * local_worksize + 2) * sizeof(short int), 0));
+  CL_CHECK(clSetKernelArg(krnl, 4, sizeof(cl_mem), &hist_cl));
+  const int roi_args[] = {roi.x_start, roi.x_end, roi.x_skip, roi.y_start, roi.y_end, roi.y_skip};
+  for (int i = 0; i < std::size(roi_args); i++) {
+    CL_CHECK(clSetKernelArg(krnl, 5 + i, sizeof(int), &roi_args[i]));
+  }
+
+  std::vector<uint8_t> rgb(rgb_size), yuv(yuv_size);
+  std::vector<uint32_t> hist(256);
+  const size_t global_work_size[] = {size_t(width / 2), size_t(height / 2)};
+  const size_t local_work_size[] = {local_worksize, local_worksize};
+  const uint32_t zero = 0;
+  double t1 = millis_since_boot();
+  for (int i = 0; i < ITERATIONS; i++) {
+    CL_CHECK(clEnqueueFillBuffer(q, hist_cl, &zero, sizeof(zero), 0, 256 * sizeof(uint32_t), 0, NULL, NULL));
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL, global_work_size, local_work_size, 0, 0, NULL));
+    CL_CHECK(clEnqueueReadBuffer(q, hist_cl, CL_TRUE, 0, 256 * sizeof(uint32_t), hist.data(), 0, NULL, NULL));
+  }
+  double fused_ms = (millis_since_boot() - t1) / ITERATIONS;
+  CL_CHECK(clEnqueueReadBuffer(q, rgb_cl, CL_TRUE, 0, rgb_size, rgb.data(), 0, NULL, NULL));
+  CL_CHECK(clEnqueueReadBuffer(q, yuv_cl, CL_TRUE, 0, yuv_size, yuv.data(), 0, NULL, NULL));
+
+  int rgb_mismatch = 0, yuv_mismatch = 0, hist_mismatch = 0;
+  for (int y = 1; y < height - 1; y++) {
+    for (int x = 1; x < width - 1; x++) {
+      for (int c = 0; c < 3; c++) rgb_mismatch += rgb[y * stride + x * 3 + c] != cl_rgb[y * stride + x * 3 + c];
+      yuv_mismatch += yuv[y * width + x] != cl_yuv[y * width + x];
+    }
+  }
+  const int uv_width = width / 2, uv_height = height / 2;
+  for (int y = 1; y < uv_height - 1; y++) {
+    for (int x = 1; x < uv_width - 1; x++) {
+      for (int plane = 0; plane < 2; plane++) {
+        const int i = width * height + plane * uv_width * uv_height + y * uv_width + x;
+        yuv_mismatch += yuv[i] != cl_yuv[i];
+      }
+    }
+  }
+
+  std::vector<uint32_t> expected_hist(256);
+  for (int y = roi.y_start; y < roi.y_end; y += roi.y_skip) {
+    for (int x = roi.x_start; x < roi.x_end; x += roi.x_skip) expected_hist[yuv[y * width + x]]++;
+  }
+  for (int i = 0; i < 256; i++) hist_mismatch += hist[i] != expected_hist[i];
+
+  bool ok = rgb_mismatch == 0 && yuv_mismatch == 0 && hist_mismatch == 0;
+  printf("%4dx%-4d cam %d fused %.2f ms (%d rgb, %d yuv, %d histogram mismatches)  two pass %.2f ms  %s\n",
+         width, height, f.camera_num, fused_ms, rgb_mismatch, yuv_mismatch, hist_mismatch, two_pass_ms, ok ? "ok" : "FAIL");
+
+  CL_CHECK(clReleaseMemObject(hist_cl));
+  CL_CHECK(clReleaseMemObject(yuv_cl));
+  CL_CHECK(clReleaseMemObject(rgb_cl));
+  CL_CHECK(clReleaseKernel(krnl));
+  return ok;
+}
+
+static bool test_frame(cl_device_id device_id, cl_context context, const Frame &f) {
+  const int rgb_width = f.real_debayer ? f.ci.frame_width : f.ci.frame_width / 2;
+  const int rgb_height = f.real_debayer ? f.ci.frame_height : f.ci.frame_height / 2;
+  const int rgb_stride = rgb_width * 3;
+  const size_t frame_size = f.ci.frame_stride * f.ci.frame_height;
+  const size_t rgb_size = rgb_stride * rgb_height, yuv_size = rgb_width * rgb_height * 3 / 2;
+  const float gain = 1.5;
+
+  std::vector<uint8_t> frame(frame_size);
+  std::mt19937 gen(f.ci.frame_width + f.camera_num + f.ci.hdr);
+  std::uniform_int_distribution<int> dist(0, 255);
+  for (auto &p : frame) p = dist(gen);
+
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+  cl_mem frame_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, frame_size, frame.data(), &err));
+  cl_mem rgb_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, rgb_size, NULL, &err));
+  cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, yuv_size, NULL, &err));
+  cl_kernel debayer_krnl = cl_debayer_kernel(device_id, context, f, rgb_width, rgb_height, rgb_stride);
+  Rgb2Yuv rgb2yuv(context, device_id, rgb_width, rgb_height, rgb_stride);
+
+  // the border real_debayer.cl leaves alone
+  std::vector<uint8_t> cl_rgb(rgb_size, 0), cl_yuv(yuv_size);
+  CL_CHECK(clEnqueueWriteBuffer(q, rgb_cl, CL_TRUE, 0, rgb_size, cl_rgb.data(), 0, NULL, NULL));
+
+  double t1 = millis_since_boot();
+  for (int i = 0; i < ITERATIONS; i++) {
+    cl_debayer(q, debayer_krnl, f, rgb_width, rgb_height, frame_cl, rgb_cl, gain);
+    rgb2yuv.queue(q, rgb_cl, yuv_cl);
+  }
+  double cl_ms = (millis_since_boot() - t1) / ITERATIONS;
+  CL_CHECK(clEnqueueReadBuffer(q, rgb_cl, CL_TRUE, 0, rgb_size, cl_rgb.data(), 0, NULL, NULL));
+  CL_CHECK(clEnqueueReadBuffer(q, yuv_cl, CL_TRUE, 0, yuv_size, cl_yuv.data(), 0, NULL, NULL));
+
+  bool pass = true;
+  for (int threads : {1, 0}) {
+    CpuIsp isp(f.ci, f.camera_num, rgb_width, rgb_height, rgb_stride, f.real_debayer, threads);
+    std::vector<uint8_t> rgb(rgb_size, 0), yuv(yuv_size), yuv_from_cl(yuv_size);
+
+    t1 = millis_since_boot();
+    for (int i = 0; i < ITERATIONS; i++) {
+      isp.debayer(frame.data(), rgb.data(), gain);
+    }
+    double t2 = millis_since_boot();
+    for (int i = 0; i < ITERATIONS; i++) {
+      isp.rgb_to_yuv(rgb.data(), yuv.data());
+    }
+    double t3 = millis_since_boot();
+
+    int max_diff = 0, mismatch = 0;
+    for (size_t i = 0; i < rgb_size; i++) {
+      int diff = std::abs(rgb[i] - cl_rgb[i]);
+      max_diff = std::max(max_diff, diff);
+      mismatch += diff > (f.real_debayer ? MAX_HALF_DIFF : 1);
+    }
+
+    // rgb to yuv is exact, compare it on the OpenCL debayer output
+    isp.rgb_to_yuv(cl_rgb.data(), yuv_from_cl.data());
+    int yuv_mismatch = 0;
+    for (size_t i = 0; i < yuv_size; i++) yuv_mismatch += yuv_from_cl[i] != cl_yuv[i];
+
+    bool ok = (f.real_debayer ? mismatch <= MAX_HALF_MISMATCH * rgb_size : mismatch == 0) && yuv_mismatch == 0;
+    printf("%4dx%-4d cam %d hdr %d threads %-2d debayer %.2f ms (max diff %d, %d off)  rgb_to_yuv %.2f ms (%d mismatches)  opencl %.2f ms  %s\n",
+           f.ci.frame_width, f.ci.frame_height, f.camera_num, f.ci.hdr, threads, (t2 - t1) / ITERATIONS, max_diff, mismatch,
+           (t3 - t2) / ITERATIONS, yuv_mismatch, cl_ms, ok ? "ok" : "FAIL");
+    pass = pass && ok;
+  }
+
+  if (f.real_debayer) {
+    pass = test_fused(device_id, context, q, f, frame_cl, cl_rgb, cl_yuv, cl_ms) && pass;
+  }
+
+  CL_CHECK(clReleaseKernel(debayer_krnl));
+  CL_CHECK(clReleaseMemObject(yuv_cl));
+  CL_CHECK(clReleaseMemObject(rgb_cl));
+  CL_CHECK(clReleaseMemObject(frame_cl));
+  CL_CHECK(clReleaseCommandQueue(q));
+  return pass;
+}
+
+int main() {
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+
+  const Frame frames[] = {
+    // EON road and driver cameras
+    {{.frame_width = 2328, .frame_height = 1748, .frame_stride = 2912, .bayer = true, .bayer_flip = 0, .hdr = false}, 0, false},
+    {{.frame_width = 2328, .frame_height = 1748, .frame_stride = 2912, .bayer = true, .bayer_flip = 3, .hdr = true}, 1, false},
+    // TICI road and driver cameras, only the road camera corrects vignetting
+    {{.frame_width = 1928, .frame_height = 1208, .frame_stride = 2416, .bayer = true, .bayer_flip = 0, .hdr = false}, 1, true},
+    {{.frame_width = 1928, .frame_height = 1208, .frame_stride = 2416, .bayer = true, .bayer_flip = 0, .hdr = false}, 2, true},
+  };
+  bool pass = true;
+  for (const Frame &f : frames) {
+    pass = test_frame(device_id, context, f) && pass;
+  }
+
+  CL_CHECK(clReleaseContext(context));
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// Fused debayer, rgb to yuv and exposure histogram. Only built with FUSED_ISP, appended to
+// real_debayer.cl, whose helpers it uses
+
+// the demosaic, color correction and tone mapping of debayer10 for the pixel at cached[offset], returns BGR
+uchar3 debayer_pixel(const __local half * cached, int offset, int row_len, int x, int y) {
+  const half pv = cached[offset];
+  half d1 = cached[offset - row_len - 1];
+  half d2 = cached[offset - row_len + 1];
+  half d3 = cached[offset + row_len - 1];
+  half d4 = cached[offset + row_len + 1];
+  half n1 = cached[offset - row_len];
+  half n2 = cached[offset + 1];
+  half n3 = cached[offset + row_len];
+  half n4 = cached[offset - 1];
+
+  half3 rgb;
+
+  // a simplified version of https://opensignalprocessingjournal.com/contents/volumes/V6/TOSIGPJ-6-1/TOSIGPJ-6-1.pdf
+  if (x % 2 == 0) {
+    if (y % 2 == 0) {
+      rgb.y = pv; // G1(R)
+      half k1 = phi(fabs_diff(d1, pv) + fabs_diff(d2, pv));
+      half k2 = phi(fabs_diff(d2, pv) + fabs_diff(d4, pv));
+      half k3 = phi(fabs_diff(d3, pv) + fabs_diff(d4, pv));
+      half k4 = phi(fabs_diff(d1, pv) + fabs_diff(d3, pv));
+      // R_G1
+      rgb.x = (k2*n2+k4*n4)/(k2+k4);
+      // B_G1
+      rgb.z = (k1*n1+k3*n3)/(k1+k3);
+    } else {
+      rgb.z = pv; // B
+      half k1 = phi(fabs_diff(d1, d3) + fabs_diff(d2, d4));
+      half k2 = phi(fabs_diff(n1, n4) + fabs_diff(n2, n3));
+      half k3 = phi(fabs_diff(d1, d2) + fabs_diff(d3, d4));
+      half k4 = phi(fabs_diff(n1, n2) + fabs_diff(n3, n4));
+      // G_B
+      rgb.y = (k1*(n1+n3)*0.5+k3*(n2+n4)*0.5)/(k1+k3);
+      // R_B
+      rgb.x = (k2*(d2+d3)*0.5+k4*(d1+d4)*0.5)/(k2+k4);
+    }
+  } else {
+    if (y % 2 == 0) {
+      rgb.x = pv; // R
+      half k1 = phi(fabs_diff(d1, d3) + fabs_diff(d2, d4));
+      half k2 = phi(fabs_diff(n1, n4) + fabs_diff(n2, n3));
+      half k3 = phi(fabs_diff(d1, d2) + fabs_diff(d3, d4));
+      half k4 = phi(fabs_diff(n1, n2) + fabs_diff(n3, n4));
+      // G_R
+      rgb.y = (k1*(n1+n3)*0.5+k3*(n2+n4)*0.5)/(k1+k3);
+      // B_R
+      rgb.z = (k2*(d2+d3)*0.5+k4*(d1+d4)*0.5)/(k2+k4);
+    } else {
+      rgb.y = pv; // G2(B)
+      half k1 = phi(fabs_diff(d1, pv) + fabs_diff(d2, pv));
+      half k2 = phi(fabs_diff(d2, pv) + fabs_diff(d4, pv));
+      half k3 = phi(fabs_diff(d3, pv) + fabs_diff(d4, pv));
+      half k4 = phi(fabs_diff(d1, pv) + fabs_diff(d3, pv));
+      // R_G2
+      rgb.x = (k1*n1+k3*n3)/(k1+k3);
+      // B_G2
+      rgb.z = (k2*n2+k4*n4)/(k2+k4);
+    }
+  }
+
+  rgb = clamp(0.0h, 1.0h, rgb);
+  rgb = color_correct(rgb);
+
+  return (uchar3)((uchar)(rgb.z), (uchar)(rgb.y), (uchar)(rgb.x));
+}
+
+// the integer math of rgb_to_yuv.cl
+inline uchar rgb_to_y(int3 bgr) {
+  return (((bgr.x * 13 + bgr.y * 65 + bgr.z * 33) + 64) >> 7) + 16;
+}
+
+// bgr is the sum of a 2x2 block halved
+inline uchar rgb_to_u(int3 bgr) {
+  return (bgr.x * 56 - bgr.y * 37 - bgr.z * 19 + 0x8080) >> 8;
+}
+
+inline uchar rgb_to_v(int3 bgr) {
+  return (bgr.z * 56 - bgr.y * 47 - bgr.x * 9 + 0x8080) >> 8;
+}
+
+// mirrors coordinates across the border, keeping the bayer phase
+inline int mirror(int v, int size) {
+  return v < 0 ? -v : (v >= size ? 2 * (size - 1) - v : v);
+}
+
+inline bool in_roi(int x, int y, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip) {
+  return x >= x_start && x < x_end && (x - x_start) % x_skip == 0 &&
+         y >= y_start && y < y_end && (y - y_start) % y_skip == 0;
+}
+
+// Each work item debayers a 2x2 quad, writes it as BGR and yuv420 and counts the luminance
+// of its pixels inside the exposure roi. Unlike debayer10 the border is filled, by mirroring
+// the raw frame
+__kernel void debayer10_yuv(const __global uchar * in,
+                            __global uchar * out,
+                            __global uchar * out_yuv,
+                            __local half * cached,
+                            __global uint * hist,
+                            int x_start, int x_end, int x_skip,
+                            int y_start, int y_end, int y_skip)
+{
+  __local uint local_hist[256];
+
+  const int qx = get_global_id(0);
+  const int qy = get_global_id(1);
+  const int lx = get_local_id(0);
+  const int ly = get_local_id(1);
+  const int group_size = get_local_size(0) * get_local_size(1);
+  const int lid = ly * get_local_size(0) + lx;
+
+  // the quads of the group with a one pixel apron
+  const int row_len = 2 * get_local_size(0) + 2;
+  const int cache_size = row_len * (2 * get_local_size(1) + 2);
+  const int cache_x = 2 * (qx - lx) - 1;
+  const int cache_y = 2 * (qy - ly) - 1;
+
+  for (int i = lid; i < 256; i += group_size) {
+    local_hist[i] = 0;
+  }
+  for (int i = lid; i < cache_size; i += group_size) {
+    cached[i] = val_from_10(in, mirror(cache_x + i % row_len, RGB_WIDTH), mirror(cache_y + i / row_len, RGB_HEIGHT));
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const int x = 2 * qx, y = 2 * qy;
+  const int offset = (2 * ly + 1) * row_len + 2 * lx + 1;
+  const uchar3 p00 = debayer_pixel(cached, offset, row_len, x, y);
+  const uchar3 p01 = debayer_pixel(cached, offset + 1, row_len, x + 1, y);
+  const uchar3 p10 = debayer_pixel(cached, offset + row_len, row_len, x, y + 1);
+  const uchar3 p11 = debayer_pixel(cached, offset + row_len + 1, row_len, x + 1, y + 1);
+
+  const int rgb_off = y * RGB_STRIDE + 3 * x;
+  vstore3(p00, 0, out + rgb_off);
+  vstore3(p01, 0, out + rgb_off + 3);
+  vstore3(p10, 0, out + rgb_off + RGB_STRIDE);
+  vstore3(p11, 0, out + rgb_off + RGB_STRIDE + 3);
+
+  const uchar2 y0 = (uchar2)(rgb_to_y(convert_int3(p00)), rgb_to_y(convert_int3(p01)));
+  const uchar2 y1 = (uchar2)(rgb_to_y(convert_int3(p10)), rgb_to_y(convert_int3(p11)));
+  vstore2(y0, 0, out_yuv + y * RGB_WIDTH + x);
+  vstore2(y1, 0, out_yuv + (y + 1) * RGB_WIDTH + x);
+
+  const int3 avg = (convert_int3(p00) + convert_int3(p01) + convert_int3(p10) + convert_int3(p11) + 1) >> 1;
+  out_yuv[RGB_SIZE + qy * UV_WIDTH + qx] = rgb_to_u(avg);
+  out_yuv[RGB_SIZE + UV_WIDTH * UV_HEIGHT + qy * UV_WIDTH + qx] = rgb_to_v(avg);
+
+  if (in_roi(x, y, x_start, x_end, x_skip, y_start, y_end, y_skip)) atomic_inc(&local_hist[y0.s0]);
+  if (in_roi(x + 1, y, x_start, x_end, x_skip, y_start, y_end, y_skip)) atomic_inc(&local_hist[y0.s1]);
+  if (in_roi(x, y + 1, x_start, x_end, x_skip, y_start, y_end, y_skip)) atomic_inc(&local_hist[y1.s0]);
+  if (in_roi(x + 1, y + 1, x_start, x_end, x_skip, y_start, y_end, y_skip)) atomic_inc(&local_hist[y1.s1]);
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int i = lid; i < 256; i += group_size) {
+    if (local_hist[i]) atomic_add(&hist[i], local_hist[i]);
+  }
+}
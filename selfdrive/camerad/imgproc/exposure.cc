@@ -0,0 +1,107 @@
+#include "selfdrive/camerad/imgproc/exposure.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+void exposure_histogram(const uint8_t *y, int stride, const ExposureRoi &roi, uint32_t *hist) {
+  assert(roi.x_skip > 0 && roi.y_skip > 0);
+  const int span = std::max(0, roi.x_end - roi.x_start);
+  const int n = (span + roi.x_skip - 1) / roi.x_skip;
+
+  // Pixels are counted into four interleaved tables, so runs of equal levels, common in flat
+  // and saturated areas, don't serialize on incrementing one counter. Without skip they are
+  // loaded 8 at a time
+  uint32_t t[4][256] = {};
+  for (int row = roi.y_start; row < roi.y_end; row += roi.y_skip) {
+    const uint8_t *p = y + row * stride + roi.x_start;
+    int i = 0;
+    if (roi.x_skip == 1) {
+      for (; i + 8 <= span; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, sizeof(v));
+        t[0][v & 0xff]++;
+        t[1][(v >> 8) & 0xff]++;
+        t[2][(v >> 16) & 0xff]++;
+        t[3][(v >> 24) & 0xff]++;
+        t[0][(v >> 32) & 0xff]++;
+        t[1][(v >> 40) & 0xff]++;
+        t[2][(v >> 48) & 0xff]++;
+        t[3][v >> 56]++;
+      }
+    } else {
+      const int skip = roi.x_skip;
+      for (; i + 4 <= n; i += 4) {
+        t[0][p[i * skip]]++;
+        t[1][p[(i + 1) * skip]]++;
+        t[2][p[(i + 2) * skip]]++;
+        t[3][p[(i + 3) * skip]]++;
+      }
+    }
+    for (; i < n; i++) {
+      t[i & 3][p[i * roi.x_skip]]++;
+    }
+  }
+
+  for (int v = 0; v < 256; v++) {
+    hist[v] += t[0][v] + t[1][v] + t[2][v] + t[3][v];
+  }
+}
+
+void ExposureStats::set_rois(const std::vector<ExposureRoi> &rois, const std::vector<float> &weights) {
+  assert(weights.empty() || weights.size() == rois.size());
+  std::vector<float> w = weights.empty() ? std::vector<float>(rois.size(), 1.0f) : weights;
+  if (rois == rois_ && w == weights_) return;
+
+  rois_ = rois;
+  weights_ = w;
+  hists_.assign(rois.size(), {});
+}
+
+void ExposureStats::update(const uint8_t *y, int stride) {
+  for (int i = 0; i < rois_.size(); i++) {
+    hists_[i].fill(0);
+    exposure_histogram(y, stride, rois_[i], hists_[i].data());
+  }
+  combine();
+}
+
+void ExposureStats::update(const uint32_t *hist) {
+  assert(rois_.size() == 1);
+  std::copy_n(hist, 256, hists_[0].begin());
+  combine();
+}
+
+void ExposureStats::combine() {
+  combined_.fill(0);
+  total_ = 0;
+
+  std::vector<uint64_t> counts(rois_.size(), 0);
+  double total_weight = 0;
+  for (int i = 0; i < rois_.size(); i++) {
+    for (uint32_t c : hists_[i]) counts[i] += c;
+    if (counts[i] == 0 || weights_[i] <= 0) continue;
+    total_ += counts[i];
+    total_weight += weights_[i];
+  }
+
+  for (int i = 0; i < rois_.size(); i++) {
+    if (counts[i] == 0 || weights_[i] <= 0) continue;
+    // 1 for a single roi, so its counts stay exact
+    const double scale = (weights_[i] / total_weight) * ((double)total_ / counts[i]);
+    for (int v = 0; v < 256; v++) combined_[v] += hists_[i][v] * scale;
+  }
+}
+
+int ExposureStats::percentile(float p) const {
+  // the integer threshold of the median search this replaced, lum_total / 2 for the median
+  const double target = std::floor((1.0 - p) * total_) - 1e-6;
+  double cur = 0;
+  int v;
+  for (v = 255; v > 0; v--) {
+    cur += combined_[v];
+    if (cur >= target) break;
+  }
+  return v;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// the pixels of a frame that auto exposure looks at, every skip-th one of [start, end)
+struct ExposureRoi {
+  int x_start = 0, x_end = 0, x_skip = 1;
+  int y_start = 0, y_end = 0, y_skip = 1;
+
+  bool operator==(const ExposureRoi &o) const {
+    return x_start == o.x_start && x_end == o.x_end && x_skip == o.x_skip &&
+           y_start == o.y_start && y_end == o.y_end && y_skip == o.y_skip;
+  }
+  bool operator!=(const ExposureRoi &o) const { return !(*this == o); }
+};
+
+// Luminance histograms of one or more weighted rois of a y plane. Every roi is rescaled
+// so its weight is its share of the counted pixels, no matter how large it is. A single
+// roi keeps its integer counts. The rois are kept until they change, a frame only costs the counting
+class ExposureStats {
+public:
+  // weights default to 1
+  void set_rois(const std::vector<ExposureRoi> &rois, const std::vector<float> &weights = {});
+  const std::vector<ExposureRoi> &rois() const { return rois_; }
+
+  // counts the rois in a y plane
+  void update(const uint8_t *y, int stride);
+  // takes the histogram of a single roi counted elsewhere, like the fused debayer kernel
+  void update(const uint32_t *hist);
+
+  // the highest level with at least floor((1 - p) * pixels) of the weighted pixels at or
+  // above it, in O(256). The median matches the integer search set_exposure_target used
+  // before, also for odd counts, and nothing counted gives 255
+  int percentile(float p) const;
+  int median() const { return percentile(0.5); }
+  const std::array<uint32_t, 256> &histogram(int roi) const { return hists_[roi]; }
+
+private:
+  void combine();
+
+  std::vector<ExposureRoi> rois_;
+  std::vector<float> weights_;
+  std::vector<std::array<uint32_t, 256>> hists_;
+  // weighted pixels at each level, they add up to total_
+  std::array<double, 256> combined_ = {};
+  uint64_t total_ = 0;
+};
+
+// counts every skip-th pixel of [x_start, x_end) for the rows of roi into hist
+void exposure_histogram(const uint8_t *y, int stride, const ExposureRoi &roi, uint32_t *hist);
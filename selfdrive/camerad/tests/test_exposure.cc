@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/camerad/imgproc/exposure.h"
+
+constexpr int WIDTH = 1928;
+constexpr int HEIGHT = 1208;
+
+// the median search set_exposure_target used before the histograms
+static int scalar_median(const uint8_t *pix_ptr, int width, const ExposureRoi &roi, uint32_t *lum_binning) {
+  int lum_med;
+  unsigned int lum_total = 0;
+  for (int y = roi.y_start; y < roi.y_end; y += roi.y_skip) {
+    for (int x = roi.x_start; x < roi.x_end; x += roi.x_skip) {
+      uint8_t lum = pix_ptr[(y * width) + x];
+      lum_binning[lum]++;
+      lum_total += 1;
+    }
+  }
+
+  unsigned int lum_cur = 0;
+  for (lum_med = 255; lum_med >= 0; lum_med--) {
+    lum_cur += lum_binning[lum_med];
+    if (lum_cur >= lum_total / 2) {
+      break;
+    }
+  }
+  return lum_med;
+}
+
+static std::vector<uint8_t> camera_frame(int seed) {
+  // smooth content with noise and flat saturated areas, like a road camera frame
+  std::vector<uint8_t> y(WIDTH * HEIGHT);
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> noise(-8, 8);
+  for (int r = 0; r < HEIGHT; r++) {
+    for (int c = 0; c < WIDTH; c++) {
+      const int v = r < HEIGHT / 5 ? 255 : 40 + (c * 160) / WIDTH + (r * 40) / HEIGHT + noise(gen);
+      y[r * WIDTH + c] = std::clamp(v, 0, 255);
+    }
+  }
+  return y;
+}
+
+static void check_against_scalar(const std::vector<uint8_t> &frame, const ExposureRoi &roi) {
+  uint32_t expected[256] = {};
+  const int expected_median = scalar_median(frame.data(), WIDTH, roi, expected);
+
+  ExposureStats stats;
+  stats.set_rois({roi});
+  stats.update(frame.data(), WIDTH);
+  INFO("roi " << roi.x_start << "-" << roi.x_end << "/" << roi.x_skip << " x "
+       << roi.y_start << "-" << roi.y_end << "/" << roi.y_skip);
+  REQUIRE(std::equal(expected, expected + 256, stats.histogram(0).begin()));
+  REQUIRE(stats.median() == expected_median);
+}
+
+TEST_CASE("exposure histogram and median match the scalar search") {
+  const auto frame = camera_frame(1);
+
+  SECTION("camera rois") {
+    // the road, wide road and driver rois, with odd offsets and every skip the loops special case
+    const ExposureRoi rois[] = {
+      {96, 96 + 1734, 2, 160, 160 + 986, 2},
+      {96, 96 + 1734, 2, 250, 250 + 524, 2},
+      {96, 1832, 2, 242, 1148, 4},
+      {7, 1001, 1, 3, 901, 1},
+      {5, 1900, 3, 1, 1200, 5},
+      {1, 18, 2, 0, 2, 1},
+      {0, 0, 1, 0, 0, 1},
+    };
+    for (const auto &roi : rois) check_against_scalar(frame, roi);
+  }
+
+  SECTION("odd pixel counts") {
+    // a single pixel, where the scalar search stops at the first level it looks at
+    check_against_scalar(frame, {500, 501, 1, 600, 601, 1});
+    // 35 pixels
+    check_against_scalar(frame, {300, 335, 1, 700, 701, 1});
+    check_against_scalar(frame, {11, 46, 5, 300, 335, 7});
+    check_against_scalar(frame, {3, 1928, 3, 241, 244, 1});
+  }
+
+  SECTION("random rois") {
+    std::mt19937 gen(2);
+    std::uniform_int_distribution<int> x_dist(0, WIDTH), y_dist(0, HEIGHT), len_dist(0, 40), skip_dist(1, 5);
+    for (int i = 0; i < 2000; i++) {
+      ExposureRoi roi;
+      roi.x_start = x_dist(gen);
+      roi.x_end = std::min(WIDTH, roi.x_start + (i % 2 ? len_dist(gen) : x_dist(gen)));
+      roi.x_skip = skip_dist(gen);
+      roi.y_start = y_dist(gen);
+      roi.y_end = std::min(HEIGHT, roi.y_start + len_dist(gen));
+      roi.y_skip = skip_dist(gen);
+      check_against_scalar(frame, roi);
+    }
+  }
+}
+
+TEST_CASE("exposure percentiles") {
+  // every level 0-255 equally often
+  std::vector<uint8_t> frame(WIDTH * HEIGHT);
+  for (int r = 0; r < HEIGHT; r++) {
+    for (int c = 0; c < WIDTH; c++) frame[r * WIDTH + c] = c % 256;
+  }
+  ExposureStats stats;
+  stats.set_rois({{0, 256 * 7, 1, 0, HEIGHT, 1}});
+  stats.update(frame.data(), WIDTH);
+  REQUIRE(stats.median() == 128);
+  REQUIRE(stats.percentile(0.9) == 230);
+  REQUIRE(stats.percentile(0.0) == 0);
+  REQUIRE(stats.percentile(1.0) == 255);
+
+  // a histogram from the fused debayer gives the same result as counting the plane
+  ExposureStats fused;
+  fused.set_rois(stats.rois());
+  fused.update(stats.histogram(0).data());
+  REQUIRE(fused.median() == stats.median());
+  REQUIRE(fused.percentile(0.1) == stats.percentile(0.1));
+
+  // nothing counted
+  ExposureStats empty;
+  empty.set_rois({{0, 0, 1, 0, 0, 1}});
+  empty.update(frame.data(), WIDTH);
+  REQUIRE(empty.median() == 255);
+}
+
+TEST_CASE("exposure roi weights") {
+  // a small dark roi on the left, a large bright one on the right
+  std::vector<uint8_t> frame(WIDTH * HEIGHT);
+  for (int r = 0; r < HEIGHT; r++) {
+    for (int c = 0; c < WIDTH; c++) frame[r * WIDTH + c] = c < 100 ? 50 : 200;
+  }
+  const std::vector<ExposureRoi> rois = {{0, 100, 1, 0, 10, 1}, {100, WIDTH, 1, 0, HEIGHT, 1}};
+  ExposureStats stats;
+
+  SECTION("weights are shares independent of roi size") {
+    stats.set_rois(rois, {3, 1});
+    stats.update(frame.data(), WIDTH);
+    REQUIRE(stats.median() == 50);
+
+    stats.set_rois(rois, {1, 3});
+    stats.update(frame.data(), WIDTH);
+    REQUIRE(stats.median() == 200);
+
+    // equal shares, half the weight is at 200
+    stats.set_rois(rois);
+    stats.update(frame.data(), WIDTH);
+    REQUIRE(stats.median() == 200);
+  }
+
+  SECTION("zero weight ignores a roi") {
+    stats.set_rois(rois, {1, 0});
+    stats.update(frame.data(), WIDTH);
+    REQUIRE(stats.median() == 50);
+  }
+}
@@ -1,6 +1,7 @@
 #include "selfdrive/common/gpio.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include <cstring>
@@ -30,3 +31,40 @@ int gpio_set(int pin_nr, bool high) {
   }
   return util::write_file(pin_val_path, (void*)(high ? "1" : "0"), 1);
 }
+
+int gpio_get_irq_fd(int pin_nr) {
+  if (gpio_init(pin_nr, false) < 0) {
+    return -1;
+  }
+
+  char path[50];
+  snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/edge", pin_nr);
+  if (util::write_file(path, (void*)"rising", strlen("rising")) < 0) {
+    return -1;
+  }
+
+  snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", pin_nr);
+  int fd = HANDLE_EINTR(open(path, O_RDONLY));
+  if (fd < 0) {
+    return -1;
+  }
+
+  // clear what is pending
+  char value;
+  HANDLE_EINTR(read(fd, &value, 1));
+  return fd;
+}
+
+int gpio_wait_irq(int fd, int timeout_ms) {
+  struct pollfd pfd = {.fd = fd, .events = POLLPRI | POLLERR};
+  int ret = HANDLE_EINTR(poll(&pfd, 1, timeout_ms));
+  if (ret <= 0) {
+    return ret;
+  }
+
+  // sysfs wants the value read again from the start to rearm
+  char value;
+  lseek(fd, 0, SEEK_SET);
+  HANDLE_EINTR(read(fd, &value, 1));
+  return 1;
+}
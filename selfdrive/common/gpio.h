@@ -8,6 +8,8 @@
   #define GPIO_UBLOX_PWR_EN     34
   #define GPIO_STM_RST_N        124
   #define GPIO_STM_BOOT0        134
+  // not confirmed on a device yet, only used with SENSORD_FIFO=1
+  #define GPIO_LSM_INT          84
 #else
   #define GPIO_HUB_RST_N        0
   #define GPIO_UBLOX_RST_N      0
@@ -15,7 +17,13 @@
   #define GPIO_UBLOX_PWR_EN     0
   #define GPIO_STM_RST_N        0
   #define GPIO_STM_BOOT0        0
+  #define GPIO_LSM_INT          0
 #endif
 
 int gpio_init(int pin_nr, bool output);
 int gpio_set(int pin_nr, bool high);
+
+// Interrupts on rising edges of an input pin. Returns a fd to wait on, or -1
+int gpio_get_irq_fd(int pin_nr);
+// Returns 1 after an edge, 0 on timeout, -1 on error
+int gpio_wait_irq(int fd, int timeout_ms);
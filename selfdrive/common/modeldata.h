@@ -32,13 +32,13 @@ namespace tici_dm_crop {
   const int width = 954;
 };
 
-const mat3 fcam_intrinsic_matrix =
-    Hardware::EON() ? (mat3){{910., 0., 1164.0 / 2,
-                              0., 910., 874.0 / 2,
-                              0., 0., 1.}}
-                    : (mat3){{2648.0, 0.0, 1928.0 / 2,
-                              0.0, 2648.0, 1208.0 / 2,
-                              0.0, 0.0, 1.0}};
+const mat3 eon_fcam_intrinsic_matrix = (mat3){{910., 0., 1164.0 / 2,
+                                               0., 910., 874.0 / 2,
+                                               0., 0., 1.}};
+const mat3 tici_fcam_intrinsic_matrix = (mat3){{2648.0, 0.0, 1928.0 / 2,
+                                                0.0, 2648.0, 1208.0 / 2,
+                                                0.0, 0.0, 1.0}};
+const mat3 fcam_intrinsic_matrix = Hardware::EON() ? eon_fcam_intrinsic_matrix : tici_fcam_intrinsic_matrix;
 
 // tici ecam focal probably wrong? magnification is not consistent across frame
 // Need to retrain model before this can be changed
@@ -0,0 +1,87 @@
+// Times the clustering of a radar cycle, radar_clusters_update against cluster_points_centroid,
+// on random scenes of cars with a few reflections each.
+//
+// Usage: ./bench_radar_cluster [cycles]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "selfdrive/controls/lib/cluster/fastcluster.h"
+#include "selfdrive/controls/lib/cluster/radar_cluster.h"
+}
+
+const double DIST = 2.5;
+
+struct Scene {
+  std::vector<double> d, y, v;
+  int size() const { return d.size(); }
+};
+
+static Scene random_scene(std::mt19937 &gen, int n) {
+  std::uniform_real_distribution<double> d(2, 150), y(-10, 10), v(-30, 5), u(0, 1);
+  std::normal_distribution<double> spread(0, 0.8);
+  Scene s;
+  while (s.size() < n) {
+    const double cd = d(gen), cy = y(gen), cv = v(gen);
+    const int reflections = u(gen) < 0.3 ? 1 : 1 + int(u(gen) * 4);
+    for (int i = 0; i < reflections && s.size() < n; i++) {
+      s.d.push_back(cd + spread(gen));
+      s.y.push_back(cy + spread(gen) * 0.5);
+      s.v.push_back(cv + spread(gen) * 0.3);
+    }
+  }
+  return s;
+}
+
+// per cycle, the best of a few runs
+template <class F>
+static double time_us(int cycles, F f) {
+  double best = 1e9;
+  for (int run = 0; run < 10; run++) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < cycles; i++) f(i);
+    const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / cycles);
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  const int cycles = argc > 1 ? atoi(argv[1]) : 200;
+  std::mt19937 gen(0);
+  RadarClusters *rc = radar_clusters_create(DIST);
+  RadarVisionLead leads[2] = {{40.0, 0.0, 20.0, 2.0, 0.5, 1.0}, {80.0, 0.0, 20.0, 4.0, 1.0, 2.0}};
+
+  printf("tracks  cluster_points_centroid  radar_clusters_update\n");
+  for (int n : {16, 32, 64, 128}) {
+    std::vector<Scene> scenes;
+    for (int i = 0; i < cycles; i++) scenes.push_back(random_scene(gen, n));
+    std::vector<int> labels(n), lead_clusters(2);
+    std::vector<double> pts(3 * n);
+    int low_speed;
+
+    const double t_fastcluster = time_us(cycles, [&](int i) {
+      const Scene &s = scenes[i];
+      for (int j = 0; j < n; j++) {
+        pts[3 * j] = s.d[j];
+        pts[3 * j + 1] = s.y[j] * 2;
+        pts[3 * j + 2] = s.v[j];
+      }
+      cluster_points_centroid(n, 3, pts.data(), DIST * DIST, labels.data());
+    });
+    const double t_engine = time_us(cycles, [&](int i) {
+      const Scene &s = scenes[i];
+      radar_clusters_update(rc, n, s.d.data(), s.y.data(), s.v.data(), 20.0, 2, leads,
+                            labels.data(), lead_clusters.data(), &low_speed);
+    });
+    printf("%6d  %20.1f us  %18.1f us\n", n, t_fastcluster, t_engine);
+  }
+
+  radar_clusters_destroy(rc);
+  return 0;
+}
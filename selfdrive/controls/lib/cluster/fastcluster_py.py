@@ -13,6 +13,33 @@ int hclust_fast(int n, double* distmat, int method, int* merge, double* height);
 void cutree_cdist(int n, const int* merge, double* height, double cdist, int* labels);
 void hclust_pdist(int n, int m, double* pts, double* out);
 void cluster_points_centroid(int n, int m, double* pts, double dist, int* idx);
+
+typedef struct {
+  double d, y, v;
+  double d_std, y_std, v_std;
+} RadarVisionLead;
+typedef struct RadarClusters RadarClusters;
+RadarClusters* radar_clusters_create(double dist);
+void radar_clusters_destroy(RadarClusters* rc);
+int radar_clusters_update(RadarClusters* rc, int n, const double* d_rel, const double* y_rel, const double* v_rel,
+                          double v_ego, int n_leads, const RadarVisionLead* leads,
+                          int* labels, int* lead_clusters, int* low_speed_cluster);
+
+typedef struct {
+  int n;
+  const uint64_t* id;
+  const double *d_rel, *y_rel, *v_rel;
+  const double* v_lead;
+  const double *v_lead_k, *a_lead_k, *a_lead_tau;
+  const int* cnt;
+  const bool* measured;
+} RadarTrackBatch;
+typedef struct RadarTracks RadarTracks;
+RadarTracks* radar_tracks_create(const double* A, const double* C, const double* K);
+void radar_tracks_destroy(RadarTracks* rt);
+void radar_tracks_update(RadarTracks* rt, int n, const uint64_t* id, const double* d_rel, const double* y_rel,
+                         const double* v_rel, const bool* measured, double v_ego, RadarTrackBatch* out);
+void radar_tracks_reset_new(RadarTracks* rt, const int* labels, int n_clusters);
 """)
 
 hclust = ffi.dlopen(cluster_fn)
@@ -26,3 +53,69 @@ def cluster_points_centroid(pts, dist):
   labels_ptr = ffi.new("int[]", n)
   hclust.cluster_points_centroid(n, m, pts_ptr, dist**2, labels_ptr)
   return list(labels_ptr)
+
+
+def doubles(x):
+  return x if isinstance(x, ffi.CData) else ffi.new("double[]", x)
+
+
+class RadarClusters():
+  """Clusters the radar tracks like cluster_points_centroid and matches the vision leads to the
+  clusters, in one call per cycle"""
+  def __init__(self, dist):
+    self.rc = ffi.gc(hclust.radar_clusters_create(dist), hclust.radar_clusters_destroy)
+
+  def update(self, n, d_rel, y_rel, v_rel, v_ego, leads):
+    """d_rel, y_rel and v_rel are n each, lists or the arrays of a RadarTrackBatch. leads are
+    (d, y, v, d_std, y_std, v_std) in radar coordinates. Returns the cluster of every track,
+    the cluster of every lead or None, and the closest cluster to stop for at low speed or None"""
+    labels_ptr = ffi.new("int[]", n)
+    leads_ptr = ffi.new("RadarVisionLead[]", [tuple(lead) for lead in leads])
+    lead_clusters_ptr = ffi.new("int[]", len(leads))
+    low_speed_ptr = ffi.new("int*")
+    hclust.radar_clusters_update(self.rc, n, doubles(d_rel), doubles(y_rel), doubles(v_rel), v_ego,
+                                 len(leads), leads_ptr, labels_ptr, lead_clusters_ptr, low_speed_ptr)
+
+    lead_clusters = [c if c >= 0 else None for c in lead_clusters_ptr]
+    low_speed_cluster = low_speed_ptr[0] if low_speed_ptr[0] >= 0 else None
+    return list(labels_ptr), lead_clusters, low_speed_cluster
+
+
+class TrackState():
+  """A track of RadarTracks, with the fields of radar_helpers.Track that Cluster reads"""
+  __slots__ = ['dRel', 'yRel', 'vRel', 'vLead', 'vLeadK', 'aLeadK', 'aLeadTau', 'cnt', 'measured']
+
+  def __init__(self, tracks, i):
+    self.dRel = tracks.d_rel[i]
+    self.yRel = tracks.y_rel[i]
+    self.vRel = tracks.v_rel[i]
+    self.vLead = tracks.v_lead[i]
+    self.vLeadK = tracks.v_lead_k[i]
+    self.aLeadK = tracks.a_lead_k[i]
+    self.aLeadTau = tracks.a_lead_tau[i]
+    self.cnt = tracks.cnt[i]
+    self.measured = tracks.measured[i]
+
+
+class RadarTracks():
+  """The radar tracks with the lead speed filter of every track, updated in one call per cycle"""
+  def __init__(self, kalman_params):
+    A = [x for row in kalman_params.A for x in row]
+    K = [row[0] for row in kalman_params.K]
+    rt = hclust.radar_tracks_create(doubles(A), doubles(kalman_params.C), doubles(K))
+    self.rt = ffi.gc(rt, hclust.radar_tracks_destroy)
+    self.tracks = ffi.new("RadarTrackBatch*")
+
+  def update(self, ids, d_rel, y_rel, v_rel, measured, v_ego):
+    """Updates the tracks with the points of a radar cycle. Returns the tracks sorted by id, as
+    a RadarTrackBatch valid until the next update"""
+    hclust.radar_tracks_update(self.rt, len(ids), ffi.new("uint64_t[]", ids), doubles(d_rel), doubles(y_rel),
+                               doubles(v_rel), ffi.new("bool[]", measured), v_ego, self.tracks)
+    return self.tracks
+
+  def reset_new(self, labels):
+    """Starts the accel of the new tracks from the tracks they are clustered with"""
+    hclust.radar_tracks_reset_new(self.rt, ffi.new("int[]", labels), max(labels, default=-1) + 1)
+
+  def track(self, i):
+    return TrackState(self.tracks, i)
@@ -0,0 +1,284 @@
+//
+// Radar track clustering for radard
+//
+// Centroid linkage merges the two clusters with the closest centroids until none are closer
+// than the cutoff. Only clusters that close can ever merge, so instead of the full distance
+// matrix of fastcluster the clusters are binned into a grid of cutoff sized cells over
+// distance and lateral offset. The pairs closer than the cutoff come from neighbouring cells
+// and wait in a heap ordered by distance. A merge moves the merged cluster in the grid and
+// only adds its pairs with the clusters around it
+//
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include "radar_cluster.h"
+}
+
+namespace {
+
+// radar is inaccurate laterally, as in Track.get_key_for_cluster
+const double Y_WEIGHT = 2.0;
+// no stationary object to stop for above this speed, as in radar_helpers.py
+const double V_EGO_STATIONARY = 4.0;
+// the cells grow beyond the cutoff when the tracks spread over more of them than this
+const int MAX_CELLS = 4096;
+
+double laplacian_cdf(double x, double mu, double b) {
+  b = std::max(b, 1e-4);
+  return std::exp(-std::abs(x - mu) / b);
+}
+
+// two clusters closer than the cutoff, valid while neither changed since
+struct Pair {
+  double dist;
+  int a, b;
+  int version_a, version_b;
+};
+
+// the heap top is the closest pair, ties go to the lowest indices
+bool later(const Pair& x, const Pair& y) {
+  if (x.dist != y.dist) return x.dist > y.dist;
+  if (x.a != y.a) return x.a > y.a;
+  return x.b > y.b;
+}
+
+struct ClusterMeans {
+  std::vector<double> d, y, v;
+
+  ClusterMeans(int n, const double* d_rel, const double* y_rel, const double* v_rel, const int* labels, int n_clusters)
+      : d(n_clusters), y(n_clusters), v(n_clusters) {
+    std::vector<int> size(n_clusters);
+    for (int i = 0; i < n; i++) {
+      const int l = labels[i];
+      d[l] += d_rel[i];
+      y[l] += y_rel[i];
+      v[l] += v_rel[i];
+      size[l]++;
+    }
+    for (int l = 0; l < n_clusters; l++) {
+      d[l] /= size[l];
+      y[l] /= size[l];
+      v[l] /= size[l];
+    }
+  }
+
+  int size() const { return d.size(); }
+
+  int match_vision(double v_ego, const RadarVisionLead& lead) const {
+    // the first of equally likely ones, like max()
+    int best = -1;
+    double best_prob = 0;
+    for (int l = 0; l < size(); l++) {
+      double prob = laplacian_cdf(d[l], lead.d, lead.d_std) *
+                    laplacian_cdf(y[l], lead.y, lead.y_std) *
+                    laplacian_cdf(v[l] + v_ego, lead.v, lead.v_std);
+      if (best < 0 || prob > best_prob) {
+        best = l;
+        best_prob = prob;
+      }
+    }
+    if (best < 0) return -1;
+
+    // stationary radar points can be false positives
+    bool dist_sane = std::abs(d[best] - lead.d) < std::max(lead.d * .25, 5.0);
+    bool vel_sane = std::abs(v[best] + v_ego - lead.v) < 10 || v_ego + v[best] > 3;
+    return dist_sane && vel_sane ? best : -1;
+  }
+
+  int low_speed_lead(double v_ego) const {
+    int closest = -1;
+    if (v_ego >= V_EGO_STATIONARY) return closest;
+    for (int l = 0; l < size(); l++) {
+      if (std::abs(y[l]) < 1.5 && d[l] < 25 && (closest < 0 || d[l] < d[closest])) {
+        closest = l;
+      }
+    }
+    return closest;
+  }
+};
+
+}  // namespace
+
+struct RadarClusters {
+  double dist;
+  double dist_sq;
+
+  // clusters in clustering space, a merge keeps the lower index and the higher one points to it
+  std::vector<double> cd, cy, cv;
+  std::vector<int> size, version, parent;
+  std::vector<int> label_of;
+
+  // the grid over distance and lateral offset. cell is -1 for tracks that aren't finite,
+  // they never merge
+  double min_d, min_y, cell_size;
+  int nx, ny;
+  std::vector<int> head, next, cell;
+
+  std::vector<Pair> heap;
+
+  explicit RadarClusters(double dist) : dist(dist), dist_sq(dist * dist) {}
+
+  void init_grid(int n) {
+    double max_d = -INFINITY, max_y = -INFINITY;
+    min_d = min_y = INFINITY;
+    for (int i = 0; i < n; i++) {
+      if (!std::isfinite(cd[i]) || !std::isfinite(cy[i]) || !std::isfinite(cv[i])) continue;
+      min_d = std::min(min_d, cd[i]);
+      max_d = std::max(max_d, cd[i]);
+      min_y = std::min(min_y, cy[i]);
+      max_y = std::max(max_y, cy[i]);
+    }
+
+    // any cell at least as large as the cutoff finds every pair in the neighbouring cells
+    cell_size = dist;
+    nx = ny = 1;
+    if (min_d <= max_d) {
+      while (true) {
+        nx = int((max_d - min_d) / cell_size) + 1;
+        ny = int((max_y - min_y) / cell_size) + 1;
+        if ((double)nx * ny <= MAX_CELLS) break;
+        cell_size *= 2;
+      }
+    }
+    head.assign(nx * ny, -1);
+    next.resize(n);
+    cell.resize(n);
+  }
+
+  // a centroid stays within its tracks, so within the grid
+  void cell_coords(int i, int* x, int* y) const {
+    *x = std::min(int((cd[i] - min_d) / cell_size), nx - 1);
+    *y = std::min(int((cy[i] - min_y) / cell_size), ny - 1);
+  }
+
+  void grid_insert(int i) {
+    int x, y;
+    cell_coords(i, &x, &y);
+    const int c = y * nx + x;
+    cell[i] = c;
+    next[i] = head[c];
+    head[c] = i;
+  }
+
+  void grid_remove(int i) {
+    int* link = &head[cell[i]];
+    while (*link != i) link = &next[*link];
+    *link = next[i];
+  }
+
+  void push_pair(int i, int j, double d) {
+    const int a = std::min(i, j), b = std::max(i, j);
+    heap.push_back({d, a, b, version[a], version[b]});
+    std::push_heap(heap.begin(), heap.end(), later);
+  }
+
+  // the pairs of i closer than the cutoff, with clusters above min_index
+  void add_pairs(int i, int min_index) {
+    int x, y;
+    cell_coords(i, &x, &y);
+    for (int cy_ = std::max(y - 1, 0); cy_ <= std::min(y + 1, ny - 1); cy_++) {
+      for (int cx_ = std::max(x - 1, 0); cx_ <= std::min(x + 1, nx - 1); cx_++) {
+        for (int j = head[cy_ * nx + cx_]; j >= 0; j = next[j]) {
+          if (j == i || j <= min_index) continue;
+          const double ed = cd[i] - cd[j], ey = cy[i] - cy[j], ev = cv[i] - cv[j];
+          const double d = ed * ed + ey * ey + ev * ev;
+          if (d < dist_sq) push_pair(i, j, d);
+        }
+      }
+    }
+  }
+
+  void merge(int a, int b) {
+    grid_remove(a);
+    grid_remove(b);
+    const double wa = size[a], wb = size[b], w = wa + wb;
+    cd[a] = (cd[a] * wa + cd[b] * wb) / w;
+    cy[a] = (cy[a] * wa + cy[b] * wb) / w;
+    cv[a] = (cv[a] * wa + cv[b] * wb) / w;
+    size[a] += size[b];
+    version[a]++;
+    version[b] = -1;
+    parent[b] = a;
+    grid_insert(a);
+    add_pairs(a, -1);
+  }
+
+  int find(int i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  int cluster(int n, const double* d_rel, const double* y_rel, const double* v_rel, int* labels) {
+    cd.assign(d_rel, d_rel + n);
+    cy.resize(n);
+    cv.assign(v_rel, v_rel + n);
+    for (int i = 0; i < n; i++) cy[i] = y_rel[i] * Y_WEIGHT;
+    size.assign(n, 1);
+    version.assign(n, 0);
+    parent.resize(n);
+    for (int i = 0; i < n; i++) parent[i] = i;
+
+    init_grid(n);
+    for (int i = 0; i < n; i++) {
+      if (std::isfinite(cd[i]) && std::isfinite(cy[i]) && std::isfinite(cv[i])) {
+        grid_insert(i);
+      } else {
+        cell[i] = -1;
+      }
+    }
+    heap.clear();
+    for (int i = 0; i < n; i++) {
+      if (cell[i] >= 0) add_pairs(i, i);
+    }
+
+    while (!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), later);
+      const Pair p = heap.back();
+      heap.pop_back();
+      if (version[p.a] == p.version_a && version[p.b] == p.version_b) {
+        merge(p.a, p.b);
+      }
+    }
+
+    // numbered like cutree_k, in the order of the first track of every cluster
+    int n_clusters = 0;
+    label_of.assign(n, -1);
+    for (int i = 0; i < n; i++) {
+      const int root = find(i);
+      if (label_of[root] < 0) label_of[root] = n_clusters++;
+      labels[i] = label_of[root];
+    }
+    return n_clusters;
+  }
+};
+
+extern "C" {
+
+RadarClusters* radar_clusters_create(double dist) {
+  return new RadarClusters(dist);
+}
+
+void radar_clusters_destroy(RadarClusters* rc) {
+  delete rc;
+}
+
+int radar_clusters_update(RadarClusters* rc, int n, const double* d_rel, const double* y_rel, const double* v_rel,
+                          double v_ego, int n_leads, const RadarVisionLead* leads,
+                          int* labels, int* lead_clusters, int* low_speed_cluster) {
+  const int n_clusters = rc->cluster(n, d_rel, y_rel, v_rel, labels);
+
+  ClusterMeans clusters(n, d_rel, y_rel, v_rel, labels, n_clusters);
+  for (int i = 0; i < n_leads; i++) {
+    lead_clusters[i] = clusters.match_vision(v_ego, leads[i]);
+  }
+  *low_speed_cluster = clusters.low_speed_lead(v_ego);
+  return n_clusters;
+}
+
+}
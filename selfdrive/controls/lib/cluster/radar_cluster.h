@@ -0,0 +1,48 @@
+//
+// Clusters the radar tracks of radard and matches the vision leads to the clusters, in one
+// call per radar cycle
+//
+
+#ifndef radarcluster_H
+#define radarcluster_H
+
+//
+// Where vision puts a lead, in radar coordinates: d is the distance from the radar, y the
+// lateral offset positive to the left and v the speed over ground
+//
+typedef struct {
+  double d, y, v;
+  double d_std, y_std, v_std;
+} RadarVisionLead;
+
+typedef struct RadarClusters RadarClusters;
+
+//
+// dist = tracks closer than this, with the lateral offset counting twice, form a cluster
+//
+RadarClusters* radar_clusters_create(double dist);
+void radar_clusters_destroy(RadarClusters* rc);
+
+//
+// Clusters the tracks with centroid linkage like cluster_points_centroid, and matches every
+// lead to the most likely sane cluster like match_vision_to_cluster in radard.py. Pairs
+// exactly as close as others can merge in a different order than in fastcluster
+//
+// Input arguments:
+//   n       = number of tracks
+//   d_rel, y_rel, v_rel = tracks, n each
+//   v_ego   = speed of the car
+//   n_leads = number of vision leads
+//   leads   = vision leads
+// Output arguments:
+//   labels            = cluster of every track, numbered in the order of their first track
+//   lead_clusters     = cluster of every lead, -1 without a sane match
+//   low_speed_cluster = closest cluster to stop for at low speed without vision, or -1
+// Return code:
+//   number of clusters
+//
+int radar_clusters_update(RadarClusters* rc, int n, const double* d_rel, const double* y_rel, const double* v_rel,
+                          double v_ego, int n_leads, const RadarVisionLead* leads,
+                          int* labels, int* lead_clusters, int* low_speed_cluster);
+
+#endif
@@ -0,0 +1,169 @@
+//
+// Radar tracks for radard
+//
+// The state of every track is kept in arrays sorted by id instead of in a Track object each, so
+// a radar cycle is a merge of the sorted points with the tracks, which drops the missing tracks
+// and starts the new ones, and then one pass of the filter over all of them
+//
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include "radar_tracks.h"
+}
+
+namespace {
+
+// the longer lead decels, the more likely it will keep decelerating, as in radar_helpers.py
+const double LEAD_ACCEL_TAU = 1.5;
+
+struct Tracks {
+  std::vector<uint64_t> id;
+  std::vector<double> d_rel, y_rel, v_rel, v_lead;
+  // the filter state
+  std::vector<double> v_lead_k, a_lead_k;
+  std::vector<double> a_lead_tau;
+  std::vector<int> cnt;
+  // as bytes, a vector of bool has no array to hand out
+  std::vector<uint8_t> measured;
+
+  void resize(int n) {
+    for (auto v : {&d_rel, &y_rel, &v_rel, &v_lead, &v_lead_k, &a_lead_k, &a_lead_tau}) v->resize(n);
+    id.resize(n);
+    cnt.resize(n);
+    measured.resize(n);
+  }
+};
+
+}  // namespace
+
+struct RadarTracks {
+  // A - K C, and K
+  double a_k[4];
+  double k[2];
+
+  Tracks tracks, next;
+  std::vector<int> order;
+  std::vector<double> cluster_a, cluster_tau;
+  std::vector<int> cluster_cnt;
+
+  void update(int n, const uint64_t *id, const double *d_rel, const double *y_rel, const double *v_rel,
+              const bool *measured, double v_ego) {
+    // the points by id, the last of a repeated one first
+    order.resize(n);
+    for (int i = 0; i < n; i++) {
+      order[i] = n - 1 - i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int i, int j) { return id[i] < id[j]; });
+    order.erase(std::unique(order.begin(), order.end(), [&](int i, int j) { return id[i] == id[j]; }), order.end());
+
+    // carry over the state of the tracks still there
+    const int m = order.size(), n_old = tracks.id.size();
+    next.resize(m);
+    int old = 0;
+    for (int p = 0; p < m; p++) {
+      const int i = order[p];
+      while (old < n_old && tracks.id[old] < id[i]) old++;
+      next.id[p] = id[i];
+      next.d_rel[p] = d_rel[i];
+      next.y_rel[p] = y_rel[i];
+      next.v_rel[p] = v_rel[i];
+      next.v_lead[p] = v_rel[i] + v_ego;
+      next.measured[p] = measured[i];
+      if (old < n_old && tracks.id[old] == id[i]) {
+        next.v_lead_k[p] = tracks.v_lead_k[old];
+        next.a_lead_k[p] = tracks.a_lead_k[old];
+        next.a_lead_tau[p] = tracks.a_lead_tau[old];
+        next.cnt[p] = tracks.cnt[old];
+      } else {
+        next.v_lead_k[p] = next.v_lead[p];
+        next.a_lead_k[p] = 0;
+        next.a_lead_tau[p] = LEAD_ACCEL_TAU;
+        next.cnt[p] = 0;
+      }
+    }
+    std::swap(tracks, next);
+
+    // the filter, except on the first update of a track
+    double *x0 = tracks.v_lead_k.data(), *x1 = tracks.a_lead_k.data(), *tau = tracks.a_lead_tau.data();
+    const double *meas = tracks.v_lead.data();
+    int *cnt = tracks.cnt.data();
+    for (int p = 0; p < m; p++) {
+      const double u0 = a_k[0] * x0[p] + a_k[1] * x1[p] + k[0] * meas[p];
+      const double u1 = a_k[2] * x0[p] + a_k[3] * x1[p] + k[1] * meas[p];
+      x0[p] = cnt[p] > 0 ? u0 : x0[p];
+      x1[p] = cnt[p] > 0 ? u1 : x1[p];
+      // learn if constant acceleration
+      tau[p] = std::abs(x1[p]) < 0.5 ? LEAD_ACCEL_TAU : tau[p] * 0.9;
+      cnt[p]++;
+    }
+  }
+
+  void reset_new(const int *labels, int n_clusters) {
+    const int m = tracks.id.size();
+    cluster_a.assign(n_clusters, 0);
+    cluster_tau.assign(n_clusters, 0);
+    cluster_cnt.assign(n_clusters, 0);
+    for (int p = 0; p < m; p++) {
+      if (tracks.cnt[p] > 1) {
+        cluster_a[labels[p]] += tracks.a_lead_k[p];
+        cluster_tau[labels[p]] += tracks.a_lead_tau[p];
+        cluster_cnt[labels[p]]++;
+      }
+    }
+    for (int p = 0; p < m; p++) {
+      if (tracks.cnt[p] > 1) continue;
+      const int c = labels[p];
+      const double a = cluster_cnt[c] > 0 ? cluster_a[c] / cluster_cnt[c] : 0;
+      // the speed of a new track is its lead speed already
+      tracks.v_lead_k[p] = tracks.v_lead[p];
+      tracks.a_lead_k[p] = a;
+      tracks.a_lead_tau[p] = cluster_cnt[c] > 0 ? cluster_tau[c] / cluster_cnt[c] : LEAD_ACCEL_TAU;
+    }
+  }
+
+  void get(RadarTrackBatch *out) const {
+    out->n = tracks.id.size();
+    out->id = tracks.id.data();
+    out->d_rel = tracks.d_rel.data();
+    out->y_rel = tracks.y_rel.data();
+    out->v_rel = tracks.v_rel.data();
+    out->v_lead = tracks.v_lead.data();
+    out->v_lead_k = tracks.v_lead_k.data();
+    out->a_lead_k = tracks.a_lead_k.data();
+    out->a_lead_tau = tracks.a_lead_tau.data();
+    out->cnt = tracks.cnt.data();
+    out->measured = reinterpret_cast<const bool *>(tracks.measured.data());
+  }
+};
+
+extern "C" {
+
+RadarTracks* radar_tracks_create(const double* A, const double* C, const double* K) {
+  RadarTracks* rt = new RadarTracks();
+  rt->a_k[0] = A[0] - K[0] * C[0];
+  rt->a_k[1] = A[1] - K[0] * C[1];
+  rt->a_k[2] = A[2] - K[1] * C[0];
+  rt->a_k[3] = A[3] - K[1] * C[1];
+  rt->k[0] = K[0];
+  rt->k[1] = K[1];
+  return rt;
+}
+
+void radar_tracks_destroy(RadarTracks* rt) {
+  delete rt;
+}
+
+void radar_tracks_update(RadarTracks* rt, int n, const uint64_t* id, const double* d_rel, const double* y_rel,
+                         const double* v_rel, const bool* measured, double v_ego, RadarTrackBatch* out) {
+  rt->update(n, id, d_rel, y_rel, v_rel, measured, v_ego);
+  rt->get(out);
+}
+
+void radar_tracks_reset_new(RadarTracks* rt, const int* labels, int n_clusters) {
+  rt->reset_new(labels, n_clusters);
+}
+
+}
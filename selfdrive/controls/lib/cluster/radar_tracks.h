@@ -0,0 +1,59 @@
+//
+// The radar tracks of radard with the lead speed filter of every track, in one call per radar
+// cycle
+//
+
+#ifndef radartracks_H
+#define radartracks_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// The tracks after an update, sorted by id. The arrays stay valid until the next update
+//
+typedef struct {
+  int n;
+  const uint64_t* id;
+  const double *d_rel, *y_rel, *v_rel;
+  const double* v_lead;
+  // filtered lead speed and accel, and how long the accel is expected to last
+  const double *v_lead_k, *a_lead_k, *a_lead_tau;
+  // updates since the track appeared
+  const int* cnt;
+  const bool* measured;
+} RadarTrackBatch;
+
+typedef struct RadarTracks RadarTracks;
+
+//
+// The filter of every track is KF1D with these A (row major), C and K
+//
+RadarTracks* radar_tracks_create(const double* A, const double* C, const double* K);
+void radar_tracks_destroy(RadarTracks* rt);
+
+//
+// Updates the tracks with the points of a radar cycle, the way Track.update does. Tracks not
+// in it are dropped, new ones start from their lead speed
+//
+// Input arguments:
+//   n     = number of points
+//   id, d_rel, y_rel, v_rel, measured = points, n each, the last one wins for a repeated id
+//   v_ego = speed of the car, aligned with the radar
+// Output arguments:
+//   out   = the tracks
+//
+void radar_tracks_update(RadarTracks* rt, int n, const uint64_t* id, const double* d_rel, const double* y_rel,
+                         const double* v_rel, const bool* measured, double v_ego, RadarTrackBatch* out);
+
+//
+// Starts the accel of the new tracks from the tracks they are clustered with, like
+// Track.reset_a_lead with the accel of their Cluster
+//
+// Input arguments:
+//   labels     = cluster of every track, as cluster_points_centroid numbers them
+//   n_clusters = number of clusters
+//
+void radar_tracks_reset_new(RadarTracks* rt, const int* labels, int n_clusters);
+
+#endif
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+extern "C" {
+#include "selfdrive/controls/lib/cluster/fastcluster.h"
+#include "selfdrive/controls/lib/cluster/radar_cluster.h"
+}
+
+const double DIST = 2.5;
+
+struct Scene {
+  std::vector<double> d, y, v;
+  int size() const { return d.size(); }
+
+  // the way radard clustered them with fastcluster
+  std::vector<int> reference_labels() const {
+    const int n = size();
+    std::vector<int> labels(n, 0);
+    if (n > 1) {
+      std::vector<double> pts;
+      for (int i = 0; i < n; i++) {
+        pts.insert(pts.end(), {d[i], y[i] * 2, v[i]});
+      }
+      cluster_points_centroid(n, 3, pts.data(), DIST * DIST, labels.data());
+    }
+    return labels;
+  }
+};
+
+// cars showing a few reflections each, and stray points
+static Scene random_scene(std::mt19937 &gen, int n) {
+  std::uniform_real_distribution<double> d(2, 150), y(-10, 10), v(-30, 5), u(0, 1);
+  std::normal_distribution<double> spread(0, 0.8);
+  Scene s;
+  while (s.size() < n) {
+    const double cd = d(gen), cy = y(gen), cv = v(gen);
+    const int reflections = u(gen) < 0.3 ? 1 : 1 + int(u(gen) * 4);
+    for (int i = 0; i < reflections && s.size() < n; i++) {
+      s.d.push_back(cd + spread(gen));
+      s.y.push_back(cy + spread(gen) * 0.5);
+      s.v.push_back(cv + spread(gen) * 0.3);
+    }
+  }
+  return s;
+}
+
+struct Clusters {
+  RadarClusters *rc = radar_clusters_create(DIST);
+  std::vector<int> labels, lead_clusters;
+  int low_speed = 0;
+
+  ~Clusters() { radar_clusters_destroy(rc); }
+
+  int update(const Scene &s, double v_ego, std::vector<RadarVisionLead> leads = {}) {
+    labels.resize(s.size());
+    lead_clusters.resize(leads.size());
+    return radar_clusters_update(rc, s.size(), s.d.data(), s.y.data(), s.v.data(), v_ego, leads.size(), leads.data(),
+                                 labels.data(), lead_clusters.data(), &low_speed);
+  }
+};
+
+TEST_CASE("radar_clusters_update clusters like cluster_points_centroid") {
+  std::mt19937 gen(0);
+  Clusters c;
+  const int n = GENERATE(0, 1, 2, 8, 16, 32, 64, 128);
+  for (int i = 0; i < 200; i++) {
+    Scene s = random_scene(gen, n);
+    const int n_clusters = c.update(s, 20.0);
+    const std::vector<int> labels = s.reference_labels();
+    REQUIRE(c.labels == labels);
+    REQUIRE(n_clusters == (n > 0 ? *std::max_element(labels.begin(), labels.end()) + 1 : 0));
+  }
+}
+
+TEST_CASE("radar_clusters_update") {
+  // a car ahead with two reflections, one to the side and a sign by the road
+  Scene s;
+  s.d = {40.0, 40.8, 30.0, 20.0};
+  s.y = {0.2, -0.1, 3.5, -6.0};
+  s.v = {-2.0, -2.1, 0.0, -20.0};
+  Clusters c;
+
+  SECTION("leads matched to their cars") {
+    const int n_clusters = c.update(s, 20.0, {
+      {41.0, 0.0, 18.5, 2.0, 0.5, 1.0},   // the car ahead
+      {31.0, 3.0, 20.0, 2.0, 0.5, 1.0},   // the car to the side
+      {80.0, 0.0, 18.0, 2.0, 0.5, 1.0},   // nothing there
+    });
+    REQUIRE(n_clusters == 3);
+    REQUIRE(c.labels == std::vector<int>({0, 0, 1, 2}));
+    REQUIRE(c.lead_clusters == std::vector<int>({0, 1, -1}));
+    REQUIRE(c.low_speed == -1);
+  }
+
+  SECTION("no match far from the stationary sign") {
+    // the sign is closest, but a lead moving this fast can't be it
+    c.update(s, 20.0, {{20.0, -6.0, 25.0, 2.0, 0.5, 1.0}});
+    REQUIRE(c.lead_clusters == std::vector<int>({-1}));
+  }
+
+  SECTION("low speed lead without vision") {
+    // stopped behind the car
+    s.d = {4.0, 4.5, 30.0, 20.0};
+    s.v = {0.0, 0.1, 0.0, -2.0};
+    c.update(s, 2.0);
+    REQUIRE(c.low_speed == 0);
+
+    // only when slow
+    c.update(s, 5.0);
+    REQUIRE(c.low_speed == -1);
+  }
+
+  SECTION("tracks that aren't finite stay on their own") {
+    s.d.push_back(NAN);
+    s.y.push_back(0.0);
+    s.v.push_back(-2.0);
+    REQUIRE(c.update(s, 20.0) == 4);
+    REQUIRE(c.labels == std::vector<int>({0, 0, 1, 2, 3}));
+  }
+
+  SECTION("no tracks") {
+    REQUIRE(c.update(Scene(), 2.0, {{41.0, 0.0, 18.5, 2.0, 0.5, 1.0}}) == 0);
+    REQUIRE(c.lead_clusters == std::vector<int>({-1}));
+    REQUIRE(c.low_speed == -1);
+  }
+}
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+extern "C" {
+#include "selfdrive/controls/lib/cluster/radar_tracks.h"
+}
+
+const double DT = 0.05;
+const double K0 = 0.24069424, K1 = 0.27958406;  // KalmanParams at 50 ms
+const double A[4] = {1.0, DT, 0.0, 1.0}, C[2] = {1.0, 0.0}, K[2] = {K0, K1};
+
+// Track and KF1D of radar_helpers.py and simple_kalman_impl.pyx
+struct Track {
+  int cnt = 0;
+  double a_lead_tau = 1.5;
+  double x0, x1 = 0;
+  double d_rel, y_rel, v_rel, v_lead;
+  bool measured;
+
+  Track(double v_lead) : x0(v_lead) {}
+
+  void update(double d, double y, double v, double vl, bool m) {
+    d_rel = d, y_rel = y, v_rel = v, v_lead = vl, measured = m;
+    if (cnt > 0) {
+      double u0 = (A[0] - K0 * C[0]) * x0 + (A[1] - K0 * C[1]) * x1 + K0 * v_lead;
+      double u1 = (A[2] - K1 * C[0]) * x0 + (A[3] - K1 * C[1]) * x1 + K1 * v_lead;
+      x0 = u0, x1 = u1;
+    }
+    a_lead_tau = std::abs(x1) < 0.5 ? 1.5 : a_lead_tau * 0.9;
+    cnt++;
+  }
+};
+
+struct Cycle {
+  std::vector<uint64_t> id;
+  std::vector<double> d, y, v;
+  std::vector<uint8_t> measured;  // as bools
+  std::vector<int> labels;  // by id
+  int n_clusters;
+};
+
+// about n tracks, a few of them replaced every cycle, in the order a radar reports them
+static std::vector<Cycle> random_cycles(std::mt19937& gen, int n, int count) {
+  std::uniform_real_distribution<double> d(2, 150), y(-10, 10), v(-30, 5), u(0, 1);
+  std::map<uint64_t, std::array<double, 3>> live;
+  uint64_t next_id = 1000;
+  std::vector<Cycle> cycles;
+  for (int c = 0; c < count; c++) {
+    for (auto it = live.begin(); it != live.end();) {
+      it = u(gen) < 0.05 ? live.erase(it) : std::next(it);
+    }
+    while (live.size() < n) {
+      live[next_id++ * 7 % 10007] = {d(gen), y(gen), v(gen)};
+    }
+    Cycle cycle;
+    for (auto& [id, t] : live) {
+      t[2] += std::normal_distribution<double>(0, 0.3)(gen);
+      t[0] += t[2] * DT;
+      cycle.id.push_back(id);
+      cycle.d.push_back(t[0]);
+      cycle.y.push_back(t[1]);
+      cycle.v.push_back(t[2]);
+      cycle.measured.push_back(u(gen) < 0.8);
+    }
+    // not sorted, and sometimes a repeated point
+    for (int i = cycle.id.size() - 1; i > 0; i--) {
+      int j = std::uniform_int_distribution<int>(0, i)(gen);
+      std::swap(cycle.id[i], cycle.id[j]);
+      std::swap(cycle.d[i], cycle.d[j]);
+      std::swap(cycle.y[i], cycle.y[j]);
+      std::swap(cycle.v[i], cycle.v[j]);
+      std::swap(cycle.measured[i], cycle.measured[j]);
+    }
+    if (!cycle.id.empty() && u(gen) < 0.2) {
+      cycle.id.push_back(cycle.id[0]);
+      cycle.d.push_back(cycle.d[0] + 1);
+      cycle.y.push_back(cycle.y[0]);
+      cycle.v.push_back(cycle.v[0]);
+      cycle.measured.push_back(true);
+    }
+    cycle.n_clusters = std::max<int>(1, live.size() / 3);
+    for (int i = 0; i < live.size(); i++) {
+      cycle.labels.push_back(std::uniform_int_distribution<int>(0, cycle.n_clusters - 1)(gen));
+    }
+    cycles.push_back(cycle);
+  }
+  return cycles;
+}
+
+struct Reference {
+  std::map<uint64_t, Track> tracks;
+
+  void update(const Cycle& c, double v_ego) {
+    std::map<uint64_t, int> points;
+    for (int i = 0; i < c.id.size(); i++) points[c.id[i]] = i;
+    for (auto it = tracks.begin(); it != tracks.end();) {
+      it = points.count(it->first) ? std::next(it) : tracks.erase(it);
+    }
+    for (auto [id, i] : points) {
+      double v_lead = c.v[i] + v_ego;
+      auto it = tracks.try_emplace(id, v_lead).first;
+      it->second.update(c.d[i], c.y[i], c.v[i], v_lead, c.measured[i]);
+    }
+
+    // Cluster.aLeadK and Cluster.aLeadTau
+    std::vector<double> a(c.n_clusters), tau(c.n_clusters);
+    std::vector<int> cnt(c.n_clusters);
+    int p = 0;
+    for (auto& [id, t] : tracks) {
+      if (t.cnt > 1) a[c.labels[p]] += t.x1, tau[c.labels[p]] += t.a_lead_tau, cnt[c.labels[p]]++;
+      p++;
+    }
+    p = 0;
+    for (auto& [id, t] : tracks) {
+      int l = c.labels[p++];
+      if (t.cnt <= 1) {
+        t.x0 = t.v_lead;
+        t.x1 = cnt[l] ? a[l] / cnt[l] : 0;
+        t.a_lead_tau = cnt[l] ? tau[l] / cnt[l] : 1.5;
+      }
+    }
+  }
+};
+
+static void update(RadarTracks* rt, const Cycle& c, double v_ego, RadarTrackBatch* out) {
+  const bool* measured = reinterpret_cast<const bool*>(c.measured.data());
+  radar_tracks_update(rt, c.id.size(), c.id.data(), c.d.data(), c.y.data(), c.v.data(), measured, v_ego, out);
+  radar_tracks_reset_new(rt, c.labels.data(), c.n_clusters);
+}
+
+// compares radar_tracks_update to a Track object per track, like radar_helpers.py has, on
+// random radar cycles with tracks coming and going
+TEST_CASE("radar_tracks_update keeps the same tracks as a Track per point") {
+  std::mt19937 gen(0);
+  int cycles = 0;
+  for (int n : {0, 1, 16, 64}) {
+    RadarTracks* rt = radar_tracks_create(A, C, K);
+    Reference ref;
+    for (const Cycle& c : random_cycles(gen, n, 500)) {
+      const double v_ego = 20.0 + std::sin(cycles * 0.01);
+      RadarTrackBatch out;
+      update(rt, c, v_ego, &out);
+      ref.update(c, v_ego);
+
+      INFO(n << " tracks, cycle " << cycles);
+      REQUIRE(out.n == ref.tracks.size());
+      int p = 0;
+      for (auto& [id, t] : ref.tracks) {
+        REQUIRE(out.id[p] == id);
+        REQUIRE(out.d_rel[p] == t.d_rel);
+        REQUIRE(out.y_rel[p] == t.y_rel);
+        REQUIRE(out.v_rel[p] == t.v_rel);
+        REQUIRE(out.v_lead[p] == t.v_lead);
+        REQUIRE(out.v_lead_k[p] == t.x0);
+        REQUIRE(out.a_lead_k[p] == t.x1);
+        REQUIRE(out.a_lead_tau[p] == t.a_lead_tau);
+        REQUIRE(out.cnt[p] == t.cnt);
+        REQUIRE(out.measured[p] == t.measured);
+        p++;
+      }
+      cycles++;
+    }
+    radar_tracks_destroy(rt);
+  }
+}
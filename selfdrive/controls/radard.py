@@ -1,7 +1,6 @@
 #!/usr/bin/env python3
 import importlib
-import math
-from collections import defaultdict, deque
+from collections import deque
 
 import cereal.messaging as messaging
 from cereal import car
@@ -9,8 +8,8 @@ from common.numpy_fast import interp
 from common.params import Params
 from common.realtime import Ratekeeper, Priority, config_realtime_process
 from selfdrive.config import RADAR_TO_CAMERA
-from selfdrive.controls.lib.cluster.fastcluster_py import cluster_points_centroid
-from selfdrive.controls.lib.radar_helpers import Cluster, Track
+from selfdrive.controls.lib.cluster.fastcluster_py import RadarClusters, RadarTracks
+from selfdrive.controls.lib.radar_helpers import Cluster
 from selfdrive.swaglog import cloudlog
 from selfdrive.hardware import TICI
 
@@ -37,40 +36,17 @@ class KalmanParams():
     self.K = [[interp(dt, dts, K0)], [interp(dt, dts, K1)]]
 
 
-def laplacian_cdf(x, mu, b):
-  b = max(b, 1e-4)
-  return math.exp(-abs(x-mu)/b)
+def vision_lead(lead_msg):
+  # where vision puts the lead, in radar coordinates
+  return (lead_msg.x[0] - RADAR_TO_CAMERA, -lead_msg.y[0], lead_msg.v[0],
+          lead_msg.xStd[0], lead_msg.yStd[0], lead_msg.vStd[0])
 
 
-def match_vision_to_cluster(v_ego, lead, clusters):
-  # match vision point to best statistical cluster match
-  offset_vision_dist = lead.x[0] - RADAR_TO_CAMERA
-
-  def prob(c):
-    prob_d = laplacian_cdf(c.dRel, offset_vision_dist, lead.xStd[0])
-    prob_y = laplacian_cdf(c.yRel, -lead.y[0], lead.yStd[0])
-    prob_v = laplacian_cdf(c.vRel + v_ego, lead.v[0], lead.vStd[0])
-
-    # This is isn't exactly right, but good heuristic
-    return prob_d * prob_y * prob_v
-
-  cluster = max(clusters, key=prob)
-
-  # if no 'sane' match is found return -1
-  # stationary radar points can be false positives
-  dist_sane = abs(cluster.dRel - offset_vision_dist) < max([(offset_vision_dist)*.25, 5.0])
-  vel_sane = (abs(cluster.vRel + v_ego - lead.v[0]) < 10) or (v_ego + cluster.vRel > 3)
-  if dist_sane and vel_sane:
-    return cluster
-  else:
-    return None
-
-
-def get_lead(v_ego, ready, clusters, lead_msg, low_speed_override=True):
+def get_lead(v_ego, ready, lead_msg, cluster, low_speed_cluster, low_speed_override=True):
   # Determine leads, this is where the essential logic happens
-  if len(clusters) > 0 and ready and lead_msg.prob > .5:
-    cluster = match_vision_to_cluster(v_ego, lead_msg, clusters)
-  else:
+  # cluster is the best sane statistical match to the vision lead, low_speed_cluster the
+  # closest one to stop for at low speed, both from RadarClusters.update
+  if not (ready and lead_msg.prob > .5):
     cluster = None
 
   lead_dict = {'status': False}
@@ -79,14 +55,10 @@ def get_lead(v_ego, ready, clusters, lead_msg, low_speed_override=True):
   elif (cluster is None) and ready and (lead_msg.prob > .5):
     lead_dict = Cluster().get_RadarState_from_vision(lead_msg, v_ego)
 
-  if low_speed_override:
-    low_speed_clusters = [c for c in clusters if c.potential_low_speed_lead(v_ego)]
-    if len(low_speed_clusters) > 0:
-      closest_cluster = min(low_speed_clusters, key=lambda c: c.dRel)
-
-      # Only choose new cluster if it is actually closer than the previous one
-      if (not lead_dict['status']) or (closest_cluster.dRel < lead_dict['dRel']):
-        lead_dict = closest_cluster.get_RadarState()
+  if low_speed_override and low_speed_cluster is not None:
+    # Only choose new cluster if it is actually closer than the previous one
+    if (not lead_dict['status']) or (low_speed_cluster.dRel < lead_dict['dRel']):
+      lead_dict = low_speed_cluster.get_RadarState()
 
   return lead_dict
 
@@ -95,8 +67,9 @@ class RadarD():
   def __init__(self, radar_ts, delay=0):
     self.current_time = 0
 
-    self.tracks = defaultdict(dict)
     self.kalman_params = KalmanParams(radar_ts)
+    self.radar_tracks = RadarTracks(self.kalman_params)
+    self.radar_clusters = RadarClusters(2.5)
 
     # v_ego
     self.v_ego = 0.
@@ -113,54 +86,28 @@ class RadarD():
     if sm.updated['modelV2']:
       self.ready = True
 
-    ar_pts = {}
-    for pt in rr.points:
-      ar_pts[pt.trackId] = [pt.dRel, pt.yRel, pt.vRel, pt.measured]
-
-    # *** remove missing points from meta data ***
-    for ids in list(self.tracks.keys()):
-      if ids not in ar_pts:
-        self.tracks.pop(ids, None)
-
-    # *** compute the tracks ***
-    for ids in ar_pts:
-      rpt = ar_pts[ids]
-
-      # align v_ego by a fixed time to align it with the radar measurement
-      v_lead = rpt[2] + self.v_ego_hist[0]
-
-      # create the track if it doesn't exist or it's a new track
-      if ids not in self.tracks:
-        self.tracks[ids] = Track(v_lead, self.kalman_params)
-      self.tracks[ids].update(rpt[0], rpt[1], rpt[2], v_lead, rpt[3])
-
-    idens = list(sorted(self.tracks.keys()))
-    track_pts = [self.tracks[iden].get_key_for_cluster() for iden in idens]
-
-    # If we have multiple points, cluster them
-    if len(track_pts) > 1:
-      cluster_idxs = cluster_points_centroid(track_pts, 2.5)
-      clusters = [None] * (max(cluster_idxs) + 1)
-
-      for idx in range(len(track_pts)):
-        cluster_i = cluster_idxs[idx]
-        if clusters[cluster_i] is None:
-          clusters[cluster_i] = Cluster()
-        clusters[cluster_i].add(self.tracks[idens[idx]])
-    elif len(track_pts) == 1:
-      # FIXME: cluster_point_centroid hangs forever if len(track_pts) == 1
-      cluster_idxs = [0]
-      clusters = [Cluster()]
-      clusters[0].add(self.tracks[idens[0]])
-    else:
-      clusters = []
+    # *** compute the tracks, align v_ego by a fixed time to align it with the radar measurement ***
+    pts = rr.points
+    tracks = self.radar_tracks.update([pt.trackId for pt in pts], [pt.dRel for pt in pts], [pt.yRel for pt in pts],
+                                      [pt.vRel for pt in pts], [pt.measured for pt in pts], self.v_ego_hist[0])
+
+    # cluster them and match the vision leads to the clusters
+    leads_v3 = sm['modelV2'].leadsV3 if enable_lead else []
+    leads = [vision_lead(leads_v3[0]), vision_lead(leads_v3[1])] if len(leads_v3) > 1 else []
+    cluster_idxs, lead_clusters, low_speed_cluster = self.radar_clusters.update(
+      tracks.n, tracks.d_rel, tracks.y_rel, tracks.v_rel, self.v_ego, leads)
 
     # if a new point, reset accel to the rest of the cluster
-    for idx in range(len(track_pts)):
-      if self.tracks[idens[idx]].cnt <= 1:
-        aLeadK = clusters[cluster_idxs[idx]].aLeadK
-        aLeadTau = clusters[cluster_idxs[idx]].aLeadTau
-        self.tracks[idens[idx]].reset_a_lead(aLeadK, aLeadTau)
+    self.radar_tracks.reset_new(cluster_idxs)
+
+    def cluster(label):
+      if label is None:
+        return None
+      c = Cluster()
+      for idx, cluster_i in enumerate(cluster_idxs):
+        if cluster_i == label:
+          c.add(self.radar_tracks.track(idx))
+      return c
 
     # *** publish radarState ***
     dat = messaging.new_message('radarState')
@@ -171,11 +118,11 @@ class RadarD():
     radarState.radarErrors = list(rr.errors)
     radarState.carStateMonoTime = sm.logMonoTime['carState']
 
-    if enable_lead:
-      leads_v3 = sm['modelV2'].leadsV3
-      if len(leads_v3) > 1:
-        radarState.leadOne = get_lead(self.v_ego, self.ready, clusters, leads_v3[0], low_speed_override=True)
-        radarState.leadTwo = get_lead(self.v_ego, self.ready, clusters, leads_v3[1], low_speed_override=False)
+    if len(leads) > 1:
+      radarState.leadOne = get_lead(self.v_ego, self.ready, leads_v3[0], cluster(lead_clusters[0]), cluster(low_speed_cluster),
+                                    low_speed_override=True)
+      radarState.leadTwo = get_lead(self.v_ego, self.ready, leads_v3[1], cluster(lead_clusters[1]), None,
+                                    low_speed_override=False)
     return dat
 
 
@@ -223,15 +170,15 @@ def radard_thread(sm=None, pm=None, can_sock=None):
     pm.send('radarState', dat)
 
     # *** publish tracks for UI debugging (keep last) ***
-    tracks = RD.tracks
-    dat = messaging.new_message('liveTracks', len(tracks))
+    tracks = RD.radar_tracks.tracks
+    dat = messaging.new_message('liveTracks', tracks.n)
 
-    for cnt, ids in enumerate(sorted(tracks.keys())):
+    for cnt in range(tracks.n):
       dat.liveTracks[cnt] = {
-        "trackId": ids,
-        "dRel": float(tracks[ids].dRel),
-        "yRel": float(tracks[ids].yRel),
-        "vRel": float(tracks[ids].vRel),
+        "trackId": tracks.id[cnt],
+        "dRel": float(tracks.d_rel[cnt]),
+        "yRel": float(tracks.y_rel[cnt]),
+        "vRel": float(tracks.v_rel[cnt]),
       }
     pm.send('liveTracks', dat)
 
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Replays the liveTracks of a log through a Track per point, the way radard used to update its
+# tracks, and through RadarTracks, checks that both filter the same and times a radar cycle of each
+import argparse
+import time
+
+import numpy as np
+
+from tools.lib.logreader import LogReader
+from selfdrive.controls.radard import KalmanParams
+from selfdrive.controls.lib.radar_helpers import Cluster, Track
+from selfdrive.controls.lib.cluster.fastcluster_py import RadarClusters, RadarTracks, cluster_points_centroid
+
+
+def python_cycle(tracks, kalman_params, pts, v_ego):
+  ar_pts = {pt[0]: pt for pt in pts}
+  for ids in list(tracks.keys()):
+    if ids not in ar_pts:
+      tracks.pop(ids, None)
+
+  for ids, pt in ar_pts.items():
+    v_lead = pt[3] + v_ego
+    if ids not in tracks:
+      tracks[ids] = Track(v_lead, kalman_params)
+    tracks[ids].update(pt[1], pt[2], pt[3], v_lead, True)
+
+  idens = list(sorted(tracks.keys()))
+  track_pts = [tracks[iden].get_key_for_cluster() for iden in idens]
+  if len(track_pts) > 1:
+    cluster_idxs = cluster_points_centroid(track_pts, 2.5)
+  else:
+    cluster_idxs = [0] * len(track_pts)
+
+  clusters = [Cluster() for _ in range(max(cluster_idxs, default=-1) + 1)]
+  for idx, iden in enumerate(idens):
+    clusters[cluster_idxs[idx]].add(tracks[iden])
+  for idx, iden in enumerate(idens):
+    if tracks[iden].cnt <= 1:
+      tracks[iden].reset_a_lead(clusters[cluster_idxs[idx]].aLeadK, clusters[cluster_idxs[idx]].aLeadTau)
+  return [tracks[iden] for iden in idens]
+
+
+def native_cycle(radar_tracks, radar_clusters, pts, v_ego):
+  tracks = radar_tracks.update([pt[0] for pt in pts], [pt[1] for pt in pts], [pt[2] for pt in pts],
+                               [pt[3] for pt in pts], [True] * len(pts), v_ego)
+  cluster_idxs, _, _ = radar_clusters.update(tracks.n, tracks.d_rel, tracks.y_rel, tracks.v_rel, v_ego, [])
+  radar_tracks.reset_new(cluster_idxs)
+  return tracks
+
+
+def stats(times):
+  times = np.array(times) * 1e6
+  return f"mean {np.mean(times):7.1f} us, p50 {np.percentile(times, 50):7.1f} us, p99 {np.percentile(times, 99):7.1f} us"
+
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(description="Time the radard tracks on the liveTracks of a log")
+  parser.add_argument("log", help="rlog or qlog, path or url")
+  args = parser.parse_args()
+
+  radar_ts = 0.05
+  v_ego = 0.
+  cycles = []
+  for msg in LogReader(args.log):
+    if msg.which() == 'carParams':
+      radar_ts = msg.carParams.radarTimeStep or radar_ts
+    elif msg.which() == 'carState':
+      v_ego = msg.carState.vEgo
+    elif msg.which() == 'liveTracks':
+      cycles.append(([(t.trackId, t.dRel, t.yRel, t.vRel) for t in msg.liveTracks], v_ego))
+  print(f"{len(cycles)} radar cycles, {max((len(c[0]) for c in cycles), default=0)} tracks at most")
+
+  kalman_params = KalmanParams(radar_ts)
+  tracks = {}
+  radar_tracks, radar_clusters = RadarTracks(kalman_params), RadarClusters(2.5)
+  python_times, native_times = [], []
+  max_diff = 0.
+  for pts, v_ego in cycles:
+    t = time.perf_counter()
+    python_tracks = python_cycle(tracks, kalman_params, pts, v_ego)
+    python_times.append(time.perf_counter() - t)
+
+    t = time.perf_counter()
+    native_tracks = native_cycle(radar_tracks, radar_clusters, pts, v_ego)
+    native_times.append(time.perf_counter() - t)
+
+    assert native_tracks.n == len(python_tracks)
+    for i, track in enumerate(python_tracks):
+      max_diff = max(max_diff, abs(native_tracks.v_lead_k[i] - track.vLeadK), abs(native_tracks.a_lead_k[i] - track.aLeadK),
+                     abs(native_tracks.a_lead_tau[i] - track.aLeadTau))
+
+  print(f"Track per point:      {stats(python_times)}")
+  print(f"RadarTracks:          {stats(native_times)}")
+  print(f"largest difference in vLeadK, aLeadK and aLeadTau: {max_diff:.2e}")
@@ -0,0 +1,99 @@
+// Times decoding the ubloxRaw of rlogs with the views of ublox_decode.h against the kaitai
+// parsers they replaced, and checks both read the same values. The raw data is framed by
+// UbloxMsgParser in the chunks it was logged in, like ubloxd gets it.
+//
+// Usage: ./bench_ublox rlog...
+
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/locationd/tests/ublox_decoders.h"
+#include "selfdrive/locationd/ublox_msg.h"
+#include "selfdrive/ui/replay/logreader.h"
+
+using namespace ublox;
+
+constexpr int ITERATIONS = 20;
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s rlog...\n", argv[0]);
+    return 1;
+  }
+
+  // the messages the views decode, as the parser hands them out
+  UbloxMsgParser parser;
+  std::vector<std::string> msgs;
+  size_t raw_bytes = 0;
+  for (int i = 1; i < argc; i++) {
+    LogReader lr;
+    if (!lr.load(argv[i])) {
+      fprintf(stderr, "failed to load %s\n", argv[i]);
+      return 1;
+    }
+    for (const Event *e : lr.events) {
+      if (e->which != cereal::Event::UBLOX_RAW) continue;
+
+      auto raw = e->event.getUbloxRaw();
+      raw_bytes += raw.size();
+      size_t consumed = 0;
+      while (consumed < raw.size()) {
+        size_t consumed_this_time = 0;
+        if (parser.add_data(raw.begin() + consumed, raw.size() - consumed, consumed_this_time)) {
+          std::string msg = parser.data();
+          const Message m = {(const uint8_t *)msg.data()};
+          if (view_size(m.msg_type()) > 0 && view_valid(m)) {
+            msgs.push_back(std::move(msg));
+          }
+          parser.reset();
+        }
+        consumed += consumed_this_time;
+      }
+    }
+  }
+  if (msgs.empty()) {
+    fprintf(stderr, "no ubloxRaw messages in %d logs\n", argc - 1);
+    return 1;
+  }
+
+  // same values, message by message
+  int mismatches = 0;
+  for (auto &msg : msgs) {
+    double sink_kaitai = NAN;
+    try {
+      sink_kaitai = decode_kaitai(msg);
+    } catch (const std::exception &e) {
+    }
+    const double sink_views = decode_views((const uint8_t *)msg.data());
+    if (sink_kaitai != sink_views && !(std::isnan(sink_kaitai) && std::isnan(sink_views))) {
+      mismatches++;
+    }
+  }
+
+  double sink_kaitai = 0, sink_views = 0;
+  double t1 = millis_since_boot();
+  for (int it = 0; it < ITERATIONS; it++) {
+    for (auto &msg : msgs) {
+      try {
+        sink_kaitai += decode_kaitai(msg);
+      } catch (const std::exception &e) {
+      }
+    }
+  }
+  double t2 = millis_since_boot();
+  for (int it = 0; it < ITERATIONS; it++) {
+    for (auto &msg : msgs) sink_views += decode_views((const uint8_t *)msg.data());
+  }
+  double t3 = millis_since_boot();
+
+  const double n = ITERATIONS * msgs.size();
+  printf("%zu bytes of ubloxRaw, %zu messages, %d decoded differently\n", raw_bytes, msgs.size(), mismatches);
+  printf("per message: kaitai %.2f us, views %.3f us\n", (t2 - t1) * 1000 / n, (t3 - t2) * 1000 / n);
+  const bool same_sums = sink_kaitai == sink_views || (std::isnan(sink_kaitai) && std::isnan(sink_views));
+  return mismatches == 0 && same_sums ? 0 : 1;
+}
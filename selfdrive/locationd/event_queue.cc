@@ -0,0 +1,58 @@
+#include "selfdrive/locationd/event_queue.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "selfdrive/common/timing.h"
+
+// the first event on top
+static bool later(const EventQueue::Event &a, const EventQueue::Event &b) {
+  return a.time > b.time;
+}
+
+uint64_t EventQueue::event_time(const cereal::Event::Reader &log) {
+  uint64_t time = log.getLogMonoTime();
+  if (log.isSensorEvents()) {
+    uint64_t first = UINT64_MAX;
+    for (const auto &sensor_reading : log.getSensorEvents()) {
+      // empty readings have none
+      if (sensor_reading.getTimestamp() != 0) {
+        first = std::min<uint64_t>(first, sensor_reading.getTimestamp());
+      }
+    }
+    if (first != UINT64_MAX) {
+      time = first;
+    }
+  }
+  return time;
+}
+
+void EventQueue::push(Event &&event) {
+  {
+    std::lock_guard lk(this->lock);
+    this->heap.push_back(std::move(event));
+    std::push_heap(this->heap.begin(), this->heap.end(), later);
+  }
+  this->cv.notify_one();
+}
+
+void EventQueue::pop_due(uint64_t window, uint64_t deadline, std::vector<Event> &out) {
+  std::unique_lock lk(this->lock);
+  uint64_t now = nanos_since_boot();
+  while (true) {
+    uint64_t wake = deadline;
+    if (!this->heap.empty()) {
+      wake = std::min(wake, this->heap.front().rcv_time + window);
+    }
+    if (now >= wake) break;
+    this->cv.wait_for(lk, std::chrono::nanoseconds(wake - now));
+    now = nanos_since_boot();
+  }
+
+  // one received later but before in time holds up the ones after it until it is due
+  while (!this->heap.empty() && this->heap.front().rcv_time + window <= now) {
+    std::pop_heap(this->heap.begin(), this->heap.end(), later);
+    out.push_back(std::move(this->heap.back()));
+    this->heap.pop_back();
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+
+// The events of all inputs, handed to the filter in the order of their time once they have
+// waited out the reorder window, so one that arrives a bit late still goes in before the ones
+// after it and the filter rarely has to rewind. The window runs on the local clock from when an
+// event was received; the time of an event only orders it, it comes from the clock of whoever
+// published it, which isn't ours during replay
+class EventQueue {
+public:
+  struct Event {
+    uint64_t time;      // see event_time
+    uint64_t rcv_time;  // nanos_since_boot when it was received
+    int input;
+    kj::Array<capnp::word> words;
+  };
+
+  // logMonoTime, or for sensorEvents the earliest sensor timestamp, the filter takes the readings at those
+  static uint64_t event_time(const cereal::Event::Reader &log);
+
+  void push(Event &&event);
+  // waits until the first event is due or until deadline, and moves the due ones to out, in order
+  void pop_due(uint64_t window, uint64_t deadline, std::vector<Event> &out);
+
+private:
+  std::mutex lock;
+  std::condition_variable cv;
+  std::vector<Event> heap;
+};
@@ -1,8 +1,12 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <thread>
 
+#include "cereal/services.h"
 #include "locationd.h"
 
 using namespace EKFS;
@@ -69,9 +73,10 @@ Localizer::Localizer() {
   this->converter = std::make_unique<LocalCoord>((ECEF) { .x = ecef_pos[0], .y = ecef_pos[1], .z = ecef_pos[2] });
 }
 
-void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix) {
-  VectorXd predicted_state = this->kf->get_x();
-  MatrixXdr predicted_cov = this->kf->get_P();
+void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix, double predict_time) {
+  VectorXd predicted_state;
+  MatrixXdr predicted_cov;
+  this->kf->get_predicted(predict_time, predicted_state, predicted_cov);
   VectorXd predicted_std = predicted_cov.diagonal().array().sqrt();
 
   VectorXd fix_ecef = predicted_state.segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START);
@@ -79,7 +84,8 @@ void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix) {
   VectorXd fix_ecef_std = predicted_std.segment<STATE_ECEF_POS_ERR_LEN>(STATE_ECEF_POS_ERR_START);
   VectorXd vel_ecef = predicted_state.segment<STATE_ECEF_VELOCITY_LEN>(STATE_ECEF_VELOCITY_START);
   VectorXd vel_ecef_std = predicted_std.segment<STATE_ECEF_VELOCITY_ERR_LEN>(STATE_ECEF_VELOCITY_ERR_START);
-  VectorXd fix_pos_geo_vec = this->get_position_geodetic();
+  Geodetic fix_pos_geo = ecef2geodetic(fix_ecef_ecef);
+  VectorXd fix_pos_geo_vec = Vector3d(fix_pos_geo.lat, fix_pos_geo.lon, fix_pos_geo.alt);
   VectorXd orientation_ecef = quat2euler(vector2quat(predicted_state.segment<STATE_ECEF_ORIENTATION_LEN>(STATE_ECEF_ORIENTATION_START)));
   VectorXd orientation_ecef_std = predicted_std.segment<STATE_ECEF_ORIENTATION_ERR_LEN>(STATE_ECEF_ORIENTATION_ERR_START);
   MatrixXdr orientation_ecef_cov = predicted_cov.block<STATE_ECEF_ORIENTATION_ERR_LEN, STATE_ECEF_ORIENTATION_ERR_LEN>(STATE_ECEF_ORIENTATION_ERR_START, STATE_ECEF_ORIENTATION_ERR_START);
@@ -195,6 +201,14 @@ VectorXd Localizer::get_stdev() {
   return this->kf->get_P().diagonal().array().sqrt();
 }
 
+void Localizer::set_process_noise(const VectorXd& Q_diag) {
+  this->kf->set_process_noise(Q_diag.asDiagonal());
+}
+
+void Localizer::set_obs_noise(int kind, const VectorXd& R_diag) {
+  this->kf->set_obs_noise(kind, R_diag.asDiagonal());
+}
+
 void Localizer::handle_sensors(double current_time, const capnp::List<cereal::SensorEventData, capnp::Kind::STRUCT>::Reader& log) {
   // TODO does not yet account for double sensor readings in the log
   for (int i = 0; i < log.size(); i++) {
@@ -427,6 +441,7 @@ void Localizer::reset_kalman(double current_time, VectorXd init_x, MatrixXdr ini
   this->kf->init_state(init_x, init_P, current_time);
   this->last_reset_time = current_time;
   this->reset_tracker += 1.0;
+  this->reset_count++;
 }
 
 void Localizer::handle_msg_bytes(const char *data, const size_t size) {
@@ -456,17 +471,16 @@ void Localizer::handle_msg(const cereal::Event::Reader& log) {
   this->update_reset_tracker();
 }
 
-kj::ArrayPtr<capnp::byte> Localizer::get_message_bytes(MessageBuilder& msg_builder, uint64_t logMonoTime,
-  bool inputsOK, bool sensorsOK, bool gpsOK)
+void Localizer::build_message(MessageBuilder& msg_builder, uint64_t logMonoTime,
+  bool inputsOK, bool sensorsOK, bool gpsOK, double predict_time)
 {
   cereal::Event::Builder evt = msg_builder.initEvent();
   evt.setLogMonoTime(logMonoTime);
   evt.setValid(inputsOK);
   cereal::LiveLocationKalman::Builder liveLoc = evt.initLiveLocationKalman();
-  this->build_live_location(liveLoc);
+  this->build_live_location(liveLoc, predict_time);
   liveLoc.setSensorsOK(sensorsOK);
   liveLoc.setGpsOK(gpsOK);
-  return msg_builder.toBytes();
 }
 
 
@@ -490,9 +504,42 @@ void Localizer::determine_gps_mode(double current_time) {
   }
 }
 
-int Localizer::locationd_thread() {
-  const std::initializer_list<const char *> service_list =
-      { "gpsLocationExternal", "sensorEvents", "cameraOdometry", "liveCalibration", "carState" };
+// Reads one input, without conflating, so a slow one never holds up the others. Polls instead of
+// a blocking receive, that swaps the signal handlers and can't be done from several threads
+static void receive_thread(Context *ctx, const char *name, int input, EventQueue *queue) {
+  std::unique_ptr<SubSocket> sock(SubSocket::create(ctx, name));
+  assert(sock != NULL);
+  std::unique_ptr<Poller> poller(Poller::create({ sock.get() }));
+
+  while (!do_exit) {
+    if (poller->poll(100).empty()) continue;
+
+    std::unique_ptr<Message> msg(sock->receive(true));
+    if (!msg) continue;
+
+    EventQueue::Event event = { .rcv_time = nanos_since_boot(), .input = input };
+    event.words = kj::heapArray<capnp::word>(msg->getSize() / sizeof(capnp::word) + 1);
+    memcpy(event.words.begin(), msg->getData(), msg->getSize());
+    capnp::FlatArrayMessageReader cmsg(event.words);
+    event.time = EventQueue::event_time(cmsg.getRoot<cereal::Event>());
+    queue->push(std::move(event));
+  }
+}
+
+static const std::vector<const char *> service_list =
+    { "gpsLocationExternal", "sensorEvents", "cameraOdometry", "liveCalibration", "carState" };
+
+void Localizer::save_gps_position() {
+  VectorXd posGeo = this->get_position_geodetic();
+  std::string lastGPSPosJSON = util::string_format(
+    "{\"latitude\": %.15f, \"longitude\": %.15f, \"altitude\": %.15f}", posGeo(0), posGeo(1), posGeo(2));
+
+  std::thread([] (const std::string gpsjson) {
+    Params().put("LastGPSPosition", gpsjson);
+  }, lastGPSPosJSON).detach();
+}
+
+int Localizer::locationd_thread_lockstep() {
   PubMaster pm({ "liveLocationKalman" });
   SubMaster sm(service_list, nullptr, { "gpsLocationExternal" });
 
@@ -508,7 +555,6 @@ int Localizer::locationd_thread() {
         }
       }
     }
-    
 
     if (sm.updated("cameraOdometry")) {
       uint64_t logMonoTime = sm["cameraOdometry"].getLogMonoTime();
@@ -516,18 +562,12 @@ int Localizer::locationd_thread() {
       bool sensorsOK = sm.alive("sensorEvents") && sm.valid("sensorEvents");
       bool gpsOK = this->isGpsOK();
 
-      MessageBuilder msg_builder;
-      kj::ArrayPtr<capnp::byte> bytes = this->get_message_bytes(msg_builder, logMonoTime, inputsOK, sensorsOK, gpsOK);
-      pm.send("liveLocationKalman", bytes.begin(), bytes.size());
+      MessageBuilder msg_builder("liveLocationKalman");
+      this->build_message(msg_builder, logMonoTime, inputsOK, sensorsOK, gpsOK);
+      pm.send("liveLocationKalman", msg_builder);
 
       if (cnt % 1200 == 0 && gpsOK) {  // once a minute
-        VectorXd posGeo = this->get_position_geodetic();
-        std::string lastGPSPosJSON = util::string_format(
-          "{\"latitude\": %.15f, \"longitude\": %.15f, \"altitude\": %.15f}", posGeo(0), posGeo(1), posGeo(2));
-
-        std::thread([] (const std::string gpsjson) {
-          Params().put("LastGPSPosition", gpsjson);
-        }, lastGPSPosJSON).detach();
+        this->save_gps_position();
       }
       cnt++;
     }
@@ -535,9 +575,89 @@ int Localizer::locationd_thread() {
   return 0;
 }
 
-int main() {
-  util::set_realtime_priority(5);
+int Localizer::locationd_thread() {
+  // process_replay sends the inputs one at a time off another clock and waits for the output
+  if (util::getenv("LOCATIOND_LOCKSTEP", 0) == 1) {
+    return this->locationd_thread_lockstep();
+  }
+
+  PubMaster pm({ "liveLocationKalman" });
+
+  // alive and valid like SubMaster has them, from the events the filter got so far
+  struct Input {
+    const char *name;
+    int freq;
+    bool ignore_alive;
+    uint64_t rcv_time;
+    bool valid;
+  };
+  std::vector<Input> inputs;
+  for (const char *name : service_list) {
+    auto it = std::find_if(std::begin(services), std::end(services), [=](auto &s) { return strcmp(s.name, name) == 0; });
+    assert(it != std::end(services));
+    inputs.push_back({ .name = name, .freq = it->frequency, .ignore_alive = strcmp(name, "gpsLocationExternal") == 0,
+                       .rcv_time = 0, .valid = true });
+  }
+  auto alive = [&](const Input &in, uint64_t now) {
+    return in.freq <= 1e-5 || (now - in.rcv_time) * 1e-9 < 10.0 / in.freq;
+  };
+  const Input &sensors = *std::find_if(inputs.begin(), inputs.end(), [](auto &in) { return strcmp(in.name, "sensorEvents") == 0; });
+  auto all_alive_and_valid = [&](uint64_t now) {
+    return std::all_of(inputs.begin(), inputs.end(), [&](const Input &in) { return in.valid && (alive(in, now) || in.ignore_alive); });
+  };
+
+  EventQueue queue;
+  std::unique_ptr<Context> ctx(Context::create());
+  std::vector<std::thread> receivers;
+  for (int i = 0; i < inputs.size(); i++) {
+    receivers.emplace_back(receive_thread, ctx.get(), inputs[i].name, i, &queue);
+  }
+
+  const uint64_t publish_interval = 1000000000ULL / PUBLISH_RATE;
+  uint64_t next_publish = nanos_since_boot() + publish_interval;
+  std::vector<EventQueue::Event> events;
+
+  uint64_t cnt = 0;
+
+  while (!do_exit) {
+    events.clear();
+    queue.pop_due(REORDER_WINDOW, next_publish, events);
+
+    for (auto &event : events) {
+      capnp::FlatArrayMessageReader cmsg(event.words);
+      const cereal::Event::Reader log = cmsg.getRoot<cereal::Event>();
+      Input &in = inputs[event.input];
+      in.rcv_time = event.rcv_time;
+      in.valid = log.getValid();
+      if (all_alive_and_valid(nanos_since_boot())) {
+        this->handle_msg(log);
+      }
+    }
 
-  Localizer localizer;
-  return localizer.locationd_thread();
+    uint64_t now = nanos_since_boot();
+    if (now < next_publish) continue;
+    // skip the ticks missed, rather than publishing them all at once
+    next_publish = std::max(next_publish + publish_interval, now + publish_interval / 2);
+
+    // the filter is behind by the reorder window, the published state is predicted up to now.
+    // Not further than MAX_PUBLISH_PREDICT, without inputs it stays at the last event it took
+    double filter_time = this->kf->get_filter_time();
+    double predict_time = std::min(now * 1e-9, filter_time + MAX_PUBLISH_PREDICT);
+    uint64_t logMonoTime = std::isnan(filter_time) ? now : (uint64_t)(predict_time * 1e9);
+    bool inputsOK = all_alive_and_valid(now);
+    bool sensorsOK = alive(sensors, now) && sensors.valid;
+    bool gpsOK = this->isGpsOK();
+
+    MessageBuilder msg_builder("liveLocationKalman");
+    this->build_message(msg_builder, logMonoTime, inputsOK, sensorsOK, gpsOK, predict_time);
+    pm.send("liveLocationKalman", msg_builder);
+
+    if (cnt % 1200 == 0 && gpsOK) {  // once a minute
+      this->save_gps_position();
+    }
+    cnt++;
+  }
+
+  for (auto &t : receivers) t.join();
+  return 0;
 }
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "cereal/messaging/messaging.h"
 #include "common/transformations/coordinates.hpp"
@@ -16,15 +17,22 @@
 #include "selfdrive/sensord/sensors/constants.h"
 #define VISION_DECIMATION 2
 #define SENSOR_DECIMATION 10
+#include "selfdrive/locationd/event_queue.h"
 #include "selfdrive/locationd/models/live_kf.h"
 
 #define POSENET_STD_HIST_HALF 20
 
+#define PUBLISH_RATE 20  // Hz
+#define REORDER_WINDOW 30000000ULL  // ns
+#define MAX_PUBLISH_PREDICT 0.1  // s
+
 class Localizer {
 public:
   Localizer();
 
   int locationd_thread();
+  // publishes after every cameraOdometry like process_replay expects, handling the inputs as they come
+  int locationd_thread_lockstep();
 
   void reset_kalman(double current_time = NAN);
   void reset_kalman(double current_time, Eigen::VectorXd init_orient, Eigen::VectorXd init_pos, Eigen::VectorXd init_vel, MatrixXdr init_pos_R, MatrixXdr init_vel_R);
@@ -34,14 +42,19 @@ public:
   void update_reset_tracker();
   bool isGpsOK();
   void determine_gps_mode(double current_time);
+  void save_gps_position();
 
-  kj::ArrayPtr<capnp::byte> get_message_bytes(MessageBuilder& msg_builder, uint64_t logMonoTime,
-    bool inputsOK, bool sensorsOK, bool gpsOK);
-  void build_live_location(cereal::LiveLocationKalman::Builder& fix);
+  // predicted to predict_time when it is after the filter time, the filter itself stays where it is
+  void build_message(MessageBuilder& msg_builder, uint64_t logMonoTime,
+    bool inputsOK, bool sensorsOK, bool gpsOK, double predict_time = NAN);
+  void build_live_location(cereal::LiveLocationKalman::Builder& fix, double predict_time = NAN);
 
   Eigen::VectorXd get_position_geodetic();
   Eigen::VectorXd get_state();
   Eigen::VectorXd get_stdev();
+  int get_reset_count() const { return this->reset_count; }
+  void set_process_noise(const Eigen::VectorXd& Q_diag);
+  void set_obs_noise(int kind, const Eigen::VectorXd& R_diag);
 
   void handle_msg_bytes(const char *data, const size_t size);
   void handle_msg(const cereal::Event::Reader& log);
@@ -70,6 +83,7 @@ private:
   int64_t unix_timestamp_millis = 0;
   double last_gps_fix = 0;
   double reset_tracker = 0.0;
+  int reset_count = 0;
   bool device_fell = false;
   bool gps_mode = false;
 };
@@ -0,0 +1,220 @@
+// Runs locationd over rlogs offline, once per parameter set, on a thread pool, and prints how
+// far each run is from the gps. No msgq, the events go to Localizer::handle_msg in logMonoTime order
+//
+// usage: locationd_batch [-j threads] [-p params] rlog...
+//
+// every line of the params file is one trial of key=scale pairs that scale the default noise,
+// q.<state> for the process noise of a state and r.<observation> for an observation kind, e.g.
+//   q.acceleration=2 r.phone_accel=0.5
+// without a params file the defaults run once
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include "selfdrive/locationd/locationd.h"
+#include "selfdrive/ui/replay/logreader.h"
+
+using namespace Eigen;
+
+const double MIN_SPEED_FOR_YAW = 5.0;  // m/s
+const double MAX_GPS_ACCURACY = 10.0;  // m
+
+const std::map<std::string, std::pair<int, int>> PROCESS_NOISE_STATES = {
+  {"ecef_pos", {STATE_ECEF_POS_ERR_START, STATE_ECEF_POS_ERR_LEN}},
+  {"ecef_orientation", {STATE_ECEF_ORIENTATION_ERR_START, STATE_ECEF_ORIENTATION_ERR_LEN}},
+  {"ecef_velocity", {STATE_ECEF_VELOCITY_ERR_START, STATE_ECEF_VELOCITY_ERR_LEN}},
+  {"angular_velocity", {STATE_ANGULAR_VELOCITY_ERR_START, STATE_ANGULAR_VELOCITY_ERR_LEN}},
+  {"gyro_bias", {STATE_GYRO_BIAS_ERR_START, STATE_GYRO_BIAS_ERR_LEN}},
+  {"acceleration", {STATE_ACCELERATION_ERR_START, STATE_ACCELERATION_ERR_LEN}},
+  {"acc_bias", {STATE_ACC_BIAS_ERR_START, STATE_ACC_BIAS_ERR_LEN}},
+};
+
+// the kinds locationd observes with the default noise, gps and camera odometry bring their own
+const std::map<std::string, int> OBSERVATION_NOISE_KINDS = {
+  {"phone_gyro", OBSERVATION_PHONE_GYRO},
+  {"phone_accel", OBSERVATION_PHONE_ACCEL},
+  {"no_rot", OBSERVATION_NO_ROT},
+  {"no_accel", OBSERVATION_NO_ACCEL},
+  {"ecef_orientation_from_gps", OBSERVATION_ECEF_ORIENTATION_FROM_GPS},
+};
+
+struct Trial {
+  std::string params;
+  VectorXd Q_diag;
+  std::map<int, VectorXd> obs_noise_diag;
+};
+
+struct Result {
+  int fixes = 0;
+  double pos_err_sq = 0, pos_err_max = 0;
+  int headings = 0;
+  double yaw_err_sq = 0;
+  int resets = 0;
+};
+
+static bool parse_trial(const std::string &line, Trial &trial) {
+  trial.params = line;
+  trial.Q_diag = live_Q_diag;
+  trial.obs_noise_diag.clear();
+
+  std::istringstream ss(line);
+  std::string token;
+  while (ss >> token) {
+    size_t eq = token.find('=');
+    if (token.size() < 3 || token[1] != '.' || eq == std::string::npos) return false;
+    const std::string key = token.substr(2, eq - 2);
+    const double scale = std::atof(token.c_str() + eq + 1);
+
+    if (token[0] == 'q' && PROCESS_NOISE_STATES.count(key)) {
+      auto [start, len] = PROCESS_NOISE_STATES.at(key);
+      trial.Q_diag.segment(start, len) *= scale;
+    } else if (token[0] == 'r' && OBSERVATION_NOISE_KINDS.count(key)) {
+      const int kind = OBSERVATION_NOISE_KINDS.at(key);
+      if (!trial.obs_noise_diag.count(kind)) {
+        trial.obs_noise_diag[kind] = live_obs_noise_diag.at(kind);
+      }
+      trial.obs_noise_diag[kind] *= scale;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void score_gps(Localizer &localizer, const cereal::GpsLocationData::Reader &gps, Result &res) {
+  // fixes locationd would use, once it is running on gps
+  if (gps.getFlags() % 2 == 0 || gps.getAccuracy() > MAX_GPS_ACCURACY || !localizer.isGpsOK()) return;
+
+  ECEF gps_ecef = geodetic2ecef({ gps.getLatitude(), gps.getLongitude(), gps.getAltitude() });
+  VectorXd x = localizer.get_state();
+  const double pos_err = (x.segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START) - gps_ecef.to_vector()).norm();
+  res.fixes++;
+  res.pos_err_sq += pos_err * pos_err;
+  res.pos_err_max = std::max(res.pos_err_max, pos_err);
+
+  if (gps.getSpeed() > MIN_SPEED_FOR_YAW) {
+    Quaterniond q(x(STATE_ECEF_ORIENTATION_START), x(STATE_ECEF_ORIENTATION_START + 1),
+                  x(STATE_ECEF_ORIENTATION_START + 2), x(STATE_ECEF_ORIENTATION_START + 3));
+    Vector3d orientation_ned = ned_euler_from_ecef(gps_ecef, quat2euler(q));
+    const double yaw_err = std::remainder(orientation_ned(2) - DEG2RAD(gps.getBearingDeg()), 2.0 * M_PI);
+    res.headings++;
+    res.yaw_err_sq += yaw_err * yaw_err;
+  }
+}
+
+static Result run_trial(const Trial &trial, const std::vector<const Event *> &events) {
+  Localizer localizer;
+  localizer.set_process_noise(trial.Q_diag);
+  for (auto &[kind, R_diag] : trial.obs_noise_diag) {
+    localizer.set_obs_noise(kind, R_diag);
+  }
+
+  Result res;
+  for (const Event *e : events) {
+    // a reader counts what it reads, so every trial gets its own
+    capnp::FlatArrayMessageReader reader(e->words);
+    cereal::Event::Reader log = reader.getRoot<cereal::Event>();
+    if (log.isGpsLocationExternal()) {
+      // how far off the filter was before it sees the fix
+      score_gps(localizer, log.getGpsLocationExternal(), res);
+    }
+    localizer.handle_msg(log);
+  }
+  // not counting the one at startup
+  res.resets = localizer.get_reset_count() - 1;
+  return res;
+}
+
+int main(int argc, char *argv[]) {
+  int threads = std::thread::hardware_concurrency();
+  std::string params_file;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:p:")) != -1) {
+    if (opt == 'j') {
+      threads = std::max(1, atoi(optarg));
+    } else if (opt == 'p') {
+      params_file = optarg;
+    } else {
+      fprintf(stderr, "usage: %s [-j threads] [-p params] rlog...\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind == argc) {
+    fprintf(stderr, "usage: %s [-j threads] [-p params] rlog...\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<Trial> trials;
+  if (params_file.empty()) {
+    trials.emplace_back();
+    parse_trial("", trials.back());
+  } else {
+    std::ifstream f(params_file);
+    std::string line;
+    while (std::getline(f, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      trials.emplace_back();
+      if (!parse_trial(line, trials.back())) {
+        fprintf(stderr, "invalid parameters: %s\n", line.c_str());
+        return 1;
+      }
+    }
+  }
+
+  // the segments in the order given, every one sorted by logMonoTime
+  std::vector<std::unique_ptr<LogReader>> logs;
+  std::vector<const Event *> events;
+  for (int i = optind; i < argc; i++) {
+    logs.push_back(std::make_unique<LogReader>());
+    if (!logs.back()->load(argv[i])) {
+      fprintf(stderr, "failed to load %s\n", argv[i]);
+      return 1;
+    }
+    for (const Event *e : logs.back()->events) {
+      switch (e->which) {
+        case cereal::Event::SENSOR_EVENTS:
+        case cereal::Event::GPS_LOCATION_EXTERNAL:
+        case cereal::Event::CAR_STATE:
+        case cereal::Event::CAMERA_ODOMETRY:
+        case cereal::Event::LIVE_CALIBRATION:
+          events.push_back(e);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  std::stable_sort(events.begin(), events.end(), [](const Event *l, const Event *r) { return l->mono_time < r->mono_time; });
+  fprintf(stderr, "%zu events, %zu trials on %d threads\n", events.size(), trials.size(), threads);
+
+  std::vector<Result> results(trials.size());
+  std::atomic<int> next = 0;
+  std::vector<std::thread> pool;
+  double t1 = millis_since_boot();
+  for (int i = 0; i < std::min<int>(threads, trials.size()); i++) {
+    pool.emplace_back([&]() {
+      for (int t = next++; t < trials.size(); t = next++) {
+        results[t] = run_trial(trials[t], events);
+      }
+    });
+  }
+  for (auto &t : pool) t.join();
+  fprintf(stderr, "done in %.1f s\n", (millis_since_boot() - t1) / 1000.0);
+
+  printf("trial,fixes,pos_rmse,pos_max,yaw_rmse_deg,resets,params\n");
+  for (int t = 0; t < trials.size(); t++) {
+    const Result &r = results[t];
+    printf("%d,%d,%.3f,%.3f,%.3f,%d,%s\n", t, r.fixes,
+           r.fixes ? std::sqrt(r.pos_err_sq / r.fixes) : NAN, r.pos_err_max,
+           r.headings ? RAD2DEG(std::sqrt(r.yaw_err_sq / r.headings)) : NAN, r.resets, trials[t].params.c_str());
+  }
+  return 0;
+}
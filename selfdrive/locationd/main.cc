@@ -0,0 +1,9 @@
+#include "selfdrive/common/util.h"
+#include "selfdrive/locationd/locationd.h"
+
+int main() {
+  util::set_realtime_priority(5);
+
+  Localizer localizer;
+  return localizer.locationd_thread();
+}
@@ -28,8 +28,10 @@ std::vector<Eigen::Map<MatrixXdr>> get_vec_mapmat(std::vector<MatrixXdr>& mat_ve
 }
 
 LiveKalman::LiveKalman() {
-  this->dim_state = live_initial_x.rows();
-  this->dim_state_err = live_initial_P_diag.rows();
+  this->dim_state = LIVE_DIM_STATE;
+  this->dim_state_err = LIVE_DIM_STATE_ERR;
+  assert(live_initial_x.rows() == this->dim_state);
+  assert(live_initial_P_diag.rows() == this->dim_state_err);
 
   this->initial_x = live_initial_x;
   this->initial_P = live_initial_P_diag.asDiagonal();
@@ -42,23 +44,21 @@ LiveKalman::LiveKalman() {
   }
 
   // init filter
-  this->filter = std::make_shared<EKFSym>(this->name, get_mapmat(this->Q), get_mapvec(this->initial_x),
-    get_mapmat(initial_P),  this->dim_state, this->dim_state_err, 0, 0, 0, std::vector<int>(),
-    std::vector<int>{3}, std::vector<std::string>(), 0.2);
+  this->filter = std::make_unique<LiveEKF>(this->name, this->Q, this->initial_x, this->initial_P,
+    std::vector<int>{3}, 0.2);
 }
 
 void LiveKalman::init_state(VectorXd& state, VectorXd& covs_diag, double filter_time) {
   MatrixXdr covs = covs_diag.asDiagonal();
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  this->filter->init_state(state, covs, filter_time);
 }
 
 void LiveKalman::init_state(VectorXd& state, MatrixXdr& covs, double filter_time) {
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  this->filter->init_state(state, covs, filter_time);
 }
 
 void LiveKalman::init_state(VectorXd& state, double filter_time) {
-  MatrixXdr covs = this->filter->covs();
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  this->filter->init_state(state, this->filter->covs(), filter_time);
 }
 
 VectorXd LiveKalman::get_x() {
@@ -81,19 +81,34 @@ std::vector<MatrixXdr> LiveKalman::get_R(int kind, int n) {
   return R;
 }
 
-std::optional<Estimate> LiveKalman::predict_and_observe(double t, int kind, std::vector<VectorXd> meas, std::vector<MatrixXdr> R) {
-  std::optional<Estimate> r;
+void LiveKalman::set_process_noise(const MatrixXdr& Q) {
+  this->Q = Q;
+  this->filter->set_process_noise(Q);
+}
+
+void LiveKalman::set_obs_noise(int kind, const MatrixXdr& R) {
+  this->obs_noise[kind] = R;
+}
+
+bool LiveKalman::predict_and_observe(double t, int kind, const std::vector<VectorXd> &meas, const std::vector<MatrixXdr> &R) {
   if (R.size() == 0) {
-    R = this->get_R(kind, meas.size());
+    return this->filter->predict_and_update_batch(t, kind, meas, this->get_R(kind, meas.size()));
   }
-  r = this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(meas), get_vec_mapmat(R));
-  return r;
+  return this->filter->predict_and_update_batch(t, kind, meas, R);
 }
 
 void LiveKalman::predict(double t) {
   this->filter->predict(t);
 }
 
+void LiveKalman::get_predicted(double t, VectorXd& x, MatrixXdr& P) {
+  LiveEKF::StateVector x_t;
+  LiveEKF::CovMatrix P_t;
+  this->filter->predicted(t, x_t, P_t);
+  x = x_t;
+  P = P_t;
+}
+
 Eigen::VectorXd LiveKalman::get_initial_x() {
   return this->initial_x;
 }
@@ -9,11 +9,14 @@
 
 #include "generated/live_kf_constants.h"
 #include "rednose/helpers/ekf_sym.h"
+#include "rednose/helpers/ekf_sym_fixed.h"
 
 #define EARTH_GM 3.986005e14  // m^3/s^2 (gravitational constant * mass of earth)
 
 using namespace EKFS;
 
+typedef EKFSymFixed<LIVE_DIM_STATE, LIVE_DIM_STATE_ERR, LIVE_MAX_OBS_DIM> LiveEKF;
+
 Eigen::Map<Eigen::VectorXd> get_mapvec(Eigen::VectorXd& vec);
 Eigen::Map<MatrixXdr> get_mapmat(MatrixXdr& mat);
 std::vector<Eigen::Map<Eigen::VectorXd>> get_vec_mapvec(std::vector<Eigen::VectorXd>& vec_vec);
@@ -31,12 +34,16 @@ public:
   MatrixXdr get_P();
   double get_filter_time();
   std::vector<MatrixXdr> get_R(int kind, int n);
+  void set_process_noise(const MatrixXdr& Q);
+  void set_obs_noise(int kind, const MatrixXdr& R);
 
-  std::optional<Estimate> predict_and_observe(double t, int kind, std::vector<Eigen::VectorXd> meas, std::vector<MatrixXdr> R = {});
+  bool predict_and_observe(double t, int kind, const std::vector<Eigen::VectorXd> &meas, const std::vector<MatrixXdr> &R = {});
   std::optional<Estimate> predict_and_update_odo_speed(std::vector<Eigen::VectorXd> speed, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_trans(std::vector<Eigen::VectorXd> trans, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_rot(std::vector<Eigen::VectorXd> rot, double t, int kind);
   void predict(double t);
+  // the state and covs at t, without moving the filter
+  void get_predicted(double t, Eigen::VectorXd& x, MatrixXdr& P);
 
   Eigen::VectorXd get_initial_x();
   MatrixXdr get_initial_P();
@@ -49,7 +56,7 @@ public:
 private:
   std::string name = "live";
 
-  std::shared_ptr<EKFSym> filter;
+  std::unique_ptr<LiveEKF> filter;
 
   int dim_state;
   int dim_state_err;
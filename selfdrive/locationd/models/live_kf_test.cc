@@ -0,0 +1,137 @@
+// Runs the live filter on a simulated drive with late camera odometry, once through EKFSym and
+// once through the fixed size LiveKalman filter, checks they stay bit identical and times them
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/locationd/models/live_kf.h"
+
+using namespace Eigen;
+
+constexpr double DURATION = 60.0;
+constexpr int ITERATIONS = 5;
+
+struct Event {
+  double t;
+  int kind;
+  VectorXd z;
+};
+
+static std::vector<Event> simulated_drive() {
+  std::vector<Event> events;
+  std::mt19937 gen(0);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  auto vec3 = [&](double x, double y, double z, double std) {
+    return Vector3d(x + std * noise(gen), y + std * noise(gen), z + std * noise(gen));
+  };
+
+  VectorXd ecef = live_initial_x.segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START);
+  for (int i = 0; i < DURATION * 100; i++) {
+    const double t = i * 0.01;
+    const double yaw_rate = 0.1 * std::sin(0.2 * t);
+    const double accel = 0.5 * std::cos(0.1 * t);
+    events.push_back({t, OBSERVATION_PHONE_GYRO, vec3(0, 0, yaw_rate, 0.01)});
+    events.push_back({t + 0.002, OBSERVATION_PHONE_ACCEL, vec3(accel, 0, 9.81, 0.1)});
+
+    // camera odometry at 20 Hz arrives about 60 ms late, so the filter rewinds for it
+    if (i % 5 == 0 && i >= 6) {
+      const double frame_t = t - 0.06;
+      events.push_back({frame_t, OBSERVATION_CAMERA_ODO_ROTATION, vec3(0, 0, yaw_rate, 0.01)});
+      events.push_back({frame_t, OBSERVATION_CAMERA_ODO_TRANSLATION, vec3(10 + t * 0.1, 0, 0, 0.1)});
+    }
+    // gps at 10 Hz
+    if (i % 10 == 0) {
+      ecef += Vector3d(0.6, 0.8, 0.0);
+      events.push_back({t + 0.004, OBSERVATION_ECEF_POS, vec3(ecef(0), ecef(1), ecef(2), 2.0)});
+      events.push_back({t + 0.004, OBSERVATION_ECEF_VEL, vec3(6.0, 8.0, 0.0, 0.2)});
+    }
+    // once in a while something too old to rewind to
+    if (i % 1000 == 500) {
+      events.push_back({t - 1.0, OBSERVATION_PHONE_GYRO, vec3(0, 0, 0, 0.01)});
+    }
+  }
+  return events;
+}
+
+static std::vector<MatrixXdr> odo_R(int kind) {
+  // camera odometry comes with its own covariance
+  if (kind == OBSERVATION_CAMERA_ODO_TRANSLATION || kind == OBSERVATION_CAMERA_ODO_ROTATION) {
+    return {MatrixXdr(Vector3d(0.1, 0.1, 0.1).asDiagonal())};
+  }
+  return {};
+}
+
+static std::unique_ptr<EKFSym> dynamic_filter(LiveKalman &kf, MatrixXdr &Q) {
+  VectorXd x = kf.get_initial_x();
+  MatrixXdr P = kf.get_initial_P();
+  return std::make_unique<EKFSym>("live", get_mapmat(Q), get_mapvec(x), get_mapmat(P), LIVE_DIM_STATE,
+    LIVE_DIM_STATE_ERR, 0, 0, 0, std::vector<int>(), std::vector<int>{3}, std::vector<std::string>(), 0.2);
+}
+
+static bool observe(EKFSym &filter, LiveKalman &kf, const Event &e) {
+  std::vector<VectorXd> z = {e.z};
+  std::vector<MatrixXdr> R = odo_R(e.kind);
+  if (R.empty()) R = kf.get_R(e.kind, 1);
+  return filter.predict_and_update_batch(e.t, e.kind, get_vec_mapvec(z), get_vec_mapmat(R)).has_value();
+}
+
+int main() {
+  const auto events = simulated_drive();
+  MatrixXdr Q = live_Q_diag.asDiagonal();
+
+  // equivalence
+  LiveKalman kf;
+  auto filter = dynamic_filter(kf, Q);
+  int mismatches = 0, rejected = 0;
+  for (const auto &e : events) {
+    const bool applied = observe(*filter, kf, e);
+    const bool kf_applied = kf.predict_and_observe(e.t, e.kind, {e.z}, odo_R(e.kind));
+    rejected += !applied;
+    if (applied != kf_applied || filter->state() != kf.get_x() || filter->covs() != kf.get_P() ||
+        filter->get_filter_time() != kf.get_filter_time()) {
+      mismatches++;
+    }
+  }
+
+  // a prediction for publishing leaves the filter where it is, and matches predicting the filter
+  VectorXd x_predicted;
+  MatrixXdr P_predicted;
+  const double t_filter = kf.get_filter_time();
+  kf.get_predicted(t_filter + 0.05, x_predicted, P_predicted);
+  if (kf.get_filter_time() != t_filter) mismatches++;
+  kf.predict(t_filter + 0.05);
+  if (x_predicted != kf.get_x() || P_predicted != kf.get_P()) mismatches++;
+
+  printf("%zu observations, %d too old, %d mismatches\n", events.size(), rejected, mismatches);
+
+  // benchmark
+  double t_dynamic = 0, t_fixed = 0;
+  for (int it = 0; it < ITERATIONS; it++) {
+    LiveKalman bench_kf;
+    auto bench_filter = dynamic_filter(bench_kf, Q);
+    std::vector<std::vector<VectorXd>> z;
+    std::vector<std::vector<MatrixXdr>> R;
+    for (const auto &e : events) {
+      z.push_back({e.z});
+      R.push_back(odo_R(e.kind));
+      if (R.back().empty()) R.back() = bench_kf.get_R(e.kind, 1);
+    }
+
+    double t1 = millis_since_boot();
+    for (int i = 0; i < events.size(); i++) {
+      bench_filter->predict_and_update_batch(events[i].t, events[i].kind, get_vec_mapvec(z[i]), get_vec_mapmat(R[i]));
+    }
+    double t2 = millis_since_boot();
+    for (int i = 0; i < events.size(); i++) {
+      bench_kf.predict_and_observe(events[i].t, events[i].kind, z[i], R[i]);
+    }
+    double t3 = millis_since_boot();
+    t_dynamic += t2 - t1;
+    t_fixed += t3 - t2;
+  }
+  const double n = ITERATIONS * events.size();
+  printf("per observation: EKFSym %.2f us, fixed %.2f us\n", t_dynamic * 1000 / n, t_fixed * 1000 / n);
+  return mismatches == 0 && rejected > 0 ? 0 : 1;
+}
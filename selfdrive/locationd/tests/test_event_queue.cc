@@ -0,0 +1,107 @@
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/locationd/event_queue.h"
+
+const uint64_t WINDOW = 50000000ULL;  // ns
+
+static EventQueue::Event event(uint64_t time, uint64_t rcv_time, int input = 0) {
+  return { .time = time, .rcv_time = rcv_time, .input = input };
+}
+
+static std::vector<uint64_t> times(const std::vector<EventQueue::Event> &events) {
+  std::vector<uint64_t> t;
+  for (auto &e : events) t.push_back(e.time);
+  return t;
+}
+
+TEST_CASE("EventQueue hands out events in order once they are due") {
+  EventQueue queue;
+  std::vector<EventQueue::Event> out;
+
+  SECTION("in the order of their time") {
+    const uint64_t rcv_time = nanos_since_boot() - WINDOW;
+    for (uint64_t t : {300, 100, 400, 200}) {
+      queue.push(event(t, rcv_time));
+    }
+    queue.pop_due(WINDOW, 0, out);
+    REQUIRE(times(out) == std::vector<uint64_t>({100, 200, 300, 400}));
+  }
+
+  SECTION("a window after they were received") {
+    // published long ago on another clock, like during replay, that doesn't make them due
+    const uint64_t start = nanos_since_boot();
+    queue.push(event(1000, start));
+    queue.push(event(2000, start));
+
+    queue.pop_due(WINDOW, start + WINDOW / 5, out);
+    REQUIRE(out.empty());
+
+    queue.pop_due(WINDOW, start + 10 * WINDOW, out);
+    REQUIRE(nanos_since_boot() >= start + WINDOW);
+    // well before the deadline
+    REQUIRE(nanos_since_boot() < start + 10 * WINDOW);
+    REQUIRE(times(out) == std::vector<uint64_t>({1000, 2000}));
+  }
+
+  SECTION("one received late goes before the ones after it") {
+    const uint64_t now = nanos_since_boot();
+    queue.push(event(200, now - WINDOW));
+    queue.push(event(300, now - WINDOW));
+    queue.push(event(100, now));
+
+    // it holds them up until it is due itself
+    queue.pop_due(WINDOW, 0, out);
+    REQUIRE(out.empty());
+
+    queue.pop_due(WINDOW, now + 10 * WINDOW, out);
+    REQUIRE(times(out) == std::vector<uint64_t>({100, 200, 300}));
+  }
+
+  SECTION("an event pushed while waiting") {
+    const uint64_t start = nanos_since_boot();
+    std::thread pusher([&]() {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(WINDOW / 5));
+      queue.push(event(100, nanos_since_boot(), 1));
+    });
+    queue.pop_due(WINDOW, start + 10 * WINDOW, out);
+    pusher.join();
+    REQUIRE(out.size() == 1);
+    REQUIRE(out[0].input == 1);
+    REQUIRE(nanos_since_boot() < start + 10 * WINDOW);
+  }
+
+  SECTION("nothing until the deadline") {
+    const uint64_t start = nanos_since_boot();
+    queue.pop_due(WINDOW, start + WINDOW / 5, out);
+    REQUIRE(out.empty());
+    REQUIRE(nanos_since_boot() >= start + WINDOW / 5);
+  }
+}
+
+TEST_CASE("EventQueue::event_time") {
+  MessageBuilder msg;
+  auto evt = msg.initEvent();
+  evt.setLogMonoTime(5000);
+
+  SECTION("logMonoTime") {
+    evt.initCarState();
+    REQUIRE(EventQueue::event_time(evt.asReader()) == 5000);
+  }
+
+  SECTION("the earliest sensor timestamp of sensorEvents") {
+    auto sensor_events = evt.initSensorEvents(3);
+    sensor_events[0].setTimestamp(0);  // an empty reading
+    sensor_events[1].setTimestamp(4200);
+    sensor_events[2].setTimestamp(4100);
+    REQUIRE(EventQueue::event_time(evt.asReader()) == 4100);
+  }
+
+  SECTION("sensorEvents without readings") {
+    auto sensor_events = evt.initSensorEvents(1);
+    sensor_events[0].setTimestamp(0);
+    REQUIRE(EventQueue::event_time(evt.asReader()) == 5000);
+  }
+}
@@ -0,0 +1,389 @@
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/locationd/generated/gps.h"
+#include "selfdrive/locationd/generated/ubx.h"
+#include "selfdrive/locationd/ublox_decode.h"
+#include "selfdrive/locationd/ublox_msg.h"
+#include "selfdrive/locationd/tests/ublox_decoders.h"
+
+using namespace ublox;
+
+constexpr int FUZZ_ITERATIONS = 200000;
+
+static std::mt19937 gen(0);
+
+static std::string random_bytes(int n) {
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::string s(n, 0);
+  for (char &c : s) c = byte(gen);
+  return s;
+}
+
+static std::string frame(uint16_t msg_type, const std::string &payload) {
+  std::string msg = "\xb5\x62"s;
+  msg.push_back(msg_type >> 8);
+  msg.push_back(msg_type & 0xFF);
+  msg.push_back(payload.size() & 0xFF);
+  msg.push_back(payload.size() >> 8);
+  return ubx_add_checksum(msg + payload);
+}
+
+// a GPS subframe with the preamble, a valid subframe id and random data
+static std::string gps_subframe_payload(int sv_id, int subframe_id) {
+  std::string data = random_bytes(GPS_SUBFRAME_SIZE);
+  data[0] = GPS_TLM_PREAMBLE;
+  data[5] = (data[5] & ~0x1C) | (subframe_id << 2);
+
+  std::string payload = random_bytes(RxmSfrbx::SIZE);
+  payload[0] = GNSS_GPS;
+  payload[1] = sv_id;
+  payload[4] = 10;
+  for (int i = 0; i < 10; i++) {
+    // the data in bits 6-29 with random parity and padding around it
+    const uint32_t parity = std::uniform_int_distribution<uint32_t>(0, 63)(gen);
+    const uint32_t padding = std::uniform_int_distribution<uint32_t>(0, 3)(gen) << 30;
+    const uint32_t bits = (uint8_t(data[3 * i]) << 16) | (uint8_t(data[3 * i + 1]) << 8) | uint8_t(data[3 * i + 2]);
+    const uint32_t word = padding | (bits << 6) | parity;
+    payload.append((const char *)&word, 4);
+  }
+  return payload;
+}
+
+static std::string random_message() {
+  switch (std::uniform_int_distribution<int>(0, 5)(gen)) {
+  case 0:
+    return frame(NAV_PVT, random_bytes(NavPvt::SIZE));
+  case 1: {
+    const int n = std::uniform_int_distribution<int>(0, 40)(gen);
+    std::string payload = random_bytes(RxmRawx::SIZE + RxmRawx::MEAS_SIZE * n);
+    payload[11] = n;
+    return frame(RXM_RAWX, payload);
+  }
+  case 2:
+    return frame(RXM_SFRBX, gps_subframe_payload(std::uniform_int_distribution<int>(1, 32)(gen),
+                                                 std::uniform_int_distribution<int>(1, 5)(gen)));
+  case 3:
+    return frame(MON_HW, random_bytes(MonHw::SIZE));
+  case 4:
+    return frame(MON_HW2, random_bytes(MonHw2::SIZE));
+  default:
+    // another message, or garbage
+    return frame(std::uniform_int_distribution<int>(0, 0xFFFF)(gen), random_bytes(std::uniform_int_distribution<int>(0, 100)(gen)));
+  }
+}
+
+// flips bits, or changes the length and cuts the message to it like the framing would
+static std::string mutate(std::string msg) {
+  std::uniform_int_distribution<int> pos(0, msg.size() - 1);
+  switch (std::uniform_int_distribution<int>(0, 3)(gen)) {
+  case 0:
+    for (int i = 0; i < 4; i++) msg[pos(gen)] ^= 1 << std::uniform_int_distribution<int>(0, 7)(gen);
+    break;
+  case 1: {
+    const int len = std::uniform_int_distribution<int>(0, msg.size() + 40)(gen);
+    msg.resize(len + UBLOX_HEADER_SIZE + UBLOX_CHECKSUM_SIZE);
+    msg[4] = len & 0xFF;
+    msg[5] = len >> 8;
+    break;
+  }
+  case 2:
+    // counts that don't fit the length
+    if (msg.size() > 17) msg[6 + 11] = std::uniform_int_distribution<int>(0, 255)(gen);
+    if (msg.size() > 10) msg[6 + 4] = std::uniform_int_distribution<int>(0, 255)(gen);
+    break;
+  default:
+    break;
+  }
+  return msg;
+}
+
+// every field the views read, both ways. Returns whether they agree
+struct Compare {
+  int mismatches = 0;
+  template <class A, class B>
+  void eq(A a, B b) {
+    if (a != b && !(std::isnan(double(a)) && std::isnan(double(b)))) mismatches++;
+  }
+};
+
+static void compare_gps_subframe(Compare &c, std::string data, GpsSubframe sf) {
+  kaitai::kstream stream(data);
+  gps_t k(&stream);
+  c.eq(k.how()->subframe_id(), sf.subframe_id());
+  switch (sf.subframe_id()) {
+  case 1: {
+    auto s = static_cast<gps_t::subframe_1_t *>(k.body());
+    c.eq(s->week_no(), sf.week_no());
+    c.eq(s->t_gd(), sf.t_gd());
+    c.eq(s->t_oc(), sf.t_oc());
+    c.eq(s->af_2(), sf.af_2());
+    c.eq(s->af_1(), sf.af_1());
+    c.eq(s->af_0(), sf.af_0());
+    break;
+  }
+  case 2: {
+    auto s = static_cast<gps_t::subframe_2_t *>(k.body());
+    c.eq(s->c_rs(), sf.c_rs());
+    c.eq(s->delta_n(), sf.delta_n());
+    c.eq(s->m_0(), sf.m_0());
+    c.eq(s->c_uc(), sf.c_uc());
+    c.eq(s->e(), sf.e());
+    c.eq(s->c_us(), sf.c_us());
+    c.eq(s->sqrt_a(), sf.sqrt_a());
+    c.eq(s->t_oe(), sf.t_oe());
+    break;
+  }
+  case 3: {
+    auto s = static_cast<gps_t::subframe_3_t *>(k.body());
+    c.eq(s->c_ic(), sf.c_ic());
+    c.eq(s->omega_0(), sf.omega_0());
+    c.eq(s->c_is(), sf.c_is());
+    c.eq(s->i_0(), sf.i_0());
+    c.eq(s->c_rc(), sf.c_rc());
+    c.eq(s->omega(), sf.omega());
+    c.eq(s->omega_dot(), sf.omega_dot());
+    c.eq(s->iode(), sf.iode());
+    c.eq(s->idot(), sf.idot());
+    break;
+  }
+  case 4: {
+    auto s = static_cast<gps_t::subframe_4_t *>(k.body());
+    c.eq(s->data_id(), sf.data_id());
+    c.eq(s->page_id(), sf.page_id());
+    if (s->page_id() == 56) {
+      auto iono = static_cast<gps_t::subframe_4_t::ionosphere_data_t *>(s->body());
+      const int8_t k_iono[] = {iono->a0(), iono->a1(), iono->a2(), iono->a3(), iono->b0(), iono->b1(), iono->b2(), iono->b3()};
+      for (int i = 0; i < 8; i++) c.eq(k_iono[i], sf.iono(i));
+    }
+    break;
+  }
+  }
+}
+
+static void compare(Compare &c, ubx_t &k, const Message &m) {
+  c.eq(k.msg_type(), m.msg_type());
+  c.eq(k.length(), m.length());
+  switch (m.msg_type()) {
+  case NAV_PVT: {
+    auto a = static_cast<ubx_t::nav_pvt_t *>(k.body());
+    NavPvt b = {m.payload()};
+    c.eq(a->i_tow(), b.i_tow());
+    c.eq(a->year(), b.year());
+    c.eq(a->month(), b.month());
+    c.eq(a->day(), b.day());
+    c.eq(a->hour(), b.hour());
+    c.eq(a->min(), b.min());
+    c.eq(a->sec(), b.sec());
+    c.eq(a->valid(), b.valid_flags());
+    c.eq(a->nano(), b.nano());
+    c.eq(a->fix_type(), b.fix_type());
+    c.eq(a->flags(), b.flags());
+    c.eq(a->num_sv(), b.num_sv());
+    c.eq(a->lon(), b.lon());
+    c.eq(a->lat(), b.lat());
+    c.eq(a->height(), b.height());
+    c.eq(a->h_acc(), b.h_acc());
+    c.eq(a->v_acc(), b.v_acc());
+    c.eq(a->vel_n(), b.vel_n());
+    c.eq(a->vel_e(), b.vel_e());
+    c.eq(a->vel_d(), b.vel_d());
+    c.eq(a->g_speed(), b.g_speed());
+    c.eq(a->head_mot(), b.head_mot());
+    c.eq(a->s_acc(), b.s_acc());
+    c.eq(a->head_acc(), b.head_acc());
+    break;
+  }
+  case RXM_RAWX: {
+    auto a = static_cast<ubx_t::rxm_rawx_t *>(k.body());
+    RxmRawx b = {m.payload()};
+    c.eq(a->rcv_tow(), b.rcv_tow());
+    c.eq(a->week(), b.week());
+    c.eq(a->leap_s(), b.leap_s());
+    c.eq(a->num_meas(), b.num_meas());
+    c.eq(a->rec_stat(), b.rec_stat());
+    for (int i = 0; i < b.num_meas(); i++) {
+      auto am = a->measurements()->at(i);
+      auto bm = b.measurement(i);
+      c.eq(am->pr_mes(), bm.pr_mes());
+      c.eq(am->cp_mes(), bm.cp_mes());
+      c.eq(am->do_mes(), bm.do_mes());
+      c.eq(int(am->gnss_id()), bm.gnss_id());
+      c.eq(am->sv_id(), bm.sv_id());
+      c.eq(am->freq_id(), bm.freq_id());
+      c.eq(am->lock_time(), bm.lock_time());
+      c.eq(am->cno(), bm.cno());
+      c.eq(am->pr_stdev(), bm.pr_stdev());
+      c.eq(am->cp_stdev(), bm.cp_stdev());
+      c.eq(am->do_stdev(), bm.do_stdev());
+      c.eq(am->trk_stat(), bm.trk_stat());
+    }
+    break;
+  }
+  case RXM_SFRBX: {
+    auto a = static_cast<ubx_t::rxm_sfrbx_t *>(k.body());
+    RxmSfrbx b = {m.payload()};
+    c.eq(int(a->gnss_id()), b.gnss_id());
+    c.eq(a->sv_id(), b.sv_id());
+    c.eq(a->num_words(), b.num_words());
+    for (int i = 0; i < b.num_words(); i++) c.eq(a->body()->at(i), b.word(i));
+
+    if (b.gnss_id() == GNSS_GPS && b.num_words() == 10) {
+      uint8_t data[GPS_SUBFRAME_SIZE];
+      gps_subframe_bytes(b, data);
+      GpsSubframe sf = {data};
+      if (sf.preamble() == GPS_TLM_PREAMBLE) {
+        compare_gps_subframe(c, std::string((const char *)data, sizeof(data)), sf);
+      }
+    }
+    break;
+  }
+  case MON_HW: {
+    auto a = static_cast<ubx_t::mon_hw_t *>(k.body());
+    MonHw b = {m.payload()};
+    c.eq(a->noise_per_ms(), b.noise_per_ms());
+    c.eq(a->agc_cnt(), b.agc_cnt());
+    c.eq(int(a->a_status()), b.a_status());
+    c.eq(int(a->a_power()), b.a_power());
+    c.eq(a->flags(), b.flags());
+    c.eq(a->jam_ind(), b.jam_ind());
+    break;
+  }
+  case MON_HW2: {
+    auto a = static_cast<ubx_t::mon_hw2_t *>(k.body());
+    MonHw2 b = {m.payload()};
+    c.eq(a->ofs_i(), b.ofs_i());
+    c.eq(a->mag_i(), b.mag_i());
+    c.eq(a->ofs_q(), b.ofs_q());
+    c.eq(a->mag_q(), b.mag_q());
+    c.eq(int(a->cfg_source()), b.cfg_source());
+    c.eq(a->low_lev_cfg(), b.low_lev_cfg());
+    c.eq(a->post_status(), b.post_status());
+    break;
+  }
+  }
+}
+
+TEST_CASE("UBX views read the same fields as kaitai") {
+  Compare c;
+  int decoded = 0, only_kaitai = 0, only_views = 0;
+  for (int it = 0; it < FUZZ_ITERATIONS; it++) {
+    std::string msg = mutate(random_message());
+    // the framing only hands out messages with the preamble and as long as their length says
+    if (msg.compare(0, 2, "\xb5\x62") != 0 ||
+        msg.size() < UBLOX_HEADER_SIZE + (uint8_t(msg[4]) | (uint8_t(msg[5]) << 8)) + UBLOX_CHECKSUM_SIZE) continue;
+    // views read the message where it is, give them exactly its bytes
+    std::vector<uint8_t> buf(msg.begin(), msg.end());
+    const Message m = {buf.data()};
+
+    bool kaitai_ok = false;
+    size_t kaitai_end = 0;
+    try {
+      kaitai::kstream stream(msg);
+      ubx_t k(&stream);
+      kaitai_ok = view_size(k.msg_type()) > 0;
+      kaitai_end = stream.pos();
+      if (kaitai_ok && view_valid(m)) {
+        compare(c, k, m);
+        decoded++;
+      }
+    } catch (const std::exception &e) {
+    }
+
+    // kaitai reads on into the checksum, the views stop at the length
+    if (kaitai_ok && !view_valid(m) && kaitai_end <= UBLOX_HEADER_SIZE + m.length()) only_kaitai++;
+    if (!kaitai_ok && view_valid(m)) only_views++;
+  }
+  REQUIRE(decoded > FUZZ_ITERATIONS / 4);
+  REQUIRE(c.mismatches == 0);
+  // the views accept what kaitai can read within the length
+  REQUIRE(only_kaitai == 0);
+  REQUIRE(only_views == 0);
+}
+
+// the messages a parser finds in a stream fed in chunks, byte for byte
+static std::vector<std::string> frames(UbloxMsgParser &parser, const std::string &stream, int max_chunk) {
+  std::vector<std::string> found;
+  std::uniform_int_distribution<int> chunk(1, max_chunk);
+  size_t pos = 0;
+  while (pos < stream.size()) {
+    const size_t len = std::min<size_t>(chunk(gen), stream.size() - pos);
+    const uint8_t *data = (const uint8_t *)stream.data() + pos;
+    size_t consumed = 0;
+    while (consumed < len) {
+      size_t consumed_this_time = 0;
+      if (parser.add_data(data + consumed, len - consumed, consumed_this_time)) {
+        found.push_back(parser.data());
+        parser.reset();
+      }
+      consumed += consumed_this_time;
+    }
+    pos += len;
+  }
+  return found;
+}
+
+TEST_CASE("UbloxMsgParser finds the same messages in place as byte by byte") {
+  // messages, some broken, with garbage in between
+  std::string stream;
+  for (int i = 0; i < 20000; i++) {
+    std::string msg = random_message();
+    if (i % 7 == 0) msg = mutate(msg);
+    stream += msg;
+    if (i % 5 == 0) stream += random_bytes(std::uniform_int_distribution<int>(0, 20)(gen));
+    // a stray preamble takes its length from whatever follows and swallows up to that much
+    if (i % 101 == 0) stream += "\xb5\x62"s;
+  }
+
+  auto parser = std::make_unique<UbloxMsgParser>();
+  auto copied = frames(*parser, stream, 1);
+  parser = std::make_unique<UbloxMsgParser>();
+  auto in_place = frames(*parser, stream, 4096);
+  REQUIRE(copied.size() > 5000);
+  REQUIRE(in_place == copied);
+}
+
+static std::string synthetic_stream() {
+  // a minute of what ubloxd gets, at 10 Hz with about 20 measurements
+  std::string stream;
+  for (int i = 0; i < 600; i++) {
+    stream += frame(NAV_PVT, random_bytes(NavPvt::SIZE));
+    std::string rawx = random_bytes(RxmRawx::SIZE + RxmRawx::MEAS_SIZE * 20);
+    rawx[11] = 20;
+    stream += frame(RXM_RAWX, rawx);
+    for (int j = 0; j < 5; j++) {
+      stream += frame(RXM_SFRBX, gps_subframe_payload(1 + (i + j) % 32, 1 + (i + j) % 5));
+    }
+    if (i % 10 == 0) {
+      stream += frame(MON_HW, random_bytes(MonHw::SIZE));
+      stream += frame(MON_HW2, random_bytes(MonHw2::SIZE));
+    }
+  }
+  return stream;
+}
+
+TEST_CASE("UBX views decode the same values as kaitai") {
+  UbloxMsgParser parser;
+  std::vector<std::string> msgs = frames(parser, synthetic_stream(), 4096);
+  int used = 0;
+  for (auto &msg : msgs) {
+    const Message m = {(const uint8_t *)msg.data()};
+    if (view_size(m.msg_type()) == 0 || !view_valid(m)) continue;
+
+    double sink_kaitai = 0;
+    try {
+      sink_kaitai = decode_kaitai(msg);
+    } catch (const std::exception &e) {
+    }
+    const double sink_views = decode_views((const uint8_t *)msg.data());
+    if (!(std::isnan(sink_kaitai) && std::isnan(sink_views))) {
+      REQUIRE(sink_kaitai == sink_views);
+    }
+    used++;
+  }
+  REQUIRE(used > 0);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+// The fields ubloxd reads from each message, decoded with the kaitai parsers and with the views
+// of ublox_decode.h and summed up, for comparing and timing the two. Shared by test_ublox and
+// bench_ublox
+
+#include <string>
+
+#include "selfdrive/locationd/generated/gps.h"
+#include "selfdrive/locationd/generated/ubx.h"
+#include "selfdrive/locationd/ublox_decode.h"
+
+namespace ublox {
+
+// whether a message is long enough for the view of its type
+inline bool view_valid(const Message &m) {
+  switch (m.msg_type()) {
+  case NAV_PVT: return NavPvt::valid(m);
+  case RXM_RAWX: return RxmRawx::valid(m);
+  case RXM_SFRBX: return RxmSfrbx::valid(m);
+  case MON_HW: return MonHw::valid(m);
+  case MON_HW2: return MonHw2::valid(m);
+  default: return false;
+  }
+}
+
+// 0 for the types without a view
+inline int view_size(uint16_t msg_type) {
+  switch (msg_type) {
+  case NAV_PVT: return NavPvt::SIZE;
+  case RXM_RAWX: return RxmRawx::SIZE;
+  case RXM_SFRBX: return RxmSfrbx::SIZE;
+  case MON_HW: return MonHw::SIZE;
+  case MON_HW2: return MonHw2::SIZE;
+  default: return 0;
+  }
+}
+
+// reads what gen_msg does
+inline double decode_kaitai(const std::string &msg) {
+  std::string dat = msg;
+  kaitai::kstream stream(dat);
+  ubx_t ubx(&stream);
+  double sink = 0;
+  switch (ubx.msg_type()) {
+  case NAV_PVT: {
+    auto m = static_cast<ubx_t::nav_pvt_t *>(ubx.body());
+    sink += (double)m->lat() + m->lon() + m->height() + m->g_speed() + m->head_mot() + m->h_acc() + m->vel_n() + m->vel_e() + m->vel_d() + m->nano();
+    break;
+  }
+  case RXM_RAWX: {
+    auto m = static_cast<ubx_t::rxm_rawx_t *>(ubx.body());
+    sink += m->rcv_tow() + m->week();
+    for (auto meas : *m->measurements()) {
+      sink += meas->pr_mes() + meas->cp_mes() + meas->do_mes() + meas->sv_id() + meas->cno() + meas->lock_time() + meas->trk_stat();
+    }
+    break;
+  }
+  case RXM_SFRBX: {
+    auto m = static_cast<ubx_t::rxm_sfrbx_t *>(ubx.body());
+    if (m->gnss_id() == ubx_t::gnss_type_t::GNSS_TYPE_GPS && m->num_words() == 10) {
+      std::string subframe_data;
+      subframe_data.reserve(30);
+      for (uint32_t word : *m->body()) {
+        word = word >> 6;
+        subframe_data.push_back(word >> 16);
+        subframe_data.push_back(word >> 8);
+        subframe_data.push_back(word >> 0);
+      }
+      kaitai::kstream sf_stream(subframe_data);
+      gps_t subframe(&sf_stream);
+      sink += subframe.how()->subframe_id();
+      if (subframe.how()->subframe_id() == 2) {
+        auto s = static_cast<gps_t::subframe_2_t *>(subframe.body());
+        sink += (double)s->m_0() + s->e() + s->sqrt_a() + s->t_oe();
+      }
+    }
+    break;
+  }
+  case MON_HW: {
+    auto m = static_cast<ubx_t::mon_hw_t *>(ubx.body());
+    sink += m->noise_per_ms() + m->agc_cnt() + m->jam_ind();
+    break;
+  }
+  }
+  return sink;
+}
+
+inline double decode_views(const uint8_t *msg) {
+  const Message m = {msg};
+  double sink = 0;
+  switch (m.msg_type()) {
+  case NAV_PVT: {
+    NavPvt p = {m.payload()};
+    sink += (double)p.lat() + p.lon() + p.height() + p.g_speed() + p.head_mot() + p.h_acc() + p.vel_n() + p.vel_e() + p.vel_d() + p.nano();
+    break;
+  }
+  case RXM_RAWX: {
+    RxmRawx r = {m.payload()};
+    sink += r.rcv_tow() + r.week();
+    for (int i = 0; i < r.num_meas(); i++) {
+      auto meas = r.measurement(i);
+      sink += meas.pr_mes() + meas.cp_mes() + meas.do_mes() + meas.sv_id() + meas.cno() + meas.lock_time() + meas.trk_stat();
+    }
+    break;
+  }
+  case RXM_SFRBX: {
+    RxmSfrbx s = {m.payload()};
+    if (s.gnss_id() == GNSS_GPS && s.num_words() == 10) {
+      uint8_t data[GPS_SUBFRAME_SIZE];
+      gps_subframe_bytes(s, data);
+      GpsSubframe sf = {data};
+      sink += sf.subframe_id();
+      if (sf.subframe_id() == 2) {
+        sink += (double)sf.m_0() + sf.e() + sf.sqrt_a() + sf.t_oe();
+      }
+    }
+    break;
+  }
+  case MON_HW: {
+    MonHw h = {m.payload()};
+    sink += h.noise_per_ms() + h.agc_cnt() + h.jam_ind();
+    break;
+  }
+  }
+  return sink;
+}
+
+}  // namespace ublox
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Views of the UBX messages ubloxd uses, read in place from the receive buffer. They hold a
+// pointer to the payload and read a field when it is asked for. The layouts are those of
+// ubx.ksy and gps.ksy, which the kaitai parsers were generated from
+namespace ublox {
+  const uint16_t NAV_PVT = 0x0107;
+  const uint16_t RXM_SFRBX = 0x0213;
+  const uint16_t RXM_RAWX = 0x0215;
+  const uint16_t MON_HW = 0x0a09;
+  const uint16_t MON_HW2 = 0x0a0b;
+
+  const uint8_t GNSS_GPS = 0;
+
+  // little endian, unaligned
+  template <class T>
+  inline T get(const uint8_t *p, int offset) {
+    T v;
+    memcpy(&v, p + offset, sizeof(T));
+    return v;
+  }
+
+  // a whole message, checksum included
+  struct Message {
+    const uint8_t *msg;
+    uint16_t msg_type() const { return (msg[2] << 8) | msg[3]; }
+    uint16_t length() const { return get<uint16_t>(msg, 4); }
+    const uint8_t *payload() const { return msg + 6; }
+  };
+
+  struct NavPvt {
+    static const int SIZE = 92;
+    static bool valid(const Message &m) { return m.length() >= SIZE; }
+    const uint8_t *p;
+
+    uint32_t i_tow() const { return get<uint32_t>(p, 0); }
+    uint16_t year() const { return get<uint16_t>(p, 4); }
+    uint8_t month() const { return p[6]; }
+    uint8_t day() const { return p[7]; }
+    uint8_t hour() const { return p[8]; }
+    uint8_t min() const { return p[9]; }
+    uint8_t sec() const { return p[10]; }
+    uint8_t valid_flags() const { return p[11]; }
+    int32_t nano() const { return get<int32_t>(p, 16); }
+    uint8_t fix_type() const { return p[20]; }
+    uint8_t flags() const { return p[21]; }
+    uint8_t num_sv() const { return p[23]; }
+    int32_t lon() const { return get<int32_t>(p, 24); }
+    int32_t lat() const { return get<int32_t>(p, 28); }
+    int32_t height() const { return get<int32_t>(p, 32); }
+    uint32_t h_acc() const { return get<uint32_t>(p, 40); }
+    uint32_t v_acc() const { return get<uint32_t>(p, 44); }
+    int32_t vel_n() const { return get<int32_t>(p, 48); }
+    int32_t vel_e() const { return get<int32_t>(p, 52); }
+    int32_t vel_d() const { return get<int32_t>(p, 56); }
+    int32_t g_speed() const { return get<int32_t>(p, 60); }
+    int32_t head_mot() const { return get<int32_t>(p, 64); }
+    int32_t s_acc() const { return get<int32_t>(p, 68); }
+    uint32_t head_acc() const { return get<uint32_t>(p, 72); }
+  };
+
+  struct RxmRawx {
+    static const int SIZE = 16;
+    static const int MEAS_SIZE = 32;
+    static bool valid(const Message &m) { return m.length() >= SIZE && m.length() >= SIZE + MEAS_SIZE * m.payload()[11]; }
+    const uint8_t *p;
+
+    struct Meas {
+      const uint8_t *p;
+      double pr_mes() const { return get<double>(p, 0); }
+      double cp_mes() const { return get<double>(p, 8); }
+      float do_mes() const { return get<float>(p, 16); }
+      uint8_t gnss_id() const { return p[20]; }
+      uint8_t sv_id() const { return p[21]; }
+      uint8_t freq_id() const { return p[23]; }
+      uint16_t lock_time() const { return get<uint16_t>(p, 24); }
+      uint8_t cno() const { return p[26]; }
+      uint8_t pr_stdev() const { return p[27]; }
+      uint8_t cp_stdev() const { return p[28]; }
+      uint8_t do_stdev() const { return p[29]; }
+      uint8_t trk_stat() const { return p[30]; }
+    };
+
+    double rcv_tow() const { return get<double>(p, 0); }
+    uint16_t week() const { return get<uint16_t>(p, 8); }
+    int8_t leap_s() const { return int8_t(p[10]); }
+    uint8_t num_meas() const { return p[11]; }
+    uint8_t rec_stat() const { return p[12]; }
+    Meas measurement(int i) const { return {p + SIZE + MEAS_SIZE * i}; }
+  };
+
+  struct RxmSfrbx {
+    static const int SIZE = 8;
+    static bool valid(const Message &m) { return m.length() >= SIZE && m.length() >= SIZE + 4 * m.payload()[4]; }
+    const uint8_t *p;
+
+    uint8_t gnss_id() const { return p[0]; }
+    uint8_t sv_id() const { return p[1]; }
+    uint8_t freq_id() const { return p[3]; }
+    uint8_t num_words() const { return p[4]; }
+    uint8_t version() const { return p[6]; }
+    uint32_t word(int i) const { return get<uint32_t>(p, SIZE + 4 * i); }
+  };
+
+  struct MonHw {
+    static const int SIZE = 60;
+    static bool valid(const Message &m) { return m.length() >= SIZE; }
+    const uint8_t *p;
+
+    uint16_t noise_per_ms() const { return get<uint16_t>(p, 16); }
+    uint16_t agc_cnt() const { return get<uint16_t>(p, 18); }
+    uint8_t a_status() const { return p[20]; }
+    uint8_t a_power() const { return p[21]; }
+    uint8_t flags() const { return p[22]; }
+    uint8_t jam_ind() const { return p[45]; }
+  };
+
+  struct MonHw2 {
+    static const int SIZE = 28;
+    static bool valid(const Message &m) { return m.length() >= SIZE; }
+    const uint8_t *p;
+
+    static const uint8_t CONFIG_SOURCE_FLASH = 102;
+    static const uint8_t CONFIG_SOURCE_OTP = 111;
+    static const uint8_t CONFIG_SOURCE_CONFIG_PINS = 112;
+    static const uint8_t CONFIG_SOURCE_ROM = 113;
+
+    int8_t ofs_i() const { return int8_t(p[0]); }
+    uint8_t mag_i() const { return p[1]; }
+    int8_t ofs_q() const { return int8_t(p[2]); }
+    uint8_t mag_q() const { return p[3]; }
+    uint8_t cfg_source() const { return p[4]; }
+    uint32_t low_lev_cfg() const { return get<uint32_t>(p, 8); }
+    uint32_t post_status() const { return get<uint32_t>(p, 20); }
+  };
+
+  // A GPS subframe is 10 words of 24 data bits, 30 bytes, big endian and not byte aligned.
+  // RXM-SFRBX sends each word in the upper bits of a u32 with the parity below
+  const int GPS_SUBFRAME_SIZE = 30;
+  const uint8_t GPS_TLM_PREAMBLE = 0x8b;
+
+  inline void gps_subframe_bytes(const RxmSfrbx &sfrbx, uint8_t *out) {
+    for (int i = 0; i < 10; i++) {
+      const uint32_t word = sfrbx.word(i) >> 6;  // TODO: Verify parity
+      out[3 * i] = word >> 16;
+      out[3 * i + 1] = word >> 8;
+      out[3 * i + 2] = word;
+    }
+  }
+
+  // len bits from bit pos, the first bit being the msb of the first byte
+  inline uint32_t bits(const uint8_t *d, int pos, int len) {
+    uint64_t v = 0;
+    for (int i = pos / 8; i <= (pos + len - 1) / 8; i++) {
+      v = (v << 8) | d[i];
+    }
+    const int tail = 7 - (pos + len - 1) % 8;
+    return (v >> tail) & ((uint64_t(1) << len) - 1);
+  }
+  inline int32_t sbits(const uint8_t *d, int pos, int len) {
+    const uint32_t v = bits(d, pos, len);
+    return (v & (uint32_t(1) << (len - 1))) ? int32_t(v) - int32_t(int64_t(1) << len) : int32_t(v);
+  }
+
+  struct GpsSubframe {
+    const uint8_t *d;
+
+    uint8_t preamble() const { return d[0]; }
+    int subframe_id() const { return bits(d, 43, 3); }
+
+    // subframe 1
+    uint16_t week_no() const { return bits(d, 48, 10); }
+    int8_t t_gd() const { return int8_t(d[20]); }
+    uint16_t t_oc() const { return bits(d, 176, 16); }
+    int8_t af_2() const { return int8_t(d[24]); }
+    int16_t af_1() const { return sbits(d, 200, 16); }
+    int32_t af_0() const { return sbits(d, 216, 22); }
+
+    // subframe 2
+    int16_t c_rs() const { return sbits(d, 56, 16); }
+    int16_t delta_n() const { return sbits(d, 72, 16); }
+    int32_t m_0() const { return sbits(d, 88, 32); }
+    int16_t c_uc() const { return sbits(d, 120, 16); }
+    int32_t e() const { return sbits(d, 136, 32); }
+    int16_t c_us() const { return sbits(d, 168, 16); }
+    uint32_t sqrt_a() const { return bits(d, 184, 32); }
+    uint16_t t_oe() const { return bits(d, 216, 16); }
+
+    // subframe 3
+    int16_t c_ic() const { return sbits(d, 48, 16); }
+    int32_t omega_0() const { return sbits(d, 64, 32); }
+    int16_t c_is() const { return sbits(d, 96, 16); }
+    int32_t i_0() const { return sbits(d, 112, 32); }
+    int16_t c_rc() const { return sbits(d, 144, 16); }
+    int32_t omega() const { return sbits(d, 160, 32); }
+    int32_t omega_dot() const { return sbits(d, 192, 24); }
+    uint8_t iode() const { return d[27]; }
+    int16_t idot() const { return sbits(d, 224, 14); }
+
+    // subframe 4, ionosphere data on page 18
+    int data_id() const { return bits(d, 48, 2); }
+    int page_id() const { return bits(d, 50, 6); }
+    int8_t iono(int i) const { return int8_t(d[7 + i]); }
+  };
+}
@@ -1,16 +1,15 @@
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <ctime>
 
 #include "cereal/messaging/messaging.h"
 #include "selfdrive/common/util.h"
-#include "selfdrive/locationd/generated/gps.h"
-#include "selfdrive/locationd/generated/ubx.h"
+#include "selfdrive/locationd/ublox_decode.h"
 
 using namespace std::string_literals;
 
@@ -85,24 +84,34 @@ namespace ublox {
 
 class UbloxMsgParser {
   public:
+    // A message that is whole in incoming_data is used from there, the rest is put together
+    // in the parse buffer. Either way it stays valid until reset
     bool add_data(const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed);
-    inline void reset() {bytes_in_parse_buf = 0;}
+    inline void reset() {bytes_in_parse_buf = 0; msg = msg_parse_buf; msg_len = 0;}
     inline int needed_bytes();
-    inline std::string data() {return std::string((const char*)msg_parse_buf, bytes_in_parse_buf);}
+    inline std::string data() {return std::string((const char*)msg, msg_len);}
 
     std::pair<std::string, kj::Array<capnp::word>> gen_msg();
-    kj::Array<capnp::word> gen_nav_pvt(ubx_t::nav_pvt_t *msg);
-    kj::Array<capnp::word> gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> gen_rxm_rawx(ubx_t::rxm_rawx_t *msg);
-    kj::Array<capnp::word> gen_mon_hw(ubx_t::mon_hw_t *msg);
-    kj::Array<capnp::word> gen_mon_hw2(ubx_t::mon_hw2_t *msg);
+    kj::Array<capnp::word> gen_nav_pvt(ublox::NavPvt msg);
+    kj::Array<capnp::word> gen_rxm_sfrbx(ublox::RxmSfrbx msg);
+    kj::Array<capnp::word> gen_rxm_rawx(ublox::RxmRawx msg);
+    kj::Array<capnp::word> gen_mon_hw(ublox::MonHw msg);
+    kj::Array<capnp::word> gen_mon_hw2(ublox::MonHw2 msg);
 
   private:
-    inline bool valid_cheksum();
+    inline bool valid_cheksum(const uint8_t *buf, size_t len);
     inline bool valid();
     inline bool valid_so_far();
 
-    std::unordered_map<int, std::unordered_map<int, std::string>> gps_subframes;
+    // the subframes of the current ephemeris of every GPS satellite, by subframe id
+    struct GpsSubframes {
+      uint8_t received = 0;
+      std::array<std::array<uint8_t, ublox::GPS_SUBFRAME_SIZE>, 6> data;
+    };
+    std::array<GpsSubframes, 256> gps_subframes;
+
+    const uint8_t *msg = msg_parse_buf;
+    size_t msg_len = 0;
 
     size_t bytes_in_parse_buf = 0;
     uint8_t msg_parse_buf[ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE];
@@ -1,7 +1,5 @@
 #include <cassert>
 
-#include <kaitai/kaitaistream.h>
-
 #include "cereal/messaging/messaging.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/util.h"
@@ -138,6 +138,10 @@ void logger_init(LoggerState *s, const char* log_name, bool has_qlog) {
   s->init_data = logger_build_init_data();
 }
 
+std::string logger_segment_path(LoggerState *s, const char* root_path, int part) {
+  return util::string_format("%s/%s--%d", root_path, s->route_name.c_str(), part);
+}
+
 static LoggerHandle* logger_open(LoggerState *s, const char* root_path) {
   LoggerHandle *h = NULL;
   for (int i=0; i<LOGGER_MAX_HANDLES; i++) {
@@ -148,8 +152,8 @@ static LoggerHandle* logger_open(LoggerState *s, const char* root_path) {
   }
   assert(h);
 
-  snprintf(h->segment_path, sizeof(h->segment_path),
-          "%s/%s--%d", root_path, s->route_name.c_str(), s->part);
+  snprintf(h->segment_path, sizeof(h->segment_path), "%s",
+          logger_segment_path(s, root_path, s->part).c_str());
 
   snprintf(h->log_path, sizeof(h->log_path), "%s/%s.bz2", h->segment_path, s->log_name);
   snprintf(h->qlog_path, sizeof(h->qlog_path), "%s/qlog.bz2", h->segment_path);
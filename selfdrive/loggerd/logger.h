@@ -87,6 +87,7 @@ typedef struct LoggerState {
 kj::Array<capnp::word> logger_build_init_data();
 std::string logger_get_route_name();
 void logger_init(LoggerState *s, const char* log_name, bool has_qlog);
+std::string logger_segment_path(LoggerState *s, const char* root_path, int part);
 int logger_next(LoggerState *s, const char* root_path,
                             char* out_segment_path, size_t out_segment_path_len,
                             int* out_part);
@@ -23,27 +23,109 @@ bool sync_encoders(LoggerdState *s, CameraType cam_type, uint32_t frame_id) {
   }
 }
 
-bool trigger_rotate_if_needed(LoggerdState *s, int cur_seg, uint32_t frame_id) {
+bool trigger_rotate_if_needed(LoggerdState *s, CameraType cam_type, int cur_seg, uint32_t frame_id) {
   const int frames_per_seg = SEGMENT_LENGTH * MAIN_FPS;
   if (cur_seg >= 0 && frame_id >= ((cur_seg + 1) * frames_per_seg) + s->start_frame_id) {
-    // trigger rotate and wait until the main logger has rotated to the new segment
-    ++s->ready_to_rotate;
-    std::unique_lock lk(s->rotate_lock);
-    s->rotate_cv.wait(lk, [&] {
-      return s->rotate_segment > cur_seg || do_exit;
-    });
-    return !do_exit;
+    // this encoder moves on to the next segment right away, the main logger rotates once every camera got there
+    update_max_atomic(s->camera_segment[cam_type], cur_seg + 1);
+    return true;
   }
   return false;
 }
 
+// every camera that triggers rotation is past the logger's segment. A camera that is ahead counts once,
+// so the logger never gets ahead of the slowest camera
+bool ready_to_rotate(LoggerdState *s) {
+  if (s->max_waiting == 0) return false;
+  for (int cam = 0; cam <= WideRoadCam; ++cam) {
+    if (s->camera_rotates[cam] && s->camera_segment[cam] <= s->rotate_segment) return false;
+  }
+  return true;
+}
+
+static void encoders_open(EncoderSegment *seg) {
+  bool ret = util::create_directories(seg->path, 0775);
+  assert(ret);
+  for (auto &e : seg->encoders) {
+    e->encoder_open(seg->path.c_str());
+  }
+}
+
+static void encoders_close(EncoderSegment *seg) {
+  for (auto &e : seg->encoders) {
+    e->encoder_close();
+  }
+}
+
+// the segment directory and the encoder locks are created here, once the camera is on that segment
+void rotate_encoders(CameraEncoders *ce, int segment, const std::string &path) {
+  if (!ce->standby) {
+    encoders_close(ce->cur);
+    ce->cur->segment = segment;
+    ce->cur->path = path;
+    encoders_open(ce->cur);
+    return;
+  }
+
+  // the standby set takes over, and the old segment drains in the background, off the frame path
+  EncoderSegment *old = ce->cur;
+  ce->standby->wait();
+  ce->standby->segment = segment;
+  ce->standby->path = path;
+  encoders_open(ce->standby);
+  ce->cur = std::exchange(ce->standby, old);
+  if (old->segment != -1) {
+    old->pending = std::async(std::launch::async, [old]() { encoders_close(old); });
+  }
+}
+
+void close_encoders(CameraEncoders *ce) {
+  if (ce->standby) {
+    ce->standby->wait();
+  }
+  encoders_close(ce->cur);
+}
+
+CameraEncoders::~CameraEncoders() {
+  for (auto &seg : segments) {
+    seg.wait();
+    for (auto &e : seg.encoders) {
+      delete e;
+    }
+  }
+}
+
+bool EncodeIdxQueue::push(int segment, kj::Array<capnp::word> &&msg) {
+  if (queue.size() >= SEGMENT_LENGTH * MAIN_FPS) {
+    dropped_count++;
+    return false;
+  }
+  queue.emplace_back(segment, std::move(msg));
+  return true;
+}
+
+std::vector<kj::Array<capnp::word>> EncodeIdxQueue::take(int segment) {
+  std::vector<kj::Array<capnp::word>> ret;
+  while (!queue.empty() && queue.front().first <= segment) {
+    if (queue.front().first == segment) {
+      ret.push_back(std::move(queue.front().second));
+    } else {
+      dropped_count++;
+    }
+    queue.pop_front();
+  }
+  return ret;
+}
+
 void encoder_thread(LoggerdState *s, const LogCameraInfo &cam_info) {
   util::set_thread_name(cam_info.filename);
 
-  int cur_seg = -1;
   int encode_idx = 0;
   LoggerHandle *lh = NULL;
-  std::vector<Encoder *> encoders;
+  int lh_segment = -1;
+  EncodeIdxQueue pending_idx;
+
+  CameraEncoders ce;
   VisionIpcClient vipc_client = VisionIpcClient("camerad", cam_info.stream_type, false);
 
   while (!do_exit) {
@@ -53,18 +135,26 @@ void encoder_thread(LoggerdState *s, const LogCameraInfo &cam_info) {
     }
 
     // init encoders
-    if (encoders.empty()) {
+    if (ce.cur->encoders.empty()) {
       VisionBuf buf_info = vipc_client.buffers[0];
       LOGD("encoder init %dx%d", buf_info.width, buf_info.height);
 
-      // main encoder
-      encoders.push_back(new Encoder(cam_info.filename, buf_info.width, buf_info.height,
-                                     cam_info.fps, cam_info.bitrate, cam_info.is_h265,
-                                     cam_info.downscale, cam_info.record));
-      // qcamera encoder
-      if (cam_info.has_qcamera) {
-        encoders.push_back(new Encoder(qcam_info.filename, qcam_info.frame_width, qcam_info.frame_height,
-                                       qcam_info.fps, qcam_info.bitrate, qcam_info.is_h265, qcam_info.downscale));
+      auto create = [&cam_info, width = buf_info.width, height = buf_info.height](EncoderSegment *seg) {
+        // main encoder
+        seg->encoders.push_back(new Encoder(cam_info.filename, width, height,
+                                            cam_info.fps, cam_info.bitrate, cam_info.is_h265,
+                                            cam_info.downscale, cam_info.record));
+        // qcamera encoder
+        if (cam_info.has_qcamera) {
+          seg->encoders.push_back(new Encoder(qcam_info.filename, qcam_info.frame_width, qcam_info.frame_height,
+                                              qcam_info.fps, qcam_info.bitrate, qcam_info.is_h265, qcam_info.downscale));
+        }
+      };
+      create(ce.cur);
+      if (STANDBY_ENCODERS) {
+        // ready long before the first rotation, which waits for it otherwise
+        ce.standby = &ce.segments[1];
+        ce.standby->pending = std::async(std::launch::async, create, ce.standby);
       }
     }
 
@@ -73,36 +163,43 @@ void encoder_thread(LoggerdState *s, const LogCameraInfo &cam_info) {
       VisionBuf* buf = vipc_client.recv(&extra);
       if (buf == nullptr) continue;
 
+      // the logger may be ahead of us, e.g. after a time-based rotation or for cameras that don't trigger rotation
+      int segment = std::max<int>(ce.cur->segment, s->rotate_segment);
       if (cam_info.trigger_rotate) {
         s->last_camera_seen_tms = millis_since_boot();
         if (!sync_encoders(s, cam_info.type, extra.frame_id)) {
           continue;
         }
 
-        // check if we're ready to rotate
-        trigger_rotate_if_needed(s, cur_seg, extra.frame_id);
-        if (do_exit) break;
+        // every camera switches on the same frame id without waiting for the others
+        if (trigger_rotate_if_needed(s, cam_info.type, ce.cur->segment, extra.frame_id)) {
+          segment = std::max(segment, ce.cur->segment + 1);
+        }
       }
 
-      // rotate the encoder if the logger is on a newer segment
-      if (s->rotate_segment > cur_seg) {
-        cur_seg = s->rotate_segment;
+      if (segment > ce.cur->segment) {
+        rotate_encoders(&ce, segment, logger_segment_path(&s->logger, LOG_ROOT.c_str(), segment));
+        LOGW("camera %d rotate encoder to %s", cam_info.type, ce.cur->path.c_str());
+      }
 
-        LOGW("camera %d rotate encoder to %s", cam_info.type, s->segment_path);
-        for (auto &e : encoders) {
-          e->encoder_close();
-          e->encoder_open(s->segment_path);
-        }
+      // pick up the logger handle of every segment the main logger gets to, up to ours
+      const int logger_segment = s->rotate_segment;
+      if (logger_segment != lh_segment && logger_segment <= ce.cur->segment) {
         if (lh) {
           lh_close(lh);
         }
         lh = logger_get_handle(&s->logger);
+        lh_segment = logger_segment;
+        for (auto &idx : pending_idx.take(lh_segment)) {
+          auto bytes = idx.asBytes();
+          lh_log(lh, bytes.begin(), bytes.size(), true);
+        }
       }
 
       // encode a frame
-      for (int i = 0; i < encoders.size(); ++i) {
-        int out_id = encoders[i]->encode_frame(buf->y, buf->u, buf->v,
-                                               buf->width, buf->height, extra.timestamp_eof);
+      for (int i = 0; i < ce.cur->encoders.size(); ++i) {
+        int out_id = ce.cur->encoders[i]->encode_frame(buf->y, buf->u, buf->v,
+                                                       buf->width, buf->height, extra.timestamp_eof);
 
         if (out_id == -1) {
           LOGE("Failed to encode frame. frame_id: %d encode_id: %d", extra.frame_id, encode_idx);
@@ -111,8 +208,8 @@ void encoder_thread(LoggerdState *s, const LogCameraInfo &cam_info) {
         // publish encode index
         if (i == 0 && out_id != -1) {
           MessageBuilder msg;
-          // this is really ugly
-          bool valid = (buf->get_frame_id() == extra.frame_id);
+          // invalid if camerad reused the buffer while we were encoding it
+          bool valid = vipc_client.release(buf);
           auto eidx = cam_info.type == DriverCam ? msg.initEvent(valid).initDriverEncodeIdx() :
                      (cam_info.type == WideRoadCam ? msg.initEvent(valid).initWideRoadEncodeIdx() : msg.initEvent(valid).initRoadEncodeIdx());
           eidx.setFrameId(extra.frame_id);
@@ -124,11 +221,13 @@ void encoder_thread(LoggerdState *s, const LogCameraInfo &cam_info) {
             eidx.setType(cam_info.type == DriverCam ? cereal::EncodeIndex::Type::FRONT : cereal::EncodeIndex::Type::FULL_H_E_V_C);
           }
           eidx.setEncodeId(encode_idx);
-          eidx.setSegmentNum(cur_seg);
+          eidx.setSegmentNum(ce.cur->segment);
           eidx.setSegmentId(out_id);
-          if (lh) {
+          if (lh_segment == ce.cur->segment) {
             auto bytes = msg.toBytes();
             lh_log(lh, bytes.begin(), bytes.size(), true);
+          } else if (!pending_idx.push(ce.cur->segment, capnp::messageToFlatArray(msg))) {
+            LOGE("camera %d logger is behind, dropping encode index %d", cam_info.type, encode_idx);
           }
         }
       }
@@ -139,32 +238,25 @@ void encoder_thread(LoggerdState *s, const LogCameraInfo &cam_info) {
     if (lh) {
       lh_close(lh);
       lh = NULL;
+      lh_segment = -1;
     }
   }
 
   LOG("encoder destroy");
-  for(auto &e : encoders) {
-    e->encoder_close();
-    delete e;
-  }
+  close_encoders(&ce);
 }
 
 void logger_rotate(LoggerdState *s) {
-  {
-    std::unique_lock lk(s->rotate_lock);
-    int segment = -1;
-    int err = logger_next(&s->logger, LOG_ROOT.c_str(), s->segment_path, sizeof(s->segment_path), &segment);
-    assert(err == 0);
-    s->rotate_segment = segment;
-    s->ready_to_rotate = 0;
-    s->last_rotate_tms = millis_since_boot();
-  }
-  s->rotate_cv.notify_all();
+  int segment = -1;
+  int err = logger_next(&s->logger, LOG_ROOT.c_str(), s->segment_path, sizeof(s->segment_path), &segment);
+  assert(err == 0);
+  s->rotate_segment = segment;
+  s->last_rotate_tms = millis_since_boot();
   LOGW((s->logger.part == 0) ? "logging to %s" : "rotated to %s", s->segment_path);
 }
 
 void rotate_if_needed(LoggerdState *s) {
-  if (s->ready_to_rotate == s->max_waiting) {
+  if (ready_to_rotate(s)) {
     logger_rotate(s);
   }
 
@@ -214,7 +306,10 @@ void loggerd_thread() {
   for (const auto &cam : cameras_logged) {
     if (cam.enable) {
       encoder_threads.push_back(std::thread(encoder_thread, &s, cam));
-      if (cam.trigger_rotate) s.max_waiting++;
+      if (cam.trigger_rotate) {
+        s.max_waiting++;
+        s.camera_rotates[cam.type] = true;
+      }
     }
   }
 
@@ -252,7 +347,6 @@ void loggerd_thread() {
   }
 
   LOGW("closing encoders");
-  s.rotate_cv.notify_all();
   for (auto &t : encoder_threads) t.join();
 
   LOGW("closing logger");
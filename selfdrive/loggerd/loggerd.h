@@ -5,11 +5,12 @@
 #include <atomic>
 #include <cassert>
 #include <cerrno>
-#include <condition_variable>
-#include <mutex>
+#include <deque>
+#include <future>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "cereal/messaging/messaging.h"
 #include "cereal/services.h"
@@ -110,11 +111,11 @@ const LogCameraInfo qcam_info = {
 struct LoggerdState {
   LoggerState logger = {};
   char segment_path[4096];
-  std::mutex rotate_lock;
-  std::condition_variable rotate_cv;
   std::atomic<int> rotate_segment;
   std::atomic<double> last_camera_seen_tms;
-  std::atomic<int> ready_to_rotate;  // count of encoders ready to rotate
+  // the segment each camera that triggers rotation moved on to last
+  std::atomic<int> camera_segment[WideRoadCam + 1] = {};
+  bool camera_rotates[WideRoadCam + 1] = {};
   int max_waiting = 0;
   double last_rotate_tms = 0.;      // last rotate time in ms
 
@@ -125,7 +126,51 @@ struct LoggerdState {
   bool camera_synced[WideRoadCam + 1] = {};
 };
 
+// A second set of encoders per camera, created in the background at startup. It takes over at every
+// rotation, so the old segment is closed in the background while the new one already encodes. On
+// device every set is an OMX session, LOGGERD_NO_STANDBY_ENCODERS closes and reopens one set in place
+const bool STANDBY_ENCODERS = getenv("LOGGERD_NO_STANDBY_ENCODERS") == nullptr;
+
+// Encoders writing one segment
+struct EncoderSegment {
+  int segment = -1;
+  std::string path;
+  std::vector<VideoEncoder *> encoders;
+  // creating or closing the encoders in the background
+  std::future<void> pending;
+
+  inline void wait() {
+    if (pending.valid()) pending.wait();
+  }
+};
+
+// The encoders of a camera. cur encodes the frames, standby is the idle set if there is one
+struct CameraEncoders {
+  EncoderSegment segments[2];
+  EncoderSegment *cur = &segments[0];
+  EncoderSegment *standby = nullptr;
+
+  ~CameraEncoders();
+};
+
+// encodeIdx packets of segments the main logger didn't rotate to yet, at most a segment of them
+class EncodeIdxQueue {
+public:
+  bool push(int segment, kj::Array<capnp::word> &&msg);
+  // the packets of segment, in order. the ones of older segments are dropped, the logger is past them
+  std::vector<kj::Array<capnp::word>> take(int segment);
+  inline size_t size() const { return queue.size(); }
+  inline int dropped() const { return dropped_count; }
+
+private:
+  std::deque<std::pair<int, kj::Array<capnp::word>>> queue;
+  int dropped_count = 0;
+};
+
 bool sync_encoders(LoggerdState *s, CameraType cam_type, uint32_t frame_id);
-bool trigger_rotate_if_needed(LoggerdState *s, int cur_seg, uint32_t frame_id);
+bool trigger_rotate_if_needed(LoggerdState *s, CameraType cam_type, int cur_seg, uint32_t frame_id);
+bool ready_to_rotate(LoggerdState *s);
+void rotate_encoders(CameraEncoders *ce, int segment, const std::string &path);
+void close_encoders(CameraEncoders *ce);
 void rotate_if_needed(LoggerdState *s);
 void loggerd_thread();
@@ -0,0 +1,234 @@
+#include <cstdlib>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/loggerd/loggerd.h"
+
+TEST_CASE("trigger_rotate_if_needed") {
+  const int frames_per_seg = SEGMENT_LENGTH * MAIN_FPS;
+  const int num_segments = 4;
+  const int num_cameras = 3;
+  const uint32_t start_frame_id = 100;
+
+  LoggerdState s;
+  s.start_frame_id = start_frame_id;
+  s.max_waiting = num_cameras;
+  s.rotate_segment = 0;
+
+  std::atomic<int> cameras_done = 0;
+  std::vector<std::map<uint32_t, int>> frame_segments(num_cameras);
+  std::vector<std::vector<uint32_t>> split_frames(num_cameras);
+
+  auto camera_thread = [&](int cam, bool slow, bool drop_boundary) {
+    // a slow camera doesn't start until the others went through every segment
+    while (slow && cameras_done < num_cameras - 1) util::sleep_for(1);
+
+    int cur_seg = 0;
+    for (uint32_t frame_id = start_frame_id; frame_id < start_frame_id + num_segments * frames_per_seg; ++frame_id) {
+      if (drop_boundary && (frame_id - start_frame_id) % frames_per_seg == 0) continue;
+
+      if (trigger_rotate_if_needed(&s, (CameraType)cam, cur_seg, frame_id)) {
+        ++cur_seg;
+        split_frames[cam].push_back(frame_id);
+      }
+      frame_segments[cam][frame_id] = cur_seg;
+    }
+    ++cameras_done;
+  };
+
+  std::vector<std::thread> threads;
+  threads.emplace_back(camera_thread, 0, false, false);
+  threads.emplace_back(camera_thread, 1, false, true);
+  threads.emplace_back(camera_thread, 2, true, false);
+  for (auto &t : threads) t.join();
+
+  REQUIRE(cameras_done == num_cameras);
+  for (int cam = 0; cam < num_cameras; ++cam) {
+    REQUIRE(s.camera_segment[cam] == num_segments - 1);
+  }
+
+  // cameras receiving every frame split on exactly the same frame ids
+  REQUIRE(split_frames[0] == split_frames[2]);
+  for (int i = 0; i < split_frames[0].size(); ++i) {
+    REQUIRE(split_frames[0][i] == start_frame_id + (i + 1) * frames_per_seg);
+    // a camera that dropped the boundary frame splits on the next frame it gets
+    REQUIRE(split_frames[1][i] == split_frames[0][i] + 1);
+  }
+
+  // every frame ends up in the same segment on all cameras
+  for (int cam = 0; cam < num_cameras; ++cam) {
+    for (auto &[frame_id, segment] : frame_segments[cam]) {
+      REQUIRE(segment == (frame_id - start_frame_id) / frames_per_seg);
+    }
+  }
+}
+
+TEST_CASE("ready_to_rotate") {
+  const int frames_per_seg = SEGMENT_LENGTH * MAIN_FPS;
+  const uint32_t start_frame_id = 100;
+  auto boundary = [&](int segment) { return start_frame_id + segment * frames_per_seg; };
+
+  LoggerdState s;
+  s.start_frame_id = start_frame_id;
+  s.rotate_segment = 0;
+  s.max_waiting = 2;
+  s.camera_rotates[RoadCam] = true;
+  s.camera_rotates[WideRoadCam] = true;
+  REQUIRE(!ready_to_rotate(&s));
+
+  // the road camera alone gets two segments ahead, it still only counts once
+  REQUIRE(trigger_rotate_if_needed(&s, RoadCam, 0, boundary(1)));
+  REQUIRE(trigger_rotate_if_needed(&s, RoadCam, 1, boundary(2)));
+  REQUIRE(!ready_to_rotate(&s));
+
+  // the driver camera doesn't trigger rotation and isn't waited for
+  REQUIRE(trigger_rotate_if_needed(&s, WideRoadCam, 0, boundary(1)));
+  REQUIRE(ready_to_rotate(&s));
+  s.rotate_segment = 1;
+
+  // the road camera is on segment 2 already, the logger follows the wide camera
+  REQUIRE(!ready_to_rotate(&s));
+  REQUIRE(!trigger_rotate_if_needed(&s, WideRoadCam, 1, boundary(2) - 1));
+  REQUIRE(trigger_rotate_if_needed(&s, WideRoadCam, 1, boundary(2)));
+  REQUIRE(ready_to_rotate(&s));
+  s.rotate_segment = 2;
+  REQUIRE(!ready_to_rotate(&s));
+}
+
+// an encoder that takes as long to close as the test wants, like OMX draining its output
+class FakeEncoder : public VideoEncoder {
+public:
+  FakeEncoder(std::atomic<bool> *can_close) : can_close(can_close) {}
+  int encode_frame(const uint8_t *y_ptr, const uint8_t *u_ptr, const uint8_t *v_ptr,
+                   int in_width, int in_height, uint64_t ts) override { return 0; }
+  void encoder_open(const char *path) override {
+    dir_existed = util::file_exists(path);
+    open_path = path;
+    opened++;
+    is_open = true;
+  }
+  void encoder_close() override {
+    if (!is_open) return;
+    while (!*can_close) util::sleep_for(1);
+    closed++;
+    is_open = false;
+  }
+
+  std::atomic<bool> *can_close;
+  std::string open_path;
+  bool dir_existed = false;
+  std::atomic<bool> is_open = false;
+  int opened = 0, closed = 0;
+};
+
+TEST_CASE("rotate_encoders") {
+  char tmp[] = "/tmp/test_loggerd_XXXXXX";
+  REQUIRE(mkdtemp(tmp) != nullptr);
+  const std::string root = tmp;
+  auto segment_path = [&](int segment) { return root + "/route--" + std::to_string(segment); };
+  const int num_segments = 4;
+
+  const bool standby = GENERATE(false, true);
+  std::atomic<bool> can_close = true;
+  CameraEncoders ce;
+  ce.segments[0].encoders.push_back(new FakeEncoder(&can_close));
+  if (standby) {
+    // like encoder_thread, the standby set is still being created when the first rotation comes
+    ce.standby = &ce.segments[1];
+    ce.standby->pending = std::async(std::launch::async, [&can_close](EncoderSegment *seg) {
+      util::sleep_for(20);
+      seg->encoders.push_back(new FakeEncoder(&can_close));
+    }, ce.standby);
+  }
+  auto encoder = [](EncoderSegment *seg) { return (FakeEncoder *)seg->encoders[0]; };
+
+  for (int segment = 0; segment < num_segments; ++segment) {
+    // nothing of a segment is on disk before the camera moves to it
+    REQUIRE(!util::file_exists(segment_path(segment)));
+
+    // the old segment can't finish closing until we let it
+    can_close = !standby;
+    EncoderSegment *old = ce.cur;
+    rotate_encoders(&ce, segment, segment_path(segment));
+
+    REQUIRE(ce.cur->segment == segment);
+    REQUIRE(encoder(ce.cur)->is_open);
+    REQUIRE(encoder(ce.cur)->open_path == segment_path(segment));
+    REQUIRE(encoder(ce.cur)->dir_existed);
+
+    if (standby) {
+      // the other set took over while the old segment drains in the background
+      REQUIRE(ce.cur != old);
+      REQUIRE(ce.standby == old);
+      REQUIRE(encoder(old)->is_open == (segment > 0));
+      can_close = true;
+      old->wait();
+      REQUIRE(!encoder(old)->is_open);
+    } else {
+      REQUIRE(ce.cur == old);
+    }
+  }
+
+  close_encoders(&ce);
+  int opened = 0, closed = 0;
+  for (auto &seg : ce.segments) {
+    for (auto e : seg.encoders) {
+      REQUIRE(!((FakeEncoder *)e)->is_open);
+      opened += ((FakeEncoder *)e)->opened;
+      closed += ((FakeEncoder *)e)->closed;
+    }
+  }
+  REQUIRE(opened == num_segments);
+  REQUIRE(closed == num_segments);
+
+  for (int segment = 0; segment < num_segments; ++segment) {
+    rmdir(segment_path(segment).c_str());
+  }
+  rmdir(tmp);
+}
+
+TEST_CASE("EncodeIdxQueue") {
+  auto packet = [](int tag) {
+    auto words = kj::heapArray<capnp::word>(1);
+    memcpy(words.begin(), &tag, sizeof(tag));
+    return words;
+  };
+  auto tag = [](const kj::Array<capnp::word> &words) {
+    int tag;
+    memcpy(&tag, words.begin(), sizeof(tag));
+    return tag;
+  };
+
+  EncodeIdxQueue queue;
+  SECTION("packets go to the segment they were encoded in") {
+    REQUIRE(queue.push(1, packet(10)));
+    REQUIRE(queue.push(1, packet(11)));
+    REQUIRE(queue.push(2, packet(20)));
+    REQUIRE(queue.push(3, packet(30)));
+
+    auto packets = queue.take(1);
+    REQUIRE(packets.size() == 2);
+    REQUIRE(tag(packets[0]) == 10);
+    REQUIRE(tag(packets[1]) == 11);
+    REQUIRE(queue.size() == 2);
+
+    // the logger went straight to segment 3, the packets of 2 have no log to go to
+    packets = queue.take(3);
+    REQUIRE(packets.size() == 1);
+    REQUIRE(tag(packets[0]) == 30);
+    REQUIRE(queue.size() == 0);
+    REQUIRE(queue.dropped() == 1);
+  }
+
+  SECTION("at most a segment of packets is held") {
+    const int max_packets = SEGMENT_LENGTH * MAIN_FPS;
+    for (int i = 0; i < max_packets; ++i) {
+      REQUIRE(queue.push(1, packet(i)));
+    }
+    REQUIRE(!queue.push(1, packet(max_packets)));
+    REQUIRE(queue.dropped() == 1);
+    REQUIRE(queue.take(1).size() == max_packets);
+  }
+}
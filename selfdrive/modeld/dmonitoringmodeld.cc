@@ -20,9 +20,15 @@ void run_model(DMonitoringModelState &model, VisionIpcClient &vipc_client) {
     VisionBuf *buf = vipc_client.recv(&extra);
     if (buf == nullptr) continue;
 
+    if (int runs = model_profile_request()) {
+      model.m->profiler.start(runs);
+    }
     double t1 = millis_since_boot();
     DMonitoringResult res = dmonitoring_eval_frame(&model, buf->addr, buf->width, buf->height);
     double t2 = millis_since_boot();
+    if (model.m->profiler.done()) {
+      model.m->profiler.report("dmonitoringmodeld");
+    }
 
     // send dm packet
     dmonitoring_publish(pm, extra.frame_id, res, (t2 - t1) / 1000.0, model.output);
@@ -38,6 +44,7 @@ int main(int argc, char **argv) {
   // init the models
   DMonitoringModelState model;
   dmonitoring_init(&model);
+  model_profile_init();
 
   VisionIpcClient vipc_client = VisionIpcClient("camerad", VISION_STREAM_DRIVER, true);
   while (!do_exit && !vipc_client.connect(false)) {
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+# Installs the ONNX Runtime release that the PC model runner builds against.
+# Usage: install_onnxruntime.sh [prefix], defaults to /usr/local. Build with
+# --onnxruntime=PREFIX or ONNXRUNTIME_DIR=PREFIX for other prefixes
+set -e
+
+VERSION=1.14.1
+PREFIX=${1:-/usr/local}
+
+case "$(uname -s)-$(uname -m)" in
+  Linux-x86_64) PLATFORM=linux-x64 ;;
+  Linux-aarch64) PLATFORM=linux-aarch64 ;;
+  Darwin-x86_64) PLATFORM=osx-x86_64 ;;
+  Darwin-arm64) PLATFORM=osx-arm64 ;;
+  *) echo "no ONNX Runtime release for $(uname -s) $(uname -m)"; exit 1 ;;
+esac
+
+NAME=onnxruntime-$PLATFORM-$VERSION
+TMP=$(mktemp -d)
+trap "rm -rf $TMP" EXIT
+
+curl -fL "https://github.com/microsoft/onnxruntime/releases/download/v$VERSION/$NAME.tgz" | tar xz -C $TMP
+
+SUDO=""
+if [ ! -w "$PREFIX" ]; then
+  SUDO="sudo"
+fi
+$SUDO mkdir -p "$PREFIX/include/onnxruntime" "$PREFIX/lib"
+$SUDO cp $TMP/$NAME/include/*.h "$PREFIX/include/onnxruntime/"
+$SUDO cp -P $TMP/$NAME/lib/libonnxruntime* "$PREFIX/lib/"
+echo "installed ONNX Runtime $VERSION to $PREFIX"
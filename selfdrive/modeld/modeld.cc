@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <mutex>
 #include <cmath>
+#include <thread>
 
 #include <eigen3/Eigen/Dense>
 
@@ -9,6 +10,7 @@
 #include "cereal/visionipc/visionipc_client.h"
 #include "selfdrive/common/clutil.h"
 #include "selfdrive/common/params.h"
+#include "selfdrive/common/queue.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/util.h"
 #include "selfdrive/hardware/hw.h"
@@ -16,58 +18,109 @@
 
 ExitHandler do_exit;
 
-mat3 update_calibration(Eigen::Matrix<float, 3, 4> &extrinsics, bool wide_camera, bool bigmodel_frame) {
-  /*
-     import numpy as np
-     from common.transformations.model import medmodel_frame_from_road_frame
-     medmodel_frame_from_ground = medmodel_frame_from_road_frame[:, (0, 1, 3)]
-     ground_from_medmodel_frame = np.linalg.inv(medmodel_frame_from_ground)
-  */
-  static const auto ground_from_medmodel_frame = (Eigen::Matrix<float, 3, 3>() <<
-     0.00000000e+00, 0.00000000e+00, 1.00000000e+00,
-    -1.09890110e-03, 0.00000000e+00, 2.81318681e-01,
-    -1.84808520e-20, 9.00738606e-04, -4.28751576e-02).finished();
-
-  static const auto ground_from_sbigmodel_frame = (Eigen::Matrix<float, 3, 3>() <<
-     0.00000000e+00,  7.31372216e-19,  1.00000000e+00,
-    -2.19780220e-03,  4.11497335e-19,  5.62637363e-01,
-    -5.46146580e-20,  1.80147721e-03, -2.73464241e-01).finished();
-
-  const auto cam_intrinsics = Eigen::Matrix<float, 3, 3, Eigen::RowMajor>(wide_camera ? ecam_intrinsic_matrix.v : fcam_intrinsic_matrix.v);
-  static const mat3 yuv_transform = get_model_yuv_transform();
-
-  auto ground_from_model_frame = bigmodel_frame ? ground_from_sbigmodel_frame : ground_from_medmodel_frame;
-  auto camera_frame_from_road_frame = cam_intrinsics * extrinsics;
-  Eigen::Matrix<float, 3, 3> camera_frame_from_ground;
-  camera_frame_from_ground.col(0) = camera_frame_from_road_frame.col(0);
-  camera_frame_from_ground.col(1) = camera_frame_from_road_frame.col(1);
-  camera_frame_from_ground.col(2) = camera_frame_from_road_frame.col(3);
-
-  auto warp_matrix = camera_frame_from_ground * ground_from_model_frame;
-  mat3 transform = {};
-  for (int i=0; i<3*3; i++) {
-    transform.v[i] = warp_matrix(i / 3, i % 3);
+static uint64_t get_ts(const VisionIpcBufExtra &extra) {
+  return Hardware::TICI() ? extra.timestamp_sof : extra.timestamp_eof;
+}
+
+static void vipc_stats_publish(PubMaster &pm, const std::vector<std::pair<VisionStreamType, VisionIpcClient *>> &clients) {
+  MessageBuilder msg;
+  auto stats = msg.initEvent().initVisionIpcStats();
+  stats.setName("modeld");
+  auto lclients = stats.initClients(clients.size());
+  for (int i = 0; i < clients.size(); i++) {
+    auto &[type, client] = clients[i];
+    const VisionIpcClientStats &s = client->stats;
+    auto lclient = lclients[i];
+    lclient.setStreamType(type);
+    lclient.setDelivered(s.delivered);
+    lclient.setSkipped(s.skipped);
+    lclient.setTorn(s.torn);
+    lclient.setBufferAgeMean(s.delivered > 0 ? (s.age_sum_ns / s.delivered) * 1e-9 : 0.);
+    lclient.setBufferAgeMax(s.age_max_ns * 1e-9);
+    lclient.setNumBuffers(client->num_buffers);
+    lclient.setBufferCountHint(client->buffer_count_hint());
+    client->reset_stats();
   }
-  return matmul3(yuv_transform, transform);
+  pm.send("visionIpcStats", msg);
 }
 
-static uint64_t get_ts(const VisionIpcBufExtra &extra) {
-  return Hardware::TICI() ? extra.timestamp_sof : extra.timestamp_eof;
+
+// The model runs as three stages: the calling thread receives and prepares frames,
+// one thread executes the model and another parses and publishes the outputs.
+// Jobs move between the stages in order, so the recurrent state sees every frame
+// exactly as it would when run sequentially
+constexpr int NUM_JOBS = 4;
+
+struct ModelJob {
+  ModelInput input;
+  VisionIpcBufExtra meta_main, meta_extra;
+  uint32_t frame_id;
+  uint32_t vipc_dropped_frames;
+  float frame_drop_ratio;
+  bool live_calib_seen;
+  ModelTimings timings;
+  std::array<float, NET_OUTPUT_SIZE> output;
+};
+
+static void execute_thread(ModelState *model, ModelJob *jobs, SafeQueue<int> *prepared, SafeQueue<int> *executed, SafeQueue<int> *input_slots) {
+  util::set_thread_name("modeld_execute");
+  while (true) {
+    int idx = prepared->pop();
+    if (idx < 0) break;
+
+    ModelJob &job = jobs[idx];
+    if (int runs = model_profile_request()) {
+      model->m->profiler.start(runs);
+    }
+    double mt1 = millis_since_boot();
+    model_execute(model, job.input);
+    double mt2 = millis_since_boot();
+    job.timings.execution_time = (mt2 - mt1) / 1000.0;
+    if (model->m->profiler.done()) {
+      model->m->profiler.report("modeld");
+    }
+
+    // copy the outputs before the next frame overwrites them
+    job.output = model->output;
+    input_slots->push(0);
+    executed->push(idx);
+  }
+  executed->push(-1);
 }
 
+static void publish_thread(ModelJob *jobs, SafeQueue<int> *executed, SafeQueue<int> *free_jobs) {
+  util::set_thread_name("modeld_publish");
+  PubMaster pm({"modelV2", "cameraOdometry"});
+  while (true) {
+    int idx = executed->pop();
+    if (idx < 0) break;
+
+    const ModelJob &job = jobs[idx];
+    const ModelOutput &model_output = *(const ModelOutput *)job.output.data();
+    model_publish(pm, job.meta_main.frame_id, job.meta_extra.frame_id, job.frame_id, job.frame_drop_ratio, model_output, job.meta_main.timestamp_eof,
+                  job.timings, kj::ArrayPtr<const float>(job.output.data(), job.output.size()), job.live_calib_seen);
+    posenet_publish(pm, job.meta_main.frame_id, job.vipc_dropped_frames, model_output, job.meta_main.timestamp_eof, job.live_calib_seen);
+    free_jobs->push(idx);
+  }
+}
 
 void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcClient &vipc_client_extra, bool main_wide_camera, bool use_extra_client) {
   // messaging
-  PubMaster pm({"modelV2", "cameraOdometry"});
+  PubMaster pm({"visionIpcStats"});
   SubMaster sm({"lateralPlan", "roadCameraState", "liveCalibration"});
 
   // setup filter to track dropped frames
   FirstOrderFilter frame_dropped_filter(0., 10., 1. / MODEL_FREQ);
 
   uint32_t frame_id = 0, last_vipc_frame_id = 0;
-  double last = 0;
   uint32_t run_count = 0;
 
+  std::vector<std::pair<VisionStreamType, VisionIpcClient *>> vipc_clients = {{main_wide_camera ? VISION_STREAM_WIDE_ROAD : VISION_STREAM_ROAD, &vipc_client_main}};
+  if (use_extra_client) {
+    vipc_clients.push_back({VISION_STREAM_WIDE_ROAD, &vipc_client_extra});
+  }
+
+  const mat3 yuv_transform = get_model_yuv_transform();
   mat3 model_transform_main = {};
   mat3 model_transform_extra = {};
   bool live_calib_seen = false;
@@ -78,6 +131,21 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcCl
   VisionIpcBufExtra meta_main = {0};
   VisionIpcBufExtra meta_extra = {0};
 
+  // The ModelFrame rings hold the input being executed plus one more, so the next frame
+  // can be prepared during execution. When the runner owns the input buffers
+  // preparation has to wait for the previous execution instead
+  auto jobs = std::make_unique<ModelJob[]>(NUM_JOBS);
+  SafeQueue<int> free_jobs, prepared, executed, input_slots;
+  for (int i = 0; i < NUM_JOBS; i++) {
+    free_jobs.push(i);
+  }
+  const bool runner_owns_input = model.m->getInputBuf() != nullptr;
+  for (int i = 0; i < (runner_owns_input ? 1 : 2); i++) {
+    input_slots.push(0);
+  }
+  std::thread execute_t(execute_thread, &model, jobs.get(), &prepared, &executed, &input_slots);
+  std::thread publish_t(publish_thread, jobs.get(), &executed, &free_jobs);
+
   while (!do_exit) {
     // Keep receiving frames until we are at least 1 frame ahead of previous extra frame
     while (get_ts(meta_main) < get_ts(meta_extra) + 25000000ULL) {
@@ -111,6 +179,7 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcCl
       buf_extra = buf_main;
       meta_extra = meta_main;
     }
+    double frame_recv_time = millis_since_boot();
 
     // TODO: path planner timeout?
     sm.update(0);
@@ -123,8 +192,8 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcCl
         extrinsic_matrix_eigen(i / 4, i % 4) = extrinsic_matrix[i];
       }
 
-      model_transform_main = update_calibration(extrinsic_matrix_eigen, main_wide_camera, false);
-      model_transform_extra = update_calibration(extrinsic_matrix_eigen, Hardware::TICI(), true);
+      model_transform_main = update_calibration(extrinsic_matrix_eigen, main_wide_camera ? ecam_intrinsic_matrix : fcam_intrinsic_matrix, yuv_transform, false);
+      model_transform_extra = update_calibration(extrinsic_matrix_eigen, Hardware::TICI() ? ecam_intrinsic_matrix : fcam_intrinsic_matrix, yuv_transform, true);
       live_calib_seen = true;
     }
 
@@ -133,10 +202,12 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcCl
       vec_desire[desire] = 1.0;
     }
 
-    double mt1 = millis_since_boot();
-    ModelOutput *model_output = model_eval_frame(&model, buf_main, buf_extra, model_transform_main, model_transform_extra, vec_desire);
-    double mt2 = millis_since_boot();
-    float model_execution_time = (mt2 - mt1) / 1000.0;
+    int idx = free_jobs.pop();
+    ModelJob &job = jobs[idx];
+    input_slots.pop();
+    double pt1 = millis_since_boot();
+    model_prepare(&model, buf_main, buf_extra, model_transform_main, model_transform_extra, vec_desire, &job.input);
+    double pt2 = millis_since_boot();
 
     // tracked dropped frames
     uint32_t vipc_dropped_frames = meta_main.frame_id - last_vipc_frame_id - 1;
@@ -147,16 +218,24 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcCl
     }
     run_count++;
 
-    float frame_drop_ratio = frames_dropped / (1 + frames_dropped);
-
-    model_publish(pm, meta_main.frame_id, meta_extra.frame_id, frame_id, frame_drop_ratio, *model_output, meta_main.timestamp_eof, model_execution_time,
-                  kj::ArrayPtr<const float>(model.output.data(), model.output.size()), live_calib_seen);
-    posenet_publish(pm, meta_main.frame_id, vipc_dropped_frames, *model_output, meta_main.timestamp_eof, live_calib_seen);
-
-    //printf("model process: %.2fms, from last %.2fms, vipc_frame_id %u, frame_id, %u, frame_drop %.3f\n", mt2 - mt1, mt1 - last, extra.frame_id, frame_id, frame_drop_ratio);
-    last = mt1;
+    job.meta_main = meta_main;
+    job.meta_extra = meta_extra;
+    job.frame_id = frame_id;
+    job.vipc_dropped_frames = vipc_dropped_frames;
+    job.frame_drop_ratio = frames_dropped / (1 + frames_dropped);
+    job.live_calib_seen = live_calib_seen;
+    job.timings = {.prepare_time = float((pt2 - pt1) / 1000.0), .frame_recv_time = frame_recv_time};
+    prepared.push(idx);
+
+    if (run_count % MODEL_FREQ == 0) {
+      vipc_stats_publish(pm, vipc_clients);
+    }
     last_vipc_frame_id = meta_main.frame_id;
   }
+
+  prepared.push(-1);
+  execute_t.join();
+  publish_t.join();
 }
 
 int main(int argc, char **argv) {
@@ -178,6 +257,7 @@ int main(int argc, char **argv) {
   // init the models
   ModelState model;
   model_init(&model, device_id, context);
+  model_profile_init();
   LOGW("models loaded, modeld starting");
 
   VisionIpcClient vipc_client_main = VisionIpcClient("camerad", main_wide_camera ? VISION_STREAM_WIDE_ROAD : VISION_STREAM_ROAD, true, device_id, context);
@@ -0,0 +1,278 @@
+// Runs the driving model over recorded segments as fast as it can and writes the modelV2
+// events of each segment into <output dir>/<segment>.rlog. Frames are decoded from the
+// camera files; desire, calibration and frame ids come from the segment's rlog. Frames are
+// evaluated back to back in encode order, without the camera timing sync of modeld.
+// The recurrent state is kept within a segment and reset between segments, so the output
+// of a segment doesn't depend on how the segments are sharded.
+//
+// Usage: modeld_batch [-j jobs] [--shard i/n] [--rhd] -o <output dir> <segment dir>...
+// Run it from selfdrive/modeld like modeld, so the model path resolves.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "cereal/visionipc/visionbuf.h"
+#include "selfdrive/common/clutil.h"
+#include "selfdrive/common/modeldata.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+#include "selfdrive/modeld/models/driving.h"
+#include "selfdrive/ui/replay/framereader.h"
+#include "selfdrive/ui/replay/logreader.h"
+
+ExitHandler do_exit;
+
+struct Segment {
+  std::string name;
+  std::string rlog;
+  std::string road_cam;
+  std::string wide_road_cam;
+};
+
+static std::string find_file(const std::string &dir, const std::vector<std::string> &names) {
+  for (const auto &name : names) {
+    if (util::file_exists(dir + "/" + name)) return dir + "/" + name;
+  }
+  return "";
+}
+
+static bool find_segment(std::string dir, Segment *seg) {
+  while (dir.size() > 1 && dir.back() == '/') dir.pop_back();
+  seg->name = dir.substr(dir.find_last_of('/') + 1);
+  seg->rlog = find_file(dir, {"rlog.bz2"});
+  seg->road_cam = find_file(dir, {"fcamera.hevc"});
+  seg->wide_road_cam = find_file(dir, {"ecamera.hevc"});
+  if (seg->rlog.empty() || seg->road_cam.empty()) {
+    printf("%s: no rlog.bz2 or fcamera.hevc\n", dir.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void init_buf(VisionBuf *buf, const FrameReader &fr, cl_device_id device_id, cl_context context) {
+  buf->allocate(fr.getYUVSize());
+  buf->init_cl(device_id, context);
+  buf->init_yuv(fr.width, fr.height);
+}
+
+static bool get_frame(FrameReader &fr, int idx, VisionBuf *buf) {
+  if (!fr.get(idx, nullptr, (uint8_t *)buf->addr)) return false;
+  return buf->sync(VISIONBUF_SYNC_TO_DEVICE) == 0;
+}
+
+static bool run_segment(ModelState &model, cl_device_id device_id, cl_context context, const Segment &seg, const std::string &out_dir) {
+  double t1 = millis_since_boot();
+  LogReader lr;
+  FrameReader road_fr, wide_fr;
+  if (!lr.load(seg.rlog) || !road_fr.load(seg.road_cam)) {
+    printf("%s: failed to load\n", seg.name.c_str());
+    return false;
+  }
+  const bool use_wide = !seg.wide_road_cam.empty() && wide_fr.load(seg.wide_road_cam);
+
+  // the device is told apart by the road camera resolution, EON frames are debayered at half size
+  const bool eon = road_fr.width == 1164;
+  const mat3 main_intrinsics = eon ? eon_fcam_intrinsic_matrix : tici_fcam_intrinsic_matrix;
+  const mat3 extra_intrinsics = use_wide ? ecam_intrinsic_matrix : main_intrinsics;
+  const mat3 yuv_transform = transform_scale_buffer((mat3){{1, 0, 0, 0, 1, 0, 0, 0, 1}}, eon ? 0.5 : 1.0);
+
+  VisionBuf buf_main, buf_wide;
+  init_buf(&buf_main, road_fr, device_id, context);
+  if (use_wide) {
+    init_buf(&buf_wide, wide_fr, device_id, context);
+  }
+
+  // wide frames are matched to road frames by frame id
+  std::unordered_map<uint32_t, uint32_t> wide_frame_idx;
+  for (const Event *e : lr.events) {
+    if (e->which == cereal::Event::WIDE_ROAD_ENCODE_IDX && !e->frame) {
+      auto idx = e->event.getWideRoadEncodeIdx();
+      wide_frame_idx[idx.getFrameId()] = idx.getSegmentId();
+    }
+  }
+
+  model_reset(&model);
+  FirstOrderFilter frame_dropped_filter(0., 10., 1. / MODEL_FREQ);
+  mat3 model_transform_main = {}, model_transform_extra = {};
+  bool live_calib_seen = false;
+  int desire = -1;
+  uint32_t frame_id = 0, last_vipc_frame_id = 0, run_count = 0;
+
+  std::string out_fn = out_dir + "/" + seg.name + ".rlog";
+  std::ofstream out(out_fn + ".tmp", std::ios::binary);
+  double execution_time = 0;
+
+  for (const Event *e : lr.events) {
+    if (do_exit) break;
+
+    if (e->which == cereal::Event::LATERAL_PLAN) {
+      desire = (int)e->event.getLateralPlan().getDesire();
+    } else if (e->which == cereal::Event::ROAD_CAMERA_STATE) {
+      frame_id = e->event.getRoadCameraState().getFrameId();
+    } else if (e->which == cereal::Event::LIVE_CALIBRATION) {
+      auto extrinsic_matrix = e->event.getLiveCalibration().getExtrinsicMatrix();
+      Eigen::Matrix<float, 3, 4> extrinsic_matrix_eigen;
+      for (int i = 0; i < 4*3; i++) {
+        extrinsic_matrix_eigen(i / 4, i % 4) = extrinsic_matrix[i];
+      }
+      model_transform_main = update_calibration(extrinsic_matrix_eigen, main_intrinsics, yuv_transform, false);
+      model_transform_extra = update_calibration(extrinsic_matrix_eigen, extra_intrinsics, yuv_transform, true);
+      live_calib_seen = true;
+    } else if (e->which == cereal::Event::ROAD_ENCODE_IDX && !e->frame) {
+      auto idx = e->event.getRoadEncodeIdx();
+      if (!get_frame(road_fr, idx.getSegmentId(), &buf_main)) continue;
+
+      VisionBuf *buf_extra = &buf_main;
+      uint32_t extra_frame_id = idx.getFrameId();
+      if (use_wide) {
+        auto it = wide_frame_idx.find(idx.getFrameId());
+        if (it == wide_frame_idx.end() || !get_frame(wide_fr, it->second, &buf_wide)) continue;
+        buf_extra = &buf_wide;
+      }
+
+      float vec_desire[DESIRE_LEN] = {0};
+      if (desire >= 0 && desire < DESIRE_LEN) {
+        vec_desire[desire] = 1.0;
+      }
+
+      double mt1 = millis_since_boot();
+      ModelOutput *model_output = model_eval_frame(&model, &buf_main, buf_extra, model_transform_main, model_transform_extra, vec_desire);
+      double mt2 = millis_since_boot();
+      execution_time += mt2 - mt1;
+
+      uint32_t vipc_dropped_frames = run_count > 0 ? idx.getFrameId() - last_vipc_frame_id - 1 : 0;
+      float frames_dropped = frame_dropped_filter.update((float)std::min(vipc_dropped_frames, 10U));
+      if (run_count < 10) { // let frame drops warm up
+        frame_dropped_filter.reset(0);
+        frames_dropped = 0.;
+      }
+      run_count++;
+      last_vipc_frame_id = idx.getFrameId();
+
+      ModelTimings timings = {.execution_time = float((mt2 - mt1) / 1000.0)};
+      MessageBuilder msg("modelV2");
+      fill_model_msg(msg, idx.getFrameId(), extra_frame_id, frame_id, frames_dropped / (1 + frames_dropped), *model_output, idx.getTimestampEof(),
+                     timings, kj::ArrayPtr<const float>(model.output.data(), model.output.size()), live_calib_seen);
+      msg.getRoot<cereal::Event>().setLogMonoTime(e->mono_time);
+
+      auto words = capnp::messageToFlatArray(msg);
+      auto bytes = words.asBytes();
+      out.write((const char *)bytes.begin(), bytes.size());
+    }
+  }
+
+  buf_main.free();
+  if (use_wide) {
+    buf_wide.free();
+  }
+  out.close();
+  if (do_exit || !out) {
+    unlink((out_fn + ".tmp").c_str());
+    return false;
+  }
+  rename((out_fn + ".tmp").c_str(), out_fn.c_str());
+
+  double seconds = (millis_since_boot() - t1) / 1000.0;
+  printf("%s: %u frames in %.1f s, %.1f fps, model %.1f ms/frame\n", seg.name.c_str(), run_count, seconds,
+         run_count / seconds, run_count > 0 ? execution_time / run_count : 0.);
+  return true;
+}
+
+static int run_worker(const std::vector<Segment> &segments, const std::string &out_dir, bool rhd) {
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+
+  ModelState model;
+  model_init(&model, device_id, context);
+#ifdef TRAFFIC_CONVENTION
+  model.traffic_convention[0] = rhd ? 0.0 : 1.0;
+  model.traffic_convention[1] = rhd ? 1.0 : 0.0;
+#endif
+
+  int failed = 0;
+  for (const auto &seg : segments) {
+    if (do_exit) break;
+    failed += !run_segment(model, device_id, context, seg, out_dir);
+  }
+
+  model_free(&model);
+  CL_CHECK(clReleaseContext(context));
+  return failed;
+}
+
+static void usage(const char *argv0) {
+  printf("usage: %s [-j jobs] [--shard i/n] [--rhd] -o <output dir> <segment dir>...\n", argv0);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int jobs = 1, shard = 0, num_shards = 1;
+  bool rhd = false;
+  std::string out_dir;
+  std::vector<std::string> dirs;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      jobs = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%d/%d", &shard, &num_shards) != 2 || num_shards < 1 || shard < 0 || shard >= num_shards) usage(argv[0]);
+    } else if (strcmp(argv[i], "--rhd") == 0) {
+      rhd = true;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      out_dir = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+    } else {
+      dirs.push_back(argv[i]);
+    }
+  }
+  if (out_dir.empty() || dirs.empty()) usage(argv[0]);
+  util::create_directories(out_dir, 0775);
+
+  // --shard splits the segments between machines, -j between processes on this one
+  std::vector<Segment> segments;
+  for (int i = shard; i < dirs.size(); i += num_shards) {
+    Segment seg;
+    if (find_segment(dirs[i], &seg)) {
+      segments.push_back(seg);
+    }
+  }
+  jobs = std::min<int>(jobs, segments.size());
+  if (jobs <= 1) {
+    return run_worker(segments, out_dir, rhd) == 0 ? 0 : 1;
+  }
+
+  // each worker gets its own OpenCL context and model, so fork before any of them exist
+  std::vector<pid_t> workers;
+  for (int j = 0; j < jobs; j++) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+      std::vector<Segment> own;
+      for (int i = j; i < segments.size(); i += jobs) {
+        own.push_back(segments[i]);
+      }
+      _exit(run_worker(own, out_dir, rhd) == 0 ? 0 : 1);
+    }
+    workers.push_back(pid);
+  }
+
+  int failed = 0;
+  for (pid_t pid : workers) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  printf("%zu segments in %d workers, %d workers failed\n", segments.size(), jobs, failed);
+  return failed == 0 ? 0 : 1;
+}
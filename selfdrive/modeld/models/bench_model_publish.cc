@@ -0,0 +1,70 @@
+// Times fill_model against the per element parser it replaced, plus a full model_publish.
+// Whether both serialize the same modelV2 is checked by tests/test_model_publish.cc
+//
+// Usage: ./bench_model_publish [raw predictions file]
+// The file holds NET_OUTPUT_SIZE floats per frame, e.g. the concatenated
+// modelV2.rawPredictions of a route recorded with SEND_RAW_PRED=1
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/modeld/models/driving.h"
+#include "selfdrive/modeld/tests/legacy_fill_model.h"
+
+constexpr int SYNTHETIC_FRAMES = 200;
+constexpr int BENCH_ITERATIONS = 2000;
+
+static std::vector<std::array<float, NET_OUTPUT_SIZE>> load_outputs(const char *fn) {
+  if (fn == nullptr) {
+    printf("using %d synthetic frames\n", SYNTHETIC_FRAMES);
+    return synthetic_outputs(SYNTHETIC_FRAMES);
+  }
+
+  std::vector<std::array<float, NET_OUTPUT_SIZE>> outputs;
+  std::ifstream f(fn, std::ios::binary);
+  std::array<float, NET_OUTPUT_SIZE> output;
+  while (f.read((char *)output.data(), sizeof(output))) {
+    outputs.push_back(output);
+  }
+  printf("loaded %zu frames from %s\n", outputs.size(), fn);
+  return outputs;
+}
+
+template <typename F>
+static double bench(const std::vector<std::array<float, NET_OUTPUT_SIZE>> &outputs, F f) {
+  double t1 = millis_since_boot();
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    f(outputs[i % outputs.size()]);
+  }
+  return (millis_since_boot() - t1) * 1000. / BENCH_ITERATIONS;
+}
+
+int main(int argc, char *argv[]) {
+  auto outputs = load_outputs(argc > 1 ? argv[1] : nullptr);
+  if (outputs.empty()) {
+    printf("no frames\n");
+    return 1;
+  }
+
+  double legacy_us = bench(outputs, [](auto &output) {
+    MessageBuilder msg("modelV2");
+    auto framed = msg.initEvent(true).initModelV2();
+    legacy::fill_model(framed, *(const ModelOutput *)output.data());
+  });
+  double fill_us = bench(outputs, [](auto &output) {
+    MessageBuilder msg("modelV2");
+    auto framed = msg.initEvent(true).initModelV2();
+    fill_model(framed, *(const ModelOutput *)output.data());
+  });
+
+  PubMaster pm({"modelV2"});
+  double publish_us = bench(outputs, [&](auto &output) {
+    model_publish(pm, 1, 1, 1, 0., *(const ModelOutput *)output.data(), 0, {},
+                  kj::ArrayPtr<const float>(output.data(), output.size()), true);
+  });
+  printf("fill: legacy %.1f us  batched %.1f us  model_publish %.1f us\n", legacy_us, fill_us, publish_us);
+  return 0;
+}
@@ -7,10 +7,12 @@
 
 #include "selfdrive/common/clutil.h"
 #include "selfdrive/common/mat.h"
+#include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
 
 ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
-  input_frames = std::make_unique<float[]>(buf_size);
+  input_ring = std::make_unique<float[]>(MODEL_FRAME_SIZE * RING_FRAMES);
 
   q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
   y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT, NULL, &err));
@@ -20,6 +22,14 @@ ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
 
   transform_init(&transform, context, device_id);
   loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
+
+  cl_device_type device_type;
+  CL_CHECK(clGetDeviceInfo(device_id, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL));
+  use_cpu = getenv("MODEL_CPU_PREPARE") != NULL || device_type == CL_DEVICE_TYPE_CPU;
+  if (use_cpu) {
+    yuv_buf = std::make_unique<uint8_t[]>(MODEL_FRAME_SIZE);
+    LOGW("preparing model frames on the cpu, simd: %s", cpu_transform_simd_name(cpu_transform_simd()));
+  }
 }
 
 float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, const mat3 &projection, cl_mem *output) {
@@ -30,10 +40,13 @@ float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, con
   if (output == NULL) {
     loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, net_input_cl);
 
-    std::memmove(&input_frames[0], &input_frames[MODEL_FRAME_SIZE], sizeof(float) * MODEL_FRAME_SIZE);
-    CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), &input_frames[MODEL_FRAME_SIZE], 0, nullptr, nullptr));
+    float *slot = next_ring_slot();
+    CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), slot, 0, nullptr, nullptr));
     clFinish(q);
-    return &input_frames[0];
+    if (ring_pos == RING_FRAMES - 1) {
+      std::memcpy(&input_ring[0], slot, sizeof(float) * MODEL_FRAME_SIZE);
+    }
+    return slot - MODEL_FRAME_SIZE;
   } else {
     loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, *output, true);
     // NOTE: Since thneed is using a different command queue, this clFinish is needed to ensure the image is ready.
@@ -42,6 +55,31 @@ float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, con
   }
 }
 
+float* ModelFrame::prepare(const uint8_t *yuv, int frame_width, int frame_height, const mat3 &projection) {
+  assert(use_cpu);
+  uint8_t *y = yuv_buf.get();
+  uint8_t *u = y + MODEL_WIDTH * MODEL_HEIGHT;
+  uint8_t *v = u + (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2);
+  transform_cpu(yuv, frame_width, frame_height, y, u, v, MODEL_WIDTH, MODEL_HEIGHT, projection);
+
+  float *slot = next_ring_slot();
+  loadyuv_cpu(y, u, v, MODEL_WIDTH, MODEL_HEIGHT, slot);
+  if (ring_pos == RING_FRAMES - 1) {
+    loadyuv_cpu(y, u, v, MODEL_WIDTH, MODEL_HEIGHT, &input_ring[0]);
+  }
+  return slot - MODEL_FRAME_SIZE;
+}
+
+void ModelFrame::reset() {
+  std::fill_n(input_ring.get(), MODEL_FRAME_SIZE * RING_FRAMES, 0);
+  ring_pos = 0;
+}
+
+float* ModelFrame::next_ring_slot() {
+  ring_pos = ring_pos % (RING_FRAMES - 1) + 1;
+  return &input_ring[ring_pos * MODEL_FRAME_SIZE];
+}
+
 ModelFrame::~ModelFrame() {
   transform_destroy(&transform);
   loadyuv_destroy(&loadyuv);
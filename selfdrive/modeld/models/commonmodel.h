@@ -26,17 +26,35 @@ class ModelFrame {
 public:
   ModelFrame(cl_device_id device_id, cl_context context);
   ~ModelFrame();
+  // Both return the previous and the new frame as one contiguous input, or NULL when
+  // the frame is written to output
   float* prepare(cl_mem yuv_cl, int width, int height, const mat3& transform, cl_mem *output);
+  // CPU path
+  float* prepare(const uint8_t *yuv, int width, int height, const mat3& transform);
+  // forgets the previous frames
+  void reset();
 
   const int MODEL_WIDTH = 512;
   const int MODEL_HEIGHT = 256;
   const int MODEL_FRAME_SIZE = MODEL_WIDTH * MODEL_HEIGHT * 3 / 2;
   const int buf_size = MODEL_FRAME_SIZE * 2;
 
+  // set by MODEL_CPU_PREPARE, or when the OpenCL device is a CPU (e.g. pocl)
+  bool use_cpu = false;
+
 private:
   Transform transform;
   LoadYUVState loadyuv;
   cl_command_queue q;
   cl_mem y_cl, u_cl, v_cl, net_input_cl;
-  std::unique_ptr<float[]> input_frames;
+
+  // Frames are written into a ring of RING_FRAMES slots, so the temporal frame
+  // doesn't have to be moved. The last slot is also written to slot 0 to keep the next
+  // input contiguous. Four slots let the next frame be prepared while the model still
+  // reads the current input
+  static constexpr int RING_FRAMES = 4;
+  float *next_ring_slot();
+  std::unique_ptr<uint8_t[]> yuv_buf;
+  std::unique_ptr<float[]> input_ring;
+  int ring_pos = 0;
 };
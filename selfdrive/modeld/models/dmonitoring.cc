@@ -1,6 +1,12 @@
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 
-#include "libyuv.h"
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "selfdrive/common/mat.h"
 #include "selfdrive/common/modeldata.h"
@@ -19,24 +25,11 @@ static inline T *get_buffer(std::vector<T> &buf, const size_t size) {
   return buf.data();
 }
 
-static inline void init_yuv_buf(std::vector<uint8_t> &buf, const int width, int height) {
-  uint8_t *y = get_buffer(buf, width * height * 3 / 2);
-  uint8_t *u = y + width * height;
-  uint8_t *v = u + (width / 2) * (height / 2);
-
-  // needed on comma two to make the padded border black
-  // equivalent to RGB(0,0,0) in YUV space
-  memset(y, 16, width * height);
-  memset(u, 128, (width / 2) * (height / 2));
-  memset(v, 128, (width / 2) * (height / 2));
-}
-
 void dmonitoring_init(DMonitoringModelState* s) {
   s->is_rhd = Params().getBool("IsRHD");
   for (int x = 0; x < std::size(s->tensor); ++x) {
     s->tensor[x] = (x - 128.f) * 0.0078125f;
   }
-  init_yuv_buf(s->resized_buf, MODEL_WIDTH, MODEL_HEIGHT);
 
 #ifdef USE_ONNX_MODEL
   s->m = new ONNXModel("../../models/dmonitoring_model.onnx", &s->output[0], OUTPUT_SIZE, USE_DSP_RUNTIME);
@@ -45,27 +38,93 @@ void dmonitoring_init(DMonitoringModelState* s) {
 #endif
 }
 
-static inline auto get_yuv_buf(std::vector<uint8_t> &buf, const int width, int height) {
-  uint8_t *y = get_buffer(buf, width * height * 3 / 2);
-  uint8_t *u = y + width * height;
-  uint8_t *v = u + (width /2) * (height / 2);
-  return std::make_tuple(y, u, v);
+struct Rect {int x, y, w, h;};
+
+// Bilinear taps along one axis, placed like libyuv's ScalePlaneBilinearDown (16.16 fixed
+// point, centered on the destination pixels). Rows use an 8 bit fraction and columns a 16
+// bit one, as libyuv does, so the output matches I420Scale up to rounding
+static void build_taps(int src, int dst, bool cols, bool mirror, std::vector<int> &i0, std::vector<int> &i1, std::vector<int> &frac) {
+  assert(dst <= src);
+  i0.resize(dst);
+  i1.resize(dst);
+  frac.resize(dst);
+
+  const int max_pos = (src - 1) << 16;
+  const int step = (int)(((int64_t)src << 16) / dst);
+  int pos = (step >> 1) - 32768;
+  for (int i = 0; i < dst; i++) {
+    if (!cols) pos = std::min(pos, max_pos);
+    int idx = pos >> 16;
+    int next = std::min(idx + 1, src - 1);
+    i0[i] = mirror ? src - 1 - idx : idx;
+    i1[i] = mirror ? src - 1 - next : next;
+    frac[i] = cols ? pos & 0xffff : (pos >> 8) & 255;
+    pos += step;
+  }
+}
+
+void DMonitoringPlaneTaps::build(int src_w, int src_h, int dst_w, int dst_h, bool mirror) {
+  std::vector<int> unused;
+  build_taps(src_w, dst_w, true, mirror, x0, x1, xf);
+  build_taps(src_h, dst_h, false, false, y0, unused, yf);
 }
 
-struct Rect {int x, y, w, h;};
-void crop_yuv(uint8_t *raw, int width, int height, uint8_t *y, uint8_t *u, uint8_t *v, const Rect &rect) {
-  uint8_t *raw_y = raw;
-  uint8_t *raw_u = raw_y + (width * height);
-  uint8_t *raw_v = raw_u + ((width / 2) * (height / 2));
-  for (int r = 0; r < rect.h / 2; r++) {
-    memcpy(y + 2 * r * rect.w, raw_y + (2 * r + rect.y) * width + rect.x, rect.w);
-    memcpy(y + (2 * r + 1) * rect.w, raw_y + (2 * r + rect.y + 1) * width + rect.x, rect.w);
-    memcpy(u + r * (rect.w / 2), raw_u + (r + (rect.y / 2)) * width / 2 + (rect.x / 2), rect.w / 2);
-    memcpy(v + r * (rect.w / 2), raw_v + (r + (rect.y / 2)) * width / 2 + (rect.x / 2), rect.w / 2);
+// out = (r0 * (256 - f) + r1 * f + 128) >> 8
+static void blend_rows(const uint8_t *r0, const uint8_t *r1, int f, uint8_t *out, int n) {
+  if (f == 0) {
+    memcpy(out, r0, n);
+    return;
+  }
+  int i = 0;
+#if defined(__ARM_NEON)
+  const uint8x8_t w0 = vdup_n_u8(256 - f), w1 = vdup_n_u8(f);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t a = vld1q_u8(r0 + i), b = vld1q_u8(r1 + i);
+    uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), w0), vget_low_u8(b), w1);
+    uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), w0), vget_high_u8(b), w1);
+    vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+  }
+#elif defined(__SSE2__)
+  const __m128i w0 = _mm_set1_epi16(256 - f), w1 = _mm_set1_epi16(f), rnd = _mm_set1_epi16(128), zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(r0 + i)), b = _mm_loadu_si128((const __m128i *)(r1 + i));
+    // the sums fit in 16 bits unsigned, the logical shift takes care of the sign
+    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1)), rnd);
+    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)), rnd);
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = (r0[i] * (256 - f) + r1[i] * f + 128) >> 8;
   }
 }
 
-DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_buf, int width, int height) {
+// Crops, mirrors and scales one plane into the dst_w x dst_h rect at (dst_x, dst_y) of a
+// out_w x out_h image, one output row at a time. Pixels outside the rect get pad.
+// emit(row, pixels) receives every output row in order
+template <class Emit>
+static void scale_plane(const uint8_t *src, int stride, const Rect &crop, const DMonitoringPlaneTaps &taps,
+                        int dst_x, int dst_y, int dst_w, int dst_h, int out_w, int out_h, uint8_t pad,
+                        uint8_t *vrow, uint8_t *orow, Emit emit) {
+  memset(orow, pad, out_w);
+  for (int r = 0; r < out_h; r++) {
+    const int dr = r - dst_y;
+    if (dr < 0 || dr >= dst_h) {
+      memset(orow + dst_x, pad, dst_w);
+    } else {
+      const uint8_t *r0 = src + (crop.y + taps.y0[dr]) * stride + crop.x;
+      blend_rows(r0, taps.yf[dr] ? r0 + stride : r0, taps.yf[dr], vrow, crop.w);
+      uint8_t *o = orow + dst_x;
+      for (int c = 0; c < dst_w; c++) {
+        int a = vrow[taps.x0[c]], b = vrow[taps.x1[c]];
+        o[c] = a + ((taps.xf[c] * (b - a) + 0x8000) >> 16);
+      }
+    }
+    emit(r, orow);
+  }
+}
+
+void dmonitoring_prepare(DMonitoringModelState* s, const uint8_t *yuv, int width, int height, float *net_input_buf) {
   Rect crop_rect;
   if (width == TICI_CAM_WIDTH) {
     const int cropped_height = tici_dm_crop::width / 1.33;
@@ -84,73 +143,60 @@ DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_
     }
   }
 
-  int resized_width = MODEL_WIDTH;
-  int resized_height = MODEL_HEIGHT;
-
-  auto [cropped_y, cropped_u, cropped_v] = get_yuv_buf(s->cropped_buf, crop_rect.w, crop_rect.h);
-  if (!s->is_rhd) {
-    crop_yuv((uint8_t *)stream_buf, width, height, cropped_y, cropped_u, cropped_v, crop_rect);
-  } else {
-    auto [mirror_y, mirror_u, mirror_v] = get_yuv_buf(s->premirror_cropped_buf, crop_rect.w, crop_rect.h);
-    crop_yuv((uint8_t *)stream_buf, width, height, mirror_y, mirror_u, mirror_v, crop_rect);
-    libyuv::I420Mirror(mirror_y, crop_rect.w,
-                       mirror_u, crop_rect.w / 2,
-                       mirror_v, crop_rect.w / 2,
-                       cropped_y, crop_rect.w,
-                       cropped_u, crop_rect.w / 2,
-                       cropped_v, crop_rect.w / 2,
-                       crop_rect.w, crop_rect.h);
+  // On TICI the crop fills the model input, on EON it is scaled into a smaller rect
+  // centered vertically and padded with black
+  Rect dst = {0, 0, MODEL_WIDTH, MODEL_HEIGHT};
+  if (!Hardware::TICI()) {
+    const int source_height = 0.7*MODEL_HEIGHT;
+    const int extra_height = (MODEL_HEIGHT - source_height) / 2;
+    const int extra_width = (MODEL_WIDTH - source_height / 2) / 2;
+    dst = {0, extra_height, source_height / 2 + extra_width, source_height};
   }
 
-  auto [resized_buf, resized_u, resized_v] = get_yuv_buf(s->resized_buf, resized_width, resized_height);
-  uint8_t *resized_y = resized_buf;
-  libyuv::FilterMode mode = libyuv::FilterModeEnum::kFilterBilinear;
-  if (Hardware::TICI()) {
-    libyuv::I420Scale(cropped_y, crop_rect.w,
-                    cropped_u, crop_rect.w / 2,
-                    cropped_v, crop_rect.w / 2,
-                    crop_rect.w, crop_rect.h,
-                    resized_y, resized_width,
-                    resized_u, resized_width / 2,
-                    resized_v, resized_width / 2,
-                    resized_width, resized_height,
-                    mode);
-  } else {
-    const int source_height = 0.7*resized_height;
-    const int extra_height = (resized_height - source_height) / 2;
-    const int extra_width = (resized_width - source_height / 2) / 2;
-    const int source_width = source_height / 2 + extra_width;
-    libyuv::I420Scale(cropped_y, crop_rect.w,
-                    cropped_u, crop_rect.w / 2,
-                    cropped_v, crop_rect.w / 2,
-                    crop_rect.w, crop_rect.h,
-                    resized_y + extra_height * resized_width, resized_width,
-                    resized_u + extra_height / 2 * resized_width / 2, resized_width / 2,
-                    resized_v + extra_height / 2 * resized_width / 2, resized_width / 2,
-                    source_width, source_height,
-                    mode);
+  // chroma sizes are rounded up like I420Scale does
+  const Rect crop_uv = {crop_rect.x / 2, crop_rect.y / 2, (crop_rect.w + 1) / 2, (crop_rect.h + 1) / 2};
+  const Rect dst_uv = {dst.x / 2, dst.y / 2, (dst.w + 1) / 2, (dst.h + 1) / 2};
+  const bool mirror = s->is_rhd;
+  if (width != s->taps_width || height != s->taps_height) {
+    s->y_taps.build(crop_rect.w, crop_rect.h, dst.w, dst.h, mirror);
+    s->uv_taps.build(crop_uv.w, crop_uv.h, dst_uv.w, dst_uv.h, mirror);
+    s->taps_width = width;
+    s->taps_height = height;
   }
 
-  int yuv_buf_len = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2) * 6; // Y|u|v -> y|y|y|y|u|v
-  float *net_input_buf = get_buffer(s->net_input_buf, yuv_buf_len);
-  // one shot conversion, O(n) anyway
-  // yuvframe2tensor, normalize
-  for (int r = 0; r < MODEL_HEIGHT/2; r++) {
+  const uint8_t *src_y = yuv;
+  const uint8_t *src_u = src_y + width * height;
+  const uint8_t *src_v = src_u + (width / 2) * (height / 2);
+  uint8_t *vrow = get_buffer(s->row_buf, crop_rect.w + MODEL_WIDTH);
+  uint8_t *orow = vrow + crop_rect.w;
+
+  // Y|u|v -> y|y|y|y|u|v, y00 y10 y01 y11 from every 2x2 block
+  const int plane = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2);
+  const float *tensor = s->tensor;
+  scale_plane(src_y, width, crop_rect, s->y_taps, dst.x, dst.y, dst.w, dst.h, MODEL_WIDTH, MODEL_HEIGHT, 16, vrow, orow,
+              [&](int r, const uint8_t *px) {
+    float *even = net_input_buf + (r & 1) * plane + (r / 2) * (MODEL_WIDTH/2);
+    float *odd = even + 2 * plane;
     for (int c = 0; c < MODEL_WIDTH/2; c++) {
-      // Y_ul
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (0*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r)*resized_width + 2*c]];
-      // Y_dl
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (1*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r+1)*resized_width + 2*c]];
-      // Y_ur
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (2*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r)*resized_width + 2*c+1]];
-      // Y_dr
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (3*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r+1)*resized_width + 2*c+1]];
-      // U
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (4*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_u[r*resized_width/2 + c]];
-      // V
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (5*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_v[r*resized_width/2 + c]];
+      even[c] = tensor[px[2*c]];
+      odd[c] = tensor[px[2*c + 1]];
     }
+  });
+  for (int i = 0; i < 2; i++) {
+    float *out = net_input_buf + (4 + i) * plane;
+    scale_plane(i == 0 ? src_u : src_v, width / 2, crop_uv, s->uv_taps, dst_uv.x, dst_uv.y, dst_uv.w, dst_uv.h,
+                MODEL_WIDTH/2, MODEL_HEIGHT/2, 128, vrow, orow, [&](int r, const uint8_t *px) {
+      for (int c = 0; c < MODEL_WIDTH/2; c++) {
+        out[r * (MODEL_WIDTH/2) + c] = tensor[px[c]];
+      }
+    });
   }
+}
+
+DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_buf, int width, int height) {
+  int yuv_buf_len = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2) * 6; // Y|u|v -> y|y|y|y|u|v
+  float *net_input_buf = get_buffer(s->net_input_buf, yuv_buf_len);
+  dmonitoring_prepare(s, (const uint8_t *)stream_buf, width, height, net_input_buf);
 
   //printf("preprocess completed. %d \n", yuv_buf_len);
   //FILE *dump_yuv_file = fopen("/tmp/rawdump.yuv", "wb");
@@ -28,18 +28,27 @@ typedef struct DMonitoringResult {
   float dsp_execution_time;
 } DMonitoringResult;
 
+// Source pixels and weights for every output row and column of one scaled plane
+struct DMonitoringPlaneTaps {
+  std::vector<int> x0, x1, xf;
+  std::vector<int> y0, yf;
+  void build(int src_w, int src_h, int dst_w, int dst_h, bool mirror);
+};
+
 typedef struct DMonitoringModelState {
   RunModel *m;
   bool is_rhd;
   float output[OUTPUT_SIZE];
-  std::vector<uint8_t> resized_buf;
-  std::vector<uint8_t> cropped_buf;
-  std::vector<uint8_t> premirror_cropped_buf;
+  std::vector<uint8_t> row_buf;
   std::vector<float> net_input_buf;
   float tensor[UINT8_MAX + 1];
+  DMonitoringPlaneTaps y_taps, uv_taps;
+  int taps_width = 0, taps_height = 0;
 } DMonitoringModelState;
 
 void dmonitoring_init(DMonitoringModelState* s);
+// Crops, mirrors (RHD), scales and normalizes a yuv frame into the model input in one pass
+void dmonitoring_prepare(DMonitoringModelState* s, const uint8_t *yuv, int width, int height, float *net_input_buf);
 DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_buf, int width, int height);
 void dmonitoring_publish(PubMaster &pm, uint32_t frame_id, const DMonitoringResult &res, float execution_time, kj::ArrayPtr<const float> raw_pred);
 void dmonitoring_free(DMonitoringModelState* s);
@@ -0,0 +1,149 @@
+// Checks the fused driver monitoring preprocessing against the crop, I420Mirror, I420Scale
+// and normalize steps it replaces, and times both. libyuv's SIMD rows round their
+// fractions to fewer bits, so the outputs may differ by a couple of levels
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "libyuv.h"
+
+#include "selfdrive/common/modeldata.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/hardware/hw.h"
+#include "selfdrive/modeld/models/dmonitoring.h"
+
+constexpr int MODEL_WIDTH = 320;
+constexpr int MODEL_HEIGHT = 640;
+constexpr int NET_INPUT_SIZE = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2) * 6;
+constexpr int ITERATIONS = 50;
+
+// in units of the 8 bit input
+constexpr int MAX_DIFF = 2;
+
+struct Rect {int x, y, w, h;};
+
+static Rect get_crop_rect(int width, int height, bool is_rhd) {
+  Rect crop_rect;
+  if (width == TICI_CAM_WIDTH) {
+    const int cropped_height = tici_dm_crop::width / 1.33;
+    crop_rect = {width / 2 - tici_dm_crop::width / 2 + tici_dm_crop::x_offset,
+                 height / 2 - cropped_height / 2 + tici_dm_crop::y_offset,
+                 cropped_height / 2,
+                 cropped_height};
+    if (!is_rhd) {
+      crop_rect.x += tici_dm_crop::width - crop_rect.w;
+    }
+  } else {
+    crop_rect = {0, 0, 372, height};
+    if (!is_rhd) {
+      crop_rect.x += width - crop_rect.w;
+    }
+  }
+  return crop_rect;
+}
+
+// the previous pipeline, with the crop copying every row libyuv reads
+static void reference_prepare(const DMonitoringModelState &s, const uint8_t *yuv, int width, int height, float *net_input_buf) {
+  const Rect rect = get_crop_rect(width, height, s.is_rhd);
+  const int uv_w = (rect.w + 1) / 2, uv_h = (rect.h + 1) / 2;
+  std::vector<uint8_t> cropped(rect.w * rect.h + 2 * uv_w * uv_h), mirrored(cropped.size());
+  uint8_t *y = cropped.data(), *u = y + rect.w * rect.h, *v = u + uv_w * uv_h;
+
+  const uint8_t *raw_u = yuv + width * height, *raw_v = raw_u + (width / 2) * (height / 2);
+  for (int r = 0; r < rect.h; r++) {
+    memcpy(y + r * rect.w, yuv + (r + rect.y) * width + rect.x, rect.w);
+  }
+  for (int r = 0; r < uv_h; r++) {
+    memcpy(u + r * uv_w, raw_u + (r + rect.y / 2) * (width / 2) + rect.x / 2, uv_w);
+    memcpy(v + r * uv_w, raw_v + (r + rect.y / 2) * (width / 2) + rect.x / 2, uv_w);
+  }
+  if (s.is_rhd) {
+    uint8_t *my = mirrored.data(), *mu = my + rect.w * rect.h, *mv = mu + uv_w * uv_h;
+    libyuv::I420Mirror(y, rect.w, u, uv_w, v, uv_w, my, rect.w, mu, uv_w, mv, uv_w, rect.w, rect.h);
+    y = my, u = mu, v = mv;
+  }
+
+  std::vector<uint8_t> resized(MODEL_WIDTH * MODEL_HEIGHT * 3 / 2);
+  uint8_t *ry = resized.data(), *ru = ry + MODEL_WIDTH * MODEL_HEIGHT, *rv = ru + MODEL_WIDTH * MODEL_HEIGHT / 4;
+  memset(ry, 16, MODEL_WIDTH * MODEL_HEIGHT);
+  memset(ru, 128, MODEL_WIDTH * MODEL_HEIGHT / 2);
+  int dst_w = MODEL_WIDTH, dst_h = MODEL_HEIGHT, extra_height = 0;
+  if (!Hardware::TICI()) {
+    dst_h = 0.7*MODEL_HEIGHT;
+    extra_height = (MODEL_HEIGHT - dst_h) / 2;
+    dst_w = dst_h / 2 + (MODEL_WIDTH - dst_h / 2) / 2;
+  }
+  libyuv::I420Scale(y, rect.w, u, uv_w, v, uv_w, rect.w, rect.h,
+                    ry + extra_height * MODEL_WIDTH, MODEL_WIDTH,
+                    ru + extra_height / 2 * MODEL_WIDTH / 2, MODEL_WIDTH / 2,
+                    rv + extra_height / 2 * MODEL_WIDTH / 2, MODEL_WIDTH / 2,
+                    dst_w, dst_h, libyuv::kFilterBilinear);
+
+  const int plane = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2);
+  for (int r = 0; r < MODEL_HEIGHT/2; r++) {
+    for (int c = 0; c < MODEL_WIDTH/2; c++) {
+      const int i = r * MODEL_WIDTH/2 + c;
+      net_input_buf[i + 0 * plane] = s.tensor[ry[(2*r) * MODEL_WIDTH + 2*c]];
+      net_input_buf[i + 1 * plane] = s.tensor[ry[(2*r+1) * MODEL_WIDTH + 2*c]];
+      net_input_buf[i + 2 * plane] = s.tensor[ry[(2*r) * MODEL_WIDTH + 2*c+1]];
+      net_input_buf[i + 3 * plane] = s.tensor[ry[(2*r+1) * MODEL_WIDTH + 2*c+1]];
+      net_input_buf[i + 4 * plane] = s.tensor[ru[r * MODEL_WIDTH/2 + c]];
+      net_input_buf[i + 5 * plane] = s.tensor[rv[r * MODEL_WIDTH/2 + c]];
+    }
+  }
+}
+
+static bool test_size(int width, int height, bool is_rhd) {
+  std::vector<uint8_t> yuv(width * height * 3 / 2);
+  std::mt19937 gen(width + is_rhd);
+  std::uniform_int_distribution<int> dist(0, 255);
+  // smooth content with some noise, like a camera frame
+  for (int r = 0; r < height; r++) {
+    for (int c = 0; c < width; c++) {
+      yuv[r * width + c] = std::clamp(int(128 + 80 * std::sin(r * 0.05) * std::cos(c * 0.03)) + dist(gen) / 16, 0, 255);
+    }
+  }
+  for (size_t i = width * height; i < yuv.size(); i++) yuv[i] = dist(gen);
+
+  DMonitoringModelState s = {};
+  s.is_rhd = is_rhd;
+  for (int x = 0; x < std::size(s.tensor); ++x) {
+    s.tensor[x] = (x - 128.f) * 0.0078125f;
+  }
+
+  std::vector<float> expected(NET_INPUT_SIZE), out(NET_INPUT_SIZE);
+  double t1 = millis_since_boot();
+  for (int i = 0; i < ITERATIONS; i++) {
+    reference_prepare(s, yuv.data(), width, height, expected.data());
+  }
+  double t2 = millis_since_boot();
+  for (int i = 0; i < ITERATIONS; i++) {
+    dmonitoring_prepare(&s, yuv.data(), width, height, out.data());
+  }
+  double t3 = millis_since_boot();
+
+  int max_diff = 0, mismatch = 0;
+  for (int i = 0; i < NET_INPUT_SIZE; i++) {
+    int diff = std::lround(std::abs(out[i] - expected[i]) / 0.0078125f);
+    max_diff = std::max(max_diff, diff);
+    mismatch += diff != 0;
+  }
+
+  bool ok = max_diff <= MAX_DIFF;
+  printf("%4dx%-4d %s  fused %.3f ms  libyuv %.3f ms  (max diff %d, %d values off)  %s\n", width, height,
+         is_rhd ? "rhd" : "lhd", (t3 - t2) / ITERATIONS, (t2 - t1) / ITERATIONS, max_diff, mismatch, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main() {
+  bool pass = true;
+  for (bool is_rhd : {false, true}) {
+    pass = test_size(1152, 864, is_rhd) && pass;
+    pass = test_size(TICI_CAM_WIDTH, 1208, is_rhd) && pass;
+  }
+  return pass ? 0 : 1;
+}
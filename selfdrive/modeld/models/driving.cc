@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -54,17 +55,58 @@ void model_init(ModelState* s, cl_device_id device_id, cl_context context) {
 #endif
 }
 
+mat3 update_calibration(const Eigen::Matrix<float, 3, 4> &extrinsics, const mat3 &intrinsics, const mat3 &yuv_transform, bool bigmodel_frame) {
+  /*
+     import numpy as np
+     from common.transformations.model import medmodel_frame_from_road_frame
+     medmodel_frame_from_ground = medmodel_frame_from_road_frame[:, (0, 1, 3)]
+     ground_from_medmodel_frame = np.linalg.inv(medmodel_frame_from_ground)
+  */
+  static const auto ground_from_medmodel_frame = (Eigen::Matrix<float, 3, 3>() <<
+     0.00000000e+00, 0.00000000e+00, 1.00000000e+00,
+    -1.09890110e-03, 0.00000000e+00, 2.81318681e-01,
+    -1.84808520e-20, 9.00738606e-04, -4.28751576e-02).finished();
+
+  static const auto ground_from_sbigmodel_frame = (Eigen::Matrix<float, 3, 3>() <<
+     0.00000000e+00,  7.31372216e-19,  1.00000000e+00,
+    -2.19780220e-03,  4.11497335e-19,  5.62637363e-01,
+    -5.46146580e-20,  1.80147721e-03, -2.73464241e-01).finished();
+
+  const auto cam_intrinsics = Eigen::Matrix<float, 3, 3, Eigen::RowMajor>(intrinsics.v);
+
+  auto ground_from_model_frame = bigmodel_frame ? ground_from_sbigmodel_frame : ground_from_medmodel_frame;
+  auto camera_frame_from_road_frame = cam_intrinsics * extrinsics;
+  Eigen::Matrix<float, 3, 3> camera_frame_from_ground;
+  camera_frame_from_ground.col(0) = camera_frame_from_road_frame.col(0);
+  camera_frame_from_ground.col(1) = camera_frame_from_road_frame.col(1);
+  camera_frame_from_ground.col(2) = camera_frame_from_road_frame.col(3);
+
+  auto warp_matrix = camera_frame_from_ground * ground_from_model_frame;
+  mat3 transform = {};
+  for (int i=0; i<3*3; i++) {
+    transform.v[i] = warp_matrix(i / 3, i % 3);
+  }
+  return matmul3(yuv_transform, transform);
+}
+
 ModelOutput* model_eval_frame(ModelState* s, VisionBuf* buf, VisionBuf* wbuf,
                               const mat3 &transform, const mat3 &transform_wide, float *desire_in) {
+  ModelInput input;
+  model_prepare(s, buf, wbuf, transform, transform_wide, desire_in, &input);
+  return model_execute(s, input);
+}
+
+void model_prepare(ModelState* s, VisionBuf* buf, VisionBuf* wbuf,
+                   const mat3 &transform, const mat3 &transform_wide, float *desire_in, ModelInput *input) {
 #ifdef DESIRE
   if (desire_in != NULL) {
     for (int i = 1; i < DESIRE_LEN; i++) {
       // Model decides when action is completed
       // so desire input is just a pulse triggered on rising edge
       if (desire_in[i] - s->prev_desire[i] > .99) {
-        s->pulse_desire[i] = desire_in[i];
+        input->desire[i] = desire_in[i];
       } else {
-        s->pulse_desire[i] = 0.0;
+        input->desire[i] = 0.0;
       }
       s->prev_desire[i] = desire_in[i];
     }
@@ -72,48 +114,92 @@ ModelOutput* model_eval_frame(ModelState* s, VisionBuf* buf, VisionBuf* wbuf,
 #endif
 
   // if getInputBuf is not NULL, net_input_buf will be
-  auto net_input_buf = s->frame->prepare(buf->buf_cl, buf->width, buf->height, transform, static_cast<cl_mem*>(s->m->getInputBuf()));
-  s->m->addImage(net_input_buf, s->frame->buf_size);
+  if (s->frame->use_cpu && s->m->getInputBuf() == nullptr) {
+    input->input = s->frame->prepare((const uint8_t *)buf->addr, buf->width, buf->height, transform);
+  } else {
+    input->input = s->frame->prepare(buf->buf_cl, buf->width, buf->height, transform, static_cast<cl_mem*>(s->m->getInputBuf()));
+  }
 
+  input->has_extra = wbuf != nullptr;
   if (wbuf != nullptr) {
-    auto net_extra_buf = s->wide_frame->prepare(wbuf->buf_cl, wbuf->width, wbuf->height, transform_wide, static_cast<cl_mem*>(s->m->getExtraBuf()));
-    s->m->addExtra(net_extra_buf, s->wide_frame->buf_size);
+    if (s->wide_frame->use_cpu && s->m->getExtraBuf() == nullptr) {
+      input->extra = s->wide_frame->prepare((const uint8_t *)wbuf->addr, wbuf->width, wbuf->height, transform_wide);
+    } else {
+      input->extra = s->wide_frame->prepare(wbuf->buf_cl, wbuf->width, wbuf->height, transform_wide, static_cast<cl_mem*>(s->m->getExtraBuf()));
+    }
+  }
+}
+
+ModelOutput* model_execute(ModelState* s, const ModelInput &input) {
+#ifdef DESIRE
+  std::copy(std::begin(input.desire), std::end(input.desire), s->pulse_desire);
+#endif
+
+  s->m->addImage(input.input, s->frame->buf_size);
+  if (input.has_extra) {
+    s->m->addExtra(input.extra, s->wide_frame->buf_size);
   }
   s->m->execute();
 
   return (ModelOutput*)&s->output;
 }
 
+void model_reset(ModelState* s) {
+  s->output.fill(0);
+#ifdef DESIRE
+  std::fill_n(s->prev_desire, DESIRE_LEN, 0);
+  std::fill_n(s->pulse_desire, DESIRE_LEN, 0);
+#endif
+  s->frame->reset();
+  s->wide_frame->reset();
+  prev_brake_5ms2_probs.fill(0);
+  prev_brake_3ms2_probs.fill(0);
+}
+
 void model_free(ModelState* s) {
   delete s->frame;
 }
 
+// Model outputs are interleaved structs. These copy one field of an output block straight
+// into a preallocated capnp list, applying op on the way, instead of gathering it into a
+// temporary array first
+template<class T>
+constexpr int stride_of() {
+  return sizeof(T) / sizeof(float);
+}
+
+template<class Op>
+void fill_strided(capnp::List<float>::Builder list, const float *src, int stride, Op op) {
+  for (int i=0; i<list.size(); i++) {
+    list.set(i, op(src[i * stride]));
+  }
+}
+
+void fill_strided(capnp::List<float>::Builder list, const float *src, int stride) {
+  fill_strided(list, src, stride, [](float v) { return v; });
+}
+
+const auto exp_op = [](float v) { return exp(v); };
+const auto sigmoid_op = [](float v) { return sigmoid(v); };
+
 void fill_lead(cereal::ModelDataV2::LeadDataV3::Builder lead, const ModelOutputLeads &leads, int t_idx, float prob_t) {
-  std::array<float, LEAD_TRAJ_LEN> lead_t = {0.0, 2.0, 4.0, 6.0, 8.0, 10.0};
+  const std::array<float, LEAD_TRAJ_LEN> lead_t = {0.0, 2.0, 4.0, 6.0, 8.0, 10.0};
   const auto &best_prediction = leads.get_best_prediction(t_idx);
   lead.setProb(sigmoid(leads.prob[t_idx]));
   lead.setProbTime(prob_t);
-  std::array<float, LEAD_TRAJ_LEN> lead_x, lead_y, lead_v, lead_a;
-  std::array<float, LEAD_TRAJ_LEN> lead_x_std, lead_y_std, lead_v_std, lead_a_std;
-  for (int i=0; i<LEAD_TRAJ_LEN; i++) {
-    lead_x[i] = best_prediction.mean[i].x;
-    lead_y[i] = best_prediction.mean[i].y;
-    lead_v[i] = best_prediction.mean[i].velocity;
-    lead_a[i] = best_prediction.mean[i].acceleration;
-    lead_x_std[i] = exp(best_prediction.std[i].x);
-    lead_y_std[i] = exp(best_prediction.std[i].y);
-    lead_v_std[i] = exp(best_prediction.std[i].velocity);
-    lead_a_std[i] = exp(best_prediction.std[i].acceleration);
-  }
+
+  constexpr int stride = stride_of<ModelOutputLeadElement>();
+  const auto &mean = best_prediction.mean[0];
+  const auto &stds = best_prediction.std[0];
   lead.setT(to_kj_array_ptr(lead_t));
-  lead.setX(to_kj_array_ptr(lead_x));
-  lead.setY(to_kj_array_ptr(lead_y));
-  lead.setV(to_kj_array_ptr(lead_v));
-  lead.setA(to_kj_array_ptr(lead_a));
-  lead.setXStd(to_kj_array_ptr(lead_x_std));
-  lead.setYStd(to_kj_array_ptr(lead_y_std));
-  lead.setVStd(to_kj_array_ptr(lead_v_std));
-  lead.setAStd(to_kj_array_ptr(lead_a_std));
+  fill_strided(lead.initX(LEAD_TRAJ_LEN), &mean.x, stride);
+  fill_strided(lead.initY(LEAD_TRAJ_LEN), &mean.y, stride);
+  fill_strided(lead.initV(LEAD_TRAJ_LEN), &mean.velocity, stride);
+  fill_strided(lead.initA(LEAD_TRAJ_LEN), &mean.acceleration, stride);
+  fill_strided(lead.initXStd(LEAD_TRAJ_LEN), &stds.x, stride, exp_op);
+  fill_strided(lead.initYStd(LEAD_TRAJ_LEN), &stds.y, stride, exp_op);
+  fill_strided(lead.initVStd(LEAD_TRAJ_LEN), &stds.velocity, stride, exp_op);
+  fill_strided(lead.initAStd(LEAD_TRAJ_LEN), &stds.acceleration, stride, exp_op);
 }
 
 void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMeta &meta_data) {
@@ -125,23 +211,10 @@ void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMet
     softmax(meta_data.desire_pred_prob[i].array.data(), desire_pred_softmax.data() + (i * DESIRE_LEN), DESIRE_LEN);
   }
 
-  std::array<float, DISENGAGE_LEN> lat_long_t = {2,4,6,8,10};
-  std::array<float, DISENGAGE_LEN> gas_disengage_sigmoid, brake_disengage_sigmoid, steer_override_sigmoid,
-                                   brake_3ms2_sigmoid, brake_4ms2_sigmoid, brake_5ms2_sigmoid;
-  for (int i=0; i<DISENGAGE_LEN; i++) {
-    gas_disengage_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].gas_disengage);
-    brake_disengage_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_disengage);
-    steer_override_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].steer_override);
-    brake_3ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_3ms2);
-    brake_4ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_4ms2);
-    brake_5ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_5ms2);
-    //gas_pressed_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].gas_pressed);
-  }
-
   std::memmove(prev_brake_5ms2_probs.data(), &prev_brake_5ms2_probs[1], 4*sizeof(float));
   std::memmove(prev_brake_3ms2_probs.data(), &prev_brake_3ms2_probs[1], 2*sizeof(float));
-  prev_brake_5ms2_probs[4] = brake_5ms2_sigmoid[0];
-  prev_brake_3ms2_probs[2] = brake_3ms2_sigmoid[0];
+  prev_brake_5ms2_probs[4] = sigmoid(meta_data.disengage_prob[0].brake_5ms2);
+  prev_brake_3ms2_probs[2] = sigmoid(meta_data.disengage_prob[0].brake_3ms2);
 
   bool above_fcw_threshold = true;
   for (int i=0; i<prev_brake_5ms2_probs.size(); i++) {
@@ -152,14 +225,17 @@ void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMet
     above_fcw_threshold = above_fcw_threshold && prev_brake_3ms2_probs[i] > FCW_THRESHOLD_3MS2;
   }
 
+  const std::array<float, DISENGAGE_LEN> lat_long_t = {2,4,6,8,10};
+  constexpr int stride = stride_of<ModelOutputDisengageProb>();
+  const auto &disengage_prob = meta_data.disengage_prob[0];
   auto disengage = meta.initDisengagePredictions();
   disengage.setT(to_kj_array_ptr(lat_long_t));
-  disengage.setGasDisengageProbs(to_kj_array_ptr(gas_disengage_sigmoid));
-  disengage.setBrakeDisengageProbs(to_kj_array_ptr(brake_disengage_sigmoid));
-  disengage.setSteerOverrideProbs(to_kj_array_ptr(steer_override_sigmoid));
-  disengage.setBrake3MetersPerSecondSquaredProbs(to_kj_array_ptr(brake_3ms2_sigmoid));
-  disengage.setBrake4MetersPerSecondSquaredProbs(to_kj_array_ptr(brake_4ms2_sigmoid));
-  disengage.setBrake5MetersPerSecondSquaredProbs(to_kj_array_ptr(brake_5ms2_sigmoid));
+  fill_strided(disengage.initGasDisengageProbs(DISENGAGE_LEN), &disengage_prob.gas_disengage, stride, sigmoid_op);
+  fill_strided(disengage.initBrakeDisengageProbs(DISENGAGE_LEN), &disengage_prob.brake_disengage, stride, sigmoid_op);
+  fill_strided(disengage.initSteerOverrideProbs(DISENGAGE_LEN), &disengage_prob.steer_override, stride, sigmoid_op);
+  fill_strided(disengage.initBrake3MetersPerSecondSquaredProbs(DISENGAGE_LEN), &disengage_prob.brake_3ms2, stride, sigmoid_op);
+  fill_strided(disengage.initBrake4MetersPerSecondSquaredProbs(DISENGAGE_LEN), &disengage_prob.brake_4ms2, stride, sigmoid_op);
+  fill_strided(disengage.initBrake5MetersPerSecondSquaredProbs(DISENGAGE_LEN), &disengage_prob.brake_5ms2, stride, sigmoid_op);
 
   meta.setEngagedProb(sigmoid(meta_data.engaged_prob));
   meta.setDesirePrediction(to_kj_array_ptr(desire_pred_softmax));
@@ -167,78 +243,45 @@ void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMet
   meta.setHardBrakePredicted(above_fcw_threshold);
 }
 
-template<size_t size>
-void fill_xyzt(cereal::ModelDataV2::XYZTData::Builder xyzt, const std::array<float, size> &t,
-               const std::array<float, size> &x, const std::array<float, size> &y, const std::array<float, size> &z) {
-  xyzt.setT(to_kj_array_ptr(t));
-  xyzt.setX(to_kj_array_ptr(x));
-  xyzt.setY(to_kj_array_ptr(y));
-  xyzt.setZ(to_kj_array_ptr(z));
-}
-
-template<size_t size>
-void fill_xyzt(cereal::ModelDataV2::XYZTData::Builder xyzt, const std::array<float, size> &t,
-               const std::array<float, size> &x, const std::array<float, size> &y, const std::array<float, size> &z,
-               const std::array<float, size> &x_std, const std::array<float, size> &y_std, const std::array<float, size> &z_std) {
-  fill_xyzt(xyzt, t, x, y, z);
-  xyzt.setXStd(to_kj_array_ptr(x_std));
-  xyzt.setYStd(to_kj_array_ptr(y_std));
-  xyzt.setZStd(to_kj_array_ptr(z_std));
+void fill_xyz(cereal::ModelDataV2::XYZTData::Builder xyzt, const ModelOutputXYZ &first, int stride) {
+  xyzt.setT(to_kj_array_ptr(T_IDXS_FLOAT));
+  fill_strided(xyzt.initX(TRAJECTORY_SIZE), &first.x, stride);
+  fill_strided(xyzt.initY(TRAJECTORY_SIZE), &first.y, stride);
+  fill_strided(xyzt.initZ(TRAJECTORY_SIZE), &first.z, stride);
 }
 
 void fill_plan(cereal::ModelDataV2::Builder &framed, const ModelOutputPlanPrediction &plan) {
-  std::array<float, TRAJECTORY_SIZE> pos_x, pos_y, pos_z;
-  std::array<float, TRAJECTORY_SIZE> pos_x_std, pos_y_std, pos_z_std;
-  std::array<float, TRAJECTORY_SIZE> vel_x, vel_y, vel_z;
-  std::array<float, TRAJECTORY_SIZE> rot_x, rot_y, rot_z;
-  std::array<float, TRAJECTORY_SIZE> rot_rate_x, rot_rate_y, rot_rate_z;
-
-  for(int i=0; i<TRAJECTORY_SIZE; i++) {
-    pos_x[i] = plan.mean[i].position.x;
-    pos_y[i] = plan.mean[i].position.y;
-    pos_z[i] = plan.mean[i].position.z;
-    pos_x_std[i] = exp(plan.std[i].position.x);
-    pos_y_std[i] = exp(plan.std[i].position.y);
-    pos_z_std[i] = exp(plan.std[i].position.z);
-    vel_x[i] = plan.mean[i].velocity.x;
-    vel_y[i] = plan.mean[i].velocity.y;
-    vel_z[i] = plan.mean[i].velocity.z;
-    rot_x[i] = plan.mean[i].rotation.x;
-    rot_y[i] = plan.mean[i].rotation.y;
-    rot_z[i] = plan.mean[i].rotation.z;
-    rot_rate_x[i] = plan.mean[i].rotation_rate.x;
-    rot_rate_y[i] = plan.mean[i].rotation_rate.y;
-    rot_rate_z[i] = plan.mean[i].rotation_rate.z;
-  }
+  constexpr int stride = stride_of<ModelOutputPlanElement>();
+  const auto &mean = plan.mean[0];
+  const auto &stds = plan.std[0];
+
+  auto position = framed.initPosition();
+  fill_xyz(position, mean.position, stride);
+  fill_strided(position.initXStd(TRAJECTORY_SIZE), &stds.position.x, stride, exp_op);
+  fill_strided(position.initYStd(TRAJECTORY_SIZE), &stds.position.y, stride, exp_op);
+  fill_strided(position.initZStd(TRAJECTORY_SIZE), &stds.position.z, stride, exp_op);
+
+  fill_xyz(framed.initVelocity(), mean.velocity, stride);
+  fill_xyz(framed.initOrientation(), mean.rotation, stride);
+  fill_xyz(framed.initOrientationRate(), mean.rotation_rate, stride);
+}
 
-  fill_xyzt(framed.initPosition(), T_IDXS_FLOAT, pos_x, pos_y, pos_z, pos_x_std, pos_y_std, pos_z_std);
-  fill_xyzt(framed.initVelocity(), T_IDXS_FLOAT, vel_x, vel_y, vel_z);
-  fill_xyzt(framed.initOrientation(), T_IDXS_FLOAT, rot_x, rot_y, rot_z);
-  fill_xyzt(framed.initOrientationRate(), T_IDXS_FLOAT, rot_rate_x, rot_rate_y, rot_rate_z);
+void fill_yz(cereal::ModelDataV2::XYZTData::Builder xyzt, const std::array<float, TRAJECTORY_SIZE> &plan_t,
+             const std::array<ModelOutputYZ, TRAJECTORY_SIZE> &line) {
+  constexpr int stride = stride_of<ModelOutputYZ>();
+  xyzt.setT(to_kj_array_ptr(plan_t));
+  xyzt.setX(to_kj_array_ptr(X_IDXS_FLOAT));
+  fill_strided(xyzt.initY(TRAJECTORY_SIZE), &line[0].y, stride);
+  fill_strided(xyzt.initZ(TRAJECTORY_SIZE), &line[0].z, stride);
 }
 
 void fill_lane_lines(cereal::ModelDataV2::Builder &framed, const std::array<float, TRAJECTORY_SIZE> &plan_t,
                      const ModelOutputLaneLines &lanes) {
-  std::array<float, TRAJECTORY_SIZE> left_far_y, left_far_z;
-  std::array<float, TRAJECTORY_SIZE> left_near_y, left_near_z;
-  std::array<float, TRAJECTORY_SIZE> right_near_y, right_near_z;
-  std::array<float, TRAJECTORY_SIZE> right_far_y, right_far_z;
-  for (int j=0; j<TRAJECTORY_SIZE; j++) {
-    left_far_y[j] = lanes.mean.left_far[j].y;
-    left_far_z[j] = lanes.mean.left_far[j].z;
-    left_near_y[j] = lanes.mean.left_near[j].y;
-    left_near_z[j] = lanes.mean.left_near[j].z;
-    right_near_y[j] = lanes.mean.right_near[j].y;
-    right_near_z[j] = lanes.mean.right_near[j].z;
-    right_far_y[j] = lanes.mean.right_far[j].y;
-    right_far_z[j] = lanes.mean.right_far[j].z;
-  }
-
   auto lane_lines = framed.initLaneLines(4);
-  fill_xyzt(lane_lines[0], plan_t, X_IDXS_FLOAT, left_far_y, left_far_z);
-  fill_xyzt(lane_lines[1], plan_t, X_IDXS_FLOAT, left_near_y, left_near_z);
-  fill_xyzt(lane_lines[2], plan_t, X_IDXS_FLOAT, right_near_y, right_near_z);
-  fill_xyzt(lane_lines[3], plan_t, X_IDXS_FLOAT, right_far_y, right_far_z);
+  fill_yz(lane_lines[0], plan_t, lanes.mean.left_far);
+  fill_yz(lane_lines[1], plan_t, lanes.mean.left_near);
+  fill_yz(lane_lines[2], plan_t, lanes.mean.right_near);
+  fill_yz(lane_lines[3], plan_t, lanes.mean.right_far);
 
   framed.setLaneLineStds({
     exp(lanes.std.left_far[0].y),
@@ -257,18 +300,9 @@ void fill_lane_lines(cereal::ModelDataV2::Builder &framed, const std::array<floa
 
 void fill_road_edges(cereal::ModelDataV2::Builder &framed, const std::array<float, TRAJECTORY_SIZE> &plan_t,
                      const ModelOutputRoadEdges &edges) {
-  std::array<float, TRAJECTORY_SIZE> left_y, left_z;
-  std::array<float, TRAJECTORY_SIZE> right_y, right_z;
-  for (int j=0; j<TRAJECTORY_SIZE; j++) {
-    left_y[j] = edges.mean.left[j].y;
-    left_z[j] = edges.mean.left[j].z;
-    right_y[j] = edges.mean.right[j].y;
-    right_z[j] = edges.mean.right[j].z;
-  }
-
   auto road_edges = framed.initRoadEdges(2);
-  fill_xyzt(road_edges[0], plan_t, X_IDXS_FLOAT, left_y, left_z);
-  fill_xyzt(road_edges[1], plan_t, X_IDXS_FLOAT, right_y, right_z);
+  fill_yz(road_edges[0], plan_t, edges.mean.left);
+  fill_yz(road_edges[1], plan_t, edges.mean.right);
 
   framed.setRoadEdgeStds({
     exp(edges.std.left[0].y),
@@ -314,28 +348,42 @@ void fill_model(cereal::ModelDataV2::Builder &framed, const ModelOutput &net_out
   }
 }
 
-void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
-                   const ModelOutput &net_outputs, uint64_t timestamp_eof,
-                   float model_execution_time, kj::ArrayPtr<const float> raw_pred, const bool valid) {
+void fill_model_msg(MessageBuilder &msg, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
+                    const ModelOutput &net_outputs, uint64_t timestamp_eof,
+                    const ModelTimings &timings, kj::ArrayPtr<const float> raw_pred, const bool valid) {
+  const double t1 = millis_since_boot();
   const uint32_t frame_age = (frame_id > vipc_frame_id) ? (frame_id - vipc_frame_id) : 0;
-  MessageBuilder msg;
   auto framed = msg.initEvent(valid).initModelV2();
   framed.setFrameId(vipc_frame_id);
   framed.setFrameIdExtra(vipc_frame_id_extra);
   framed.setFrameAge(frame_age);
   framed.setFrameDropPerc(frame_drop * 100);
   framed.setTimestampEof(timestamp_eof);
-  framed.setModelExecutionTime(model_execution_time);
+  framed.setModelExecutionTime(timings.execution_time);
+  framed.setPrepareTime(timings.prepare_time);
   if (send_raw_pred) {
     framed.setRawPredictions(raw_pred.asBytes());
   }
   fill_model(framed, net_outputs);
+
+  const double t2 = millis_since_boot();
+  framed.setParseTime((t2 - t1) / 1000.0);
+  if (timings.frame_recv_time > 0) {
+    framed.setPipelineLatency((t2 - timings.frame_recv_time) / 1000.0);
+  }
+}
+
+void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
+                   const ModelOutput &net_outputs, uint64_t timestamp_eof,
+                   const ModelTimings &timings, kj::ArrayPtr<const float> raw_pred, const bool valid) {
+  MessageBuilder msg("modelV2");
+  fill_model_msg(msg, vipc_frame_id, vipc_frame_id_extra, frame_id, frame_drop, net_outputs, timestamp_eof, timings, raw_pred, valid);
   pm.send("modelV2", msg);
 }
 
 void posenet_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames,
                      const ModelOutput &net_outputs, uint64_t timestamp_eof, const bool valid) {
-  MessageBuilder msg;
+  MessageBuilder msg("cameraOdometry");
   const auto &v_mean = net_outputs.pose.velocity_mean;
   const auto &r_mean = net_outputs.pose.rotation_mean;
   const auto &v_std = net_outputs.pose.velocity_std;
@@ -8,6 +8,8 @@
 #include <array>
 #include <memory>
 
+#include <eigen3/Eigen/Dense>
+
 #include "cereal/messaging/messaging.h"
 #include "cereal/visionipc/visionipc_client.h"
 #include "selfdrive/common/mat.h"
@@ -266,12 +268,37 @@ struct ModelState {
 #endif
 };
 
+// A frame prepared by model_prepare, ready for model_execute. The inputs point into the
+// ModelFrame rings, so the next frame can be prepared while this one runs
+struct ModelInput {
+  float *input = nullptr;
+  float *extra = nullptr;
+  bool has_extra = false;
+  float desire[DESIRE_LEN] = {};
+};
+
+struct ModelTimings {
+  float prepare_time = 0;
+  float execution_time = 0;
+  double frame_recv_time = 0;  // millis_since_boot when the frame was received
+};
+
+mat3 update_calibration(const Eigen::Matrix<float, 3, 4> &extrinsics, const mat3 &intrinsics, const mat3 &yuv_transform, bool bigmodel_frame);
 void model_init(ModelState* s, cl_device_id device_id, cl_context context);
 ModelOutput *model_eval_frame(ModelState* s, VisionBuf* buf, VisionBuf* buf_wide,
                               const mat3 &transform, const mat3 &transform_wide, float *desire_in);
+void model_prepare(ModelState* s, VisionBuf* buf, VisionBuf* buf_wide,
+                   const mat3 &transform, const mat3 &transform_wide, float *desire_in, ModelInput *input);
+ModelOutput *model_execute(ModelState* s, const ModelInput &input);
+// clears the recurrent state and the previous frames, as if the model was just loaded
+void model_reset(ModelState* s);
 void model_free(ModelState* s);
+void fill_model(cereal::ModelDataV2::Builder &framed, const ModelOutput &net_outputs);
+void fill_model_msg(MessageBuilder &msg, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
+                    const ModelOutput &net_outputs, uint64_t timestamp_eof,
+                    const ModelTimings &timings, kj::ArrayPtr<const float> raw_pred, const bool valid);
 void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
                    const ModelOutput &net_outputs, uint64_t timestamp_eof,
-                   float model_execution_time, kj::ArrayPtr<const float> raw_pred, const bool valid);
+                   const ModelTimings &timings, kj::ArrayPtr<const float> raw_pred, const bool valid);
 void posenet_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames,
                      const ModelOutput &net_outputs, uint64_t timestamp_eof, const bool valid);
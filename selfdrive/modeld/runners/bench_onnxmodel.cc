@@ -0,0 +1,64 @@
+// Measures supercombo latency on the CPU runner against the modeld frame budget.
+// Usage: bench_onnxmodel [iterations] [model path], ONNX_THREADS sets the thread count
+// and MODEL_PROFILE=<runs> profiles that many more runs
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/modeld/models/driving.h"
+
+constexpr int MODEL_INPUT_SIZE = 512 * 256 * 3 / 2 * 2;
+
+int main(int argc, char *argv[]) {
+  int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+  const char *path = argc > 2 ? argv[2] : "../../models/supercombo.onnx";
+
+  std::vector<float> output(NET_OUTPUT_SIZE);
+  std::vector<float> input(MODEL_INPUT_SIZE), extra(MODEL_INPUT_SIZE);
+  float desire[DESIRE_LEN] = {}, traffic_convention[TRAFFIC_CONVENTION_LEN] = {1.0, 0.0};
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dist(0.0, 255.0);
+  for (auto &v : input) v = dist(gen);
+  for (auto &v : extra) v = dist(gen);
+
+  ONNXModel m(path, output.data(), NET_OUTPUT_SIZE, USE_GPU_RUNTIME, true);
+  m.addRecurrent(&output[OUTPUT_SIZE], TEMPORAL_SIZE);
+  m.addDesire(desire, DESIRE_LEN);
+  m.addTrafficConvention(traffic_convention, TRAFFIC_CONVENTION_LEN);
+  m.addImage(input.data(), input.size());
+  m.addExtra(extra.data(), extra.size());
+
+  // first runs include graph optimization and allocator warmup
+  for (int i = 0; i < 3; i++) m.execute();
+
+  std::vector<double> latency;
+  for (int i = 0; i < iterations; i++) {
+    double t1 = millis_since_boot();
+    m.execute();
+    latency.push_back(millis_since_boot() - t1);
+  }
+
+  const double budget = 1000.0 / MODEL_FREQ;
+  std::sort(latency.begin(), latency.end());
+  double mean = std::accumulate(latency.begin(), latency.end(), 0.0) / latency.size();
+  int over = latency.end() - std::upper_bound(latency.begin(), latency.end(), budget);
+  printf("%s, ONNX_THREADS=%s\n", path, getenv("ONNX_THREADS") ? getenv("ONNX_THREADS") : "auto");
+  printf("mean %.2f ms  p50 %.2f ms  p99 %.2f ms  max %.2f ms\n",
+         mean, latency[latency.size() / 2], latency[latency.size() * 99 / 100], latency.back());
+  printf("%d of %d runs over the %.0f ms budget\n", over, iterations, budget);
+
+  // MODEL_PROFILE=<runs> adds a per node breakdown
+  model_profile_init();
+  if (int runs = model_profile_request()) {
+    m.profiler.start(runs);
+    while (!m.profiler.done()) m.execute();
+    m.profiler.report("bench_onnxmodel");
+  }
+  return over > 0;
+}
@@ -0,0 +1,184 @@
+#include "selfdrive/modeld/runners/onnxmodel.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "json11.hpp"
+
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/util.h"
+
+// the *NameAllocated and EndProfilingAllocated calls need ONNX Runtime 1.14 or newer
+#if ORT_API_VERSION < 14
+#error "ONNX Runtime 1.14 or newer is required, see selfdrive/modeld/install_onnxruntime.sh"
+#endif
+
+ONNXModel::ONNXModel(const char *path, float *loutput, size_t loutput_size, int runtime, bool luse_extra)
+  : env(ORT_LOGGING_LEVEL_WARNING, "modeld"),
+    memory_info(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)) {
+  output = loutput;
+  output_size = loutput_size;
+  use_extra = luse_extra;
+
+  model_path = path;
+  session = createSession(false);
+
+  Ort::AllocatorWithDefaultOptions allocator;
+  for (size_t i = 0; i < session->GetInputCount(); i++) {
+    Input input;
+    input.name = session->GetInputNameAllocated(i, allocator).get();
+    input.shape = session->GetInputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape();
+    input.size = 1;
+    for (auto &d : input.shape) {
+      // dynamic batch dimension
+      if (d < 0) d = 1;
+      input.size *= d;
+    }
+    printf("model input %zu: %s, %zu floats\n", i, input.name.c_str(), input.size);
+    inputs.push_back(input);
+  }
+  for (auto &input : inputs) input_names.push_back(input.name.c_str());
+
+  assert(session->GetOutputCount() == 1);
+  output_name = session->GetOutputNameAllocated(0, allocator).get();
+  output_shape = session->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+  size_t model_output_size = 1;
+  for (auto &d : output_shape) {
+    if (d < 0) d = 1;
+    model_output_size *= d;
+  }
+  if (output_size != 0) {
+    assert(output_size == model_output_size);
+  } else {
+    output_size = model_output_size;
+  }
+}
+
+std::unique_ptr<Ort::Session> ONNXModel::createSession(bool profile) {
+  // there is no GPU or DSP runtime here, everything runs on the CPU
+  Ort::SessionOptions options;
+  const char *threads = getenv("ONNX_THREADS");
+  options.SetIntraOpNumThreads(threads ? atoi(threads) : 0);
+  options.SetInterOpNumThreads(1);
+  options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+  options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+  if (profile) {
+    options.EnableProfiling((model_profile_dir() + "/onnx_profile").c_str());
+  }
+  return std::make_unique<Ort::Session>(env, model_path.c_str(), options);
+}
+
+void ONNXModel::setInput(int idx, float *buf, int buf_size) {
+  // same input order as the snpe runner
+  const int real_idx = idx + ((use_extra && idx > 0) ? 1 : 0);
+  assert(real_idx < inputs.size());
+  assert(inputs[real_idx].size == buf_size);
+  inputs[real_idx].buf = buf;
+}
+
+void ONNXModel::addRecurrent(float *state, int state_size) {
+  recurrent = state;
+  recurrent_buf.resize(state_size);
+  setInput(3, recurrent_buf.data(), state_size);
+}
+
+void ONNXModel::addTrafficConvention(float *state, int state_size) {
+  setInput(2, state, state_size);
+}
+
+void ONNXModel::addDesire(float *state, int state_size) {
+  setInput(1, state, state_size);
+}
+
+void ONNXModel::addImage(float *image_buf, int buf_size) {
+  assert(inputs.size() > 0 && inputs[0].size == buf_size);
+  inputs[0].buf = image_buf;
+}
+
+void ONNXModel::addExtra(float *image_buf, int buf_size) {
+  assert(use_extra && inputs.size() > 1 && inputs[1].size == buf_size);
+  inputs[1].buf = image_buf;
+}
+
+void ONNXModel::execute() {
+  if (recurrent != nullptr) {
+    memcpy(recurrent_buf.data(), recurrent, recurrent_buf.size() * sizeof(float));
+  }
+
+  // tensors only wrap the caller's buffers, nothing is copied
+  std::vector<Ort::Value> input_values;
+  input_values.reserve(inputs.size());
+  for (auto &input : inputs) {
+    assert(input.buf != nullptr);
+    input_values.push_back(Ort::Value::CreateTensor<float>(memory_info, input.buf, input.size,
+                                                           input.shape.data(), input.shape.size()));
+  }
+  Ort::Value output_value = Ort::Value::CreateTensor<float>(memory_info, output, output_size,
+                                                            output_shape.data(), output_shape.size());
+
+  // ONNX Runtime can only profile a whole session, so captures run on a second session
+  // created with profiling on, and the node timings are read back from its trace file
+  const bool profiling = profiler.active();
+  if (profiling) {
+    if (!profile_session) profile_session = createSession(true);
+    profiler.beginRun();
+  }
+
+  const char *output_names[] = {output_name.c_str()};
+  try {
+    Ort::Session *s = profiling ? profile_session.get() : session.get();
+    s->Run(Ort::RunOptions{nullptr}, input_names.data(), input_values.data(), input_values.size(),
+           output_names, &output_value, 1);
+  } catch (const Ort::Exception &e) {
+    LOGE("onnx model execution failed: %s", e.what());
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (profiling) {
+    profiler.endRun();
+    if (profiler.done()) readProfile();
+  }
+}
+
+void ONNXModel::readProfile() {
+  Ort::AllocatorWithDefaultOptions allocator;
+  std::string fn = profile_session->EndProfilingAllocated(allocator).get();
+  profile_session.reset();
+
+  std::string err;
+  json11::Json trace = json11::Json::parse(util::read_file(fn), err);
+  unlink(fn.c_str());
+  if (!err.empty()) {
+    LOGE("failed to parse onnx profile %s: %s", fn.c_str(), err.c_str());
+    return;
+  }
+
+  // the first run of the capture is the profiler's warmup run, the ones after it are recorded
+  std::vector<double> run_starts;
+  for (const auto &e : trace.array_items()) {
+    if (e["name"].string_value() == "model_run") run_starts.push_back(e["ts"].number_value());
+  }
+  std::sort(run_starts.begin(), run_starts.end());
+  if (run_starts.size() < 2) {
+    LOGE("onnx profile %s has %zu runs", fn.c_str(), run_starts.size());
+    return;
+  }
+  const double first_run_us = run_starts[1];
+
+  // the trace counts microseconds from the session start, line its runs up with the profiler's
+  const double offset_ms = profiler.captureStart() - first_run_us / 1e3;
+
+  const std::string suffix = "_kernel_time";
+  for (const auto &e : trace.array_items()) {
+    std::string name = e["name"].string_value();
+    if (e["cat"].string_value() != "Node" || e["ts"].number_value() < first_run_us || name.size() <= suffix.size() ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) continue;
+    name.resize(name.size() - suffix.size());
+    profiler.add(name, offset_ms + e["ts"].number_value() / 1e3, e["dur"].number_value() / 1e3);
+  }
+}
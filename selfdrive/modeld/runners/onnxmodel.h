@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "selfdrive/modeld/runners/runmodel.h"
+
+// Runs the onnx model in-process on the CPU through ONNX Runtime.
+// ONNX_THREADS sets the number of intra-op threads, 0 lets ONNX Runtime decide
+class ONNXModel : public RunModel {
+public:
+  ONNXModel(const char *path, float *loutput, size_t loutput_size, int runtime, bool luse_extra = false);
+  void addRecurrent(float *state, int state_size);
+  void addDesire(float *state, int state_size);
+  void addTrafficConvention(float *state, int state_size);
+  void addImage(float *image_buf, int buf_size);
+  void addExtra(float *image_buf, int buf_size);
+  void execute();
+
+private:
+  struct Input {
+    std::string name;
+    std::vector<int64_t> shape;
+    size_t size;
+    float *buf = nullptr;
+  };
+  void setInput(int idx, float *buf, int buf_size);
+  std::unique_ptr<Ort::Session> createSession(bool profile);
+  void readProfile();
+
+  Ort::Env env;
+  std::string model_path;
+  std::unique_ptr<Ort::Session> session;
+  // only exists while a profile capture runs
+  std::unique_ptr<Ort::Session> profile_session;
+  Ort::MemoryInfo memory_info;
+
+  std::vector<Input> inputs;
+  std::vector<const char *> input_names;
+  std::string output_name;
+  std::vector<int64_t> output_shape;
+  float *output;
+  size_t output_size;
+  bool use_extra;
+
+  // the recurrent state aliases the output buffer, so it is copied in before each run
+  float *recurrent = nullptr;
+  std::vector<float> recurrent_buf;
+};
@@ -0,0 +1,128 @@
+#include "selfdrive/modeld/runners/profiler.h"
+
+#include <csignal>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+
+#include "json11.hpp"
+
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
+
+void ModelProfiler::start(int runs) {
+  spans.clear();
+  remaining_runs = runs + 1;
+  finished = false;
+  warmup = true;
+  capture_start_ms = -1;
+}
+
+void ModelProfiler::beginRun() {
+  run_start_ms = millis_since_boot();
+  run_first_span = spans.size();
+  if (!warmup && capture_start_ms < 0) capture_start_ms = run_start_ms;
+}
+
+void ModelProfiler::endRun() {
+  if (warmup) {
+    spans.resize(run_first_span);
+    warmup = false;
+  } else {
+    add(RUN, run_start_ms, millis_since_boot() - run_start_ms);
+  }
+  if (--remaining_runs == 0) finished = true;
+}
+
+void ModelProfiler::add(const std::string &name, double start_ms, double duration_ms) {
+  spans.push_back({name, start_ms, duration_ms});
+}
+
+std::vector<ModelProfiler::Stat> ModelProfiler::stats() const {
+  std::map<std::string, std::vector<double>> durations;
+  for (const auto &s : spans) {
+    durations[s.name].push_back(s.duration_ms);
+  }
+
+  std::vector<Stat> ret;
+  for (auto &[name, d] : durations) {
+    std::sort(d.begin(), d.end());
+    double total = 0;
+    for (double v : d) total += v;
+    auto pct = [&d](int p) { return d[std::min(d.size() - 1, d.size() * p / 100)]; };
+    ret.push_back({name, (int)d.size(), total, total / d.size(), pct(50), pct(90), pct(99), d.back()});
+  }
+  std::sort(ret.begin(), ret.end(), [](const Stat &a, const Stat &b) {
+    if ((a.name == RUN) != (b.name == RUN)) return a.name == RUN;
+    return a.total_ms > b.total_ms;
+  });
+  return ret;
+}
+
+bool ModelProfiler::writeChromeTrace(const std::string &path) const {
+  // complete events in microseconds, loads in chrome://tracing and perfetto
+  json11::Json::array events;
+  for (const auto &s : spans) {
+    events.push_back(json11::Json::object{
+      {"name", s.name},
+      {"ph", "X"},
+      {"ts", s.start_ms * 1e3},
+      {"dur", s.duration_ms * 1e3},
+      {"pid", 0},
+      {"tid", s.name == RUN ? 0 : 1},
+    });
+  }
+  std::ofstream f(path);
+  f << json11::Json(json11::Json::object{{"traceEvents", events}}).dump();
+  return f.good();
+}
+
+void ModelProfiler::report(const char *model_name) {
+  const auto st = stats();
+  printf("%s profile, %zu spans\n", model_name, spans.size());
+  printf("%-48s %6s %9s %9s %9s %9s %9s\n", "layer", "count", "total ms", "mean", "p50", "p90", "p99");
+  for (int i = 0; i < std::min<int>(st.size(), 30); i++) {
+    const Stat &s = st[i];
+    printf("%-48.48s %6d %9.2f %9.3f %9.3f %9.3f %9.3f\n", s.name.c_str(), s.count, s.total_ms, s.mean_ms, s.p50_ms, s.p90_ms, s.p99_ms);
+  }
+
+  std::string path = model_profile_dir() + "/" + model_name + "_profile_" + std::to_string((uint64_t)millis_since_boot()) + ".json";
+  if (writeChromeTrace(path)) {
+    LOGW("%s profile written to %s", model_name, path.c_str());
+  } else {
+    LOGE("failed to write %s profile to %s", model_name, path.c_str());
+  }
+  spans.clear();
+  finished = false;
+}
+
+std::string model_profile_dir() {
+  const char *dir = getenv("MODEL_PROFILE_DIR");
+  return dir ? dir : "/tmp";
+}
+
+static std::atomic<int> profile_request = 0;
+static int signal_runs = 100;
+
+static void profile_signal_handler(int) {
+  profile_request = signal_runs;
+}
+
+void model_profile_init() {
+  if (const char *runs = getenv("MODEL_PROFILE_RUNS")) {
+    signal_runs = std::max(1, atoi(runs));
+  }
+  std::signal(SIGUSR1, profile_signal_handler);
+  if (const char *runs = getenv("MODEL_PROFILE")) {
+    profile_request = std::max(1, atoi(runs));
+  }
+}
+
+int model_profile_request() {
+  if (profile_request.load(std::memory_order_relaxed) == 0) return 0;
+  return profile_request.exchange(0);
+}
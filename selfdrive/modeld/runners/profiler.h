@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Per layer timings of a RunModel backend over a fixed number of runs. Nothing is recorded
+// until start() is called, the backends only check active() on every run while it is off.
+// The first run of a capture only warms up and is dropped.
+// Thneed times each OpenCL kernel, ONNX Runtime each graph node, SNPE only whole runs
+class ModelProfiler {
+public:
+  struct Span {
+    std::string name;
+    double start_ms;
+    double duration_ms;
+  };
+  struct Stat {
+    std::string name;
+    int count;
+    double total_ms, mean_ms, p50_ms, p90_ms, p99_ms, max_ms;
+  };
+
+  // the span covering a whole run
+  static constexpr const char *RUN = "run";
+
+  void start(int runs);
+  bool active() const { return remaining_runs > 0; }
+  // true once the last run of a capture ended, until report() or the next start()
+  bool done() const { return finished; }
+
+  void beginRun();
+  void endRun();
+  void add(const std::string &name, double start_ms, double duration_ms);
+  // start of the first recorded run of the capture, in millis_since_boot
+  double captureStart() const { return capture_start_ms; }
+
+  // sorted by total time, the run span first
+  std::vector<Stat> stats() const;
+  bool writeChromeTrace(const std::string &path) const;
+  // prints the slowest layers and writes the trace to MODEL_PROFILE_DIR (/tmp by default)
+  void report(const char *model_name);
+
+private:
+  std::vector<Span> spans;
+  int remaining_runs = 0;
+  bool finished = false, warmup = false;
+  size_t run_first_span = 0;
+  double run_start_ms = 0, capture_start_ms = -1;
+};
+
+// MODEL_PROFILE_DIR, /tmp by default
+std::string model_profile_dir();
+
+// Captures are requested at runtime with SIGUSR1 and, once at startup, with MODEL_PROFILE=<runs>.
+// model_profile_request() returns the number of runs to capture if one was requested since
+// the last call, else 0. MODEL_PROFILE_RUNS sets the length of SIGUSR1 captures (100 by default)
+void model_profile_init();
+int model_profile_request();
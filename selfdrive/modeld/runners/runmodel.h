@@ -1,4 +1,7 @@
 #pragma once
+
+#include "selfdrive/modeld/runners/profiler.h"
+
 class RunModel {
 public:
   virtual ~RunModel() {}
@@ -10,5 +13,7 @@ public:
   virtual void execute() {}
   virtual void* getInputBuf() { return nullptr; }
   virtual void* getExtraBuf() { return nullptr; }
-};
 
+  // filled by execute() while a capture is active
+  ModelProfiler profiler;
+};
@@ -184,6 +184,7 @@ void SNPEModel::execute() {
       }
       memset(recurrent, 0, recurrent_size*sizeof(float));
       thneed = new Thneed();
+      thneed->profiler = &profiler;
       if (!snpe->execute(inputMap, outputMap)) {
         PrintErrorStringAndExit();
       }
@@ -232,9 +233,14 @@ void SNPEModel::execute() {
       bool extra_ret = extraBuffer->setBufferAddress(extra);
       assert(extra_ret == true);
     }
+    // the layers of an SNPE network can only be timed with a profiling level set at build
+    // time, so captures only get whole runs here
+    const bool profiling = profiler.active();
+    if (profiling) profiler.beginRun();
     if (!snpe->execute(inputMap, outputMap)) {
       PrintErrorStringAndExit();
     }
+    if (profiling) profiler.endRun();
 #ifdef USE_THNEED
   }
 #endif
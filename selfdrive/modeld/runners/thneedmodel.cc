@@ -4,6 +4,7 @@
 
 ThneedModel::ThneedModel(const char *path, float *loutput, size_t loutput_size, int runtime, bool luse_extra) {
   thneed = new Thneed(true);
+  thneed->profiler = &profiler;
   thneed->record = 0;
   thneed->load(path);
   thneed->clexec();
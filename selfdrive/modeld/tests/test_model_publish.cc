@@ -0,0 +1,17 @@
+#include <cstring>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/modeld/tests/legacy_fill_model.h"
+
+TEST_CASE("fill_model serializes the same modelV2 as the per element parser") {
+  // frame after frame, both keep the same brake probability history for hardBrakePredicted
+  const auto outputs = synthetic_outputs(200);
+  for (int i = 0; i < outputs.size(); i++) {
+    INFO("frame " << i);
+    auto expected = build_model_msg(outputs[i], legacy::fill_model);
+    auto actual = build_model_msg(outputs[i], fill_model);
+    auto expected_bytes = expected.asBytes(), actual_bytes = actual.asBytes();
+    REQUIRE(actual_bytes.size() == expected_bytes.size());
+    REQUIRE(memcmp(expected_bytes.begin(), actual_bytes.begin(), expected_bytes.size()) == 0);
+  }
+}
@@ -11,6 +11,7 @@
 
 #include "selfdrive/common/clutil.h"
 #include "selfdrive/common/timing.h"
+#include "selfdrive/modeld/runners/profiler.h"
 //#define RUN_DISASSEMBLER
 #define RUN_OPTIMIZER
 
@@ -297,6 +298,11 @@ void Thneed::wait() {
 }
 
 void Thneed::execute(float **finputs, float *foutput, bool slow) {
+  if (profiler != NULL && profiler->active()) {
+    execute_profiled(finputs, foutput);
+    return;
+  }
+
   uint64_t tb, te;
   if (record & THNEED_DEBUG) tb = nanos_since_boot();
 
@@ -304,22 +310,7 @@ void Thneed::execute(float **finputs, float *foutput, bool slow) {
   copy_inputs(finputs);
 
   // ****** set power constraint
-  int ret;
-  struct kgsl_device_constraint_pwrlevel pwrlevel;
-  pwrlevel.level = KGSL_CONSTRAINT_PWR_MAX;
-
-  struct kgsl_device_constraint constraint;
-  constraint.type = KGSL_CONSTRAINT_PWRLEVEL;
-  constraint.context_id = context_id;
-  constraint.data = (void*)&pwrlevel;
-  constraint.size = sizeof(pwrlevel);
-
-  struct kgsl_device_getproperty prop;
-  prop.type = KGSL_PROP_PWR_CONSTRAINT;
-  prop.value = (void*)&constraint;
-  prop.sizebytes = sizeof(constraint);
-  ret = ioctl(fd, IOCTL_KGSL_SETPROPERTY, &prop);
-  assert(ret == 0);
+  set_power_constraint(true);
 
   // ****** run commands
   int i = 0;
@@ -334,12 +325,7 @@ void Thneed::execute(float **finputs, float *foutput, bool slow) {
   copy_output(foutput);
 
   // ****** unset power constraint
-  constraint.type = KGSL_CONSTRAINT_NONE;
-  constraint.data = NULL;
-  constraint.size = 0;
-
-  ret = ioctl(fd, IOCTL_KGSL_SETPROPERTY, &prop);
-  assert(ret == 0);
+  set_power_constraint(false);
 
   if (record & THNEED_DEBUG) {
     te = nanos_since_boot();
@@ -347,6 +333,42 @@ void Thneed::execute(float **finputs, float *foutput, bool slow) {
   }
 }
 
+void Thneed::set_power_constraint(bool max) {
+  struct kgsl_device_constraint_pwrlevel pwrlevel;
+  pwrlevel.level = KGSL_CONSTRAINT_PWR_MAX;
+
+  struct kgsl_device_constraint constraint;
+  constraint.type = max ? KGSL_CONSTRAINT_PWRLEVEL : KGSL_CONSTRAINT_NONE;
+  constraint.context_id = context_id;
+  constraint.data = max ? (void*)&pwrlevel : NULL;
+  constraint.size = max ? sizeof(pwrlevel) : 0;
+
+  struct kgsl_device_getproperty prop;
+  prop.type = KGSL_PROP_PWR_CONSTRAINT;
+  prop.value = (void*)&constraint;
+  prop.sizebytes = sizeof(constraint);
+  int ret = ioctl(fd, IOCTL_KGSL_SETPROPERTY, &prop);
+  assert(ret == 0);
+}
+
+// same GPU power level as execute, so the kernel timings match the recorded runs
+void Thneed::execute_profiled(float **finputs, float *foutput) {
+  assert(record == 0);
+  profiler->beginRun();
+  copy_inputs(finputs);
+  set_power_constraint(true);
+  for (auto &k : kq) {
+    double start = millis_since_boot();
+    cl_int ret = k->exec();
+    assert(ret == CL_SUCCESS);
+    clFinish(command_queue);
+    profiler->add(k->name, start, millis_since_boot() - start);
+  }
+  copy_output(foutput);
+  set_power_constraint(false);
+  profiler->endRun();
+}
+
 void Thneed::clinit() {
   device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
   context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
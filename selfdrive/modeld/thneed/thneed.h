@@ -24,6 +24,7 @@ namespace json11 {
   class Json;
 }
 class Thneed;
+class ModelProfiler;
 
 class GPUMalloc {
   public:
@@ -104,6 +105,9 @@ class Thneed {
     vector<size_t> input_sizes;
     cl_mem output = NULL;
 
+    // while a capture is active, execute runs the queued kernels one at a time to time each
+    ModelProfiler *profiler = NULL;
+
     cl_context context = NULL;
     cl_command_queue command_queue;
     cl_device_id device_id;
@@ -131,5 +135,7 @@ class Thneed {
     void save(const char *filename, bool save_binaries=false);
   private:
     void clinit();
+    void set_power_constraint(bool max);
+    void execute_profiled(float **finputs, float *foutput);
 };
 
@@ -0,0 +1,274 @@
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_TRANSFORM_X86
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define CPU_TRANSFORM_NEON
+#endif
+
+// keep in sync with transform.cl
+#define INTER_BITS 5
+#define INTER_TAB_SIZE (1 << INTER_BITS)
+#define INTER_REMAP_COEF_BITS 15
+#define INTER_REMAP_COEF_SCALE (1 << INTER_REMAP_COEF_BITS)
+
+CpuTransformSimd cpu_transform_simd() {
+  static const CpuTransformSimd simd = []() {
+    // CPU_TRANSFORM_NO_SIMD forces the scalar path, e.g. for comparisons
+    if (getenv("CPU_TRANSFORM_NO_SIMD")) return CpuTransformSimd::NONE;
+#if defined(CPU_TRANSFORM_X86)
+    if (__builtin_cpu_supports("avx2")) return CpuTransformSimd::AVX2;
+#elif defined(CPU_TRANSFORM_NEON)
+    return CpuTransformSimd::NEON;
+#endif
+    return CpuTransformSimd::NONE;
+  }();
+  return simd;
+}
+
+const char *cpu_transform_simd_name(CpuTransformSimd simd) {
+  switch (simd) {
+    case CpuTransformSimd::AVX2: return "avx2";
+    case CpuTransformSimd::NEON: return "neon";
+    default: return "none";
+  }
+}
+
+// Bilinear weights for every subpixel position, as the kernel computes them per pixel
+struct WarpTable {
+  int32_t w[INTER_TAB_SIZE * INTER_TAB_SIZE][4];
+};
+
+static inline int32_t saturate_short(float v) {
+  return std::clamp((int32_t)nearbyintf(v), -32768, 32767);
+}
+
+static const WarpTable &warp_table() {
+  static const WarpTable table = []() {
+    WarpTable t;
+    for (int ay = 0; ay < INTER_TAB_SIZE; ay++) {
+      for (int ax = 0; ax < INTER_TAB_SIZE; ax++) {
+        float taby = 1.f/INTER_TAB_SIZE*ay;
+        float tabx = 1.f/INTER_TAB_SIZE*ax;
+        int32_t *w = t.w[ay * INTER_TAB_SIZE + ax];
+        w[0] = saturate_short((1.0f-taby)*(1.0f-tabx) * INTER_REMAP_COEF_SCALE);
+        w[1] = saturate_short((1.0f-taby)*tabx * INTER_REMAP_COEF_SCALE);
+        w[2] = saturate_short(taby*(1.0f-tabx) * INTER_REMAP_COEF_SCALE);
+        w[3] = saturate_short(taby*tabx * INTER_REMAP_COEF_SCALE);
+      }
+    }
+    return t;
+  }();
+  return table;
+}
+
+static inline uint8_t warp_pixel(const uint8_t *src, int src_cols, int src_rows,
+                                 const float *M, const WarpTable &tab, int dx, int dy) {
+  float X0 = M[0] * dx + M[1] * dy + M[2];
+  float Y0 = M[3] * dx + M[4] * dy + M[5];
+  float W = M[6] * dx + M[7] * dy + M[8];
+  W = W != 0.0f ? INTER_TAB_SIZE / W : 0.0f;
+  int X = (int)nearbyintf(X0 * W), Y = (int)nearbyintf(Y0 * W);
+
+  int sx = std::clamp(X >> INTER_BITS, -32768, 32767);
+  int sy = std::clamp(Y >> INTER_BITS, -32768, 32767);
+  int ay = Y & (INTER_TAB_SIZE - 1);
+  int ax = X & (INTER_TAB_SIZE - 1);
+
+  auto at = [&](int x, int y) -> int {
+    return (x >= 0 && x < src_cols && y >= 0 && y < src_rows) ? src[y * src_cols + x] : 0;
+  };
+  const int32_t *w = tab.w[ay * INTER_TAB_SIZE + ax];
+  int val = at(sx, sy) * w[0] + at(sx+1, sy) * w[1] + at(sx, sy+1) * w[2] + at(sx+1, sy+1) * w[3];
+  return std::clamp((val + (1 << (INTER_REMAP_COEF_BITS-1))) >> INTER_REMAP_COEF_BITS, 0, 255);
+}
+
+#if defined(CPU_TRANSFORM_X86)
+// Eight pixels at a time. Groups whose taps are all inside the image are gathered,
+// the rest (borders, out of frame) fall back to the scalar path
+__attribute__((target("avx2")))
+static void warp_row_avx2(const uint8_t *src, int src_cols, int src_rows,
+                          const float *M, const WarpTable &tab, uint8_t *dst, int dst_cols, int dy) {
+  const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 m0 = _mm256_set1_ps(M[0]), m3 = _mm256_set1_ps(M[3]), m6 = _mm256_set1_ps(M[6]);
+  const __m256 m1dy = _mm256_set1_ps(M[1] * dy), m4dy = _mm256_set1_ps(M[4] * dy), m7dy = _mm256_set1_ps(M[7] * dy);
+  const __m256 m2 = _mm256_set1_ps(M[2]), m5 = _mm256_set1_ps(M[5]), m8 = _mm256_set1_ps(M[8]);
+  const __m256 tab_size = _mm256_set1_ps(INTER_TAB_SIZE);
+  const __m256i frac_mask = _mm256_set1_epi32(INTER_TAB_SIZE - 1);
+  const __m256i byte_mask = _mm256_set1_epi32(0xff);
+  const __m256i round = _mm256_set1_epi32(1 << (INTER_REMAP_COEF_BITS-1));
+  const __m256i max_sx = _mm256_set1_epi32(src_cols - 1), max_sy = _mm256_set1_epi32(src_rows - 2);
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i cols = _mm256_set1_epi32(src_cols);
+  const int *weights = (const int *)tab.w;
+
+  int dx = 0;
+  for (; dx + 8 <= dst_cols; dx += 8) {
+    __m256 x = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(dx), iota));
+    __m256 X0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), m1dy), m2);
+    __m256 Y0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m3, x), m4dy), m5);
+    __m256 W = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m6, x), m7dy), m8);
+    W = _mm256_and_ps(_mm256_div_ps(tab_size, W), _mm256_cmp_ps(W, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+
+    // rounds to nearest even like rint
+    __m256i X = _mm256_cvtps_epi32(_mm256_mul_ps(X0, W));
+    __m256i Y = _mm256_cvtps_epi32(_mm256_mul_ps(Y0, W));
+    __m256i sx = _mm256_srai_epi32(X, INTER_BITS), sy = _mm256_srai_epi32(Y, INTER_BITS);
+
+    // sx + 1 < cols, and sy + 2 < rows so the 4 byte loads of the second row stay in the plane
+    __m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(sx, minus_one), _mm256_cmpgt_epi32(max_sx, sx)),
+                                      _mm256_and_si256(_mm256_cmpgt_epi32(sy, minus_one), _mm256_cmpgt_epi32(max_sy, sy)));
+    if (_mm256_movemask_epi8(inside) != -1) {
+      for (int i = 0; i < 8; i++) dst[dx + i] = warp_pixel(src, src_cols, src_rows, M, tab, dx + i, dy);
+      continue;
+    }
+
+    __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(sy, cols), sx);
+    __m256i g0 = _mm256_i32gather_epi32((const int *)src, idx, 1);
+    __m256i g1 = _mm256_i32gather_epi32((const int *)src, _mm256_add_epi32(idx, cols), 1);
+    __m256i v0 = _mm256_and_si256(g0, byte_mask), v1 = _mm256_and_si256(_mm256_srli_epi32(g0, 8), byte_mask);
+    __m256i v2 = _mm256_and_si256(g1, byte_mask), v3 = _mm256_and_si256(_mm256_srli_epi32(g1, 8), byte_mask);
+
+    __m256i t = _mm256_slli_epi32(_mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(Y, frac_mask), INTER_BITS),
+                                                  _mm256_and_si256(X, frac_mask)), 2);
+    __m256i val = _mm256_mullo_epi32(v0, _mm256_i32gather_epi32(weights, t, 4));
+    val = _mm256_add_epi32(val, _mm256_mullo_epi32(v1, _mm256_i32gather_epi32(weights + 1, t, 4)));
+    val = _mm256_add_epi32(val, _mm256_mullo_epi32(v2, _mm256_i32gather_epi32(weights + 2, t, 4)));
+    val = _mm256_add_epi32(val, _mm256_mullo_epi32(v3, _mm256_i32gather_epi32(weights + 3, t, 4)));
+    val = _mm256_srai_epi32(_mm256_add_epi32(val, round), INTER_REMAP_COEF_BITS);
+
+    // saturating packs work per 128 bit lane, the result is in bytes 0-3 of each lane
+    __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(val, val), _mm256_setzero_si256());
+    int32_t lo = _mm256_extract_epi32(packed, 0), hi = _mm256_extract_epi32(packed, 4);
+    memcpy(dst + dx, &lo, 4);
+    memcpy(dst + dx + 4, &hi, 4);
+  }
+  for (; dx < dst_cols; dx++) dst[dx] = warp_pixel(src, src_cols, src_rows, M, tab, dx, dy);
+}
+#endif
+
+void warp_perspective_cpu(const uint8_t *src, int src_width, int src_height,
+                          uint8_t *dst, int dst_width, int dst_height,
+                          const mat3 &projection, CpuTransformSimd simd) {
+  const WarpTable &tab = warp_table();
+  const float *M = projection.v;
+  for (int dy = 0; dy < dst_height; dy++) {
+    uint8_t *row = dst + dy * dst_width;
+#if defined(CPU_TRANSFORM_X86)
+    if (simd == CpuTransformSimd::AVX2) {
+      warp_row_avx2(src, src_width, src_height, M, tab, row, dst_width, dy);
+      continue;
+    }
+#endif
+    for (int dx = 0; dx < dst_width; dx++) row[dx] = warp_pixel(src, src_width, src_height, M, tab, dx, dy);
+  }
+}
+
+void transform_cpu(const uint8_t *in_yuv, int in_width, int in_height,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v,
+                   int out_width, int out_height,
+                   const mat3 &projection, CpuTransformSimd simd) {
+  // in and out uv is half the size of y.
+  const mat3 projection_uv = transform_scale_buffer(projection, 0.5);
+  const int in_uv_width = in_width / 2, in_uv_height = in_height / 2;
+  const uint8_t *in_u = in_yuv + in_width * in_height;
+  const uint8_t *in_v = in_u + in_uv_width * in_uv_height;
+
+  warp_perspective_cpu(in_yuv, in_width, in_height, out_y, out_width, out_height, projection, simd);
+  warp_perspective_cpu(in_u, in_uv_width, in_uv_height, out_u, out_width / 2, out_height / 2, projection_uv, simd);
+  warp_perspective_cpu(in_v, in_uv_width, in_uv_height, out_v, out_width / 2, out_height / 2, projection_uv, simd);
+}
+
+#if defined(CPU_TRANSFORM_X86)
+// Splits 16 pixels of a row into the even and odd column channels
+__attribute__((target("avx2")))
+static int split_row_avx2(const uint8_t *row, int half_width, float *even, float *odd) {
+  const __m128i deinterleave = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  int c = 0;
+  for (; c + 8 <= half_width; c += 8) {
+    __m128i px = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row + c * 2)), deinterleave);
+    _mm256_storeu_ps(even + c, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(px)));
+    _mm256_storeu_ps(odd + c, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(px, 8))));
+  }
+  return c;
+}
+
+__attribute__((target("avx2")))
+static int convert_avx2(const uint8_t *in, int len, float *out) {
+  int i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m128i px = _mm_loadl_epi64((const __m128i *)(in + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(px)));
+  }
+  return i;
+}
+#elif defined(CPU_TRANSFORM_NEON)
+static int split_row_neon(const uint8_t *row, int half_width, float *even, float *odd) {
+  int c = 0;
+  for (; c + 8 <= half_width; c += 8) {
+    uint8x8x2_t px = vld2_u8(row + c * 2);
+    uint16x8_t e = vmovl_u8(px.val[0]), o = vmovl_u8(px.val[1]);
+    vst1q_f32(even + c, vcvtq_f32_u32(vmovl_u16(vget_low_u16(e))));
+    vst1q_f32(even + c + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(e))));
+    vst1q_f32(odd + c, vcvtq_f32_u32(vmovl_u16(vget_low_u16(o))));
+    vst1q_f32(odd + c + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(o))));
+  }
+  return c;
+}
+
+static int convert_neon(const uint8_t *in, int len, float *out) {
+  int i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint16x8_t px = vmovl_u8(vld1_u8(in + i));
+    vst1q_f32(out + i, vcvtq_f32_u32(vmovl_u16(vget_low_u16(px))));
+    vst1q_f32(out + i + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(px))));
+  }
+  return i;
+}
+#endif
+
+static void split_row(const uint8_t *row, int half_width, float *even, float *odd, CpuTransformSimd simd) {
+  int c = 0;
+#if defined(CPU_TRANSFORM_X86)
+  if (simd == CpuTransformSimd::AVX2) c = split_row_avx2(row, half_width, even, odd);
+#elif defined(CPU_TRANSFORM_NEON)
+  if (simd == CpuTransformSimd::NEON) c = split_row_neon(row, half_width, even, odd);
+#endif
+  for (; c < half_width; c++) {
+    even[c] = row[c * 2];
+    odd[c] = row[c * 2 + 1];
+  }
+}
+
+static void convert(const uint8_t *in, int len, float *out, CpuTransformSimd simd) {
+  int i = 0;
+#if defined(CPU_TRANSFORM_X86)
+  if (simd == CpuTransformSimd::AVX2) i = convert_avx2(in, len, out);
+#elif defined(CPU_TRANSFORM_NEON)
+  if (simd == CpuTransformSimd::NEON) i = convert_neon(in, len, out);
+#endif
+  for (; i < len; i++) out[i] = in[i];
+}
+
+void loadyuv_cpu(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                 int width, int height, float *out, CpuTransformSimd simd) {
+  const int half_width = width / 2;
+  const int uv_size = half_width * (height / 2);
+
+  // 02
+  // 13
+  float *y0 = out, *y1 = out + uv_size, *y2 = out + uv_size * 2, *y3 = out + uv_size * 3;
+  for (int r = 0; r < height / 2; r++) {
+    split_row(y + (r * 2) * width, half_width, y0 + r * half_width, y2 + r * half_width, simd);
+    split_row(y + (r * 2 + 1) * width, half_width, y1 + r * half_width, y3 + r * half_width, simd);
+  }
+  convert(u, uv_size, out + uv_size * 4, simd);
+  convert(v, uv_size, out + uv_size * 5, simd);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#include "selfdrive/common/mat.h"
+
+// CPU versions of transform.cl and loadyuv.cl for machines without a usable OpenCL GPU.
+// They follow the kernels' fixed point math, the SIMD level is picked at runtime
+
+enum class CpuTransformSimd {
+  NONE,
+  AVX2,
+  NEON,
+};
+
+CpuTransformSimd cpu_transform_simd();
+const char *cpu_transform_simd_name(CpuTransformSimd simd);
+
+// Same as warpPerspective in transform.cl for one plane
+void warp_perspective_cpu(const uint8_t *src, int src_width, int src_height,
+                          uint8_t *dst, int dst_width, int dst_height,
+                          const mat3 &projection, CpuTransformSimd simd = cpu_transform_simd());
+
+// Same as transform_queue: warps all three planes of a packed yuv420 frame
+void transform_cpu(const uint8_t *in_yuv, int in_width, int in_height,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v,
+                   int out_width, int out_height,
+                   const mat3 &projection, CpuTransformSimd simd = cpu_transform_simd());
+
+// Same as loadyuv_queue without the shift: packs the planes into the 6 channel
+// float layout the models take (y00, y10, y01, y11, u, v)
+void loadyuv_cpu(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                 int width, int height, float *out, CpuTransformSimd simd = cpu_transform_simd());
@@ -0,0 +1,125 @@
+// Checks the CPU warp and loadyuv against transform.cl and loadyuv.cl, and times both.
+// The warp may differ by one where the OpenCL compiler contracts the projection into fma
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "selfdrive/common/clutil.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/modeld/transforms/loadyuv.h"
+#include "selfdrive/modeld/transforms/transform.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+constexpr int MODEL_WIDTH = 512;
+constexpr int MODEL_HEIGHT = 256;
+constexpr int MODEL_FRAME_SIZE = MODEL_WIDTH * MODEL_HEIGHT * 3 / 2;
+constexpr int ITERATIONS = 50;
+
+// fraction of warped pixels allowed to be off by one
+constexpr double MAX_WARP_MISMATCH = 1e-3;
+
+static bool test_size(cl_device_id device_id, cl_context context, int width, int height) {
+  const size_t yuv_size = width * height * 3 / 2;
+  std::vector<uint8_t> yuv(yuv_size);
+  std::mt19937 gen(width);
+  std::uniform_int_distribution<int> dist(0, 255);
+  for (auto &p : yuv) p = dist(gen);
+
+  // the road camera projection modeld uses, slightly rotated to exercise the perspective divide
+  const float s = width / 1164.0;
+  mat3 projection = {{
+    1.25f * s, 0.01f, 0.20f * width,
+    -0.01f, 1.25f * s, 0.35f * height,
+    1e-6f, 2e-6f, 1.0f,
+  }};
+
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+  cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, yuv_size, yuv.data(), &err));
+  cl_mem y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT, NULL, &err));
+  cl_mem u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT / 4, NULL, &err));
+  cl_mem v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT / 4, NULL, &err));
+  cl_mem out_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_FRAME_SIZE * sizeof(float), NULL, &err));
+
+  Transform transform;
+  LoadYUVState loadyuv;
+  transform_init(&transform, context, device_id);
+  loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
+
+  std::vector<uint8_t> cl_planes(MODEL_FRAME_SIZE);
+  std::vector<float> cl_out(MODEL_FRAME_SIZE);
+  double t1 = millis_since_boot();
+  for (int i = 0; i < ITERATIONS; i++) {
+    transform_queue(&transform, q, yuv_cl, width, height, y_cl, u_cl, v_cl, MODEL_WIDTH, MODEL_HEIGHT, projection);
+    loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, out_cl);
+    CL_CHECK(clEnqueueReadBuffer(q, out_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), cl_out.data(), 0, NULL, NULL));
+  }
+  double cl_ms = (millis_since_boot() - t1) / ITERATIONS;
+  CL_CHECK(clEnqueueReadBuffer(q, y_cl, CL_TRUE, 0, MODEL_WIDTH * MODEL_HEIGHT, &cl_planes[0], 0, NULL, NULL));
+  CL_CHECK(clEnqueueReadBuffer(q, u_cl, CL_TRUE, 0, MODEL_WIDTH * MODEL_HEIGHT / 4, &cl_planes[MODEL_WIDTH * MODEL_HEIGHT], 0, NULL, NULL));
+  CL_CHECK(clEnqueueReadBuffer(q, v_cl, CL_TRUE, 0, MODEL_WIDTH * MODEL_HEIGHT / 4, &cl_planes[MODEL_WIDTH * MODEL_HEIGHT * 5 / 4], 0, NULL, NULL));
+
+  bool pass = true;
+  for (auto simd : {CpuTransformSimd::NONE, cpu_transform_simd()}) {
+    std::vector<uint8_t> planes(MODEL_FRAME_SIZE);
+    std::vector<float> out(MODEL_FRAME_SIZE);
+    uint8_t *y = &planes[0], *u = y + MODEL_WIDTH * MODEL_HEIGHT, *v = u + MODEL_WIDTH * MODEL_HEIGHT / 4;
+
+    t1 = millis_since_boot();
+    for (int i = 0; i < ITERATIONS; i++) {
+      transform_cpu(yuv.data(), width, height, y, u, v, MODEL_WIDTH, MODEL_HEIGHT, projection, simd);
+    }
+    double t2 = millis_since_boot();
+    for (int i = 0; i < ITERATIONS; i++) {
+      loadyuv_cpu(y, u, v, MODEL_WIDTH, MODEL_HEIGHT, out.data(), simd);
+    }
+    double t3 = millis_since_boot();
+
+    int max_diff = 0, mismatch = 0;
+    for (int i = 0; i < MODEL_FRAME_SIZE; i++) {
+      int diff = std::abs(planes[i] - cl_planes[i]);
+      max_diff = std::max(max_diff, diff);
+      mismatch += diff != 0;
+    }
+
+    // loadyuv is exact, compare it on the OpenCL warp output
+    std::vector<float> packed(MODEL_FRAME_SIZE);
+    uint8_t *cy = &cl_planes[0], *cu = cy + MODEL_WIDTH * MODEL_HEIGHT, *cv = cu + MODEL_WIDTH * MODEL_HEIGHT / 4;
+    loadyuv_cpu(cy, cu, cv, MODEL_WIDTH, MODEL_HEIGHT, packed.data(), simd);
+    int loadyuv_mismatch = 0;
+    for (int i = 0; i < MODEL_FRAME_SIZE; i++) loadyuv_mismatch += packed[i] != cl_out[i];
+
+    bool ok = max_diff <= 1 && mismatch <= MAX_WARP_MISMATCH * MODEL_FRAME_SIZE && loadyuv_mismatch == 0;
+    printf("%4dx%-4d %-4s warp %.2f ms (max diff %d, %d px off)  loadyuv %.3f ms (%d mismatches)  opencl %.2f ms  %s\n",
+           width, height, cpu_transform_simd_name(simd), (t2 - t1) / ITERATIONS, max_diff, mismatch,
+           (t3 - t2) / ITERATIONS, loadyuv_mismatch, cl_ms, ok ? "ok" : "FAIL");
+    pass = pass && ok;
+  }
+
+  transform_destroy(&transform);
+  loadyuv_destroy(&loadyuv);
+  CL_CHECK(clReleaseMemObject(out_cl));
+  CL_CHECK(clReleaseMemObject(v_cl));
+  CL_CHECK(clReleaseMemObject(u_cl));
+  CL_CHECK(clReleaseMemObject(y_cl));
+  CL_CHECK(clReleaseMemObject(yuv_cl));
+  CL_CHECK(clReleaseCommandQueue(q));
+  return pass;
+}
+
+int main() {
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+
+  bool pass = test_size(device_id, context, 1164, 874);
+  pass = test_size(device_id, context, 1928, 1208) && pass;
+
+  CL_CHECK(clReleaseContext(context));
+  return pass ? 0 : 1;
+}
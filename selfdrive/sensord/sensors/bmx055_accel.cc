@@ -1,11 +1,12 @@
 #include "bmx055_accel.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
 
-BMX055_Accel::BMX055_Accel(I2CBus *bus) : I2CSensor(bus) {}
+BMX055_Accel::BMX055_Accel(I2CBus *bus) : I2CSensor(bus), clock(BMX055_ACCEL_FIFO_RATE_HZ) {}
 
 int BMX055_Accel::init() {
   int ret = 0;
@@ -49,17 +50,22 @@ void BMX055_Accel::get_event(cereal::SensorEventData::Builder &event) {
   int len = read_register(BMX055_ACCEL_I2C_REG_X_LSB, buffer, sizeof(buffer));
   assert(len == 6);
 
+  FifoSample sample = {start_time, {read_12_bit(buffer[0], buffer[1]), read_12_bit(buffer[2], buffer[3]), read_12_bit(buffer[4], buffer[5])}};
+  get_event(event, sample);
+}
+
+void BMX055_Accel::get_event(cereal::SensorEventData::Builder &event, const FifoSample &sample) {
   // 12 bit = +-2g
   float scale = 9.81 * 2.0f / (1 << 11);
-  float x = -read_12_bit(buffer[0], buffer[1]) * scale;
-  float y = -read_12_bit(buffer[2], buffer[3]) * scale;
-  float z = read_12_bit(buffer[4], buffer[5]) * scale;
+  float x = -sample.raw[0] * scale;
+  float y = -sample.raw[1] * scale;
+  float z = sample.raw[2] * scale;
 
   event.setSource(cereal::SensorEventData::SensorSource::BMX055);
   event.setVersion(1);
   event.setSensor(SENSOR_ACCELEROMETER);
   event.setType(SENSOR_TYPE_ACCELEROMETER);
-  event.setTimestamp(start_time);
+  event.setTimestamp(sample.timestamp);
 
   float xyz[] = {x, y, z};
   auto svec = event.initAcceleration();
@@ -67,3 +73,42 @@ void BMX055_Accel::get_event(cereal::SensorEventData::Builder &event) {
   svec.setStatus(true);
 
 }
+
+int BMX055_Accel::init_fifo() {
+  // writing the config also empties it
+  int ret = set_register(BMX055_ACCEL_I2C_REG_FIFO_CONFIG_1, BMX055_ACCEL_FIFO_STREAM_XYZ);
+  if (ret < 0) {
+    LOGE("Setting up fifo failed: %d", ret);
+    return ret;
+  }
+  clock.reset();
+  return 0;
+}
+
+int BMX055_Accel::read_fifo(uint64_t t, std::vector<FifoSample> &samples) {
+  uint8_t status;
+  int ret = read_register(BMX055_ACCEL_I2C_REG_FIFO_STATUS, &status, 1);
+  if (ret < 0) return ret;
+
+  if (status & BMX055_ACCEL_FIFO_OVERRUN) {
+    LOGW("BMX055 accel fifo overrun");
+    clock.reset();
+  }
+
+  // frames of x, y and z, reading on from the data register pops the next one. Five fit in an SMBus read
+  const int frames = status & BMX055_ACCEL_FIFO_FRAMES_MASK;
+  const size_t first = samples.size();
+  uint8_t buffer[5 * 6];
+  for (int f = 0; f < frames; f += 5) {
+    const int n = std::min(5, frames - f);
+    ret = read_register(BMX055_ACCEL_I2C_REG_FIFO, buffer, n * 6);
+    if (ret < 0) return ret;
+
+    for (int i = 0; i < n; i++) {
+      const uint8_t *b = &buffer[i * 6];
+      samples.push_back({0, {read_12_bit(b[0], b[1]), read_12_bit(b[2], b[3]), read_12_bit(b[4], b[5])}});
+    }
+  }
+  clock.stamp(t, samples.data() + first, frames);
+  return frames;
+}
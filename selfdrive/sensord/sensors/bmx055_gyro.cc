@@ -1,14 +1,16 @@
 #include "bmx055_gyro.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
 #include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
 
 #define DEG2RAD(x) ((x) * M_PI / 180.0)
 
 
-BMX055_Gyro::BMX055_Gyro(I2CBus *bus) : I2CSensor(bus) {}
+BMX055_Gyro::BMX055_Gyro(I2CBus *bus) : I2CSensor(bus), clock(BMX055_GYRO_FIFO_RATE_HZ) {}
 
 int BMX055_Gyro::init() {
   int ret = 0;
@@ -60,17 +62,22 @@ void BMX055_Gyro::get_event(cereal::SensorEventData::Builder &event) {
   int len = read_register(BMX055_GYRO_I2C_REG_RATE_X_LSB, buffer, sizeof(buffer));
   assert(len == 6);
 
+  FifoSample sample = {start_time, {read_16_bit(buffer[0], buffer[1]), read_16_bit(buffer[2], buffer[3]), read_16_bit(buffer[4], buffer[5])}};
+  get_event(event, sample);
+}
+
+void BMX055_Gyro::get_event(cereal::SensorEventData::Builder &event, const FifoSample &sample) {
   // 16 bit = +- 125 deg/s
   float scale = 125.0f / (1 << 15);
-  float x = -DEG2RAD(read_16_bit(buffer[0], buffer[1]) * scale);
-  float y = -DEG2RAD(read_16_bit(buffer[2], buffer[3]) * scale);
-  float z = DEG2RAD(read_16_bit(buffer[4], buffer[5]) * scale);
+  float x = -DEG2RAD(sample.raw[0] * scale);
+  float y = -DEG2RAD(sample.raw[1] * scale);
+  float z = DEG2RAD(sample.raw[2] * scale);
 
   event.setSource(cereal::SensorEventData::SensorSource::BMX055);
   event.setVersion(1);
   event.setSensor(SENSOR_GYRO_UNCALIBRATED);
   event.setType(SENSOR_TYPE_GYROSCOPE_UNCALIBRATED);
-  event.setTimestamp(start_time);
+  event.setTimestamp(sample.timestamp);
 
   float xyz[] = {x, y, z};
   auto svec = event.initGyroUncalibrated();
@@ -78,3 +85,42 @@ void BMX055_Gyro::get_event(cereal::SensorEventData::Builder &event) {
   svec.setStatus(true);
 
 }
+
+int BMX055_Gyro::init_fifo() {
+  // keeps the 116 Hz filter from init, which samples at 1000 Hz. Writing the config also empties it
+  int ret = set_register(BMX055_GYRO_I2C_REG_FIFO_CONFIG_1, BMX055_GYRO_FIFO_STREAM_XYZ);
+  if (ret < 0) {
+    LOGE("Setting up fifo failed: %d", ret);
+    return ret;
+  }
+  clock.reset();
+  return 0;
+}
+
+int BMX055_Gyro::read_fifo(uint64_t t, std::vector<FifoSample> &samples) {
+  uint8_t status;
+  int ret = read_register(BMX055_GYRO_I2C_REG_FIFO_STATUS, &status, 1);
+  if (ret < 0) return ret;
+
+  if (status & BMX055_GYRO_FIFO_OVERRUN) {
+    LOGW("BMX055 gyro fifo overrun");
+    clock.reset();
+  }
+
+  // frames of x, y and z, reading on from the data register pops the next one. Five fit in an SMBus read
+  const int frames = status & BMX055_GYRO_FIFO_FRAMES_MASK;
+  const size_t first = samples.size();
+  uint8_t buffer[5 * 6];
+  for (int f = 0; f < frames; f += 5) {
+    const int n = std::min(5, frames - f);
+    ret = read_register(BMX055_GYRO_I2C_REG_FIFO, buffer, n * 6);
+    if (ret < 0) return ret;
+
+    for (int i = 0; i < n; i++) {
+      const uint8_t *b = &buffer[i * 6];
+      samples.push_back({0, {read_16_bit(b[0], b[1]), read_16_bit(b[2], b[3]), read_16_bit(b[4], b[5])}});
+    }
+  }
+  clock.stamp(t, samples.data() + first, frames);
+  return frames;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <vector>
+
+#include "selfdrive/sensord/sensors/fifo_clock.h"
 #include "selfdrive/sensord/sensors/i2c_sensor.h"
 
 // Address of the chip on the bus
@@ -8,9 +11,11 @@
 // Registers of the chip
 #define BMX055_GYRO_I2C_REG_ID         0x00
 #define BMX055_GYRO_I2C_REG_RATE_X_LSB 0x02
+#define BMX055_GYRO_I2C_REG_FIFO_STATUS 0x0E
 #define BMX055_GYRO_I2C_REG_RANGE      0x0F
 #define BMX055_GYRO_I2C_REG_BW         0x10
 #define BMX055_GYRO_I2C_REG_HBW        0x13
+#define BMX055_GYRO_I2C_REG_FIFO_CONFIG_1 0x3E
 #define BMX055_GYRO_I2C_REG_FIFO       0x3F
 
 // Constants
@@ -27,11 +32,23 @@
 
 #define BMX055_GYRO_BW_116HZ 0b0010
 
+// stream mode, x y and z
+#define BMX055_GYRO_FIFO_STREAM_XYZ  (0b10 << 6)
+#define BMX055_GYRO_FIFO_OVERRUN     (1 << 7)
+#define BMX055_GYRO_FIFO_FRAMES_MASK 0x7F
+#define BMX055_GYRO_FIFO_RATE_HZ     1000
+
 
 class BMX055_Gyro : public I2CSensor {
   uint8_t get_device_address() {return BMX055_GYRO_I2C_ADDR;}
+  FifoClock clock;
 public:
   BMX055_Gyro(I2CBus *bus);
   int init();
   void get_event(cereal::SensorEventData::Builder &event);
+  void get_event(cereal::SensorEventData::Builder &event, const FifoSample &sample);
+
+  // read the samples from the fifo instead, call after init
+  int init_fifo();
+  int read_fifo(uint64_t t, std::vector<FifoSample> &samples);
 };
@@ -0,0 +1,44 @@
+#include "fifo_clock.h"
+
+#include <algorithm>
+
+// how fast the newest sample and the period follow the reads
+const double PHASE_GAIN = 0.1;
+const double PERIOD_GAIN = 0.01;
+// the oscillators are within a few percent
+const double MAX_PERIOD_ERROR = 0.05;
+// start over after a gap this many periods long, e.g. after an overrun
+const int MAX_GAP_PERIODS = 100;
+
+FifoClock::FifoClock(double rate_hz) : nominal_period(1e9 / rate_hz), period(1e9 / rate_hz) {}
+
+void FifoClock::reset() {
+  period = nominal_period;
+  last_timestamp = 0;
+  last_read = 0;
+}
+
+void FifoClock::stamp(uint64_t t, FifoSample *samples, int count) {
+  if (count <= 0) return;
+
+  double newest = t;
+  if (last_read != 0 && t > last_read && t - last_read < MAX_GAP_PERIODS * period) {
+    // where the newest sample would be at the current period, pulled towards the read. It
+    // can't be after the read
+    const double predicted = last_timestamp + count * period;
+    newest = std::min<double>(t, predicted + PHASE_GAIN * (t - predicted));
+
+    const double measured = (newest - last_timestamp) / count;
+    period += PERIOD_GAIN * (measured - period);
+    period = std::clamp(period, nominal_period * (1 - MAX_PERIOD_ERROR), nominal_period * (1 + MAX_PERIOD_ERROR));
+  }
+
+  // keep the timestamps increasing when the read came early
+  const double spacing = last_read != 0 && newest - (count - 1) * period <= last_timestamp
+                           ? (newest - last_timestamp) / count : period;
+  for (int i = 0; i < count; i++) {
+    samples[i].timestamp = newest - (count - 1 - i) * spacing;
+  }
+  last_timestamp = newest;
+  last_read = t;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// A raw sample drained from a hardware fifo
+struct FifoSample {
+  uint64_t timestamp;
+  int16_t raw[3];
+};
+
+// Timestamps the samples drained from a hardware fifo. A read only tells how many samples
+// arrived since the last one, so the newest is put close to the read and the others a sample
+// period apart. The sensor runs off its own oscillator, a few percent off its nominal rate,
+// so the period is learned from the reads. Both follow the reads slowly, so jitter in when a
+// read happens, like a slow I2C transfer, doesn't move the timestamps
+class FifoClock {
+public:
+  FifoClock(double rate_hz);
+  void reset();
+  // sets the timestamps of count samples read at t, oldest first
+  void stamp(uint64_t t, FifoSample *samples, int count);
+  double period_ns() const { return period; }
+
+private:
+  const double nominal_period;
+  double period;
+  double last_timestamp = 0;
+  uint64_t last_read = 0;
+};
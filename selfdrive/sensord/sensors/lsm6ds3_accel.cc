@@ -45,16 +45,21 @@ void LSM6DS3_Accel::get_event(cereal::SensorEventData::Builder &event) {
   int len = read_register(LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL, buffer, sizeof(buffer));
   assert(len == sizeof(buffer));
 
+  FifoSample sample = {start_time, {read_16_bit(buffer[0], buffer[1]), read_16_bit(buffer[2], buffer[3]), read_16_bit(buffer[4], buffer[5])}};
+  get_event(event, sample);
+}
+
+void LSM6DS3_Accel::get_event(cereal::SensorEventData::Builder &event, const FifoSample &sample) {
   float scale = 9.81 * 2.0f / (1 << 15);
-  float x = read_16_bit(buffer[0], buffer[1]) * scale;
-  float y = read_16_bit(buffer[2], buffer[3]) * scale;
-  float z = read_16_bit(buffer[4], buffer[5]) * scale;
+  float x = sample.raw[0] * scale;
+  float y = sample.raw[1] * scale;
+  float z = sample.raw[2] * scale;
 
   event.setSource(source);
   event.setVersion(1);
   event.setSensor(SENSOR_ACCELEROMETER);
   event.setType(SENSOR_TYPE_ACCELEROMETER);
-  event.setTimestamp(start_time);
+  event.setTimestamp(sample.timestamp);
 
   float xyz[] = {y, -x, z};
   auto svec = event.initAcceleration();
@@ -0,0 +1,99 @@
+#include "lsm6ds3_fifo.h"
+
+#include <algorithm>
+
+#include "selfdrive/common/swaglog.h"
+
+// SMBus block reads are at most 32 bytes, that is two data sets
+const int SETS_PER_READ = 2;
+
+LSM6DS3_Fifo::LSM6DS3_Fifo(I2CBus *bus) : bus(bus), clock(LSM6DS3_FIFO_RATE_HZ) {}
+
+int LSM6DS3_Fifo::read_register(uint register_address, uint8_t *buffer, uint8_t len) {
+  return bus->read_register(LSM6DS3_FIFO_I2C_ADDR, register_address, buffer, len);
+}
+
+int LSM6DS3_Fifo::set_register(uint register_address, uint8_t data) {
+  return bus->set_register(LSM6DS3_FIFO_I2C_ADDR, register_address, data);
+}
+
+int LSM6DS3_Fifo::init(int watermark) {
+  const int threshold = watermark * LSM6DS3_FIFO_SET_WORDS;
+  const std::pair<uint, uint8_t> config[] = {
+    // whole samples only, and reads of the status and the fifo continue at the next byte
+    {LSM6DS3_FIFO_I2C_REG_CTRL3_C, LSM6DS3_FIFO_CTRL3_C_BDU_IF_INC},
+    {LSM6DS3_FIFO_I2C_REG_CTRL1_XL, LSM6DS3_FIFO_ODR_208HZ},
+    {LSM6DS3_FIFO_I2C_REG_CTRL2_G, LSM6DS3_FIFO_ODR_208HZ},
+    // bypass mode first to empty it
+    {LSM6DS3_FIFO_I2C_REG_CTRL5, 0},
+    {LSM6DS3_FIFO_I2C_REG_CTRL1, uint8_t(threshold & 0xFF)},
+    {LSM6DS3_FIFO_I2C_REG_CTRL2, uint8_t((threshold >> 8) & 0x0F)},
+    {LSM6DS3_FIFO_I2C_REG_CTRL3, LSM6DS3_FIFO_CTRL3_NO_DECIMATION},
+    {LSM6DS3_FIFO_I2C_REG_INT1_CTRL, LSM6DS3_FIFO_INT1_FTH},
+    {LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_CTRL5_ODR_208HZ | LSM6DS3_FIFO_CTRL5_CONTINUOUS},
+  };
+  for (auto &[reg, value] : config) {
+    int ret = set_register(reg, value);
+    if (ret < 0) {
+      LOGE("Setting up fifo failed: %d", ret);
+      return ret;
+    }
+  }
+  clock.reset();
+  buffer.resize(SETS_PER_READ * LSM6DS3_FIFO_SET_WORDS * 2);
+  return 0;
+}
+
+int LSM6DS3_Fifo::read(uint64_t t, std::vector<FifoSample> &accel, std::vector<FifoSample> &gyro) {
+  uint8_t status[4];
+  int ret = read_register(LSM6DS3_FIFO_I2C_REG_STATUS1, status, sizeof(status));
+  if (ret < 0) return ret;
+
+  int words = status[0] | ((status[1] & 0x0F) << 8);
+  if (words == 0 && (status[1] & LSM6DS3_FIFO_STATUS2_FULL)) {
+    // the count is 12 bits
+    words = LSM6DS3_FIFO_SIZE_WORDS;
+  }
+  const int pattern = status[2] | ((status[3] & 0x03) << 8);
+  if (status[1] & LSM6DS3_FIFO_STATUS2_OVER_RUN) {
+    // the oldest samples are lost, and the rest isn't where the clock expects it
+    LOGW("LSM6DS3 fifo overrun");
+    overruns++;
+    clock.reset();
+  }
+
+  // the pattern is the next word to read, after an overrun it can be in the middle of a set
+  if (pattern != 0 && pattern < LSM6DS3_FIFO_SET_WORDS) {
+    for (int i = pattern; i < LSM6DS3_FIFO_SET_WORDS && words > 0; i++, words--) {
+      ret = read_register(LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, buffer.data(), 2);
+      if (ret < 0) return ret;
+    }
+  }
+
+  // reading on from DATA_OUT_H goes back to DATA_OUT_L for the next word
+  const int sets = words / LSM6DS3_FIFO_SET_WORDS;
+  const size_t first = gyro.size();
+  for (int s = 0; s < sets; s += SETS_PER_READ) {
+    const int n = std::min(SETS_PER_READ, sets - s);
+    ret = read_register(LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, buffer.data(), n * LSM6DS3_FIFO_SET_WORDS * 2);
+    if (ret < 0) return ret;
+
+    for (int i = 0; i < n; i++) {
+      const uint8_t *b = &buffer[i * LSM6DS3_FIFO_SET_WORDS * 2];
+      FifoSample g, a;
+      for (int j = 0; j < 3; j++) {
+        g.raw[j] = int16_t(b[2 * j] | (b[2 * j + 1] << 8));
+        a.raw[j] = int16_t(b[6 + 2 * j] | (b[6 + 2 * j + 1] << 8));
+      }
+      gyro.push_back(g);
+      accel.push_back(a);
+    }
+  }
+
+  // one clock for both, they are sampled together
+  clock.stamp(t, gyro.data() + first, sets);
+  for (int i = 0; i < sets; i++) {
+    accel[first + i].timestamp = gyro[first + i].timestamp;
+  }
+  return sets;
+}
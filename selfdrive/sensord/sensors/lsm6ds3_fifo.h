@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "selfdrive/common/i2c.h"
+#include "selfdrive/sensord/sensors/fifo_clock.h"
+
+// Address of the chip on the bus
+#define LSM6DS3_FIFO_I2C_ADDR            0x6A
+
+// Registers of the chip
+#define LSM6DS3_FIFO_I2C_REG_CTRL1       0x06
+#define LSM6DS3_FIFO_I2C_REG_CTRL2       0x07
+#define LSM6DS3_FIFO_I2C_REG_CTRL3       0x08
+#define LSM6DS3_FIFO_I2C_REG_CTRL5       0x0A
+#define LSM6DS3_FIFO_I2C_REG_INT1_CTRL   0x0D
+#define LSM6DS3_FIFO_I2C_REG_CTRL1_XL    0x10
+#define LSM6DS3_FIFO_I2C_REG_CTRL2_G     0x11
+#define LSM6DS3_FIFO_I2C_REG_CTRL3_C     0x12
+#define LSM6DS3_FIFO_I2C_REG_STATUS1     0x3A
+#define LSM6DS3_FIFO_I2C_REG_DATA_OUT_L  0x3E
+
+// Constants
+#define LSM6DS3_FIFO_ODR_208HZ           (0b0101 << 4)
+#define LSM6DS3_FIFO_CTRL3_NO_DECIMATION ((0b001 << 3) | 0b001)
+#define LSM6DS3_FIFO_CTRL5_ODR_208HZ     (0b0101 << 3)
+#define LSM6DS3_FIFO_CTRL5_CONTINUOUS    0b110
+#define LSM6DS3_FIFO_INT1_FTH            (1 << 3)
+#define LSM6DS3_FIFO_CTRL3_C_BDU_IF_INC  ((1 << 6) | (1 << 2))
+#define LSM6DS3_FIFO_STATUS2_OVER_RUN    (1 << 6)
+#define LSM6DS3_FIFO_STATUS2_FULL        (1 << 5)
+
+#define LSM6DS3_FIFO_RATE_HZ             208
+// a data set is gyro x, y, z then accel x, y, z, 16 bit each
+#define LSM6DS3_FIFO_SET_WORDS           6
+#define LSM6DS3_FIFO_SIZE_WORDS          4096
+
+// The accel and gyro of the LSM6DS3 at 208 Hz through its fifo. The chip raises INT1 once
+// the fifo holds the watermark and every read drains it. Registers of CTRL1_XL and CTRL2_G
+// are shared with LSM6DS3_Accel and LSM6DS3_Gyro, init this after them
+class LSM6DS3_Fifo {
+  I2CBus *bus;
+  FifoClock clock;
+  std::vector<uint8_t> buffer;
+
+  int read_register(uint register_address, uint8_t *buffer, uint8_t len);
+  int set_register(uint register_address, uint8_t data);
+
+public:
+  int overruns = 0;
+
+  LSM6DS3_Fifo(I2CBus *bus);
+  // watermark in data sets
+  int init(int watermark);
+  // appends the samples in the fifo, t is when it was found above the watermark.
+  // Returns the number of data sets read or a negative error
+  int read(uint64_t t, std::vector<FifoSample> &accel, std::vector<FifoSample> &gyro);
+};
@@ -49,16 +49,21 @@ void LSM6DS3_Gyro::get_event(cereal::SensorEventData::Builder &event) {
   int len = read_register(LSM6DS3_GYRO_I2C_REG_OUTX_L_G, buffer, sizeof(buffer));
   assert(len == sizeof(buffer));
 
+  FifoSample sample = {start_time, {read_16_bit(buffer[0], buffer[1]), read_16_bit(buffer[2], buffer[3]), read_16_bit(buffer[4], buffer[5])}};
+  get_event(event, sample);
+}
+
+void LSM6DS3_Gyro::get_event(cereal::SensorEventData::Builder &event, const FifoSample &sample) {
   float scale = 8.75 / 1000.0;
-  float x = DEG2RAD(read_16_bit(buffer[0], buffer[1]) * scale);
-  float y = DEG2RAD(read_16_bit(buffer[2], buffer[3]) * scale);
-  float z = DEG2RAD(read_16_bit(buffer[4], buffer[5]) * scale);
+  float x = DEG2RAD(sample.raw[0] * scale);
+  float y = DEG2RAD(sample.raw[1] * scale);
+  float z = DEG2RAD(sample.raw[2] * scale);
 
   event.setSource(source);
   event.setVersion(2);
   event.setSensor(SENSOR_GYRO_UNCALIBRATED);
   event.setType(SENSOR_TYPE_GYROSCOPE_UNCALIBRATED);
-  event.setTimestamp(start_time);
+  event.setTimestamp(sample.timestamp);
 
   float xyz[] = {y, -x, z};
   auto svec = event.initGyroUncalibrated();
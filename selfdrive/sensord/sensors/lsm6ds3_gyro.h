@@ -1,5 +1,6 @@
 #pragma once
 
+#include "selfdrive/sensord/sensors/fifo_clock.h"
 #include "selfdrive/sensord/sensors/i2c_sensor.h"
 
 // Address of the chip on the bus
@@ -23,4 +24,5 @@ public:
   LSM6DS3_Gyro(I2CBus *bus);
   int init();
   void get_event(cereal::SensorEventData::Builder &event);
+  void get_event(cereal::SensorEventData::Builder &event, const FifoSample &sample);
 };
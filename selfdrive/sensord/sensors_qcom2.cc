@@ -1,10 +1,13 @@
 #include <sys/resource.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <vector>
 
 #include "cereal/messaging/messaging.h"
+#include "selfdrive/common/gpio.h"
 #include "selfdrive/common/i2c.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
@@ -16,6 +19,7 @@
 #include "selfdrive/sensord/sensors/constants.h"
 #include "selfdrive/sensord/sensors/light_sensor.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_accel.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_fifo.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_gyro.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_temp.h"
 #include "selfdrive/sensord/sensors/mmc5603nj_magn.h"
@@ -23,6 +27,11 @@
 
 #define I2C_BUS_IMU 1
 
+// data sets in the LSM6DS3 fifo before it interrupts, about 100 Hz at 208 Hz
+#define LSM6DS3_FIFO_WATERMARK 2
+// without an interrupt for this long the fifos are read anyway
+#define IRQ_TIMEOUT_MS 50
+
 ExitHandler do_exit;
 
 int sensor_loop() {
@@ -88,24 +97,92 @@ int sensor_loop() {
     return -1;
   }
 
+  // Everything is polled every 10 ms. With SENSORD_FIFO=1 the IMUs are read from their fifos every
+  // time the LSM6DS3 one is at the watermark instead, with the other sensors polled along. That is
+  // opt-in until the interrupt pin is confirmed on a device, a wrong one caps the rate at IRQ_TIMEOUT_MS
+  LSM6DS3_Fifo lsm6ds3_fifo(i2c_bus_imu);
+  const bool use_fifo = util::getenv("SENSORD_FIFO", 0) == 1 && lsm6ds3_fifo.init(LSM6DS3_FIFO_WATERMARK) == 0;
+  bool bmx055_accel_fifo = false, bmx055_gyro_fifo = false;
+  int irq_fd = -1;
+  if (use_fifo) {
+    auto remove = [&](Sensor *s) { sensors.erase(std::remove(sensors.begin(), sensors.end(), s), sensors.end()); };
+    remove(&lsm6ds3_accel);
+    remove(&lsm6ds3_gyro);
+    if (std::find(sensors.begin(), sensors.end(), &bmx055_accel) != sensors.end() && bmx055_accel.init_fifo() == 0) {
+      bmx055_accel_fifo = true;
+      remove(&bmx055_accel);
+    }
+    if (std::find(sensors.begin(), sensors.end(), &bmx055_gyro) != sensors.end() && bmx055_gyro.init_fifo() == 0) {
+      bmx055_gyro_fifo = true;
+      remove(&bmx055_gyro);
+    }
+
+    irq_fd = gpio_get_irq_fd(GPIO_LSM_INT);
+    if (irq_fd < 0) {
+      LOGW("No LSM6DS3 interrupt, reading the fifo every 10 ms");
+    }
+  }
+
   PubMaster pm({"sensorEvents"});
 
+  std::vector<FifoSample> lsm_accel, lsm_gyro, bmx_accel, bmx_gyro;
   while (!do_exit) {
     std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 
-    const int num_events = sensors.size();
+    lsm_accel.clear();
+    lsm_gyro.clear();
+    bmx_accel.clear();
+    bmx_gyro.clear();
+    if (use_fifo) {
+      if (irq_fd >= 0) {
+        gpio_wait_irq(irq_fd, IRQ_TIMEOUT_MS);
+      }
+      // when the fifo was found at the watermark, the reads take a while
+      uint64_t t = nanos_since_boot();
+      if (lsm6ds3_fifo.read(t, lsm_accel, lsm_gyro) < 0) {
+        LOGE("Reading LSM6DS3 fifo failed");
+      }
+      if (bmx055_accel_fifo && bmx055_accel.read_fifo(t, bmx_accel) < 0) {
+        LOGE("Reading BMX055 accel fifo failed");
+      }
+      if (bmx055_gyro_fifo && bmx055_gyro.read_fifo(t, bmx_gyro) < 0) {
+        LOGE("Reading BMX055 gyro fifo failed");
+      }
+    }
+
+    const int num_events = sensors.size() + lsm_accel.size() + lsm_gyro.size() + bmx_accel.size() + bmx_gyro.size();
     MessageBuilder msg;
     auto sensor_events = msg.initEvent().initSensorEvents(num_events);
 
-    for (int i = 0; i < num_events; i++) {
+    int i = 0;
+    for (; i < sensors.size(); i++) {
       auto event = sensor_events[i];
       sensors[i]->get_event(event);
     }
+    for (int j = 0; j < lsm_accel.size(); j++) {
+      auto accel = sensor_events[i++];
+      lsm6ds3_accel.get_event(accel, lsm_accel[j]);
+      auto gyro = sensor_events[i++];
+      lsm6ds3_gyro.get_event(gyro, lsm_gyro[j]);
+    }
+    for (auto &sample : bmx_accel) {
+      auto event = sensor_events[i++];
+      bmx055_accel.get_event(event, sample);
+    }
+    for (auto &sample : bmx_gyro) {
+      auto event = sensor_events[i++];
+      bmx055_gyro.get_event(event, sample);
+    }
 
     pm.send("sensorEvents", msg);
 
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    std::this_thread::sleep_for(std::chrono::milliseconds(10) - (end - begin));
+    if (!use_fifo || irq_fd < 0) {
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10) - (end - begin));
+    }
+  }
+  if (irq_fd >= 0) {
+    close(irq_fd);
   }
   return 0;
 }
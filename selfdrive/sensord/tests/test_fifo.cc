@@ -0,0 +1,191 @@
+#include <cassert>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/sensord/sensors/lsm6ds3_fifo.h"
+
+constexpr int WATERMARK = 2;
+constexpr double DURATION = 60.0;
+
+// The fifo registers of an LSM6DS3. Data set s is gyro {s & 0xFFFF, s >> 16, GYRO_TAG} and
+// accel {s & 0xFFFF, s >> 16, ACCEL_TAG}, so a reader can tell which one it got
+const int16_t GYRO_TAG = 0x5A5A;
+const int16_t ACCEL_TAG = 0x3C3C;
+
+class SimulatedBus : public I2CBus {
+public:
+  SimulatedBus(double rate_hz) : period(1e9 / rate_hz) {}
+
+  // the chip samples up to t
+  void advance(double t) {
+    while (next_t <= t) {
+      const int16_t words[] = {int16_t(next_set & 0xFFFF), int16_t(next_set >> 16), GYRO_TAG,
+                               int16_t(next_set & 0xFFFF), int16_t(next_set >> 16), ACCEL_TAG};
+      for (int k = 0; k < LSM6DS3_FIFO_SET_WORDS; k++) {
+        // continuous mode, the oldest word makes room
+        if (fifo.size() == LSM6DS3_FIFO_SIZE_WORDS) {
+          fifo.pop_front();
+          over_run = true;
+        }
+        fifo.push_back({words[k], k});
+      }
+      set_times.push_back(next_t);
+      next_set++;
+      next_t += period;
+    }
+  }
+  // when the fifo is up to the watermark, counting from t
+  double watermark_time(double t) const {
+    const int missing = WATERMARK - int(fifo.size()) / LSM6DS3_FIFO_SET_WORDS;
+    return std::max(t, next_t + std::max(0, missing - 1) * period);
+  }
+
+  int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) override {
+    assert(device_address == LSM6DS3_FIFO_I2C_ADDR && configured && len <= 32);
+    if (register_address == LSM6DS3_FIFO_I2C_REG_STATUS1) {
+      assert(len == 4);
+      buffer[0] = fifo.size() & 0xFF;
+      // a full fifo counts 0 words
+      buffer[1] = ((fifo.size() >> 8) & 0x0F) | (over_run ? LSM6DS3_FIFO_STATUS2_OVER_RUN : 0) |
+                  (fifo.size() == LSM6DS3_FIFO_SIZE_WORDS ? LSM6DS3_FIFO_STATUS2_FULL : 0);
+      const int pattern = fifo.empty() ? 0 : fifo.front().second;
+      buffer[2] = pattern & 0xFF;
+      buffer[3] = pattern >> 8;
+      over_run = false;
+    } else if (register_address == LSM6DS3_FIFO_I2C_REG_DATA_OUT_L) {
+      assert(len % 2 == 0);
+      for (int i = 0; i < len; i += 2) {
+        const int16_t word = fifo.empty() ? 0 : fifo.front().first;
+        if (!fifo.empty()) fifo.pop_front();
+        buffer[i] = word & 0xFF;
+        buffer[i + 1] = (word >> 8) & 0xFF;
+      }
+    } else {
+      return -1;
+    }
+    reads++;
+    return len;
+  }
+  int set_register(uint8_t device_address, uint register_address, uint8_t data) override {
+    assert(device_address == LSM6DS3_FIFO_I2C_ADDR);
+    if (register_address == LSM6DS3_FIFO_I2C_REG_CTRL5) {
+      if (data == 0) fifo.clear();
+      configured = data == (LSM6DS3_FIFO_CTRL5_ODR_208HZ | LSM6DS3_FIFO_CTRL5_CONTINUOUS);
+    } else if (register_address == LSM6DS3_FIFO_I2C_REG_CTRL1) {
+      assert(data == WATERMARK * LSM6DS3_FIFO_SET_WORDS);
+    }
+    return 0;
+  }
+
+  std::vector<double> set_times;
+  int reads = 0;
+
+private:
+  const double period;
+  double next_t = 0;
+  long next_set = 0;
+  bool over_run = false;
+  bool configured = false;
+  std::deque<std::pair<int16_t, int>> fifo;
+};
+
+struct Errors {
+  double sq = 0, max = 0;
+  int n = 0;
+  void add(double err) {
+    sq += err * err;
+    max = std::max(max, std::abs(err));
+    n++;
+  }
+  double rms() const { return std::sqrt(sq / n); }
+};
+
+// Drains a simulated LSM6DS3 fifo the way sensord does, with an oscillator off its nominal rate,
+// late wakeups and stalls long enough to overrun it
+static void run(double rate_error) {
+  SimulatedBus bus(LSM6DS3_FIFO_RATE_HZ * (1 + rate_error));
+  LSM6DS3_Fifo fifo(&bus);
+  REQUIRE(fifo.init(WATERMARK) == 0);
+
+  // the interrupt is usually handled within half a millisecond, sometimes after several
+  std::mt19937 gen(1);
+  std::exponential_distribution<double> latency(1 / 0.3e6);
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  std::vector<FifoSample> accel, gyro;
+  Errors fifo_err, read_err;
+  long expected = 0;
+  int lost = 0, broken = 0, out_of_order = 0;
+  uint64_t last_timestamp = 0;
+  double t = 0, next_stall = 20e9;
+  while (t < DURATION * 1e9) {
+    t = bus.watermark_time(t) + latency(gen);
+    if (uniform(gen) < 0.01) t += 15e6;
+    // twice a stall long enough to overrun
+    if (t > next_stall && next_stall < 60e9) {
+      t += 5e9;
+      next_stall += 20e9;
+    }
+    bus.advance(t);
+
+    // what the old loop would have stamped, the time of the read
+    const double read_t = t + 0.2e6 + uniform(gen) * 1e6;
+    accel.clear();
+    gyro.clear();
+    const int sets = fifo.read(t, accel, gyro);
+    REQUIRE(sets == gyro.size());
+    REQUIRE(sets == accel.size());
+
+    for (int i = 0; i < sets; i++) {
+      const long s = uint16_t(gyro[i].raw[0]) | (long(gyro[i].raw[1]) << 16);
+      const long s_accel = uint16_t(accel[i].raw[0]) | (long(accel[i].raw[1]) << 16);
+      if (gyro[i].raw[2] != GYRO_TAG || accel[i].raw[2] != ACCEL_TAG || s != s_accel || s >= bus.set_times.size()) {
+        broken++;
+        continue;
+      }
+      if (s < expected) {
+        out_of_order++;
+      }
+      lost += s - expected;
+      expected = s + 1;
+      out_of_order += gyro[i].timestamp <= last_timestamp || accel[i].timestamp != gyro[i].timestamp;
+      last_timestamp = gyro[i].timestamp;
+
+      // the second after a resync doesn't count
+      if (bus.set_times[s] > 1e9 && std::abs(bus.set_times[s] - 20e9) > 6e9 && std::abs(bus.set_times[s] - 40e9) > 6e9) {
+        fifo_err.add(gyro[i].timestamp - bus.set_times[s]);
+        // the old loop read only the newest sample
+        if (i == sets - 1) read_err.add(read_t - bus.set_times[s]);
+      }
+    }
+  }
+
+  INFO(bus.set_times.size() << " samples, " << lost << " lost in " << fifo.overruns << " overruns");
+  INFO("timestamp error: fifo " << fifo_err.rms() / 1e6 << " ms rms " << fifo_err.max / 1e6 << " ms max, read time "
+       << read_err.rms() / 1e6 << " ms rms " << read_err.max / 1e6 << " ms max");
+
+  // every sample comes out whole and in order, only the overruns lose any
+  REQUIRE(broken == 0);
+  REQUIRE(out_of_order == 0);
+  REQUIRE(fifo.overruns == 2);
+  REQUIRE(lost > 0);
+
+  // the fifo timestamps are closer than stamping samples with the time they are read
+  REQUIRE(fifo_err.rms() < read_err.rms() / 2);
+  REQUIRE(fifo_err.max < read_err.max);
+}
+
+TEST_CASE("LSM6DS3_Fifo drains whole samples with fifo timestamps") {
+  SECTION("nominal rate") {
+    run(0.0);
+  }
+  SECTION("3% fast") {
+    run(0.03);
+  }
+  SECTION("3% slow") {
+    run(-0.03);
+  }
+}
@@ -139,6 +139,9 @@ if __name__ == "__main__":
       'logMonoTime',
       'modelV2.frameDropPerc',
       'modelV2.modelExecutionTime',
+      'modelV2.prepareTime',
+      'modelV2.parseTime',
+      'modelV2.pipelineLatency',
       'driverState.modelExecutionTime',
       'driverState.dspExecutionTime'
     ]
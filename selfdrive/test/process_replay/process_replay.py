@@ -299,6 +299,8 @@ CONFIGS = [
   ),
   ProcessConfig(
     proc_name="locationd",
+    # with LOCATIOND_LOCKSTEP locationd handles the inputs as they come and publishes after every
+    # cameraOdometry, instead of reordering them and publishing at 20 Hz
     pub_sub={
       "cameraOdometry": ["liveLocationKalman"],
       "sensorEvents": [], "gpsLocationExternal": [], "liveCalibration": [], "carState": [],
@@ -349,6 +351,7 @@ def setup_env(simulation=False):
 
   os.environ["NO_RADAR_SLEEP"] = "1"
   os.environ["REPLAY"] = "1"
+  os.environ["LOCATIOND_LOCKSTEP"] = "1"
 
   if simulation:
     os.environ["SIMULATION"] = "1"